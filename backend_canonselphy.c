@@ -527,6 +527,10 @@ done:
 
 /* Private data structure */
 struct canonselphy_printjob {
+	size_t jobsize;
+	int copies;
+	int can_combine;
+
 	int16_t paper_code;
 	uint8_t bw_mode;
 
@@ -538,7 +542,7 @@ struct canonselphy_printjob {
 	uint8_t *plane_c;
 	uint8_t *footer;
 
-	int copies;
+	int streaming; /* Planes (and footer) are still in the spool */
 };
 
 struct canonselphy_ctx {
@@ -679,6 +683,8 @@ static void canonselphy_cleanup_job(const void *vjob) {
 		free(job->plane_c);
 	if (job->footer)
 		free(job->footer);
+	if (job->streaming)
+		dyesub_stream_close();
 
 	free((void*)vjob);
 }
@@ -702,6 +708,7 @@ static int canonselphy_read_parse(void *vctx, const void **vjob, int data_fd, in
 		return CUPS_BACKEND_RETRY_CURRENT;
 	}
 	memset(job, 0, sizeof(*job));
+	job->jobsize = sizeof(*job);
 	job->copies = copies;
 
 	/* The CP900 job *may* have a 4-byte null footer after the
@@ -713,7 +720,7 @@ static int canonselphy_read_parse(void *vctx, const void **vjob, int data_fd, in
 			return CUPS_BACKEND_CANCEL;
 		}
 		ERROR("Read failed (%d/%d)\n", i, 4);
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		canonselphy_cleanup_job(job);
 		return CUPS_BACKEND_FAILED;
 	}
@@ -734,7 +741,7 @@ static int canonselphy_read_parse(void *vctx, const void **vjob, int data_fd, in
 		}
 		ERROR("Read failed (%d/%d)\n",
 		      i, MAX_HEADER - offset);
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		canonselphy_cleanup_job(job);
 		return CUPS_BACKEND_FAILED;
 	}
@@ -766,6 +773,28 @@ static int canonselphy_read_parse(void *vctx, const void **vjob, int data_fd, in
 	/* Add in plane header length! */
 	job->plane_len += 12;
 
+	/* Single copies of colour jobs can be passed straight through */
+	remain = 3 * job->plane_len - (MAX_HEADER-ctx->printer->init_length) +
+		ctx->printer->foot_length;
+	if (job->copies == 1 && !job->bw_mode &&
+	    dyesub_stream_open(data_fd, remain)) {
+		job->streaming = 1;
+		job->header = malloc(ctx->printer->init_length);
+		job->plane_y = malloc(MAX_HEADER-ctx->printer->init_length);
+		job->footer = malloc(ctx->printer->foot_length);
+		if (!job->plane_y || !job->header ||
+		    (ctx->printer->foot_length && !job->footer)) {
+			ERROR("Memory allocation failure!\n");
+			canonselphy_cleanup_job(job);
+			return CUPS_BACKEND_RETRY_CURRENT;
+		}
+		memcpy(job->header, rdbuf, ctx->printer->init_length);
+		memcpy(job->plane_y, rdbuf+ctx->printer->init_length,
+		       MAX_HEADER-ctx->printer->init_length);
+		*vjob = job;
+		return CUPS_BACKEND_OK;
+	}
+
 	/* Set up buffers */
 	job->plane_y = malloc(job->plane_len);
 	job->plane_m = malloc(job->plane_len);
@@ -842,6 +871,7 @@ static int canonselphy_main_loop(void *vctx, const void *vjob) {
 	int last_state = -1, state = S_IDLE;
 	int ret, num;
 	int copies;
+	struct dyesub_poll poll;
 
 	const struct canonselphy_printjob *job = vjob;
 
@@ -858,6 +888,8 @@ static int canonselphy_main_loop(void *vctx, const void *vjob) {
 
 	if (ret < 0)
 		return CUPS_BACKEND_FAILED;
+
+	dyesub_poll_reset(&poll);
 top:
 
 	if (state != last_state) {
@@ -888,12 +920,13 @@ top:
 
 	if (memcmp(rdbuf, rdbuf2, READBACK_LEN)) {
 		memcpy(rdbuf2, rdbuf, READBACK_LEN);
+		dyesub_poll_reset(&poll);
 	} else if (state == last_state) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	}
 	last_state = state;
 
-	fflush(stderr);
+	dyesub_log_flush();
 
 	switch(state) {
 	case S_IDLE:
@@ -975,7 +1008,13 @@ top:
 		else
 			INFO("Sending YELLOW plane\n");
 
-		if ((ret = send_data(ctx->dev, ctx->endp_down, job->plane_y, job->plane_len)))
+		if (job->streaming)
+			ret = dyesub_stream_send(ctx->dev, ctx->endp_down,
+						 job->plane_y, MAX_HEADER-ctx->printer->init_length,
+						 job->plane_len - (MAX_HEADER-ctx->printer->init_length));
+		else
+			ret = send_data(ctx->dev, ctx->endp_down, job->plane_y, job->plane_len);
+		if (ret)
 			return CUPS_BACKEND_FAILED;
 
 		state = S_PRINTER_Y_SENT;
@@ -991,7 +1030,11 @@ top:
 	case S_PRINTER_READY_M:
 		INFO("Sending MAGENTA plane\n");
 
-		if ((ret = send_data(ctx->dev, ctx->endp_down, job->plane_m, job->plane_len)))
+		if (job->streaming)
+			ret = dyesub_stream_send(ctx->dev, ctx->endp_down, NULL, 0, job->plane_len);
+		else
+			ret = send_data(ctx->dev, ctx->endp_down, job->plane_m, job->plane_len);
+		if (ret)
 			return CUPS_BACKEND_FAILED;
 
 		state = S_PRINTER_M_SENT;
@@ -1004,7 +1047,11 @@ top:
 	case S_PRINTER_READY_C:
 		INFO("Sending CYAN plane\n");
 
-		if ((ret = send_data(ctx->dev, ctx->endp_down, job->plane_c, job->plane_len)))
+		if (job->streaming)
+			ret = dyesub_stream_send(ctx->dev, ctx->endp_down, NULL, 0, job->plane_len);
+		else
+			ret = send_data(ctx->dev, ctx->endp_down, job->plane_c, job->plane_len);
+		if (ret)
 			return CUPS_BACKEND_FAILED;
 
 		state = S_PRINTER_C_SENT;
@@ -1032,6 +1079,11 @@ top:
 		if (ctx->printer->foot_length) {
 			INFO("Cleaning up\n");
 
+			/* Footer follows the planes in the spool */
+			if (job->streaming &&
+			    dyesub_stream_read(job->footer, ctx->printer->foot_length))
+				return CUPS_BACKEND_FAILED;
+
 			if ((ret = send_data(ctx->dev, ctx->endp_down, job->footer, ctx->printer->foot_length)))
 				return CUPS_BACKEND_FAILED;
 		}
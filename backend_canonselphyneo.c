@@ -236,7 +236,7 @@ static void selphyneo_cleanup_job(const void *vjob) {
 	const struct selphyneo_printjob *job = vjob;
 
 	if (job->databuf)
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
 
 	free((void*)job);
 }
@@ -269,7 +269,7 @@ static int selphyneo_read_parse(void *vctx, const void **vjob, int data_fd, int
 		}
 		ERROR("Read failed (%d/%d)\n",
 		      i, (int)sizeof(hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		selphyneo_cleanup_job(job);
 		return CUPS_BACKEND_FAILED;
 	}
@@ -290,9 +290,16 @@ static int selphyneo_read_parse(void *vctx, const void **vjob, int data_fd, int
 
 	// XXX Sanity check job against loaded media?
 
+	/* Use the header and payload in place, if possible */
+	job->databuf = dyesub_spool_borrow(data_fd, sizeof(hdr), remain);
+	if (job->databuf) {
+		job->datalen = sizeof(hdr) + remain;
+		goto done;
+	}
+
 	/* Allocate a buffer */
 	job->datalen = 0;
-	job->databuf = malloc(remain + sizeof(hdr));
+	job->databuf = dyesub_buf_alloc(remain + sizeof(hdr));
 	if (!job->databuf) {
 		ERROR("Memory allocation failure!\n");
 		selphyneo_cleanup_job(job);
@@ -314,6 +321,7 @@ static int selphyneo_read_parse(void *vctx, const void **vjob, int data_fd, int
 		job->datalen += i;
 	}
 
+done:
 	*vjob = job;
 
 	return CUPS_BACKEND_OK;
@@ -322,6 +330,7 @@ static int selphyneo_read_parse(void *vctx, const void **vjob, int data_fd, int
 static int selphyneo_main_loop(void *vctx, const void *vjob) {
 	struct selphyneo_ctx *ctx = vctx;
 	struct selphyneo_readback rdback;
+	struct dyesub_poll poll;
 
 	int ret, num;
 	int copies;
@@ -345,6 +354,7 @@ static int selphyneo_main_loop(void *vctx, const void *vjob) {
 top:
 	INFO("Waiting for printer idle\n");
 
+	dyesub_poll_reset(&poll);
 	do {
 		ret = read_data(ctx->dev, ctx->endp_up,
 				(uint8_t*) &rdback, sizeof(rdback), &num);
@@ -372,7 +382,7 @@ top:
 			return CUPS_BACKEND_STOP;
 		}
 
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	} while(1);
 
 	dump_markers(&ctx->marker, 1, 0);
@@ -401,6 +411,7 @@ top:
 		return CUPS_BACKEND_FAILED;
 
 	INFO("Waiting for printer acknowledgement\n");
+	dyesub_poll_reset(&poll);
 	do {
 		ret = read_data(ctx->dev, ctx->endp_up,
 				(uint8_t*) &rdback, sizeof(rdback), &num);
@@ -433,7 +444,7 @@ top:
 			break;
 		}
 
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	} while(1);
 
 	/* Clean up */
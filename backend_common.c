@@ -26,10 +26,18 @@
 
 #include "backend_common.h"
 #include <errno.h>
+#include <stdarg.h>
 #include <signal.h>
 #include <strings.h>  /* For strncasecmp */
+#include <pthread.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
-#define BACKEND_VERSION "0.106"
+#define BACKEND_VERSION "0.107"
 #ifndef URI_PREFIX
 #error "Must Define URI_PREFIX"
 #endif
@@ -42,8 +50,27 @@
 #endif
 #endif
 
+#ifndef DAEMON_PATH
+#define DAEMON_PATH "/var/run"
+#endif
+
+#ifndef STATE_PATH
+#define STATE_PATH "/var/cache/dyesub"
+#endif
+
 #define URB_XFER_SIZE  (64*1024)
+#define URB_QUEUE_DEPTH 4
+#define URB_QUEUE_MAX   32
+
+#define PIPELINE_DEPTH  1
+#define PIPELINE_MAX    8
+#define JOB_LOOKAHEAD   2
+#define BUF_POOL_MB     64
+#define GROUP_MAX       8
 #define XFER_TIMEOUT    15000
+#define POLL_MIN_MS     100
+#define POLL_MAX_MS     1000
+#define POLL_ETA_MAX_MS 10000
 
 #define USB_SUBCLASS_PRINTER 0x1
 #define USB_INTERFACE_PROTOCOL_BIDIR 0x2
@@ -62,9 +89,36 @@ int test_mode = 0;
 int quiet = 0;
 
 const char *corrtable_path = CORRTABLE_PATH;
+const char *state_path = STATE_PATH;
 static int max_xfer_size = URB_XFER_SIZE;
 static int xfer_timeout = XFER_TIMEOUT;
+static int xfer_queue_depth = URB_QUEUE_DEPTH;
+static int poll_min_ms = POLL_MIN_MS;
+static int poll_max_ms = POLL_MAX_MS;
+static struct libusb_context *usb_ctx = NULL;
+static int pipeline_depth = PIPELINE_DEPTH;
+static int job_lookahead = JOB_LOOKAHEAD;
+static int spool_mmap = 1;
+static int stream_data = 1;
+
+/* Memory-mapped spool file, if any */
+static struct {
+	int fd;
+	uint8_t *base;
+	size_t len;
+} spool_map = { -1, NULL, 0 };
+
+/* Payload left in the spool for main_loop() to forward, if any */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd;          /* -1 when nothing is outstanding */
+	uint32_t remain;
+} spool_stream = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, -1, 0 };
 static int old_uri = 0;
+static struct dyesub_group *printer_group = NULL;
+static int daemon_mode = 0;
+static const char *daemon_path = DAEMON_PATH;
 
 /* Support Functions */
 int backend_claim_interface(struct libusb_device_handle *dev, int iface,
@@ -112,11 +166,432 @@ static int lookup_printer_type(struct dyesub_backend *backend, uint16_t idVendor
 	return type;
 }
 
+/* Logging.
+
+   CUPS picks up everything we have to say from stderr.  Rather than
+   writing each message (or, for hex dumps, each byte) separately, they
+   are collected and written out with a single write() at well-defined
+   points: right away for ERROR messages, before anything that may block
+   on the printer (USB transfers and status polling), once a batch of PPD
+   lines is complete, when the buffer fills up, and at exit.  Anything
+   that writes to stderr some other way, such as the image processing
+   libraries, must call dyesub_log_flush() first.
+*/
+#define LOG_BUF_SIZE 8192
+
+static struct {
+	char buf[LOG_BUF_SIZE];
+	size_t len;
+	pthread_mutex_t lock;
+} logbuf = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void log_write(const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(STDERR_FILENO, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		buf += ret;
+		len -= ret;
+	}
+}
+
+void dyesub_log_flush(void)
+{
+	pthread_mutex_lock(&logbuf.lock);
+	log_write(logbuf.buf, logbuf.len);
+	logbuf.len = 0;
+	pthread_mutex_unlock(&logbuf.lock);
+}
+
+void dyesub_log(int flush, const char *prefix, const char *fmt, ...)
+{
+	va_list ap;
+	size_t plen = strlen(prefix);
+	int len;
+
+	va_start(ap, fmt);
+	pthread_mutex_lock(&logbuf.lock);
+
+	/* Try to tack it onto the end of what's there already */
+	if (logbuf.len + plen < LOG_BUF_SIZE) {
+		va_list ap2;
+		va_copy(ap2, ap);
+		len = vsnprintf(logbuf.buf + logbuf.len + plen,
+				LOG_BUF_SIZE - logbuf.len - plen, fmt, ap2);
+		va_end(ap2);
+		if (len >= 0 && logbuf.len + plen + len < LOG_BUF_SIZE) {
+			memcpy(logbuf.buf + logbuf.len, prefix, plen);
+			logbuf.len += plen + len;
+			goto done;
+		}
+	}
+
+	/* Didn't fit, so make room */
+	log_write(logbuf.buf, logbuf.len);
+	logbuf.len = 0;
+
+	len = vsnprintf(logbuf.buf + plen, LOG_BUF_SIZE - plen, fmt, ap);
+	if (len < 0)
+		goto done;
+	if (plen + len < LOG_BUF_SIZE) {
+		memcpy(logbuf.buf, prefix, plen);
+		logbuf.len = plen + len;
+	} else {
+		/* Too big to ever fit; write it out truncated */
+		log_write(prefix, plen);
+		log_write(logbuf.buf + plen, LOG_BUF_SIZE - plen - 1);
+		log_write("\n", 1);
+	}
+
+done:
+	if (flush) {
+		log_write(logbuf.buf, logbuf.len);
+		logbuf.len = 0;
+	}
+	pthread_mutex_unlock(&logbuf.lock);
+	va_end(ap);
+}
+
+/* USB transcripts.
+
+   With USB_RECORD set, every exchange with the printer is appended to
+   that file: the device and string descriptors, the IEEE1284 device ID,
+   and all bulk reads and writes along with their data and how long they
+   took.  Recording starts once the printer has been picked, so nothing
+   is captured from the other devices looked at along the way.  Only a
+   single printer can be recorded, not a group.
+
+   With USB_REPLAY set, no device is opened at all; the printer's side
+   of the conversation is answered from a transcript instead, so
+   attach() and main_loop() run exactly as they would against the real
+   thing.  Writes are checked against the transcript as they go by.
+   Both can be set at once, which captures what a replay did.
+
+   USB_REPLAY_SPEED scales the recorded transfer times (and status
+   polling delays); the default of 0 replays as fast as possible.
+*/
+#define USBX_MAGIC "DSUBUSB1"
+
+enum {
+	USBX_DEVICE = 'D',  /* struct usbx_dev */
+	USBX_STRING = 'S',  /* index is the string descriptor index */
+	USBX_DEVID  = 'I',  /* Raw IEEE1284 device ID response */
+	USBX_OUT    = 'O',  /* index is the endpoint */
+	USBX_IN     = 'R',  /* index is the endpoint */
+};
+
+struct usbx_rec {
+	uint8_t  type;
+	uint8_t  index;
+	uint16_t rsvd;
+	int32_t  ret;   /* libusb return code, LE */
+	uint32_t len;   /* Data bytes that follow, LE */
+	uint32_t usec;  /* How long the exchange took, LE */
+} __attribute__((packed));
+
+struct usbx_dev {
+	uint16_t vid;   /* LE */
+	uint16_t pid;   /* LE */
+	uint8_t  iManufacturer;
+	uint8_t  iProduct;
+	uint8_t  iSerialNumber;
+	uint8_t  iface;
+	uint8_t  altset;
+	uint8_t  endp_up;
+	uint8_t  endp_down;
+} __attribute__((packed));
+
+static struct {
+	FILE *rec;                /* USB_RECORD */
+	int recording;            /* The printer has been picked */
+	pthread_mutex_t lock;
+
+	uint8_t *base;            /* USB_REPLAY, mapped */
+	size_t len;
+	const struct usbx_rec **recs;
+	uint32_t num;
+	uint32_t next;            /* Next bulk record to consume */
+	uint32_t mismatches;
+	double speed;
+} usbx = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+#define usbx_replay (usbx.recs != NULL)
+
+static uint64_t usbx_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usbx_record(uint8_t type, uint8_t index, int ret,
+			const void *data, uint32_t len, uint64_t start)
+{
+	struct usbx_rec rec;
+
+	if (!usbx.rec || !usbx.recording)
+		return;
+
+	rec.type = type;
+	rec.index = index;
+	rec.rsvd = 0;
+	rec.ret = cpu_to_le32(ret);
+	rec.len = cpu_to_le32(len);
+	rec.usec = cpu_to_le32(start ? usbx_now() - start : 0);
+
+	pthread_mutex_lock(&usbx.lock);
+	if (fwrite(&rec, sizeof(rec), 1, usbx.rec) != 1 ||
+	    (len && fwrite(data, len, 1, usbx.rec) != 1)) {
+		WARNING("Unable to write USB transcript, stopping recording\n");
+		fclose(usbx.rec);
+		usbx.rec = NULL;
+	}
+	pthread_mutex_unlock(&usbx.lock);
+}
+
+static int usbx_open(const char *record, const char *replay)
+{
+	uint32_t max = 0;
+	size_t off;
+	int fd;
+
+	if (replay && getenv("USB_REPLAY_SPEED"))
+		usbx.speed = atof(getenv("USB_REPLAY_SPEED"));
+
+	if (record) {
+		usbx.rec = fopen(record, "wb");
+		if (!usbx.rec) {
+			ERROR("Unable to create USB transcript '%s'\n", record);
+			return CUPS_BACKEND_FAILED;
+		}
+		fwrite(USBX_MAGIC, strlen(USBX_MAGIC), 1, usbx.rec);
+	}
+
+	if (!replay)
+		return CUPS_BACKEND_OK;
+
+	fd = open(replay, O_RDONLY);
+	if (fd < 0) {
+		ERROR("Unable to open USB transcript '%s'\n", replay);
+		return CUPS_BACKEND_FAILED;
+	}
+	usbx.len = lseek(fd, 0, SEEK_END);
+	if (usbx.len > strlen(USBX_MAGIC))
+		usbx.base = mmap(NULL, usbx.len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (!usbx.base || usbx.base == MAP_FAILED ||
+	    memcmp(usbx.base, USBX_MAGIC, strlen(USBX_MAGIC))) {
+		ERROR("'%s' is not a USB transcript\n", replay);
+		goto fail;
+	}
+
+	/* Index the records */
+	for (off = strlen(USBX_MAGIC) ; off + sizeof(struct usbx_rec) <= usbx.len ; ) {
+		const struct usbx_rec *rec = (const struct usbx_rec *)(usbx.base + off);
+		off += sizeof(*rec) + le32_to_cpu(rec->len);
+		if (off > usbx.len) {
+			WARNING("USB transcript is truncated\n");
+			break;
+		}
+		if (usbx.num == max) {
+			const struct usbx_rec **recs;
+			max = max ? max * 2 : 256;
+			recs = realloc(usbx.recs, max * sizeof(*recs));
+			if (!recs) {
+				ERROR("Memory allocation failure!\n");
+				goto fail;
+			}
+			usbx.recs = recs;
+		}
+		usbx.recs[usbx.num++] = rec;
+	}
+	if (!usbx.num) {
+		ERROR("USB transcript '%s' is empty\n", replay);
+		goto fail;
+	}
+	DEBUG("Replaying %u USB records from '%s'\n", usbx.num, replay);
+
+	return CUPS_BACKEND_OK;
+
+fail:
+	if (usbx.base && usbx.base != MAP_FAILED)
+		munmap(usbx.base, usbx.len);
+	usbx.base = NULL;
+	free(usbx.recs);
+	usbx.recs = NULL;
+	return CUPS_BACKEND_FAILED;
+}
+
+static void usbx_close(void)
+{
+	if (usbx.rec)
+		fclose(usbx.rec);
+	usbx.rec = NULL;
+
+	if (usbx_replay) {
+		if (usbx.next < usbx.num)
+			DEBUG("USB replay finished with %u records unused\n", usbx.num - usbx.next);
+		if (usbx.mismatches)
+			WARNING("USB replay: %u writes differed from the transcript\n", usbx.mismatches);
+		munmap(usbx.base, usbx.len);
+		free(usbx.recs);
+		usbx.recs = NULL;
+	}
+}
+
+static const void *usbx_data(const struct usbx_rec *rec)
+{
+	return rec + 1;
+}
+
+static void usbx_delay(const struct usbx_rec *rec)
+{
+	uint64_t usec;
+	struct timespec t;
+
+	if (usbx.speed <= 0)
+		return;
+	usec = le32_to_cpu(rec->usec) * usbx.speed;
+	t.tv_sec = usec / 1000000;
+	t.tv_nsec = (usec % 1000000) * 1000;
+	while (nanosleep(&t, &t) && errno == EINTR && !terminate);
+}
+
+/* Descriptors and the device ID can be asked for at any point */
+static const struct usbx_rec *usbx_find(uint8_t type, uint8_t index)
+{
+	uint32_t i;
+
+	for (i = 0 ; i < usbx.num ; i++) {
+		if (usbx.recs[i]->type == type &&
+		    (type != USBX_STRING || usbx.recs[i]->index == index))
+			return usbx.recs[i];
+	}
+	return NULL;
+}
+
+/* Bulk transfers are consumed in order; call with usbx.lock held */
+static void usbx_skip(void)
+{
+	while (usbx.next < usbx.num &&
+	       usbx.recs[usbx.next]->type != USBX_OUT &&
+	       usbx.recs[usbx.next]->type != USBX_IN)
+		usbx.next++;
+}
+
+static int usbx_replay_out(uint8_t endp, const uint8_t *buf, int len)
+{
+	const struct usbx_rec *rec = NULL;
+	int ret = 0;
+
+	pthread_mutex_lock(&usbx.lock);
+	usbx_skip();
+	if (usbx.next < usbx.num && usbx.recs[usbx.next]->type == USBX_OUT) {
+		rec = usbx.recs[usbx.next++];
+		ret = le32_to_cpu(rec->ret);
+		if (rec->index != endp || le32_to_cpu(rec->len) != (uint32_t)len ||
+		    memcmp(usbx_data(rec), buf, len)) {
+			if (!usbx.mismatches++)
+				WARNING("USB replay: write of %d bytes differs from transcript record %u\n", len, usbx.next - 1);
+		}
+	} else {
+		if (!usbx.mismatches++)
+			WARNING("USB replay: unexpected write of %d bytes\n", len);
+	}
+	pthread_mutex_unlock(&usbx.lock);
+
+	if (rec)
+		usbx_delay(rec);
+	return ret;
+}
+
+static int usbx_replay_in(uint8_t endp, uint8_t *buf, int buflen, int *readlen)
+{
+	const struct usbx_rec *rec = NULL;
+
+	pthread_mutex_lock(&usbx.lock);
+	/* Skip over any writes we didn't make */
+	while (usbx_skip(), usbx.next < usbx.num) {
+		rec = usbx.recs[usbx.next++];
+		if (rec->type == USBX_IN && rec->index == endp)
+			break;
+		if (rec->type == USBX_OUT && !usbx.mismatches++)
+			WARNING("USB replay: expected write of %u bytes never happened\n", le32_to_cpu(rec->len));
+		rec = NULL;
+	}
+	pthread_mutex_unlock(&usbx.lock);
+
+	if (!rec) {
+		ERROR("USB replay: transcript exhausted\n");
+		*readlen = 0;
+		return LIBUSB_ERROR_NO_DEVICE;
+	}
+
+	*readlen = le32_to_cpu(rec->len);
+	if (*readlen > buflen)
+		*readlen = buflen;
+	memcpy(buf, usbx_data(rec), *readlen);
+	usbx_delay(rec);
+
+	return le32_to_cpu(rec->ret);
+}
+
+int dyesub_get_device_descriptor(struct libusb_device_handle *dev,
+				 struct libusb_device_descriptor *desc)
+{
+	if (usbx_replay) {
+		const struct usbx_rec *rec = usbx_find(USBX_DEVICE, 0);
+		const struct usbx_dev *d;
+
+		memset(desc, 0, sizeof(*desc));
+		if (!rec || le32_to_cpu(rec->len) < sizeof(*d))
+			return LIBUSB_ERROR_NOT_FOUND;
+		d = usbx_data(rec);
+		desc->idVendor = le16_to_cpu(d->vid);
+		desc->idProduct = le16_to_cpu(d->pid);
+		desc->iManufacturer = d->iManufacturer;
+		desc->iProduct = d->iProduct;
+		desc->iSerialNumber = d->iSerialNumber;
+		desc->bNumConfigurations = 1;
+		return LIBUSB_SUCCESS;
+	}
+
+	return libusb_get_device_descriptor(libusb_get_device(dev), desc);
+}
+
+int dyesub_get_string_descriptor(struct libusb_device_handle *dev,
+				 uint8_t index, unsigned char *buf, int len)
+{
+	uint64_t start;
+	int ret;
+
+	start = usbx_now();
+	if (usbx_replay) {
+		const struct usbx_rec *rec = usbx_find(USBX_STRING, index);
+		ret = rec ? (int)le32_to_cpu(rec->ret) : LIBUSB_ERROR_NOT_FOUND;
+		if (ret > len)
+			ret = len;
+		if (ret > 0)
+			memcpy(buf, usbx_data(rec), ret);
+	} else {
+		ret = libusb_get_string_descriptor_ascii(dev, index, buf, len);
+	}
+	usbx_record(USBX_STRING, index, ret, buf, ret > 0 ? ret : 0, start);
+
+	return ret;
+}
+
 /* Interface **MUST** already be claimed! */
 #define ID_BUF_SIZE 2048
 char *get_device_id(struct libusb_device_handle *dev, int iface)
 {
-	int length;
+	uint64_t start;
+	int length, ret;
 	char *buf = malloc(ID_BUF_SIZE + 1);
 
 	if (!buf) {
@@ -124,13 +599,24 @@ char *get_device_id(struct libusb_device_handle *dev, int iface)
 		return NULL;
 	}
 
-	if (libusb_control_transfer(dev,
-				    LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_ENDPOINT_IN |
-				    LIBUSB_RECIPIENT_INTERFACE,
-				    0, 0,
-				    (iface << 8),
-				    (unsigned char *)buf, ID_BUF_SIZE, 5000) < 0)
-	{
+	start = usbx_now();
+	if (usbx_replay) {
+		const struct usbx_rec *rec = usbx_find(USBX_DEVID, 0);
+		ret = rec ? (int)le32_to_cpu(rec->ret) : LIBUSB_ERROR_NOT_FOUND;
+		if (ret > ID_BUF_SIZE)
+			ret = ID_BUF_SIZE;
+		if (ret > 0)
+			memcpy(buf, usbx_data(rec), ret);
+	} else {
+		ret = libusb_control_transfer(dev,
+					      LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_ENDPOINT_IN |
+					      LIBUSB_RECIPIENT_INTERFACE,
+					      0, 0,
+					      (iface << 8),
+					      (unsigned char *)buf, ID_BUF_SIZE, 5000);
+	}
+	usbx_record(USBX_DEVID, 0, ret, buf, ret > 0 ? ret : 0, start);
+	if (ret < 0) {
 		*buf = '\0';
 		goto done;
 	}
@@ -224,20 +710,209 @@ char *dict_find(const char *key, int dlen, struct deviceid_dict* dict)
 	return NULL;
 }
 
+/* Per-page timing.
+
+   Each thread accumulates time spent per phase in thread_timing.  What
+   read_parse() accumulated is stashed away keyed by the job pointer, then
+   merged with what main_loop() accumulates when the page is printed, and
+   written out as a single JSON line.  When TIMING_LOG isn't set, all of
+   this boils down to a test of timing_log.
+*/
+struct dyesub_timing {
+	uint64_t ns[TIMING_MAX];
+	uint64_t bytes;  /* Sent to the printer */
+	uint64_t start;  /* Of the current read_parse() or main_loop() */
+};
+
+#define TIMING_SLOTS 64
+
+static FILE *timing_log = NULL;
+static pthread_mutex_t timing_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct dyesub_timing thread_timing;
+static struct {
+	const void *job;
+	uint64_t parse_ns;
+	struct dyesub_timing t;
+} timing_parsed[TIMING_SLOTS];
+static int timing_next = 0;
+
+static uint64_t timing_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t dyesub_timing_start(void)
+{
+	if (!timing_log)
+		return 0;
+
+	return timing_now();
+}
+
+void dyesub_timing_stop(int phase, uint64_t start)
+{
+	if (!start)
+		return;
+
+	thread_timing.ns[phase] += timing_now() - start;
+}
+
+static void timing_begin(void)
+{
+	if (!timing_log)
+		return;
+
+	memset(&thread_timing, 0, sizeof(thread_timing));
+	thread_timing.start = timing_now();
+}
+
+/* Caller must hold timing_lock */
+static int timing_find(const void *job)
+{
+	int i;
+
+	for (i = 0 ; i < TIMING_SLOTS ; i++) {
+		if (timing_parsed[i].job == job)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Caller must hold timing_lock */
+static int timing_slot(const void *job)
+{
+	int i = timing_find(job);
+
+	if (i < 0) {
+		i = timing_next;
+		timing_next = (timing_next + 1) % TIMING_SLOTS;
+	}
+	timing_parsed[i].job = job;
+
+	return i;
+}
+
+/* Called after read_parse() returns a job */
+static void timing_parsed_job(const void *job)
+{
+	int i;
+
+	if (!timing_log || !job)
+		return;
+
+	pthread_mutex_lock(&timing_lock);
+	i = timing_slot(job);
+	timing_parsed[i].parse_ns = timing_now() - thread_timing.start;
+	timing_parsed[i].t = thread_timing;
+	pthread_mutex_unlock(&timing_lock);
+}
+
+/* A combined job inherits the parsing costs of its parts */
+static void timing_combined_job(const void *job, const void *job1, const void *job2)
+{
+	int i, j1, j2, k;
+
+	if (!timing_log)
+		return;
+
+	pthread_mutex_lock(&timing_lock);
+	j1 = timing_find(job1);
+	j2 = (job2 != job1) ? timing_find(job2) : -1;
+	i = timing_slot(job);
+	timing_parsed[i].parse_ns = 0;
+	memset(&timing_parsed[i].t, 0, sizeof(timing_parsed[i].t));
+	if (j1 >= 0 && j1 != i) {
+		timing_parsed[i].parse_ns += timing_parsed[j1].parse_ns;
+		for (k = 0 ; k < TIMING_MAX ; k++)
+			timing_parsed[i].t.ns[k] += timing_parsed[j1].t.ns[k];
+	}
+	if (j2 >= 0 && j2 != i) {
+		timing_parsed[i].parse_ns += timing_parsed[j2].parse_ns;
+		for (k = 0 ; k < TIMING_MAX ; k++)
+			timing_parsed[i].t.ns[k] += timing_parsed[j2].t.ns[k];
+	}
+	pthread_mutex_unlock(&timing_lock);
+}
+
+#define NS_TO_MS(__x) ((double)(__x) / 1000000.0)
+
+/* Called after main_loop() returns; emits the page's record */
+static void timing_printed_job(const struct dyesub_backend *backend,
+			       const void *job, int page,
+			       const char *serno, int ret)
+{
+	struct dyesub_timing parsed;
+	uint64_t parse_ns = 0, print_ns, read_ns;
+	int i;
+
+	if (!timing_log)
+		return;
+
+	print_ns = timing_now() - thread_timing.start;
+
+	pthread_mutex_lock(&timing_lock);
+	memset(&parsed, 0, sizeof(parsed));
+	i = timing_find(job);
+	if (i >= 0) {
+		parse_ns = timing_parsed[i].parse_ns;
+		parsed = timing_parsed[i].t;
+	}
+
+	/* Whatever parsing time isn't accounted for is reading the spool */
+	read_ns = parse_ns - parsed.ns[TIMING_LUT] - parsed.ns[TIMING_EFFECT];
+	if (read_ns > parse_ns)
+		read_ns = 0;
+
+	if (timing_log == stderr)
+		dyesub_log_flush();
+	fprintf(timing_log, "{\"page\":%d,\"backend\":\"%s\",", page, backend->name);
+	if (serno)
+		fprintf(timing_log, "\"printer\":\"%s\",", serno);
+	fprintf(timing_log,
+		"\"result\":%d,"
+		"\"parse_ms\":%.3f,\"read_ms\":%.3f,"
+		"\"lut_ms\":%.3f,\"effect_ms\":%.3f,"
+		"\"print_ms\":%.3f,\"usb_ms\":%.3f,\"wait_ms\":%.3f,"
+		"\"bytes\":%llu,\"usb_mbps\":%.2f}\n",
+		ret,
+		NS_TO_MS(parse_ns), NS_TO_MS(read_ns),
+		NS_TO_MS(parsed.ns[TIMING_LUT] + thread_timing.ns[TIMING_LUT]),
+		NS_TO_MS(parsed.ns[TIMING_EFFECT] + thread_timing.ns[TIMING_EFFECT]),
+		NS_TO_MS(print_ns),
+		NS_TO_MS(thread_timing.ns[TIMING_USB]),
+		NS_TO_MS(thread_timing.ns[TIMING_WAIT]),
+		(unsigned long long)thread_timing.bytes,
+		thread_timing.ns[TIMING_USB] ?
+		(double)thread_timing.bytes * 1000.0 / thread_timing.ns[TIMING_USB] : 0.0);
+	fflush(timing_log);
+	pthread_mutex_unlock(&timing_lock);
+}
+
 /* I/O functions */
 int read_data(struct libusb_device_handle *dev, uint8_t endp,
 	      uint8_t *buf, int buflen, int *readlen)
 {
+	uint64_t start;
 	int ret;
 
 	/* Clear buffer */
 	memset(buf, 0, buflen);
 
-	ret = libusb_bulk_transfer(dev, endp,
-				   buf,
-				   buflen,
-				   readlen,
-				   xfer_timeout);
+	dyesub_log_flush();
+	start = usbx_now();
+	if (usbx_replay)
+		ret = usbx_replay_in(endp, buf, buflen, readlen);
+	else
+		ret = libusb_bulk_transfer(dev, endp,
+					   buf,
+					   buflen,
+					   readlen,
+					   xfer_timeout);
+	usbx_record(USBX_IN, endp, ret, buf, *readlen, start);
 
 	if (ret < 0) {
 		ERROR("Failure to receive data from printer (libusb error %d: (%d/%d from 0x%02x))\n", ret, *readlen, buflen, endp);
@@ -269,34 +944,35 @@ done:
 	return ret;
 }
 
-int send_data(struct libusb_device_handle *dev, uint8_t endp,
-	      const uint8_t *buf, int len)
+static void dump_send_data(const uint8_t *buf, int len2)
 {
-	int num = 0;
+	if ((dyesub_debug > 1 && len2 < 4096) ||
+	    dyesub_debug > 2) {
+		int i = len2;
 
-	if (dyesub_debug) {
-		DEBUG("Sending %d bytes to printer\n", len);
+		DEBUG("-> ");
+		while(i > 0) {
+			if ((len2-i) != 0 &&
+			    (len2-i) % 16 == 0) {
+				DEBUG2("\n");
+				DEBUG("   ");
+			}
+			DEBUG2("%02x ", buf[len2-i]);
+			i--;
+		}
+		DEBUG2("\n");
 	}
+}
+
+static int send_data_sync(struct libusb_device_handle *dev, uint8_t endp,
+			  const uint8_t *buf, int len)
+{
+	int num = 0;
 
 	while (len) {
 		int len2 = (len > max_xfer_size) ? max_xfer_size: len;
 
-		if ((dyesub_debug > 1 && len2 < 4096) ||
-		    dyesub_debug > 2) {
-			int i = len2;
-
-			DEBUG("-> ");
-			while(i > 0) {
-				if ((len2-i) != 0 &&
-				    (len2-i) % 16 == 0) {
-					DEBUG2("\n");
-					DEBUG("   ");
-				}
-				DEBUG2("%02x ", buf[len2-i]);
-				i--;
-			}
-			DEBUG2("\n");
-		}
+		dump_send_data(buf, len2);
 
 		int ret = libusb_bulk_transfer(dev, endp,
 					       (uint8_t*) buf, len2,
@@ -313,34 +989,287 @@ int send_data(struct libusb_device_handle *dev, uint8_t endp,
 	return CUPS_BACKEND_OK;
 }
 
-/* More stuff */
-#ifndef _WIN32
-static void sigterm_handler(int signum) {
-	UNUSED(signum);
-
-	terminate = 1;
-	INFO("Job Cancelled");
-}
-#endif
+/* Asynchronous sender; keeps up to xfer_queue_depth URBs in flight */
+struct send_async_state {
+	struct libusb_transfer *idle[URB_QUEUE_MAX];
+	int num_idle;
+	int inflight;
+	int error;    /* First libusb error encountered */
+	int err_num;  /* Bytes actually sent by the failing URB */
+	int err_len;  /* Size of the failing URB */
+};
 
-static char *sanitize_string(char *str) {
-	int len = strlen(str);
+static void send_data_async_cb(struct libusb_transfer *xfer)
+{
+	struct send_async_state *state = xfer->user_data;
+	int err;
+
+	state->idle[state->num_idle++] = xfer;
+	state->inflight--;
+
+	switch (xfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		/* A short write can't be retried once later URBs are queued */
+		err = (xfer->actual_length == xfer->length) ? 0 : LIBUSB_ERROR_IO;
+		break;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		err = LIBUSB_ERROR_TIMEOUT;
+		break;
+	case LIBUSB_TRANSFER_STALL:
+		err = LIBUSB_ERROR_PIPE;
+		break;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		err = LIBUSB_ERROR_NO_DEVICE;
+		break;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		err = LIBUSB_ERROR_OVERFLOW;
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		err = LIBUSB_ERROR_INTERRUPTED;
+		break;
+	default:
+		err = LIBUSB_ERROR_IO;
+		break;
+	}
 
-	while(len && (str[len-1] <= 0x20)) {
-		str[len-1] = 0;
-		len--;
+	/* Only the first failure is interesting; the rest are fallout */
+	if (err && !state->error) {
+		state->error = err;
+		state->err_num = xfer->actual_length;
+		state->err_len = xfer->length;
 	}
-	return str;
 }
 
-/*
+static int send_data_async(struct libusb_device_handle *dev, uint8_t endp,
+			   const uint8_t *buf, int len)
+{
+	struct libusb_transfer *xfers[URB_QUEUE_MAX];
+	struct send_async_state state;
+	int depth = xfer_queue_depth;
+	int cancelled = 0;
+	int i, ret;
+
+	if (depth > URB_QUEUE_MAX)
+		depth = URB_QUEUE_MAX;
+
+	memset(&state, 0, sizeof(state));
+	for (i = 0 ; i < depth ; i++) {
+		xfers[i] = libusb_alloc_transfer(0);
+		if (!xfers[i]) {
+			while (i--)
+				libusb_free_transfer(xfers[i]);
+			/* Fall back to the blocking path */
+			return send_data_sync(dev, endp, buf, len);
+		}
+		state.idle[state.num_idle++] = xfers[i];
+	}
 
-   These functions are Public Domain code obtained from:
+	while (len || state.inflight) {
+		/* Keep the queue topped up */
+		while (len && state.num_idle && !state.error) {
+			struct libusb_transfer *xfer = state.idle[--state.num_idle];
+			int len2 = (len > max_xfer_size) ? max_xfer_size: len;
+
+			dump_send_data(buf, len2);
+
+			libusb_fill_bulk_transfer(xfer, dev, endp,
+						  (uint8_t*) buf, len2,
+						  send_data_async_cb, &state,
+						  xfer_timeout);
+			ret = libusb_submit_transfer(xfer);
+			if (ret < 0) {
+				state.idle[state.num_idle++] = xfer;
+				state.error = ret;
+				state.err_num = 0;
+				state.err_len = len2;
+				break;
+			}
+			state.inflight++;
+			buf += len2;
+			len -= len2;
+		}
 
-   http://www.geekhideout.com/urlcode.shtml
+		/* On failure, reap everything still outstanding */
+		if (state.error && !cancelled) {
+			for (i = 0 ; i < depth ; i++)
+				libusb_cancel_transfer(xfers[i]);
+			cancelled = 1;
+			len = 0;
+		}
 
-*/
-#include <ctype.h>  /* for isalnum() */
+		if (!state.inflight)
+			break;
+
+		ret = libusb_handle_events_completed(usb_ctx, NULL);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED && !state.error) {
+			state.error = ret;
+			state.err_num = 0;
+			state.err_len = 0;
+		}
+	}
+
+	for (i = 0 ; i < depth ; i++)
+		libusb_free_transfer(xfers[i]);
+
+	if (state.error) {
+		ERROR("Failure to send data to printer (libusb error %d: (%d/%d to 0x%02x))\n", state.error, state.err_num, state.err_len, endp);
+		return state.error;
+	}
+
+	return CUPS_BACKEND_OK;
+}
+
+int send_data(struct libusb_device_handle *dev, uint8_t endp,
+	      const uint8_t *buf, int len)
+{
+	struct timespec start, end;
+	uint64_t timing = dyesub_timing_start();
+	uint64_t usb_start;
+	int ret;
+
+	if (dyesub_debug) {
+		DEBUG("Sending %d bytes to printer\n", len);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	}
+
+	dyesub_log_flush();
+	usb_start = usbx_now();
+	if (usbx_replay)
+		ret = usbx_replay_out(endp, buf, len);
+	/* Only worth queueing up URBs when we have more than one */
+	else if (xfer_queue_depth > 1 && len > max_xfer_size)
+		ret = send_data_async(dev, endp, buf, len);
+	else
+		ret = send_data_sync(dev, endp, buf, len);
+	usbx_record(USBX_OUT, endp, ret, buf, len, usb_start);
+
+	if (timing) {
+		dyesub_timing_stop(TIMING_USB, timing);
+		if (!ret)
+			thread_timing.bytes += len;
+	}
+
+	if (dyesub_debug && !ret && len > max_xfer_size) {
+		long usec;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		usec = (end.tv_sec - start.tv_sec) * 1000000 +
+			(end.tv_nsec - start.tv_nsec) / 1000;
+		if (usec <= 0)
+			usec = 1;
+		DEBUG("Sent %d bytes in %ld ms (%.2f MB/s, queue depth %d)\n",
+		      len, usec / 1000, (double)len / usec,
+		      xfer_queue_depth > 1 ? xfer_queue_depth : 1);
+	}
+
+	return ret;
+}
+
+/* Adaptive status polling.
+
+   Poll quickly right after a command or status change, then back off
+   (up to poll_max_ms) while nothing changes, so long mechanical phases
+   don't generate needless USB traffic.  If the printer tells us how long
+   it'll be, sleep that long instead.
+*/
+static void poll_msleep(int ms)
+{
+	struct timespec t;
+
+	dyesub_log_flush();
+
+	/* Replays go at the transcript's pace, not the printer's */
+	if (usbx_replay)
+		ms *= usbx.speed;
+	if (ms <= 0)
+		return;
+	t.tv_sec = ms / 1000;
+	t.tv_nsec = (ms % 1000) * 1000000;
+
+	while (nanosleep(&t, &t) && errno == EINTR && !terminate);
+}
+
+void dyesub_poll_reset(struct dyesub_poll *poll)
+{
+	poll->interval = poll_min_ms;
+	poll->eta = 0;
+}
+
+void dyesub_poll_eta(struct dyesub_poll *poll, int eta_ms)
+{
+	poll->eta = eta_ms;
+}
+
+void dyesub_poll_sleep(struct dyesub_poll *poll)
+{
+	uint64_t timing = dyesub_timing_start();
+
+	if (poll->interval < poll_min_ms)
+		poll->interval = poll_min_ms;
+
+	if (poll->eta > 0) {
+		int ms = poll->eta;
+		if (ms > POLL_ETA_MAX_MS)
+			ms = POLL_ETA_MAX_MS;
+		poll_msleep(ms);
+		dyesub_timing_stop(TIMING_WAIT, timing);
+		/* Expect something to happen, so go back to polling quickly */
+		dyesub_poll_reset(poll);
+		return;
+	}
+
+	poll_msleep(poll->interval);
+	dyesub_timing_stop(TIMING_WAIT, timing);
+
+	poll->interval *= 2;
+	if (poll->interval > poll_max_ms)
+		poll->interval = poll_max_ms;
+}
+
+int dyesub_poll_until(dyesub_poll_fn fn, void *ctx, void *arg)
+{
+	struct dyesub_poll poll;
+	int ret;
+
+	dyesub_poll_reset(&poll);
+
+	while ((ret = fn(ctx, arg, &poll)) == DYESUB_POLL_AGAIN)
+		dyesub_poll_sleep(&poll);
+
+	return ret;
+}
+
+/* More stuff */
+#ifndef _WIN32
+static void sigterm_handler(int signum) {
+	UNUSED(signum);
+
+	terminate = 1;
+	/* Not via INFO(), as that takes a lock */
+	if (!quiet) {
+		static const char msg[] = "INFO: Job Cancelled\n";
+		log_write(msg, sizeof(msg) - 1);
+	}
+}
+#endif
+
+static char *sanitize_string(char *str) {
+	int len = strlen(str);
+
+	while(len && (str[len-1] <= 0x20)) {
+		str[len-1] = 0;
+		len--;
+	}
+	return str;
+}
+
+/*
+
+   These functions are Public Domain code obtained from:
+
+   http://www.geekhideout.com/urlcode.shtml
+
+*/
+#include <ctype.h>  /* for isalnum() */
 static char to_hex(char code) {
 	static const char hex[] = "0123456789abcdef";
 	return hex[code & 15];
@@ -766,6 +1695,22 @@ static int find_and_enumerate(struct libusb_context *ctx,
 		return found;
 	}
 
+	if (usbx_replay) {
+		const struct usbx_rec *rec = usbx_find(USBX_DEVICE, 0);
+		const struct usbx_dev *d;
+
+		if (!rec || le32_to_cpu(rec->len) < sizeof(*d)) {
+			ERROR("USB transcript has no device record\n");
+			return -1;
+		}
+		d = usbx_data(rec);
+		*r_endp_up = d->endp_up;
+		*r_endp_down = d->endp_down;
+		*r_iface = d->iface;
+		*r_altset = d->altset;
+		return 1;
+	}
+
 	STATE("+org.gutenprint.searching-for-device\n");
 
 	/* Enumerate and find suitable device */
@@ -1001,6 +1946,7 @@ for more details.\n\
 You should have received a copy of the GNU General Public License\n\
 along with this program; if not, see <https://www.gnu.org/licenses/>.\n\n";
 
+	dyesub_log_flush();
 	fprintf(stderr, "%s", license);
 }
 
@@ -1024,6 +1970,7 @@ void print_help(const char *argv0, const struct dyesub_backend *backend)
 		int i;
 		DEBUG("Environment variables:\n");
 		DEBUG(" DYESUB_DEBUG EXTRA_PID EXTRA_VID EXTRA_TYPE BACKEND SERIAL OLD_URI_SCHEME BACKEND_QUIET\n");
+		DEBUG(" BACKEND_DAEMON DAEMON_PATH STATE_PATH\n");
 		DEBUG("CUPS Usage:\n");
 		DEBUG("\tDEVICE_URI=someuri %s job user title num-copies options [ filename ]\n", URI_PREFIX);
 		DEBUG("\n");
@@ -1079,9 +2026,14 @@ static int parse_cmdstream(struct dyesub_backend *backend, void *backend_ctx, in
 	char *lp;
 
 	if (fd != fileno(stdin)) {
-		fp = fdopen(fd, "r");
-		if (!fp) {
+		/* Use a private descriptor, the caller owns 'fd' */
+		fd = dup(fd);
+		if (fd >= 0)
+			fp = fdopen(fd, "r");
+		if (fd < 0 || !fp) {
 			ERROR("Can't open data stream!\n");
+			if (fd >= 0)
+				close(fd);
 			return CUPS_BACKEND_FAILED;
 		}
 	}
@@ -1112,154 +2064,1818 @@ static int parse_cmdstream(struct dyesub_backend *backend, void *backend_ctx, in
 	return CUPS_BACKEND_OK;
 }
 
-static int handle_input(struct dyesub_backend *backend, void *backend_ctx,
-			const char *fname, char *uri, char *type)
+/* Zero-copy spool access.
+
+   When the spool is a regular file, it is mapped privately (ie
+   copy-on-write) for the duration of the job.  Backends can then
+   borrow the payload in place instead of reading it into a malloc()ed
+   buffer, and are free to modify it.  Borrowed buffers must be
+   released with dyesub_buf_free(), which also handles pooled and
+   ordinary malloc()ed buffers.
+*/
+static void spool_map_open(int data_fd)
+{
+#ifndef _WIN32
+	struct stat st;
+	void *base;
+
+	if (!spool_mmap)
+		return;
+	if (fstat(data_fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+		return;
+
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		    data_fd, 0);
+	if (base == MAP_FAILED) {
+		DEBUG("Unable to map spool file (%d), reading it instead\n", errno);
+		return;
+	}
+	posix_madvise(base, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	spool_map.fd = data_fd;
+	spool_map.base = base;
+	spool_map.len = st.st_size;
+#else
+	UNUSED(data_fd);
+#endif
+}
+
+static void spool_map_close(void)
 {
-	int ret = CUPS_BACKEND_OK;
 #ifndef _WIN32
+	if (spool_map.base)
+		munmap(spool_map.base, spool_map.len);
+#endif
+	spool_map.fd = -1;
+	spool_map.base = NULL;
+	spool_map.len = 0;
+}
+
+uint8_t *dyesub_spool_borrow(int data_fd, int lookback, int len)
+{
+	off_t off;
+
+	if (!spool_map.base || data_fd != spool_map.fd ||
+	    lookback < 0 || len < 0)
+		return NULL;
+
+	off = lseek(data_fd, 0, SEEK_CUR);
+	if (off < lookback || (size_t)off + len > spool_map.len)
+		return NULL;
+
+	/* Consume the payload as if we'd read() it */
+	if (lseek(data_fd, len, SEEK_CUR) < 0)
+		return NULL;
+
+	return spool_map.base + off - lookback;
+}
+
+/* Page buffer pool.
+
+   Page-sized buffers are rounded up to a size class (four per power of
+   two) and handed back to the pool instead of being freed, so that the
+   next page or copy can reuse them without another round of page
+   faults.  Fresh buffers are pre-faulted up front, while the printer is
+   still busy with the previous page.  BUF_POOL_MB bounds how much idle
+   memory the pool holds on to; anything beyond that is freed.
+*/
+#define BUF_POOL_SLOTS   32
+#define BUF_POOL_MIN     (256*1024)  /* Smaller buffers bypass the pool */
+
+static struct {
+	pthread_mutex_t lock;
+	struct {
+		uint8_t *buf;
+		size_t cap;
+		int in_use;
+	} slot[BUF_POOL_SLOTS];
+	size_t idle;
+} buf_pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static size_t buf_pool_limit = BUF_POOL_MB * 1024 * 1024;
+
+static size_t buf_pool_class(size_t len)
+{
+	size_t step = 1;
+
+	while (step <= len / 8)
+		step <<= 1;
+
+	return (len + step - 1) & ~(step - 1);
+}
+
+static void buf_pool_trim(void)
+{
 	int i;
+
+	/* Caller must hold buf_pool.lock */
+	for (i = 0 ; i < BUF_POOL_SLOTS && buf_pool.idle > buf_pool_limit ; i++) {
+		if (!buf_pool.slot[i].buf || buf_pool.slot[i].in_use)
+			continue;
+		free(buf_pool.slot[i].buf);
+		buf_pool.idle -= buf_pool.slot[i].cap;
+		buf_pool.slot[i].buf = NULL;
+		buf_pool.slot[i].cap = 0;
+	}
+}
+
+void *dyesub_buf_alloc(size_t len)
+{
+	size_t cap, off, pagesize;
+	uint8_t *buf;
+	int i, best = -1, empty = -1;
+
+	if (len < BUF_POOL_MIN || !buf_pool_limit)
+		return malloc(len);
+
+	pthread_mutex_lock(&buf_pool.lock);
+	for (i = 0 ; i < BUF_POOL_SLOTS ; i++) {
+		if (!buf_pool.slot[i].buf) {
+			if (empty < 0 && !buf_pool.slot[i].in_use)
+				empty = i;
+			continue;
+		}
+		if (buf_pool.slot[i].in_use ||
+		    buf_pool.slot[i].cap < len ||
+		    buf_pool.slot[i].cap / 2 > len)
+			continue;
+		if (best < 0 || buf_pool.slot[i].cap < buf_pool.slot[best].cap)
+			best = i;
+	}
+	if (best >= 0) {
+		buf_pool.slot[best].in_use = 1;
+		buf_pool.idle -= buf_pool.slot[best].cap;
+		pthread_mutex_unlock(&buf_pool.lock);
+		return buf_pool.slot[best].buf;
+	}
+	if (empty < 0) {
+		/* Registry is full; make room if anything is idle */
+		for (i = 0 ; i < BUF_POOL_SLOTS ; i++) {
+			if (buf_pool.slot[i].in_use)
+				continue;
+			free(buf_pool.slot[i].buf);
+			buf_pool.idle -= buf_pool.slot[i].cap;
+			buf_pool.slot[i].buf = NULL;
+			buf_pool.slot[i].cap = 0;
+			empty = i;
+			break;
+		}
+	}
+	if (empty >= 0) {
+		buf_pool.slot[empty].in_use = 1;  /* Reserve it */
+		buf_pool.slot[empty].buf = NULL;
+	}
+	pthread_mutex_unlock(&buf_pool.lock);
+
+	if (empty < 0)
+		return malloc(len);
+
+	cap = buf_pool_class(len);
+	buf = malloc(cap);
+
+	pthread_mutex_lock(&buf_pool.lock);
+	if (buf) {
+		buf_pool.slot[empty].buf = buf;
+		buf_pool.slot[empty].cap = cap;
+	} else {
+		buf_pool.slot[empty].in_use = 0;
+	}
+	pthread_mutex_unlock(&buf_pool.lock);
+
+	if (!buf)
+		return NULL;
+
+	/* Fault it in now rather than while we're feeding the printer */
+#ifndef _WIN32
+	pagesize = sysconf(_SC_PAGESIZE);
+#else
+	pagesize = 4096;
 #endif
-	const void *job;
-	int data_fd = fileno(stdin);
-	int read_page = 0, print_page = 0;
-	struct dyesub_joblist *jlist = NULL;
+	for (off = 0 ; off < cap ; off += pagesize)
+		buf[off] = 0;
 
-	if (!fname) {
-		if (uri && strlen(uri))
-			ERROR("ERROR: No input file specified\n");
-		ret = CUPS_BACKEND_FAILED;
-		goto done;
+	return buf;
+}
+
+void dyesub_buf_free(void *buf)
+{
+	int i;
+
+	if (!buf)
+		return;
+
+	if (spool_map.base &&
+	    (uint8_t *)buf >= spool_map.base &&
+	    (uint8_t *)buf < spool_map.base + spool_map.len)
+		return;
+
+	pthread_mutex_lock(&buf_pool.lock);
+	for (i = 0 ; i < BUF_POOL_SLOTS ; i++) {
+		if (buf_pool.slot[i].buf != buf)
+			continue;
+		buf_pool.slot[i].in_use = 0;
+		buf_pool.idle += buf_pool.slot[i].cap;
+		buf_pool_trim();
+		pthread_mutex_unlock(&buf_pool.lock);
+		return;
 	}
+	pthread_mutex_unlock(&buf_pool.lock);
 
-	if (ncopies < 1) {
-		ERROR("ERROR: need to have at least 1 copy!\n");
-		ret = CUPS_BACKEND_FAILED;
-		goto done;
+	free(buf);
+}
+
+static void buf_pool_drain(void)
+{
+	int i;
+
+	pthread_mutex_lock(&buf_pool.lock);
+	for (i = 0 ; i < BUF_POOL_SLOTS ; i++) {
+		if (!buf_pool.slot[i].buf || buf_pool.slot[i].in_use)
+			continue;
+		free(buf_pool.slot[i].buf);
+		buf_pool.slot[i].buf = NULL;
+		buf_pool.slot[i].cap = 0;
 	}
+	buf_pool.idle = 0;
+	pthread_mutex_unlock(&buf_pool.lock);
+}
 
-	/* Open file if not STDIN */
-	if (strcmp("-", fname)) {
-		data_fd = open(fname, O_RDONLY);
-		if (data_fd < 0) {
-			perror("ERROR:Can't open input file");
-			ret = CUPS_BACKEND_FAILED;
-			goto done;
+/* Streaming pass-through.
+
+   Backends that send the payload to the printer unmodified can leave it
+   in the spool instead of buffering the whole page; main_loop() then
+   forwards it to the printer as it arrives.  Only one payload can be
+   outstanding at a time, so the read-ahead pipeline waits for it to be
+   consumed (or discarded) before parsing the next page.
+*/
+int dyesub_stream_open(int data_fd, uint32_t len)
+{
+	if (!stream_data || !len)
+		return 0;
+
+	/* A mapped spool is already zero-copy */
+	if (spool_map.base && data_fd == spool_map.fd)
+		return 0;
+
+	/* Collated copies need the payload more than once */
+	if (collate && ncopies > 1)
+		return 0;
+
+	/* A group may retry the page on another printer */
+	if (printer_group)
+		return 0;
+
+	pthread_mutex_lock(&spool_stream.lock);
+	if (spool_stream.fd != -1) {
+		pthread_mutex_unlock(&spool_stream.lock);
+		return 0;
+	}
+	spool_stream.fd = data_fd;
+	spool_stream.remain = len;
+	pthread_mutex_unlock(&spool_stream.lock);
+
+	DEBUG("Streaming %u bytes of payload from spool\n", len);
+
+	return 1;
+}
+
+static int stream_fill(uint8_t *buf, uint32_t len)
+{
+	while (len) {
+		int i = read(spool_stream.fd, buf, len);
+		if (i <= 0) {
+			if (i < 0)
+				ERROR("Read failed: %s\n", strerror(errno));
+			ERROR("Spool ended with %u bytes of payload outstanding\n",
+			      spool_stream.remain);
+			return CUPS_BACKEND_CANCEL;
 		}
+		buf += i;
+		len -= i;
+		spool_stream.remain -= i;
 	}
 
-#ifndef _WIN32
-	/* Ensure we're using BLOCKING I/O */
-	i = fcntl(data_fd, F_GETFL, 0);
-	if (i < 0) {
-		perror("ERROR:Can't open input");
-		ret = CUPS_BACKEND_FAILED;
-		goto done;
+	return CUPS_BACKEND_OK;
+}
+
+int dyesub_stream_read(uint8_t *buf, uint32_t len)
+{
+	if (spool_stream.fd == -1 || len > spool_stream.remain) {
+		ERROR("Streamed payload too short (%u/%u)\n",
+		      spool_stream.remain, len);
+		return CUPS_BACKEND_FAILED;
 	}
-	i &= ~O_NONBLOCK;
-	i = fcntl(data_fd, F_SETFL, i);
-	if (i < 0) {
-		perror("ERROR:Can't open input");
-		ret = CUPS_BACKEND_FAILED;
-		goto done;
+
+	return stream_fill(buf, len);
+}
+
+int dyesub_stream_send(struct libusb_device_handle *dev, uint8_t endp,
+		       const uint8_t *prefix, int prefixlen, uint32_t len)
+{
+	uint8_t *buf;
+	int chunk, fill;
+	int ret = CUPS_BACKEND_OK;
+
+	if (spool_stream.fd == -1 || len > spool_stream.remain) {
+		ERROR("Streamed payload too short (%u/%u)\n",
+		      spool_stream.remain, len);
+		return CUPS_BACKEND_FAILED;
+	}
+
+	/* Keep each chunk a multiple of the transfer size, so the printer
+	   sees exactly the same packets as if we had buffered everything */
+	chunk = max_xfer_size * (xfer_queue_depth > 1 ? xfer_queue_depth : 1);
+	while (chunk < prefixlen + max_xfer_size)
+		chunk += max_xfer_size;
+
+	buf = malloc(chunk);
+	if (!buf) {
+		ERROR("Memory allocation failure (%d bytes)\n", chunk);
+		return CUPS_BACKEND_FAILED;
+	}
+
+	fill = prefixlen;
+	if (prefixlen)
+		memcpy(buf, prefix, prefixlen);
+
+	while (len || fill) {
+		uint32_t n = chunk - fill;
+		if (n > len)
+			n = len;
+
+		if ((ret = stream_fill(buf + fill, n)))
+			break;
+		len -= n;
+		fill += n;
+
+		if ((ret = send_data(dev, endp, buf, fill)))
+			break;
+		fill = 0;
+	}
+
+	free(buf);
+	return ret;
+}
+
+void dyesub_stream_close(void)
+{
+	uint8_t buf[4096];
+
+	pthread_mutex_lock(&spool_stream.lock);
+	if (spool_stream.fd != -1) {
+		/* Skip over whatever main_loop() didn't consume */
+		while (spool_stream.remain) {
+			uint32_t n = spool_stream.remain;
+			if (n > sizeof(buf))
+				n = sizeof(buf);
+			if (stream_fill(buf, n))
+				break;
+		}
+		spool_stream.fd = -1;
+		spool_stream.remain = 0;
+		pthread_cond_broadcast(&spool_stream.cond);
+	}
+	pthread_mutex_unlock(&spool_stream.lock);
+}
+
+static void stream_wait_idle(void)
+{
+	pthread_mutex_lock(&spool_stream.lock);
+	while (spool_stream.fd != -1)
+		pthread_cond_wait(&spool_stream.cond, &spool_stream.lock);
+	pthread_mutex_unlock(&spool_stream.lock);
+}
+
+/* A single attached printer */
+struct dyesub_printer {
+	struct libusb_device_handle *dev;
+	void *ctx;
+	uint8_t iface;
+	const char *serno;
+};
+
+/* Find, claim, and attach the backend to a printer */
+static int printer_open(struct libusb_context *ctx, struct dyesub_backend *backend,
+			const char *serno, const char *backend_str, int jobid,
+			struct dyesub_printer *p)
+{
+	struct libusb_device **list = NULL;
+	uint8_t endp_up, endp_down;
+	uint8_t altset;
+	int printer_type;
+	int found;
+	int ret;
+
+	memset(p, 0, sizeof(*p));
+	p->serno = serno;
+
+	/* Enumerate devices */
+	found = find_and_enumerate(ctx, &list, backend, serno, backend_str, 0, NUM_CLAIM_ATTEMPTS, &p->iface, &altset, &endp_up, &endp_down);
+
+	if (found == -1) {
+		ERROR("Printer open failure (No matching printers found!)\n");
+		ret = CUPS_BACKEND_RETRY;
+		goto done;
+	}
+
+	if (test_mode) {
+		WARNING("**** TEST MODE %d!\n", test_mode);
+		if (test_mode >= TEST_MODE_NOATTACH)
+			goto bypass;
+	}
+	if (usbx_replay)
+		goto bypass;
+
+	/* Open an appropriate device */
+	ret = libusb_open(list[found], &p->dev);
+	if (ret) {
+		ERROR("Printer open failure (Need to be root?) (%d)\n", ret);
+		ret = CUPS_BACKEND_RETRY_CURRENT;
+		goto done;
+	}
+
+	/* Detach the kernel driver */
+	if (libusb_kernel_driver_active(p->dev, p->iface)) {
+		ret = libusb_detach_kernel_driver(p->dev, p->iface);
+		if (ret && (ret != LIBUSB_ERROR_NOT_SUPPORTED)) {
+			ERROR("Printer open failure (Could not detach printer from kernel) (%d)\n", ret);
+			ret = CUPS_BACKEND_RETRY_CURRENT;
+			goto done_close;
+		}
+	}
+
+	/* Claim the interface so we can start using this! */
+	ret = backend_claim_interface(p->dev, p->iface, NUM_CLAIM_ATTEMPTS);
+	if (ret) {
+		ERROR("Printer open failure (Unable to claim interface) (%d)\n", ret);
+		ret = CUPS_BACKEND_RETRY;
+		goto done_close;
+	}
+
+	/* Use the appropriate altesetting! */
+	if (altset != 0) {
+		ret = libusb_set_interface_alt_setting(p->dev, p->iface, altset);
+		if (ret) {
+			ERROR("Printer open failure (Unable to issue altsettinginterface) (%d)\n", ret);
+			ret = CUPS_BACKEND_RETRY;
+			goto done_claimed;
+		}
+	}
+
+bypass:
+	if (usbx.rec && test_mode < TEST_MODE_NOATTACH) {
+		struct libusb_device_descriptor desc;
+		struct usbx_dev d;
+
+		usbx.recording = 1;
+		dyesub_get_device_descriptor(p->dev, &desc);
+		d.vid = cpu_to_le16(desc.idVendor);
+		d.pid = cpu_to_le16(desc.idProduct);
+		d.iManufacturer = desc.iManufacturer;
+		d.iProduct = desc.iProduct;
+		d.iSerialNumber = desc.iSerialNumber;
+		d.iface = p->iface;
+		d.altset = altset;
+		d.endp_up = endp_up;
+		d.endp_down = endp_down;
+		usbx_record(USBX_DEVICE, 0, 0, &d, sizeof(d), 0);
+	}
+
+	/* Initialize backend */
+	DEBUG("Initializing '%s' backend (version %s)\n",
+	      backend->name, backend->version);
+	p->ctx = backend->init();
+
+	if (test_mode < TEST_MODE_NOATTACH) {
+		struct libusb_device_descriptor desc;
+
+		dyesub_get_device_descriptor(p->dev, &desc);
+
+		printer_type = lookup_printer_type(backend,
+						   desc.idVendor, desc.idProduct);
+	} else {
+		printer_type = lookup_printer_type(backend,
+						   extra_vid, extra_pid);
+	}
+
+	if (printer_type <= P_UNKNOWN) {
+		ERROR("Unable to lookup printer type\n");
+		ret = CUPS_BACKEND_FAILED;
+		goto done_claimed;
+	}
+
+	/* Attach backend to device */ // XXX pass backend_str?
+	if (backend->attach(p->ctx, p->dev, printer_type, endp_up, endp_down, p->iface, jobid)) {
+		ERROR("Unable to attach to printer!\n");
+		ret = CUPS_BACKEND_FAILED;
+		goto done_claimed;
+	}
+
+	ret = CUPS_BACKEND_OK;
+	goto done;
+
+done_claimed:
+	if (test_mode < TEST_MODE_NOATTACH && p->dev)
+		libusb_release_interface(p->dev, p->iface);
+
+done_close:
+	if (test_mode < TEST_MODE_NOATTACH && p->dev)
+		libusb_close(p->dev);
+	p->dev = NULL;
+
+	if (p->ctx) {
+		if (backend->teardown)
+			backend->teardown(p->ctx);
+		else
+			generic_teardown(p->ctx);
+		p->ctx = NULL;
+	}
+
+done:
+	if (list)
+		libusb_free_device_list(list, 1);
+
+	return ret;
+}
+
+static void printer_close(struct dyesub_backend *backend, struct dyesub_printer *p)
+{
+	if (test_mode < TEST_MODE_NOATTACH && p->dev) {
+		libusb_release_interface(p->dev, p->iface);
+		libusb_close(p->dev);
+	}
+	p->dev = NULL;
+
+	if (p->ctx) {
+		if (backend->teardown)
+			backend->teardown(p->ctx);
+		else
+			generic_teardown(p->ctx);
+//		STATE("-org.gutenprint.attached-to-device");
+	}
+	p->ctx = NULL;
+}
+
+/* Printer groups.
+
+   When given several (identical) printers' serial numbers, separated by
+   commas, the backend attaches to all of them at once.  Pages are parsed
+   as usual, using the context of whichever printer is idle at the time,
+   and each one is handed to a worker thread for whichever printer is best
+   able to take it, based on the backend's query_ready() hook (free
+   buffers, cooling, etc) and the remaining media reported by
+   query_markers().  The backend's check_job() hook then redoes the media
+   checks read_parse() made against the printer it was parsed with.  A
+   printer that fails is taken out of the group and its page is handed to
+   another one.
+
+   Copies of the same job are printed one after the other, never at the
+   same time, as main_loop() is free to modify the job it is given.
+
+   Only idle printers are ever queried or parsed against, and a printer
+   being queried is not parsed against (or vice versa), so no backend
+   context is used by more than one thread at a time.
+*/
+static void __dyesub_joblist_plan(struct dyesub_joblist *list);
+
+struct group_job {
+	const void *job;
+	int refs;  /* Copies not yet printed (or abandoned) */
+	int busy;  /* A copy is with a printer */
+};
+
+/* One copy of a job, as handed to a printer */
+struct group_page {
+	struct group_job *job;
+	int num;  /* Page number, for logging */
+};
+
+struct dyesub_group;
+
+struct group_unit {
+	struct dyesub_group *group;
+	struct dyesub_printer printer;
+	pthread_t thread;
+	int running;  /* Worker thread was started */
+
+	struct group_page *page;  /* Assigned page, if any */
+	int parsing;  /* Context is in use by read_parse() */
+	int probing;  /* Context is in use by group_dispatch() */
+	int offline;
+	int pages;
+};
+
+struct dyesub_group {
+	struct dyesub_backend *backend;
+	char *sernos;  /* Storage for the split-up serial numbers */
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	int ret;       /* Last printer failure */
+	int rejected;  /* A page was rejected as unprintable */
+
+	struct group_page *orphans[GROUP_MAX];  /* Pages from failed printers */
+	int num_orphans;
+
+	struct group_unit units[GROUP_MAX];
+	int num_units;
+};
+
+/* Caller must hold the group lock */
+static void group_put_job(struct dyesub_group *g, struct group_job *job, int copies)
+{
+	job->refs -= copies;
+	if (job->refs)
+		return;
+
+	g->backend->cleanup_job(job->job);
+	free(job);
+}
+
+static void *group_worker(void *arg)
+{
+	struct group_unit *u = arg;
+	struct dyesub_group *g = u->group;
+	struct group_page *page;
+	int ret;
+
+	pthread_mutex_lock(&g->lock);
+	while (1) {
+		while (!u->page && !g->stop)
+			pthread_cond_wait(&g->cond, &g->lock);
+		if (!u->page)
+			break;
+		page = u->page;
+		pthread_mutex_unlock(&g->lock);
+
+		INFO("Printing page %d on printer %s\n", page->num, u->printer.serno);
+		if (test_mode >= TEST_MODE_NOPRINT)
+			WARNING("**** TEST MODE, bypassing printing!\n");
+
+		ret = CUPS_BACKEND_OK;
+		timing_begin();
+		if (test_mode < TEST_MODE_NOPRINT ||
+		    g->backend->flags & BACKEND_FLAG_DUMMYPRINT)
+			ret = g->backend->main_loop(u->printer.ctx, page->job->job);
+		timing_printed_job(g->backend, page->job->job, page->num,
+				   u->printer.serno, ret);
+
+		pthread_mutex_lock(&g->lock);
+		u->page = NULL;
+		page->job->busy = 0;
+		if (ret == CUPS_BACKEND_OK) {
+			u->pages++;
+			group_put_job(g, page->job, 1);
+			free(page);
+		} else if (ret == CUPS_BACKEND_CANCEL) {
+			/* Bad job, no point in trying elsewhere */
+			ERROR("Printer %s rejected page %d\n", u->printer.serno, page->num);
+			g->rejected = 1;
+			group_put_job(g, page->job, 1);
+			free(page);
+		} else {
+			ERROR("Printer %s failed (%d), removing it from the group\n",
+			      u->printer.serno, ret);
+			u->offline = 1;
+			g->ret = ret;
+			g->orphans[g->num_orphans++] = page;
+		}
+		pthread_cond_broadcast(&g->cond);
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	return NULL;
+}
+
+/* Total media remaining, or -1 if unknown */
+static int group_media_remaining(struct dyesub_group *g, struct group_unit *u)
+{
+	struct marker *markers = NULL;
+	int count = 0;
+	int i, total = -1;
+
+	if (test_mode >= TEST_MODE_NOPRINT || !g->backend->query_markers)
+		return -1;
+	if (g->backend->query_markers(u->printer.ctx, &markers, &count))
+		return -1;
+
+	for (i = 0 ; i < count ; i++) {
+		if (markers[i].levelnow < 0)
+			continue;
+		if (total < 0)
+			total = 0;
+		total += markers[i].levelnow;
+	}
+
+	return total;
+}
+
+/* Done querying these printers; let group_read_parse() have them */
+static void group_unprobe(struct dyesub_group *g, struct group_unit **units, int num)
+{
+	int i;
+
+	pthread_mutex_lock(&g->lock);
+	for (i = 0 ; i < num ; i++)
+		units[i]->probing = 0;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+}
+
+/* Hand a page to the most suitable idle printer, waiting until there is one.
+   A page no printer can print is dropped.  On failure, the page is still
+   the caller's. */
+static int group_dispatch(struct dyesub_group *g, struct group_page *page)
+{
+	struct group_unit *idle[GROUP_MAX];
+	struct group_unit *best;
+	struct dyesub_poll poll;
+	int best_ready, best_media;
+	int i, num_idle, online;
+	int online_mask, unfit = 0;  /* Bitmasks of printers */
+
+	dyesub_poll_reset(&poll);
+
+	while (1) {
+		pthread_mutex_lock(&g->lock);
+		num_idle = 0;
+		online = 0;
+		online_mask = 0;
+		for (i = 0 ; i < g->num_units ; i++) {
+			if (g->units[i].offline)
+				continue;
+			online++;
+			online_mask |= 1 << i;
+			if (!g->units[i].page && !g->units[i].parsing &&
+			    !(unfit & (1 << i)))
+				idle[num_idle++] = &g->units[i];
+		}
+
+		/* Nobody left that could print it, so drop it */
+		if (online && (unfit & online_mask) == online_mask) {
+			ERROR("No printer in the group can print page %d\n", page->num);
+			g->rejected = 1;
+			group_put_job(g, page->job, 1);
+			pthread_mutex_unlock(&g->lock);
+			free(page);
+			return CUPS_BACKEND_OK;
+		}
+
+		/* Everyone is busy, or another copy of this job is still
+		   printing; wait for a printer to finish its page */
+		if (online && (!num_idle || page->job->busy) && !terminate) {
+			pthread_cond_wait(&g->cond, &g->lock);
+			pthread_mutex_unlock(&g->lock);
+			continue;
+		}
+		if (online && !terminate) {
+			for (i = 0 ; i < num_idle ; i++)
+				idle[i]->probing = 1;
+		}
+		pthread_mutex_unlock(&g->lock);
+
+		if (!online) {
+			ERROR("No printers left in the group!\n");
+			return g->ret ? g->ret : CUPS_BACKEND_STOP;
+		}
+		if (terminate)
+			return CUPS_BACKEND_CANCEL;
+
+		best = NULL;
+		best_ready = 0;
+		best_media = -1;
+		for (i = 0 ; i < num_idle ; i++) {
+			int ready = 1;
+			int media;
+
+			if (g->backend->query_ready) {
+				ready = g->backend->query_ready(idle[i]->printer.ctx);
+				if (ready < 0) {
+					ERROR("Printer %s is offline, removing it from the group\n",
+					      idle[i]->printer.serno);
+					pthread_mutex_lock(&g->lock);
+					idle[i]->offline = 1;
+					pthread_mutex_unlock(&g->lock);
+					continue;
+				}
+				if (!ready)
+					continue;
+			}
+
+			media = group_media_remaining(g, idle[i]);
+			if (!media)
+				continue;
+
+			/* Prefer the most free buffers, then the most media */
+			if (ready > best_ready ||
+			    (ready == best_ready && media > best_media)) {
+				best = idle[i];
+				best_ready = ready;
+				best_media = media;
+			}
+		}
+
+		/* The page was parsed against whichever printer was idle
+		   at the time; make sure this one can print it */
+		if (best && g->backend->check_job &&
+		    g->backend->check_job(best->printer.ctx, page->job->job)) {
+			WARNING("Printer %s can't print page %d, trying another\n",
+				best->printer.serno, page->num);
+			unfit |= 1 << (best - g->units);
+			group_unprobe(g, idle, num_idle);
+			continue;
+		}
+
+		if (best) {
+			pthread_mutex_lock(&g->lock);
+			if (best->parsing || best->page) {
+				/* Shouldn't happen while it's being probed */
+				pthread_mutex_unlock(&g->lock);
+				group_unprobe(g, idle, num_idle);
+				continue;
+			}
+			DEBUG("Dispatching page %d to printer %s (ready %d, media %d)\n",
+			      page->num, best->printer.serno, best_ready, best_media);
+			best->page = page;
+			page->job->busy = 1;
+			for (i = 0 ; i < num_idle ; i++)
+				idle[i]->probing = 0;
+			pthread_cond_broadcast(&g->cond);
+			pthread_mutex_unlock(&g->lock);
+			return CUPS_BACKEND_OK;
+		}
+		group_unprobe(g, idle, num_idle);
+
+		/* Idle printers aren't ready yet (cooling down, etc) */
+		dyesub_poll_sleep(&poll);
+	}
+}
+
+/* read_parse() against an idle printer's context, so that it never runs
+   alongside that printer's main_loop() or group_dispatch()'s queries.
+   group_dispatch() leaves the printer alone until we're done. */
+static int group_read_parse(struct dyesub_group *g, const void **job,
+			    int data_fd, int copies)
+{
+	struct group_unit *u = NULL;
+	int i, ret;
+
+	pthread_mutex_lock(&g->lock);
+	while (1) {
+		/* Prefer printers still in the group, but any will do */
+		for (i = 0 ; i < g->num_units && !u ; i++) {
+			if (!g->units[i].page && !g->units[i].probing &&
+			    !g->units[i].offline)
+				u = &g->units[i];
+		}
+		for (i = 0 ; i < g->num_units && !u ; i++) {
+			if (!g->units[i].page && !g->units[i].probing)
+				u = &g->units[i];
+		}
+		if (u)
+			break;
+		pthread_cond_wait(&g->cond, &g->lock);
+	}
+	u->parsing = 1;
+	pthread_mutex_unlock(&g->lock);
+
+	ret = g->backend->read_parse(u->printer.ctx, job, data_fd, copies);
+
+	pthread_mutex_lock(&g->lock);
+	u->parsing = 0;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+/* Re-dispatch any pages left behind by failed printers */
+static int group_dispatch_orphans(struct dyesub_group *g)
+{
+	struct group_page *page;
+	int ret = CUPS_BACKEND_OK;
+
+	pthread_mutex_lock(&g->lock);
+	while (g->num_orphans) {
+		page = g->orphans[--g->num_orphans];
+		pthread_mutex_unlock(&g->lock);
+
+		WARNING("Retrying page %d on another printer\n", page->num);
+		ret = group_dispatch(g, page);
+
+		pthread_mutex_lock(&g->lock);
+		if (ret) {
+			group_put_job(g, page->job, 1);
+			free(page);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+/* Group counterpart to dyesub_joblist_print(); each copy of each job is
+   handed off to a printer, and the job is freed once all have printed. */
+static int group_print(struct dyesub_group *g, struct dyesub_joblist *list, int *pagenum)
+{
+	struct group_job *jobs[DYESUB_MAX_JOB_ENTRIES];
+	struct group_page *page;
+	int sent[DYESUB_MAX_JOB_ENTRIES];
+	int i, j;
+	int ret = CUPS_BACKEND_OK;
+
+	__dyesub_joblist_plan(list);
+
+	/* Take ownership of the list's jobs */
+	for (j = 0 ; j < list->num_entries ; j++) {
+		sent[j] = 0;
+		jobs[j] = NULL;
+		if (!list->entries[j])
+			continue;
+		jobs[j] = malloc(sizeof(*jobs[j]));
+		if (!jobs[j]) {
+			ERROR("Memory allocation failure!\n");
+			ret = CUPS_BACKEND_RETRY_CURRENT;
+			goto done;
+		}
+		jobs[j]->job = list->entries[j];
+		jobs[j]->refs = list->copies;
+		jobs[j]->busy = 0;
+		list->entries[j] = NULL;
+	}
+
+	for (i = 0 ; i < list->copies ; i++) {
+		for (j = 0 ; j < list->num_entries ; j++) {
+			if (!jobs[j])
+				continue;
+
+			ret = group_dispatch_orphans(g);
+			if (ret)
+				goto done;
+
+			page = malloc(sizeof(*page));
+			if (!page) {
+				ERROR("Memory allocation failure!\n");
+				ret = CUPS_BACKEND_RETRY_CURRENT;
+				goto done;
+			}
+			page->job = jobs[j];
+			page->num = ++(*pagenum);
+			INFO("Queueing page %d\n", page->num);
+
+			ret = group_dispatch(g, page);
+			if (ret) {
+				free(page);
+				goto done;
+			}
+			sent[j]++;
+		}
+	}
+
+done:
+	/* Drop the copies that were never handed off */
+	pthread_mutex_lock(&g->lock);
+	for (j = 0 ; j < list->num_entries ; j++) {
+		if (jobs[j] && sent[j] < list->copies)
+			group_put_job(g, jobs[j], list->copies - sent[j]);
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+/* Wait for every printer in the group to finish its current page */
+static int group_drain(struct dyesub_group *g)
+{
+	int i, ret;
+
+	while (1) {
+		ret = group_dispatch_orphans(g);
+		if (ret)
+			return ret;
+
+		pthread_mutex_lock(&g->lock);
+		for (i = 0 ; i < g->num_units ; i++) {
+			if (g->units[i].page)
+				break;
+		}
+		if (i == g->num_units) {
+			pthread_mutex_unlock(&g->lock);
+			break;
+		}
+		pthread_cond_wait(&g->cond, &g->lock);
+		pthread_mutex_unlock(&g->lock);
+	}
+
+	for (i = 0 ; i < g->num_units ; i++) {
+		if (g->units[i].pages)
+			INFO("Printer %s printed %d page(s)\n",
+			     g->units[i].printer.serno, g->units[i].pages);
+		g->units[i].pages = 0;
+	}
+
+	ret = g->rejected ? CUPS_BACKEND_CANCEL : CUPS_BACKEND_OK;
+	g->rejected = 0;
+
+	return ret;
+}
+
+static void group_close(void)
+{
+	struct dyesub_group *g = printer_group;
+	int i;
+
+	if (!g)
+		return;
+
+	pthread_mutex_lock(&g->lock);
+	g->stop = 1;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+
+	for (i = 0 ; i < g->num_units ; i++) {
+		if (g->units[i].running)
+			pthread_join(g->units[i].thread, NULL);
+		printer_close(g->backend, &g->units[i].printer);
+	}
+	while (g->num_orphans) {
+		struct group_page *page = g->orphans[--g->num_orphans];
+		group_put_job(g, page->job, 1);
+		free(page);
+	}
+
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->lock);
+	free(g->sernos);
+	free(g);
+	printer_group = NULL;
+}
+
+static int group_open(struct libusb_context *ctx, struct dyesub_backend *backend,
+		      const char *sernos, const char *backend_str, int jobid)
+{
+	struct dyesub_group *g;
+	char *serno, *saveptr = NULL;
+	int ret = CUPS_BACKEND_OK;
+	int i;
+
+	if (backend->flags & BACKEND_FLAG_NOPIPELINE) {
+		ERROR("Printer groups are not supported by the '%s' backend\n", backend->name);
+		return CUPS_BACKEND_FAILED;
+	}
+	if (usbx_replay || usbx.rec) {
+		ERROR("Printer groups can't be recorded to or replayed from a USB transcript\n");
+		return CUPS_BACKEND_FAILED;
+	}
+
+	g = calloc(1, sizeof(*g));
+	if (!g) {
+		ERROR("Memory allocation failure (%d bytes)\n", (int)sizeof(*g));
+		return CUPS_BACKEND_RETRY_CURRENT;
+	}
+	g->backend = backend;
+	g->sernos = strdup(sernos);
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+	printer_group = g;
+
+	if (!g->sernos) {
+		ERROR("Memory allocation failure!\n");
+		ret = CUPS_BACKEND_RETRY_CURRENT;
+		goto fail;
+	}
+
+	for (serno = strtok_r(g->sernos, ",", &saveptr) ; serno ;
+	     serno = strtok_r(NULL, ",", &saveptr)) {
+		struct group_unit *u = &g->units[g->num_units];
+
+		if (g->num_units == GROUP_MAX) {
+			ERROR("Too many printers in group (max %d)\n", GROUP_MAX);
+			ret = CUPS_BACKEND_FAILED;
+			goto fail;
+		}
+
+		INFO("Attaching to printer %s\n", serno);
+		ret = printer_open(ctx, backend, serno, backend_str, jobid, &u->printer);
+		if (ret)
+			goto fail;
+		u->group = g;
+		g->num_units++;
+	}
+
+	if (!g->num_units) {
+		ERROR("No printers in group!\n");
+		ret = CUPS_BACKEND_FAILED;
+		goto fail;
+	}
+
+	for (i = 0 ; i < g->num_units ; i++) {
+		if (pthread_create(&g->units[i].thread, NULL, group_worker, &g->units[i])) {
+			ERROR("Unable to start printer thread\n");
+			ret = CUPS_BACKEND_FAILED;
+			goto fail;
+		}
+		g->units[i].running = 1;
+	}
+
+	/* A streamed page would have the next page read from under it */
+	stream_data = 0;
+
+	return CUPS_BACKEND_OK;
+
+fail:
+	group_close();
+	return ret;
+}
+
+/* Read-ahead pipeline.
+
+   A reader thread runs the backend's read_parse() and queues up to
+   pipeline_depth parsed pages, so the host-side work for the next page
+   overlaps with main_loop() printing the current one.  Backends whose
+   read_parse() can't run concurrently with main_loop() must set
+   BACKEND_FLAG_NOPIPELINE.
+*/
+struct dyesub_pipeline {
+	struct dyesub_backend *backend;
+	void *backend_ctx;
+	int data_fd;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	const void *jobs[PIPELINE_MAX];
+	int head;
+	int count;
+	int depth;
+
+	int done;  /* Reader has finished; 'ret' is valid */
+	int ret;   /* Final read_parse() result */
+	int stop;  /* Consumer has bailed out */
+};
+
+static void *pipeline_reader(void *arg)
+{
+	struct dyesub_pipeline *p = arg;
+
+	while (1) {
+		const void *job = NULL;
+		int ret;
+
+		/* Wait for room in the queue */
+		pthread_mutex_lock(&p->lock);
+		while (p->count >= p->depth && !p->stop)
+			pthread_cond_wait(&p->cond, &p->lock);
+		if (p->stop) {
+			p->done = 1;
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		pthread_mutex_unlock(&p->lock);
+
+		timing_begin();
+		if (printer_group)
+			ret = group_read_parse(printer_group, &job, p->data_fd, ncopies);
+		else
+			ret = p->backend->read_parse(p->backend_ctx, &job, p->data_fd, ncopies);
+		if (!ret)
+			timing_parsed_job(job);
+
+		pthread_mutex_lock(&p->lock);
+		if (ret) {
+			p->ret = ret;
+			p->done = 1;
+			pthread_cond_broadcast(&p->cond);
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		if (!job) {
+			pthread_mutex_unlock(&p->lock);
+			WARNING("No job returned by backend read_parse?\n");
+			continue;
+		}
+		if (p->stop) {
+			pthread_mutex_unlock(&p->lock);
+			p->backend->cleanup_job(job);
+			continue;
+		}
+		p->jobs[(p->head + p->count) % PIPELINE_MAX] = job;
+		p->count++;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+
+		/* Don't touch the spool until a streamed payload is gone */
+		stream_wait_idle();
+	}
+
+	return NULL;
+}
+
+static struct dyesub_pipeline *pipeline_start(struct dyesub_backend *backend,
+					      void *backend_ctx, int data_fd)
+{
+	struct dyesub_pipeline *p;
+
+	if (pipeline_depth <= 0 || (backend->flags & BACKEND_FLAG_NOPIPELINE))
+		return NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (!p) {
+		ERROR("Memory allocation failure (%d bytes)\n", (int)sizeof(*p));
+		return NULL;
+	}
+	p->backend = backend;
+	p->backend_ctx = backend_ctx;
+	p->data_fd = data_fd;
+	p->depth = pipeline_depth;
+	/* Keep a parsed page on hand for every printer in a group */
+	if (printer_group && p->depth < printer_group->num_units)
+		p->depth = printer_group->num_units;
+	if (p->depth > PIPELINE_MAX)
+		p->depth = PIPELINE_MAX;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	if (pthread_create(&p->thread, NULL, pipeline_reader, p)) {
+		WARNING("Unable to start reader thread, parsing serially\n");
+		pthread_cond_destroy(&p->cond);
+		pthread_mutex_destroy(&p->lock);
+		free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+/* Same semantics as read_parse(), but never returns a NULL job on success */
+static int pipeline_next(struct dyesub_pipeline *p, const void **job)
+{
+	int ret = CUPS_BACKEND_OK;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->count && !p->done)
+		pthread_cond_wait(&p->cond, &p->lock);
+	if (p->count) {
+		*job = p->jobs[p->head];
+		p->head = (p->head + 1) % PIPELINE_MAX;
+		p->count--;
+		pthread_cond_broadcast(&p->cond);
+	} else {
+		ret = p->ret;
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return ret;
+}
+
+static void pipeline_finish(struct dyesub_pipeline *p)
+{
+	/* Tell the reader to stop after its current page, if any */
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	/* Discard anything left over; this also releases a reader
+	   waiting on a streamed payload */
+	pthread_mutex_lock(&p->lock);
+	while (p->count) {
+		const void *job = p->jobs[p->head];
+		p->head = (p->head + 1) % PIPELINE_MAX;
+		p->count--;
+		pthread_mutex_unlock(&p->lock);
+		p->backend->cleanup_job(job);
+		pthread_mutex_lock(&p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	pthread_join(p->thread, NULL);
+
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+/* Parse and print everything that arrives on data_fd */
+static int process_input(struct dyesub_backend *backend, void *backend_ctx,
+			 int data_fd, const char *type)
+{
+	int ret = CUPS_BACKEND_OK;
+	const void *job;
+	int read_page = 0, print_page = 0;
+	struct dyesub_joblist *jlist = NULL;
+	struct dyesub_pipeline *pipeline = NULL;
+
+	/* Time for the main processing loop */
+	INFO("Printing started (%d copies)\n", ncopies);
+
+	/* See if it's a CUPS command stream, and if yes, handle it! */
+	if (type && !strcmp("application/vnd.cups-command", type))
+	{
+		ret = parse_cmdstream(backend, backend_ctx, data_fd);
+		goto done;
+	}
+
+	/* Emit a verbose marker dump */
+	ret = query_markers(backend, backend_ctx, 1);
+	if (ret)
+		goto done;
+
+	/* Read ahead while printing, if possible */
+	pipeline = pipeline_start(backend, backend_ctx, data_fd);
+
+newpage:
+	/* Read in data */
+	job = NULL;
+	if (pipeline) {
+		ret = pipeline_next(pipeline, &job);
+	} else {
+		timing_begin();
+		if (printer_group)
+			ret = group_read_parse(printer_group, &job, data_fd, ncopies);
+		else
+			ret = backend->read_parse(backend_ctx, &job, data_fd, ncopies);
+		if (!ret)
+			timing_parsed_job(job);
+	}
+	if (ret) {
+		if (read_page)
+			goto done_multiple;
+		else
+			goto done;
+	}
+
+	if (!job) {
+		WARNING("No job returned by backend read_parse?\n");
+		goto newpage;
+	}
+
+	/* Create a joblist if needed */
+	if (!jlist) {
+		jlist = dyesub_joblist_create(backend, backend_ctx);
+	}
+	if (!jlist) {
+		backend->cleanup_job(job);
+		goto done;
+	}
+
+	/* Stick it onto the end of the list */
+	dyesub_joblist_appendjob(jlist, job);
+	read_page++;
+
+	INFO("Parsed page %d (%d copies)\n", read_page, ncopies);
+
+	/* If we get here, we can wait for another combined job, do so */
+	if (dyesub_joblist_canwait(jlist))
+		goto newpage;
+
+print_list:
+	/* Print the pagelist */
+	if (printer_group)
+		ret = group_print(printer_group, jlist, &print_page);
+	else
+		ret = dyesub_joblist_print(jlist, &print_page);
+	if (ret)
+		goto done;
+
+	dyesub_joblist_cleanup(jlist);
+	jlist = NULL;
+
+	/* Since we have no way of telling if there's more data remaining
+	   to be read (without actually trying to read it), always assume
+	   multiple print jobs. */
+	goto newpage;
+
+done_multiple:
+	if (jlist)
+		goto print_list;
+
+	ret = CUPS_BACKEND_OK;
+
+done:
+	if (jlist) dyesub_joblist_cleanup(jlist);
+	if (pipeline) pipeline_finish(pipeline);
+	if (printer_group) {
+		int ret2 = group_drain(printer_group);
+		if (!ret)
+			ret = ret2;
+	}
+
+	return ret;
+}
+
+static int handle_input(struct dyesub_backend *backend, void *backend_ctx,
+			const char *fname, char *uri, char *type)
+{
+	int ret = CUPS_BACKEND_OK;
+#ifndef _WIN32
+	int i;
+#endif
+	int data_fd = fileno(stdin);
+
+	if (!fname) {
+		if (uri && strlen(uri))
+			ERROR("ERROR: No input file specified\n");
+		ret = CUPS_BACKEND_FAILED;
+		goto done;
+	}
+
+	if (ncopies < 1) {
+		ERROR("ERROR: need to have at least 1 copy!\n");
+		ret = CUPS_BACKEND_FAILED;
+		goto done;
+	}
+
+	/* Open file if not STDIN */
+	if (strcmp("-", fname)) {
+		data_fd = open(fname, O_RDONLY);
+		if (data_fd < 0) {
+			ERROR("Can't open input file: %s\n", strerror(errno));
+			ret = CUPS_BACKEND_FAILED;
+			goto done;
+		}
+	}
+
+#ifndef _WIN32
+	/* Ensure we're using BLOCKING I/O */
+	i = fcntl(data_fd, F_GETFL, 0);
+	if (i < 0) {
+		ERROR("Can't open input: %s\n", strerror(errno));
+		ret = CUPS_BACKEND_FAILED;
+		goto done_close;
+	}
+	i &= ~O_NONBLOCK;
+	i = fcntl(data_fd, F_SETFL, i);
+	if (i < 0) {
+		ERROR("Can't open input: %s\n", strerror(errno));
+		ret = CUPS_BACKEND_FAILED;
+		goto done_close;
+	}
+
+	/* Ignore SIGPIPE */
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGTERM, sigterm_handler);
+#endif
+
+	spool_map_open(data_fd);
+
+	ret = process_input(backend, backend_ctx, data_fd, type);
+
+	/* All jobs are gone by now, so nothing can still be borrowing */
+	spool_map_close();
+
+#ifndef _WIN32
+done_close:
+#endif
+	if (data_fd != fileno(stdin))
+		close(data_fd);
+
+done:
+	return ret;
+}
+
+#ifndef _WIN32
+/* Persistent daemon mode.
+
+   The daemon attaches to a single printer (selected via SERIAL) and keeps
+   the USB handle and the backend context (including any loaded libraries
+   and correction tables) alive across jobs.  It listens on a local socket;
+   each connection carries one job:
+
+     client -> daemon:  struct daemon_hdr, followed by the spool data
+     daemon -> client:  the backend's stderr output for that job, followed
+                        by a final DAEMON_RESULT line with the return code.
+
+   In CUPS mode, the backend first tries to hand the job to a daemon
+   serving the URI's serial number, and only attaches to the printer
+   itself if none is listening.
+*/
+#define DAEMON_MAGIC    0x44594553  /* 'DYES' */
+#define DAEMON_VERSION  2
+#define DAEMON_RESULT   "DAEMON-RESULT: "
+#define DAEMON_BUF_SIZE (64*1024)
+
+struct daemon_hdr {
+	uint32_t magic;
+	uint32_t version;
+	int32_t  copies;
+	char     type[64];  /* FINAL_CONTENT_TYPE, NUL-terminated */
+};
+
+static int daemon_socket_path(const char *serno, struct sockaddr_un *addr)
+{
+	int len;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	len = snprintf(addr->sun_path, sizeof(addr->sun_path),
+		       "%s/dyesub-%s.sock", daemon_path, serno);
+	if (len < 0 || len >= (int)sizeof(addr->sun_path)) {
+		ERROR("Daemon socket path too long\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int write_all(int fd, const uint8_t *buf, int len)
+{
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int read_all(int fd, uint8_t *buf, int len)
+{
+	while (len > 0) {
+		ssize_t ret = read(fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ret == 0)
+			return -1;
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int daemon_serve(struct dyesub_backend *backend, void *backend_ctx,
+			const char *serno)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	int sock;
+	int jobs = 0;
+	mode_t old_umask;
+
+	if (!serno) {
+		ERROR("Daemon mode requires SERIAL to be set!\n");
+		return CUPS_BACKEND_FAILED;
+	}
+	if (daemon_socket_path(serno, &addr))
+		return CUPS_BACKEND_FAILED;
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		ERROR("Unable to create daemon socket (%d)\n", errno);
+		return CUPS_BACKEND_FAILED;
+	}
+
+	/* Only the owner (ie root, when spawned by CUPS) may submit jobs */
+	unlink(addr.sun_path);
+	old_umask = umask(0077);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, 4)) {
+		umask(old_umask);
+		ERROR("Unable to listen on '%s' (%d)\n", addr.sun_path, errno);
+		close(sock);
+		return CUPS_BACKEND_FAILED;
 	}
-
-	/* Ignore SIGPIPE */
+	umask(old_umask);
+
+	/* SIGTERM must interrupt accept(), so no SA_RESTART */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigterm_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
 	signal(SIGPIPE, SIG_IGN);
-	signal(SIGTERM, sigterm_handler);
-#endif
 
-	/* Time for the main processing loop */
-	INFO("Printing started (%d copies)\n", ncopies);
+	INFO("Daemon serving '%s' on %s\n", serno, addr.sun_path);
 
-	/* See if it's a CUPS command stream, and if yes, handle it! */
-	if (type && !strcmp("application/vnd.cups-command", type))
-	{
-		ret = parse_cmdstream(backend, backend_ctx, data_fd);
-		goto done;
-	}
+	while (!terminate) {
+		struct daemon_hdr hdr;
+		int conn, saved_stderr;
+		int ret;
 
-	/* Emit a verbose marker dump */
-	ret = query_markers(backend, backend_ctx, 1);
-	if (ret)
-		goto done;
+		conn = accept(sock, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+			ERROR("Daemon accept failure (%d)\n", errno);
+			break;
+		}
 
-newpage:
-	/* Read in data */
-	job = NULL;
-	if ((ret = backend->read_parse(backend_ctx, &job, data_fd, ncopies))) {
-		if (read_page)
-			goto done_multiple;
-		else
-			goto done;
+		if (read_all(conn, (uint8_t *)&hdr, sizeof(hdr)) ||
+		    hdr.magic != DAEMON_MAGIC ||
+		    hdr.version != DAEMON_VERSION ||
+		    hdr.copies < 1 ||
+		    hdr.type[sizeof(hdr.type) - 1]) {
+			WARNING("Rejecting malformed daemon request\n");
+			close(conn);
+			continue;
+		}
+
+		ncopies = hdr.copies;
+		jobs++;
+		INFO("Daemon accepted job %d (%d copies)\n", jobs, ncopies);
+
+		/* Route all backend messages for this job to the client */
+		dyesub_log_flush();
+		saved_stderr = dup(STDERR_FILENO);
+		dup2(conn, STDERR_FILENO);
+
+		ret = process_input(backend, backend_ctx, conn,
+				    hdr.type[0] ? hdr.type : NULL);
+
+		dyesub_log_flush();
+		fprintf(stderr, DAEMON_RESULT "%d\n", ret);
+		dup2(saved_stderr, STDERR_FILENO);
+		close(saved_stderr);
+		close(conn);
+
+		INFO("Daemon finished job %d (%d)\n", jobs, ret);
 	}
 
-	if (!job) {
-		WARNING("No job returned by backend read_parse?\n");
-		goto newpage;
+	close(sock);
+	unlink(addr.sun_path);
+
+	return CUPS_BACKEND_OK;
+}
+
+/* Forward one line of daemon output to our stderr, or pick up the result */
+static void daemon_client_line(const char *line, int *result)
+{
+	if (!strncmp(line, DAEMON_RESULT, strlen(DAEMON_RESULT)))
+		*result = atoi(line + strlen(DAEMON_RESULT));
+	else
+		dyesub_log(0, "", "%s", line);
+}
+
+/* Returns -1 if no daemon is available, otherwise the job's result */
+static int daemon_submit_job(const char *serno, const char *fname,
+			     const char *type)
+{
+	struct sockaddr_un addr;
+	struct daemon_hdr hdr;
+	uint8_t *buf;
+	char line[1024];
+	int linelen = 0;
+	int sock, data_fd;
+	int buflen = 0, bufoff = 0;
+	int eof = 0;
+	int result = -1;
+
+	if (!serno || !fname)
+		return -1;
+
+	if (daemon_socket_path(serno, &addr))
+		return -1;
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		if (dyesub_debug)
+			DEBUG("No daemon listening on %s (%d)\n", addr.sun_path, errno);
+		close(sock);
+		return -1;
 	}
 
-	/* Create a joblist if needed */
-	if (!jlist) {
-		jlist = dyesub_joblist_create(backend, backend_ctx);
+	data_fd = fileno(stdin);
+	if (strcmp("-", fname)) {
+		data_fd = open(fname, O_RDONLY);
+		if (data_fd < 0) {
+			ERROR("Can't open input file: %s\n", strerror(errno));
+			close(sock);
+			return CUPS_BACKEND_FAILED;
+		}
 	}
-	if (!jlist) {
-		backend->cleanup_job(job);
+
+	buf = malloc(DAEMON_BUF_SIZE);
+	if (!buf) {
+		ERROR("Memory allocation failure (%d bytes)\n", DAEMON_BUF_SIZE);
+		result = CUPS_BACKEND_RETRY_CURRENT;
 		goto done;
 	}
 
-	/* Stick it onto the end of the list */
-	dyesub_joblist_appendjob(jlist, job);
-	read_page++;
-
-	INFO("Parsed page %d (%d copies)\n", read_page, ncopies);
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = DAEMON_MAGIC;
+	hdr.version = DAEMON_VERSION;
+	hdr.copies = ncopies;
+	if (type)
+		strncpy(hdr.type, type, sizeof(hdr.type) - 1);
 
-	/* If we get here, we can wait for another combined job, do so */
-	if (dyesub_joblist_canwait(jlist))
-		goto newpage;
+	signal(SIGPIPE, SIG_IGN);
 
-print_list:
-	/* Print the pagelist */
-	ret = dyesub_joblist_print(jlist, &print_page);
-	if (ret)
+	DEBUG("Handing job off to daemon on %s\n", addr.sun_path);
+	if (write_all(sock, (uint8_t *)&hdr, sizeof(hdr))) {
+		ERROR("Unable to send job to daemon (%d)\n", errno);
+		result = CUPS_BACKEND_RETRY;
 		goto done;
+	}
 
-	dyesub_joblist_cleanup(jlist);
-	jlist = NULL;
+	/* Stream the spool out while relaying the daemon's messages, so
+	   neither side can stall on a full socket buffer. */
+	while (1) {
+		struct pollfd pfd;
+		ssize_t ret;
 
-	/* Since we have no way of telling if there's more data remaining
-	   to be read (without actually trying to read it), always assume
-	   multiple print jobs. */
-	goto newpage;
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		if (!eof)
+			pfd.events |= POLLOUT;
 
-done_multiple:
-	if (jlist)
-		goto print_list;
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
 
-	close(data_fd);
+		if (pfd.revents & POLLOUT) {
+			if (bufoff == buflen) {
+				ret = read(data_fd, buf, DAEMON_BUF_SIZE);
+				if (ret < 0 && errno == EINTR)
+					continue;
+				if (ret <= 0) {
+					eof = 1;
+					shutdown(sock, SHUT_WR);
+					continue;
+				}
+				buflen = ret;
+				bufoff = 0;
+			}
+			ret = write(sock, buf + bufoff, buflen - bufoff);
+			if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+				/* Daemon stopped reading; collect its output */
+				eof = 1;
+				continue;
+			}
+			if (ret > 0)
+				bufoff += ret;
+		}
 
-	ret = CUPS_BACKEND_OK;
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+			ret = read(sock, line + linelen, sizeof(line) - 1 - linelen);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret <= 0)
+				break;
+			linelen += ret;
+			line[linelen] = 0;
+
+			/* Process all complete lines */
+			while (1) {
+				char *nl = strchr(line, '\n');
+				if (!nl && linelen < (int)sizeof(line) - 1)
+					break;
+				if (nl) {
+					char c = *(nl + 1);
+					*(nl + 1) = 0;
+					daemon_client_line(line, &result);
+					*(nl + 1) = c;
+					linelen -= (nl + 1 - line);
+					memmove(line, nl + 1, linelen + 1);
+				} else {
+					daemon_client_line(line, &result);
+					linelen = 0;
+					line[0] = 0;
+				}
+			}
+		}
+	}
+	if (linelen)
+		daemon_client_line(line, &result);
+
+	if (result < 0) {
+		ERROR("Daemon connection lost before job completed\n");
+		result = CUPS_BACKEND_RETRY;
+	}
 
 done:
-	if (jlist) dyesub_joblist_cleanup(jlist);
+	if (buf)
+		free(buf);
+	if (data_fd != fileno(stdin))
+		close(data_fd);
+	close(sock);
 
-	return ret;
+	return result;
 }
+#endif
 
 int main (int argc, char **argv)
 {
 	struct libusb_context *ctx = NULL;
-	struct libusb_device **list = NULL;
-	struct libusb_device_handle *dev = NULL;
 
 	struct dyesub_backend *backend = NULL;
+	struct dyesub_printer printer;
 	void * backend_ctx = NULL;
 
-	uint8_t endp_up, endp_down;
-	uint8_t iface, altset;
-
 	int ret = CUPS_BACKEND_OK;
 
-	int found = -1;
 	int jobid = 0;
 
 	int stats_only = 0;
@@ -1268,7 +3884,9 @@ int main (int argc, char **argv)
 	const char *fname = NULL;
 	char *use_serno = NULL;
 	const char *backend_str = NULL;
-	int  printer_type;
+
+	/* Anything still buffered goes out before we exit, however we exit */
+	atexit(dyesub_log_flush);
 
 	/* Handle environment variables  */
 	if (getenv("BACKEND_QUIET"))
@@ -1291,12 +3909,54 @@ int main (int argc, char **argv)
 		max_xfer_size = atoi(getenv("MAX_XFER_SIZE"));
 	if (getenv("XFER_TIMEOUT"))
 		xfer_timeout = atoi(getenv("XFER_TIMEOUT"));
+	if (getenv("XFER_QUEUE_DEPTH"))
+		xfer_queue_depth = atoi(getenv("XFER_QUEUE_DEPTH"));
+	if (getenv("POLL_MIN_MS"))
+		poll_min_ms = atoi(getenv("POLL_MIN_MS"));
+	if (getenv("POLL_MAX_MS"))
+		poll_max_ms = atoi(getenv("POLL_MAX_MS"));
+	if (poll_min_ms < 1)
+		poll_min_ms = 1;
+	if (poll_max_ms < poll_min_ms)
+		poll_max_ms = poll_min_ms;
+	if (getenv("PIPELINE_DEPTH"))
+		pipeline_depth = atoi(getenv("PIPELINE_DEPTH"));
+	if (getenv("JOB_LOOKAHEAD"))
+		job_lookahead = atoi(getenv("JOB_LOOKAHEAD"));
+	if (job_lookahead < 1)
+		job_lookahead = 1;
+	if (job_lookahead > DYESUB_MAX_LOOKAHEAD)
+		job_lookahead = DYESUB_MAX_LOOKAHEAD;
+	if (getenv("SPOOL_MMAP"))
+		spool_mmap = atoi(getenv("SPOOL_MMAP"));
+	if (getenv("BUF_POOL_MB") && atoi(getenv("BUF_POOL_MB")) >= 0)
+		buf_pool_limit = (size_t)atoi(getenv("BUF_POOL_MB")) * 1024 * 1024;
+	if (getenv("TIMING_LOG")) {
+		if (!strcmp(getenv("TIMING_LOG"), "-"))
+			timing_log = stderr;
+		else
+			timing_log = fopen(getenv("TIMING_LOG"), "a");
+		if (!timing_log)
+			WARNING("Unable to open timing log '%s'\n", getenv("TIMING_LOG"));
+	}
+	if (getenv("STREAM_DATA"))
+		stream_data = atoi(getenv("STREAM_DATA"));
 	if (getenv("TEST_MODE"))
 		test_mode = atoi(getenv("TEST_MODE"));
 	if (getenv("OLD_URI_SCHEME"))
 		old_uri = atoi(getenv("OLD_URI_SCHEME"));
 	if (getenv("CORRTABLE_PATH"))
 		corrtable_path = getenv("CORRTABLE_PATH");
+	if (getenv("BACKEND_DAEMON"))
+		daemon_mode = atoi(getenv("BACKEND_DAEMON"));
+	if (getenv("DAEMON_PATH"))
+		daemon_path = getenv("DAEMON_PATH");
+	if (getenv("STATE_PATH"))
+		state_path = getenv("STATE_PATH");
+	if (getenv("USB_RECORD") || getenv("USB_REPLAY")) {
+		if (usbx_open(getenv("USB_RECORD"), getenv("USB_REPLAY")))
+			exit(1);
+	}
 
 	if (test_mode >= TEST_MODE_NOATTACH && (extra_vid == -1 || extra_pid == -1)) {
 		ERROR("Must specify EXTRA_VID, EXTRA_PID in test mode > 1!\n");
@@ -1376,6 +4036,14 @@ int main (int argc, char **argv)
 		/* Always enable fast return in CUPS mode */
 		fast_return++;
 
+#ifndef _WIN32
+		/* If a daemon already owns this printer, hand the job over */
+		ret = daemon_submit_job(use_serno, fname, type);
+		if (ret >= 0)
+			return ret;
+		ret = CUPS_BACKEND_OK;
+#endif
+
 	} else {  /* Standalone mode */
 
 		/* Try to guess backend from executable name */
@@ -1417,6 +4085,7 @@ int main (int argc, char **argv)
 		ret = CUPS_BACKEND_RETRY_CURRENT;
 		goto done;
 	}
+	usb_ctx = ctx;
 
 	/* If we don't have a valid backend, print help and terminate */
 	if (!backend && !stats_only) {
@@ -1426,7 +4095,7 @@ int main (int argc, char **argv)
 	}
 
 	/* If we're in standalone mode, print help only if no args */
-	if ((!uri || !strlen(uri)) && !stats_only) {
+	if ((!uri || !strlen(uri)) && !stats_only && !daemon_mode) {
 		if (argc < 2) {
 			print_help(argv[0], backend); // probes all devices
 			ret = CUPS_BACKEND_OK;
@@ -1434,88 +4103,17 @@ int main (int argc, char **argv)
 		}
 	}
 
-	/* Enumerate devices */
-	found = find_and_enumerate(ctx, &list, backend, use_serno, backend_str, 0, NUM_CLAIM_ATTEMPTS, &iface, &altset, &endp_up, &endp_down);
-
-	if (found == -1) {
-		ERROR("Printer open failure (No matching printers found!)\n");
-		ret = CUPS_BACKEND_RETRY;
-		goto done;
-	}
-
-	if (test_mode) {
-		WARNING("**** TEST MODE %d!\n", test_mode);
-		if (test_mode >= TEST_MODE_NOATTACH)
-			goto bypass;
-	}
-
-	/* Open an appropriate device */
-	ret = libusb_open(list[found], &dev);
-	if (ret) {
-		ERROR("Printer open failure (Need to be root?) (%d)\n", ret);
-		ret = CUPS_BACKEND_RETRY_CURRENT;
-		goto done;
-	}
-
-	/* Detach the kernel driver */
-	if (libusb_kernel_driver_active(dev, iface)) {
-		ret = libusb_detach_kernel_driver(dev, iface);
-		if (ret && (ret != LIBUSB_ERROR_NOT_SUPPORTED)) {
-			ERROR("Printer open failure (Could not detach printer from kernel) (%d)\n", ret);
-			ret = CUPS_BACKEND_RETRY_CURRENT;
-			goto done_close;
-		}
-	}
-
-	/* Claim the interface so we can start using this! */
-	ret = backend_claim_interface(dev, iface, NUM_CLAIM_ATTEMPTS);
-	if (ret) {
-		ERROR("Printer open failure (Unable to claim interface) (%d)\n", ret);
-		ret = CUPS_BACKEND_RETRY;
-		goto done_close;
-	}
-
-	/* Use the appropriate altesetting! */
-	if (altset != 0) {
-		ret = libusb_set_interface_alt_setting(dev, iface, altset);
-		if (ret) {
-			ERROR("Printer open failure (Unable to issue altsettinginterface) (%d)\n", ret);
-			ret = CUPS_BACKEND_RETRY;
-			goto done_claimed;
-		}
-	}
-
-bypass:
-	/* Initialize backend */
-	DEBUG("Initializing '%s' backend (version %s)\n",
-	      backend->name, backend->version);
-	backend_ctx = backend->init();
-
-	if (test_mode < TEST_MODE_NOATTACH) {
-		struct libusb_device *device;
-		struct libusb_device_descriptor desc;
-
-		device = libusb_get_device(dev);
-		libusb_get_device_descriptor(device, &desc);
-
-		printer_type = lookup_printer_type(backend,
-						   desc.idVendor, desc.idProduct);
+	/* Attach to the printer, or all of them for a group */
+	if (use_serno && strchr(use_serno, ',')) {
+		ret = group_open(ctx, backend, use_serno, backend_str, jobid);
+		if (ret)
+			goto done;
+		backend_ctx = printer_group->units[0].printer.ctx;
 	} else {
-		printer_type = lookup_printer_type(backend,
-						   extra_vid, extra_pid);
-	}
-
-	if (printer_type <= P_UNKNOWN) {
-		ERROR("Unable to lookup printer type\n");
-		ret = CUPS_BACKEND_FAILED;
-		goto done_claimed;
-	}
-
-	/* Attach backend to device */ // XXX pass backend_str?
-	if (backend->attach(backend_ctx, dev, printer_type, endp_up, endp_down, iface, jobid)) {
-		ERROR("Unable to attach to printer!\n");
-		ret = CUPS_BACKEND_FAILED;
-		goto done_claimed;
+		ret = printer_open(ctx, backend, use_serno, backend_str, jobid, &printer);
+		if (ret)
+			goto done;
+		backend_ctx = printer.ctx;
 	}
 
 //	STATE("+org.gutenprint.attached-to-device\n");
@@ -1545,31 +4143,31 @@ bypass:
 		fname = argv[optind]; // XXX do this a smarter way?
 	}
 
+#ifndef _WIN32
+	/* Keep the printer attached and serve jobs until terminated */
+	if (daemon_mode && (!uri || !strlen(uri))) {
+		ret = daemon_serve(backend, backend_ctx, use_serno);
+		goto done_claimed;
+	}
+#endif
+
 	/* Parse the file passed in */
 	ret = handle_input(backend, backend_ctx, fname, uri, type);
 
 done_claimed:
-	if (test_mode < TEST_MODE_NOATTACH)
-		libusb_release_interface(dev, iface);
+	if (printer_group)
+		group_close();
+	else
+		printer_close(backend, &printer);
 
-done_close:
-	if (test_mode < TEST_MODE_NOATTACH)
-		libusb_close(dev);
 done:
-
-	if (backend && backend_ctx) {
-		if (backend->teardown)
-			backend->teardown(backend_ctx);
-		else
-			generic_teardown(backend_ctx);
-//		STATE("-org.gutenprint.attached-to-device");
-	}
-
-	if (list)
-		libusb_free_device_list(list, 1);
-
 	libusb_exit(ctx);
 
+	if (timing_log && timing_log != stderr)
+		fclose(timing_log);
+	usbx_close();
+	buf_pool_drain();
+
 	return ret;
 }
 
@@ -1671,6 +4269,8 @@ minimal:
 			PPD("StpMediaID%d=%d\n", i, markers[i].numtype);
 		}
 	}
+
+	dyesub_log_flush();
 }
 
 int dyesub_read_file(const char *filename, void *databuf, int datalen,
@@ -1750,6 +4350,7 @@ struct dyesub_joblist *dyesub_joblist_create(const struct dyesub_backend *backen
 	list->backend = backend;
 	list->ctx = ctx;
 	list->num_entries = 0;
+	list->num_pending = 0;
 
 	if (collate)
 		list->copies = ncopies;
@@ -1762,6 +4363,8 @@ struct dyesub_joblist *dyesub_joblist_create(const struct dyesub_backend *backen
 void dyesub_joblist_cleanup(const struct dyesub_joblist *list)
 {
 	int i;
+	for (i = 0; i < list->num_pending ; i++)
+		list->backend->cleanup_job(list->pending[i]);
 	for (i = 0; i < list->num_entries ; i++) {
 		if (list->entries[i])
 			list->backend->cleanup_job(list->entries[i]);
@@ -1779,122 +4382,121 @@ static int __dyesub_joblist_addjob(struct dyesub_joblist *list, const void *job)
 	return CUPS_BACKEND_OK;
 }
 
-static int __dyesub_append_job(struct dyesub_joblist *list, const void **vjob, int polarity)
+/* Turn the held-back pages into a print list, pairing up whatever
+   the backend can combine.  A page is only ever paired with the one
+   right after it, so pages still come out in the order they arrived.
+   Compatibility is decided by combine_jobs(), which only ever matches
+   pages with identical parameters. */
+static void __dyesub_joblist_plan(struct dyesub_joblist *list)
 {
-	struct dyesub_job_common *job, *combined;
-	const struct dyesub_job_common *oldjob;
+	struct dyesub_job_common *multi[DYESUB_MAX_LOOKAHEAD];
+	struct dyesub_job_common *pair[DYESUB_MAX_LOOKAHEAD];
+	struct dyesub_job_common **pending = list->pending;
+	int num = list->num_pending;
+	int polarity = 0;
+	int lead = -1;
+	int pages = 0;
+	int start = list->num_entries;
+	int i, j;
 
-	/* Create writable copy of the new job */
-	job = malloc(((const struct dyesub_job_common *)*vjob)->jobsize);
-	if (!job) {
-		ERROR("Memory allocation failure!\n");
-		return CUPS_BACKEND_RETRY_CURRENT;
-	}
-	memcpy(job, *vjob, ((const struct dyesub_job_common *)*vjob)->jobsize);
+	if (!num)
+		return;
 
-	/* If we can't combine the new job, don't bother doing anything else */
-	if (!job->can_combine) {
-		free(job);
-		return CUPS_BACKEND_OK;
+	for (i = 0 ; i < num ; i++) {
+		pages += pending[i]->copies;
+		multi[i] = NULL;
+		pair[i] = NULL;
 	}
 
-	/* Get the old job */
-	oldjob = dyesub_joblist_popjob(list);
-
-	/* If we can't combine with it, carry on as before */
-	if (oldjob && (oldjob->copies > 1 || !oldjob->can_combine)) {
-		__dyesub_joblist_addjob(list, oldjob);
-		oldjob = NULL;
+	/* Combine multiple copies of the same page */
+	for (i = 0 ; i < num ; i++) {
+		if (pending[i]->copies < 2)
+			continue;
+		multi[i] = list->backend->combine_jobs(pending[i], pending[i]);
+		if (!multi[i])
+			continue;
+		INFO("Successfully combined multiple copies\n");
+		timing_combined_job(multi[i], pending[i], pending[i]);
+		multi[i]->copies = pending[i]->copies / 2;
+		pending[i]->copies %= 2;
 	}
 
-	if (oldjob) {
-		/* Try to combine first copy with old job */
-		combined = list->backend->combine_jobs(oldjob, job);
-		if (combined) {
-			INFO("Successfully combined two jobs\n");
-			/* Success, add it to the list */
-	                __dyesub_joblist_addjob(list, combined);
-			combined = NULL;
-
-			/* Clean up the old job */
-			list->backend->cleanup_job(oldjob);
-
-			/* Anything left in the new job? */
-			job->copies--;
-			if (job->copies == 0) {
-				/* Nope, we're done */
-				list->backend->cleanup_job(job);
-			} else if (job->copies == 1) {
-				/* Just one, shove it on the list */
-				__dyesub_joblist_addjob(list, job);
-			}
-
-			goto done;
-		} else {
-			/* Failed to combine, restore old job and continue */
-			__dyesub_joblist_addjob(list, oldjob);
+	/* If the printer has a rewound half-panel waiting, a leftover
+	   single copy of the first page goes out on its own to use it up.
+	   We can't know which printer of a group will get it, so don't
+	   bother there. */
+	if (list->backend->job_polarity && !printer_group)
+		polarity = list->backend->job_polarity(list->ctx);
+	if (polarity && pending[0]->copies == 1)
+		lead = 0;
+
+	/* Pair each leftover single copy with the nearest compatible one
+	   after it.  The pair prints in place of the first page, so the
+	   second is moved up by less than the size of the window. */
+	for (i = 0 ; i < num ; i++) {
+		if (i == lead || pending[i]->copies != 1)
+			continue;
+		for (j = i + 1 ; j < num && !pair[i] ; j++) {
+			if (j == lead || pending[j]->copies != 1)
+				continue;
+			pair[i] = list->backend->combine_jobs(pending[i], pending[j]);
 		}
-
-		polarity = 0;
-	}
-
-	/* If we have no work to do, just return */
-	if (job->copies == 1) {
-		free(job);
-		return CUPS_BACKEND_OK;
-	}
-
-	/* Attempt to combine multiple copies! */
-	combined = list->backend->combine_jobs(job, job);
-
-	if (!combined) {
-		/* Failed, so return */
-		free(job);
-		return CUPS_BACKEND_OK;
-	}
-
-	INFO("Successfully combined multiple copies\n");
-	combined->copies = job->copies / 2;
-	job->copies = job->copies % 2;
-
-	/* Add the combined job at start if we can */
-	if (!polarity) {
-		__dyesub_joblist_addjob(list, combined);
-	}
-
-	/* Add the remainder, if any */
-	if (job->copies) {
-		__dyesub_joblist_addjob(list, job);
-	} else {
-		list->backend->cleanup_job(job);
+		if (!pair[i])
+			continue;
+		j--;
+		INFO("Successfully combined two jobs\n");
+		timing_combined_job(pair[i], pending[i], pending[j]);
+		pair[i]->copies = 1;
+		pending[i]->copies = 0;
+		pending[j]->copies = 0;
 	}
 
-	/* Add combined job at end of we need to */
-	if (polarity) {
-		__dyesub_joblist_addjob(list, combined);
+	for (i = 0 ; i < num ; i++) {
+		if (i == lead)
+			__dyesub_joblist_addjob(list, pending[i]);
+		if (multi[i])
+			__dyesub_joblist_addjob(list, multi[i]);
+		if (pair[i])
+			__dyesub_joblist_addjob(list, pair[i]);
+		if (i == lead)
+			continue;
+		if (pending[i]->copies)
+			__dyesub_joblist_addjob(list, pending[i]);
+		else
+			list->backend->cleanup_job(pending[i]);
 	}
 
-done:
-	/* Clean up */
-	free((void*)*vjob);
-	*vjob = NULL;
+	DEBUG("Planned %d page(s) from %d job(s) into %d print(s)\n",
+	      pages, num, list->num_entries - start);
 
-	return CUPS_BACKEND_OK;
+	list->num_pending = 0;
 }
 
-int dyesub_joblist_appendjob(struct dyesub_joblist *list, const void *job)
+int dyesub_joblist_appendjob(struct dyesub_joblist *list, const void *vjob)
 {
-	if (list->backend->combine_jobs) {
-		int polarity = 0;
-		if (list->backend->job_polarity)
-			polarity = list->backend->job_polarity(list->ctx);
-		__dyesub_append_job(list, &job, polarity);
+	const struct dyesub_job_common *job = vjob;
+
+	/* Hold back anything we might be able to combine */
+	if (list->backend->combine_jobs && job->can_combine &&
+	    list->num_pending < DYESUB_MAX_LOOKAHEAD) {
+		struct dyesub_job_common *copy;
+
+		/* Create writable copy of the new job */
+		copy = malloc(job->jobsize);
+		if (copy) {
+			memcpy(copy, job, job->jobsize);
+			timing_combined_job(copy, job, job);
+			free((void*)job);
+			list->pending[list->num_pending++] = copy;
+			return CUPS_BACKEND_OK;
+		}
+		ERROR("Memory allocation failure!\n");
 	}
 
-	if (job)
-		__dyesub_joblist_addjob(list, job);
+	/* Otherwise it prints after everything held back so far */
+	__dyesub_joblist_plan(list);
 
-	return CUPS_BACKEND_OK;
+	return __dyesub_joblist_addjob(list, job);
 }
 
 const void *dyesub_joblist_popjob(struct dyesub_joblist *list)
@@ -1908,20 +4510,28 @@ const void *dyesub_joblist_popjob(struct dyesub_joblist *list)
 
 int dyesub_joblist_canwait(struct dyesub_joblist *list)
 {
-	if (list->num_entries == DYESUB_MAX_JOB_ENTRIES)
+	/* Something that can't be combined is already queued */
+	if (list->num_entries)
 		return 0;
-	if (!list->num_entries)
+	if (!list->num_pending)
 		return 1;
+	if (list->num_pending >= job_lookahead)
+		return 0;
+	/* The next page is stuck behind a streamed payload */
+	if (spool_stream.fd != -1)
+		return 0;
 
-	return ((const struct dyesub_job_common *)(list->entries[list->num_entries - 1]))->can_combine;
+	return 1;
 }
 
-int dyesub_joblist_print(const struct dyesub_joblist *list, int *pagenum)
+int dyesub_joblist_print(struct dyesub_joblist *list, int *pagenum)
 {
 	int i, j;
 	int ret;
 //	int pages = 0;
 
+	__dyesub_joblist_plan(list);
+
 	for (i = 0 ; i < list->copies ; i++) {
 		for (j = 0 ; j < list->num_entries ; j++) {
 			if (list->entries[j]) {
@@ -1932,11 +4542,17 @@ int dyesub_joblist_print(const struct dyesub_joblist *list, int *pagenum)
 					WARNING("**** TEST MODE, bypassing printing!\n");
 
 				/* Print this page */
+				timing_begin();
 				if (test_mode < TEST_MODE_NOPRINT ||
 				    list->backend->flags & BACKEND_FLAG_DUMMYPRINT) {
 					ret = list->backend->main_loop(list->ctx, list->entries[j]);
+					timing_printed_job(list->backend, list->entries[j],
+							   *pagenum, NULL, ret);
 					if (ret)
 						return ret;
+				} else {
+					timing_printed_job(list->backend, list->entries[j],
+							   *pagenum, NULL, CUPS_BACKEND_OK);
 				}
 
 //				pages += copies;
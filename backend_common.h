@@ -24,6 +24,7 @@
  *
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,15 +51,20 @@
 #endif
 
 #define STR_LEN_MAX 64
-#define STATE( ... ) do { if (!quiet) fprintf(stderr, "STATE: " __VA_ARGS__ ); } while(0)
-#define ATTR( ... ) do { if (!quiet) fprintf(stderr, "ATTR: " __VA_ARGS__ ); } while(0)
-#define PAGE( ... ) do { if (!quiet) fprintf(stderr, "PAGE: " __VA_ARGS__ ); } while(0)
-#define DEBUG( ... ) do { if (!quiet) fprintf(stderr, "DEBUG: " __VA_ARGS__ ); } while(0)
-#define DEBUG2( ... ) do { if (!quiet) fprintf(stderr, __VA_ARGS__ ); } while(0)
-#define INFO( ... )  do { if (!quiet) fprintf(stderr, "INFO: " __VA_ARGS__ ); } while(0)
-#define WARNING( ... )  do { fprintf(stderr, "WARNING: " __VA_ARGS__ ); } while(0)
-#define ERROR( ... ) do { fprintf(stderr, "ERROR: " __VA_ARGS__ ); sleep(1); } while (0)
-#define PPD( ... ) do { fprintf(stderr, "PPD: " __VA_ARGS__ ); sleep(1); } while (0)
+/* Buffered logging; see dyesub_log_flush() */
+void dyesub_log(int flush, const char *prefix, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+void dyesub_log_flush(void);
+
+#define STATE( ... ) do { if (!quiet) dyesub_log(0, "STATE: ", __VA_ARGS__ ); } while(0)
+#define ATTR( ... ) do { if (!quiet) dyesub_log(0, "ATTR: ", __VA_ARGS__ ); } while(0)
+#define PAGE( ... ) do { if (!quiet) dyesub_log(0, "PAGE: ", __VA_ARGS__ ); } while(0)
+#define DEBUG( ... ) do { if (!quiet) dyesub_log(0, "DEBUG: ", __VA_ARGS__ ); } while(0)
+#define DEBUG2( ... ) do { if (!quiet) dyesub_log(0, "", __VA_ARGS__ ); } while(0)
+#define INFO( ... )  do { if (!quiet) dyesub_log(0, "INFO: ", __VA_ARGS__ ); } while(0)
+#define WARNING( ... )  do { dyesub_log(0, "WARNING: ", __VA_ARGS__ ); } while(0)
+#define ERROR( ... ) do { dyesub_log(1, "ERROR: ", __VA_ARGS__ ); } while (0)
+#define PPD( ... ) do { dyesub_log(0, "PPD: ", __VA_ARGS__ ); } while (0)
 
 #if (__BYTE_ORDER == __LITTLE_ENDIAN)
 #define le16_to_cpu(__x) __x
@@ -93,6 +99,12 @@ int parse1284_data(const char *device_id, struct deviceid_dict* dict);
 char *dict_find(const char *key, int dlen, struct deviceid_dict* dict);
 char *get_device_id(struct libusb_device_handle *dev, int iface);
 
+/* Use these instead of libusb directly, so USB transcripts see them */
+int dyesub_get_device_descriptor(struct libusb_device_handle *dev,
+				 struct libusb_device_descriptor *desc);
+int dyesub_get_string_descriptor(struct libusb_device_handle *dev,
+				 uint8_t index, unsigned char *buf, int len);
+
 /* To enumerate supported devices */
 enum {
 	P_UNKNOWN = 0,
@@ -193,22 +205,27 @@ struct printerstats {
 	int32_t cnt_life[DECKS_MAX];  /* Lifetime prints */
 };
 
-#define DYESUB_MAX_JOB_ENTRIES 3
+#define DYESUB_MAX_LOOKAHEAD 32
+/* Planning can split a page into a combined job plus a leftover copy,
+   and a non-combinable page may be queued behind the planned ones */
+#define DYESUB_MAX_JOB_ENTRIES (DYESUB_MAX_LOOKAHEAD * 2 + 1)
+
+/* This should be the start of every per-printer job struct! */
+struct dyesub_job_common {
+	size_t jobsize;
+	int copies;
+	int can_combine;
+};
 
 struct dyesub_joblist {
 	// TODO: mutex/lock
 	const struct dyesub_backend *backend;
 	void *ctx;
 	int num_entries;
+	int num_pending;
 	int copies;
 	const void *entries[DYESUB_MAX_JOB_ENTRIES];
-};
-
-/* This should be the start of every per-printer job struct! */
-struct dyesub_job_common {
-	size_t jobsize;
-	int copies;
-	int can_combine;
+	struct dyesub_job_common *pending[DYESUB_MAX_LOOKAHEAD]; /* Not yet planned */
 };
 
 /* Exported functions */
@@ -217,6 +234,36 @@ int send_data(struct libusb_device_handle *dev, uint8_t endp,
 int read_data(struct libusb_device_handle *dev, uint8_t endp,
 	      uint8_t *buf, int buflen, int *readlen);
 
+/* Adaptive status polling, to replace fixed sleep(1) loops.  Call
+   dyesub_poll_reset() whenever the printer state changes, and
+   dyesub_poll_sleep() between status queries when it doesn't. */
+struct dyesub_poll {
+	int interval;  /* Next sleep, in ms */
+	int eta;       /* Printer-reported time remaining in ms, 0 if unknown */
+};
+void dyesub_poll_reset(struct dyesub_poll *poll);
+void dyesub_poll_eta(struct dyesub_poll *poll, int eta_ms);
+void dyesub_poll_sleep(struct dyesub_poll *poll);
+
+/* Status predicate for dyesub_poll_until(); returns DYESUB_POLL_AGAIN to
+   keep waiting, otherwise a CUPS_BACKEND_* code that ends the wait. */
+#define DYESUB_POLL_AGAIN -1
+typedef int (*dyesub_poll_fn)(void *ctx, void *arg, struct dyesub_poll *poll);
+int dyesub_poll_until(dyesub_poll_fn fn, void *ctx, void *arg);
+
+/* Per-page timing instrumentation, enabled by TIMING_LOG.  Bracket
+   expensive host-side work with these; USB transfers, status polling,
+   read_parse() and main_loop() are timed by the common code. */
+enum {
+	TIMING_LUT = 0,  /* Color lookup tables */
+	TIMING_EFFECT,   /* Image processing/effects */
+	TIMING_USB,      /* Sending data to the printer */
+	TIMING_WAIT,     /* Waiting on the printer */
+	TIMING_MAX,
+};
+uint64_t dyesub_timing_start(void);  /* Returns 0 if disabled */
+void dyesub_timing_stop(int phase, uint64_t start);
+
 void dump_markers(const struct marker *markers, int marker_count, int full);
 
 void print_license_blurb(void);
@@ -225,6 +272,28 @@ void print_help(const char *argv0, const struct dyesub_backend *backend);
 int dyesub_read_file(const char *filename, void *databuf, int datalen,
 		     int *actual_len);
 
+/* Borrow 'len' bytes of the spool in place, starting 'lookback' bytes
+   before the current position, and advance past them.  Returns NULL if
+   the spool isn't mapped; fall back to read() in that case. */
+uint8_t *dyesub_spool_borrow(int data_fd, int lookback, int len);
+
+/* Pooled, pre-faulted page buffers.  dyesub_buf_free() releases these
+   as well as borrowed spool buffers and anything malloc()ed. */
+void *dyesub_buf_alloc(size_t len);
+void dyesub_buf_free(void *buf);
+
+/* Leave 'len' bytes of payload in the spool for main_loop() to forward
+   with dyesub_stream_send().  Returns 0 if the caller must buffer it
+   instead.  Only use this when main_loop() will send the payload
+   exactly once, ie no copies generated on the host and no retries.
+   dyesub_stream_close() skips anything left unconsumed and must be
+   called when the job is cleaned up. */
+int dyesub_stream_open(int data_fd, uint32_t len);
+int dyesub_stream_send(struct libusb_device_handle *dev, uint8_t endp,
+		       const uint8_t *prefix, int prefixlen, uint32_t len);
+int dyesub_stream_read(uint8_t *buf, uint32_t len);
+void dyesub_stream_close(void);
+
 uint16_t uint16_to_packed_bcd(uint16_t val);
 uint32_t packed_bcd_to_uint32(const char *in, int len);
 
@@ -239,12 +308,13 @@ int backend_claim_interface(struct libusb_device_handle *dev, int iface,
 struct dyesub_joblist *dyesub_joblist_create(const struct dyesub_backend *backend, void *ctx);
 int dyesub_joblist_appendjob(struct dyesub_joblist *list, const void *job);
 void dyesub_joblist_cleanup(const struct dyesub_joblist *list);
-int dyesub_joblist_print(const struct dyesub_joblist *list, int *pagenum);
+int dyesub_joblist_print(struct dyesub_joblist *list, int *pagenum);
 const void *dyesub_joblist_popjob(struct dyesub_joblist *list);
 int dyesub_joblist_canwait(struct dyesub_joblist *list);
 
 #define BACKEND_FLAG_BADISERIAL 0x00000001
 #define BACKEND_FLAG_DUMMYPRINT 0x00000002
+#define BACKEND_FLAG_NOPIPELINE 0x00000004 /* read_parse can't overlap main_loop */
 
 /* Backend Functions */
 struct dyesub_backend {
@@ -266,6 +336,8 @@ struct dyesub_backend {
 	int  (*query_serno)(struct libusb_device_handle *dev, uint8_t endp_up, uint8_t endp_down, int iface, char *buf, int buf_len); /* Optional */
 	int  (*query_markers)(void *ctx, struct marker **markers, int *count);
 	int  (*query_stats)(void *ctx, struct printerstats *stats); /* Optional */
+	int  (*query_ready)(void *ctx); /* Optional; 0 if busy, else free job slots, <0 if offline */
+	int  (*check_job)(void *ctx, const void *job); /* Optional; redo printer-specific checks on a job parsed against another printer, nonzero if it can't be printed */
 	const struct device_id devices[];
 };
 
@@ -281,6 +353,7 @@ extern int collate;
 extern int test_mode;
 extern int quiet;
 extern const char *corrtable_path;
+extern const char *state_path;  /* Empty to disable on-disk caches */
 
 enum {
 	TEST_MODE_NONE = 0,
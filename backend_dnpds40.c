@@ -315,7 +315,7 @@ static void *dnp_combine_jobs(const void *vjob1,
 	}
 	memcpy(newjob, job1, sizeof(*newjob));
 
-	newjob->databuf = malloc(((new_w*new_h+1024+54+10))*3+1024 + abs(gap_bytes));
+	newjob->databuf = dyesub_buf_alloc(((new_w*new_h+1024+54+10))*3+1024 + abs(gap_bytes));
 	newjob->datalen = 0;
 	newjob->multicut = new_multicut;
 	newjob->can_rewind = 0;
@@ -1063,15 +1063,13 @@ static int dnpds40_attach(void *vctx, struct libusb_device_handle *dev, int type
 		/* Figure out actual Manufacturer */
 		{
 			struct libusb_device_descriptor desc;
-			struct libusb_device *udev;
 
-			udev = libusb_get_device(ctx->dev);
-			libusb_get_device_descriptor(udev, &desc);
+			dyesub_get_device_descriptor(ctx->dev, &desc);
 
 			char buf[STR_LEN_MAX + 1];
 			buf[0] = 0;
 			buf[STR_LEN_MAX] = 0;
-			libusb_get_string_descriptor_ascii(ctx->dev, desc.iManufacturer, (unsigned char*)buf, STR_LEN_MAX);
+			dyesub_get_string_descriptor(ctx->dev, desc.iManufacturer, (unsigned char*)buf, STR_LEN_MAX);
 
 			if (!strncmp(buf, "Dai", 3)) /* "Dai Nippon Printing" */
 				ctx->mfg = 0;
@@ -1358,7 +1356,7 @@ static void dnpds40_cleanup_job(const void *vjob) {
 	const struct dnpds40_printjob *job = vjob;
 
 	if (job->databuf)
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
 
 	free((void*)job);
 }
@@ -1391,9 +1389,200 @@ static void dnpds40_teardown(void *vctx) {
 
 #define MAX_PRINTJOB_LEN (((ctx->native_width*ctx->max_height+1024+54+10))*3+1024) /* Worst-case, YMC */
 
+/* Check the job against the loaded media and what the printer supports,
+   and work out if it can be rewound.  Returns nonzero if it can't be
+   printed. */
+static int dnpds40_check_media(const struct dnpds40_ctx *ctx,
+			       struct dnpds40_printjob *job)
+{
+	job->can_rewind = 0;
+
+	if (job->multicut == 0)
+		return CUPS_BACKEND_OK;
+
+	if (job->multicut < 100) {
+		switch(ctx->media) {
+		case 150: // 4x6, QW410
+			if (job->multicut != MULTICUT_4x4 &&
+			    job->multicut != MULTICUT_4x6) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 151: // 4x8, QW410
+			if (job->multicut != MULTICUT_4x4 &&
+			    job->multicut != MULTICUT_4x6 &&
+			    job->multicut != MULTICUT_4x8) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 160: // 4.5x6, QW410
+			if (job->multicut != MULTICUT_4_5x4_5 &&
+			    job->multicut != MULTICUT_4_5x6) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 161: // 4.5x8, QW410
+			if (job->multicut != MULTICUT_4_5x4_5 &&
+			    job->multicut != MULTICUT_4_5x6 &&
+			    job->multicut != MULTICUT_4_5x8) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 200: //"5x3.5 (L)"
+			if (job->multicut != MULTICUT_5x3_5) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 210: //"5x7 (2L)"
+			if (job->multicut != MULTICUT_5x3_5 && job->multicut != MULTICUT_5x7 &&
+			    job->multicut != MULTICUT_5x3_5X2 && job->multicut != MULTICUT_5x5) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			/* Only 3.5x5 on 7x5 media can be rewound */
+			if (job->multicut == MULTICUT_5x3_5)
+				job->can_rewind = 1;
+			break;
+		case 300: //"6x4 (PC)"
+			if (job->multicut != MULTICUT_6x4) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 310: //"6x8 (A5)"
+			if (job->multicut != MULTICUT_6x4 && job->multicut != MULTICUT_6x8 &&
+			    job->multicut != MULTICUT_6x4X2 &&
+			    job->multicut != MULTICUT_6x6 && job->multicut != 30) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			/* Only 6x4 on 6x8 media can be rewound */
+			if (job->multicut == MULTICUT_6x4)
+				job->can_rewind = 1;
+			break;
+		case 400: //"6x9 (A5W)"
+			if (job->multicut != MULTICUT_6x4 && job->multicut != MULTICUT_6x8 &&
+			    job->multicut != MULTICUT_6x9 && job->multicut != MULTICUT_6x4X2 &&
+			    job->multicut != MULTICUT_6x6 &&
+			    job->multicut != MULTICUT_6x4_5 && job->multicut != MULTICUT_6x4_5X2) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			/* Only 6x4 or 6x4.5 on 6x9 media can be rewound */
+			if (job->multicut == MULTICUT_6x4 || job->multicut == MULTICUT_6x4_5)
+				job->can_rewind = 1;
+			break;
+		case 500: //"8x10"
+			if (ctx->type == P_DNP_DS820 &&
+			    (job->multicut == MULTICUT_8x7 || job->multicut == MULTICUT_8x9)) {
+				/* These are okay */
+			} else if (job->multicut < MULTICUT_8x10 || job->multicut == MULTICUT_8x12 ||
+			    job->multicut == MULTICUT_8x6X2 || job->multicut >= MULTICUT_8x6_8x5 ) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+
+			/* 8x4, 8x5 can be rewound */
+			if (job->multicut == MULTICUT_8x4 ||
+			    job->multicut == MULTICUT_8x5)
+				job->can_rewind = 1;
+			break;
+		case 510: //"8x12"
+			if (job->multicut < MULTICUT_8x10 || (job->multicut > MULTICUT_8xA4LEN && !(job->multicut == MULTICUT_8x7 || job->multicut == MULTICUT_8x9))) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+
+			/* 8x4, 8x5, 8x6 can be rewound */
+			if (job->multicut == MULTICUT_8x4 ||
+			    job->multicut == MULTICUT_8x5 ||
+			    job->multicut == MULTICUT_8x6)
+				job->can_rewind = 1;
+			break;
+		case 600: //"A4"
+			if (job->multicut < MULTICUT_A5 || job->multicut > MULTICUT_A4x5X2) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			/* A4xn and A5 can be rewound */
+			if (job->multicut == MULTICUT_A4x4 ||
+			    job->multicut == MULTICUT_A4x5 ||
+			    job->multicut == MULTICUT_A4x6 ||
+			    job->multicut == MULTICUT_A5)
+				job->can_rewind = 1;
+			break;
+		default:
+			ERROR("Unknown media (%u vs %u)!\n", ctx->media, job->multicut);
+			return CUPS_BACKEND_CANCEL;
+		}
+	} else if (job->multicut < 400) {
+		int mcut = job->multicut;
+
+		switch(ctx->duplex_media) {
+		case 100: //"8x10.75"
+			if (mcut > MULTICUT_S_BACK)
+				mcut -= MULTICUT_S_BACK;
+			else if (mcut > MULTICUT_S_FRONT)
+				mcut -= MULTICUT_S_FRONT;
+
+			if (mcut == MULTICUT_S_8x12 ||
+			    mcut == MULTICUT_S_8x6X2 ||
+			    mcut == MULTICUT_S_8x4X3) {
+				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->duplex_media, job->multicut);
+				return CUPS_BACKEND_CANCEL;
+			}
+			break;
+		case 200: //"8x12"
+			/* Everything is legal */
+			break;
+		default:
+			ERROR("Unknown duplexer media (%u vs %u)!\n", ctx->duplex_media, job->multicut);
+			return CUPS_BACKEND_CANCEL;
+		}
+	} else {
+		ERROR("Multicut value out of range! (%u)\n", job->multicut);
+		return CUPS_BACKEND_CANCEL;
+	}
+
+	/* Additional santity checks, make sure printer support exists */
+	if (!ctx->supports_6x6 && job->multicut == MULTICUT_6x6) {
+		ERROR("Printer does not support 6x6 prints, aborting!\n");
+		return CUPS_BACKEND_CANCEL;
+	}
+
+	if (!ctx->supports_5x5 && job->multicut == MULTICUT_5x5) {
+		ERROR("Printer does not support 5x5 prints, aborting!\n");
+		return CUPS_BACKEND_CANCEL;
+	}
+
+	if ((job->multicut == MULTICUT_6x4_5 || job->multicut == MULTICUT_6x4_5X2) &&
+	    !ctx->supports_6x4_5) {
+		ERROR("Printer does not support 6x4.5 prints, aborting!\n");
+		return CUPS_BACKEND_CANCEL;
+	}
+
+	if (job->multicut == MULTICUT_6x9 && !ctx->supports_6x9) {
+		ERROR("Printer does not support 6x9 prints, aborting!\n");
+		return CUPS_BACKEND_CANCEL;
+	}
+
+	if (job->multicut == MULTICUT_5x3_5X2 && !ctx->supports_3x5x2) {
+		ERROR("Printer does not support 3.5x5*2 prints, aborting!\n");
+		return CUPS_BACKEND_CANCEL;
+	}
+
+	return CUPS_BACKEND_OK;
+}
+
 static int dnpds40_read_parse(void *vctx, const void **vjob, int data_fd, int copies) {
 	struct dnpds40_ctx *ctx = vctx;
 	int run = 1;
+	int ret;
 	char buf[9] = { 0 };
 
 	struct dnpds40_printjob *job = NULL;
@@ -1419,7 +1608,7 @@ static int dnpds40_read_parse(void *vctx, const void **vjob, int data_fd, int co
 	   the end of the job.
 	*/
 
-	job->databuf = malloc(MAX_PRINTJOB_LEN);
+	job->databuf = dyesub_buf_alloc(MAX_PRINTJOB_LEN);
 	if (!job->databuf) {
 		dnpds40_cleanup_job(job);
 		ERROR("Memory allocation failure!\n");
@@ -1769,207 +1958,12 @@ parsed:
 	}
 
 	/* Sanity-check type vs loaded media */
-	if (job->multicut == 0)
-		goto skip_multicut;
-
-	if (job->multicut < 100) {
-		switch(ctx->media) {
-		case 150: // 4x6, QW410
-			if (job->multicut != MULTICUT_4x4 &&
-			    job->multicut != MULTICUT_4x6) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 151: // 4x8, QW410
-			if (job->multicut != MULTICUT_4x4 &&
-			    job->multicut != MULTICUT_4x6 &&
-			    job->multicut != MULTICUT_4x8) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 160: // 4.5x6, QW410
-			if (job->multicut != MULTICUT_4_5x4_5 &&
-			    job->multicut != MULTICUT_4_5x6) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 161: // 4.5x8, QW410
-			if (job->multicut != MULTICUT_4_5x4_5 &&
-			    job->multicut != MULTICUT_4_5x6 &&
-			    job->multicut != MULTICUT_4_5x8) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 200: //"5x3.5 (L)"
-			if (job->multicut != MULTICUT_5x3_5) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 210: //"5x7 (2L)"
-			if (job->multicut != MULTICUT_5x3_5 && job->multicut != MULTICUT_5x7 &&
-			    job->multicut != MULTICUT_5x3_5X2 && job->multicut != MULTICUT_5x5) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			/* Only 3.5x5 on 7x5 media can be rewound */
-			if (job->multicut == MULTICUT_5x3_5)
-				job->can_rewind = 1;
-			break;
-		case 300: //"6x4 (PC)"
-			if (job->multicut != MULTICUT_6x4) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 310: //"6x8 (A5)"
-			if (job->multicut != MULTICUT_6x4 && job->multicut != MULTICUT_6x8 &&
-			    job->multicut != MULTICUT_6x4X2 &&
-			    job->multicut != MULTICUT_6x6 && job->multicut != 30) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			/* Only 6x4 on 6x8 media can be rewound */
-			if (job->multicut == MULTICUT_6x4)
-				job->can_rewind = 1;
-			break;
-		case 400: //"6x9 (A5W)"
-			if (job->multicut != MULTICUT_6x4 && job->multicut != MULTICUT_6x8 &&
-			    job->multicut != MULTICUT_6x9 && job->multicut != MULTICUT_6x4X2 &&
-			    job->multicut != MULTICUT_6x6 &&
-			    job->multicut != MULTICUT_6x4_5 && job->multicut != MULTICUT_6x4_5X2) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			/* Only 6x4 or 6x4.5 on 6x9 media can be rewound */
-			if (job->multicut == MULTICUT_6x4 || job->multicut == MULTICUT_6x4_5)
-				job->can_rewind = 1;
-			break;
-		case 500: //"8x10"
-			if (ctx->type == P_DNP_DS820 &&
-			    (job->multicut == MULTICUT_8x7 || job->multicut == MULTICUT_8x9)) {
-				/* These are okay */
-			} else if (job->multicut < MULTICUT_8x10 || job->multicut == MULTICUT_8x12 ||
-			    job->multicut == MULTICUT_8x6X2 || job->multicut >= MULTICUT_8x6_8x5 ) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-
-			/* 8x4, 8x5 can be rewound */
-			if (job->multicut == MULTICUT_8x4 ||
-			    job->multicut == MULTICUT_8x5)
-				job->can_rewind = 1;
-			break;
-		case 510: //"8x12"
-			if (job->multicut < MULTICUT_8x10 || (job->multicut > MULTICUT_8xA4LEN && !(job->multicut == MULTICUT_8x7 || job->multicut == MULTICUT_8x9))) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-
-			/* 8x4, 8x5, 8x6 can be rewound */
-			if (job->multicut == MULTICUT_8x4 ||
-			    job->multicut == MULTICUT_8x5 ||
-			    job->multicut == MULTICUT_8x6)
-				job->can_rewind = 1;
-			break;
-		case 600: //"A4"
-			if (job->multicut < MULTICUT_A5 || job->multicut > MULTICUT_A4x5X2) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			/* A4xn and A5 can be rewound */
-			if (job->multicut == MULTICUT_A4x4 ||
-			    job->multicut == MULTICUT_A4x5 ||
-			    job->multicut == MULTICUT_A4x6 ||
-			    job->multicut == MULTICUT_A5)
-				job->can_rewind = 1;
-			break;
-		default:
-			ERROR("Unknown media (%u vs %u)!\n", ctx->media, job->multicut);
-			dnpds40_cleanup_job(job);
-			return CUPS_BACKEND_CANCEL;
-		}
-	} else if (job->multicut < 400) {
-		int mcut = job->multicut;
-
-		switch(ctx->duplex_media) {
-		case 100: //"8x10.75"
-			if (mcut > MULTICUT_S_BACK)
-				mcut -= MULTICUT_S_BACK;
-			else if (mcut > MULTICUT_S_FRONT)
-				mcut -= MULTICUT_S_FRONT;
-
-			if (mcut == MULTICUT_S_8x12 ||
-			    mcut == MULTICUT_S_8x6X2 ||
-			    mcut == MULTICUT_S_8x4X3) {
-				ERROR("Incorrect media for job loaded (%u vs %u)\n", ctx->duplex_media, job->multicut);
-				dnpds40_cleanup_job(job);
-				return CUPS_BACKEND_CANCEL;
-			}
-			break;
-		case 200: //"8x12"
-			/* Everything is legal */
-			break;
-		default:
-			ERROR("Unknown duplexer media (%u vs %u)!\n", ctx->duplex_media, job->multicut);
-			dnpds40_cleanup_job(job);
-			return CUPS_BACKEND_CANCEL;
-		}
-	} else {
-		ERROR("Multicut value out of range! (%u)\n", job->multicut);
-		dnpds40_cleanup_job(job);
-		return CUPS_BACKEND_CANCEL;
-	}
-
-	/* Additional santity checks, make sure printer support exists */
-	if (!ctx->supports_6x6 && job->multicut == MULTICUT_6x6) {
-		ERROR("Printer does not support 6x6 prints, aborting!\n");
-		dnpds40_cleanup_job(job);
-		return CUPS_BACKEND_CANCEL;
-	}
-
-	if (!ctx->supports_5x5 && job->multicut == MULTICUT_5x5) {
-		ERROR("Printer does not support 5x5 prints, aborting!\n");
+	ret = dnpds40_check_media(ctx, job);
+	if (ret) {
 		dnpds40_cleanup_job(job);
-		return CUPS_BACKEND_CANCEL;
-	}
-
-	if ((job->multicut == MULTICUT_6x4_5 || job->multicut == MULTICUT_6x4_5X2) &&
-	    !ctx->supports_6x4_5) {
-		ERROR("Printer does not support 6x4.5 prints, aborting!\n");
-		dnpds40_cleanup_job(job);
-		return CUPS_BACKEND_CANCEL;
-	}
-
-	if (job->multicut == MULTICUT_6x9 && !ctx->supports_6x9) {
-		ERROR("Printer does not support 6x9 prints, aborting!\n");
-		dnpds40_cleanup_job(job);
-		return CUPS_BACKEND_CANCEL;
-	}
-
-	if (job->multicut == MULTICUT_5x3_5X2 && !ctx->supports_3x5x2) {
-		ERROR("Printer does not support 3.5x5*2 prints, aborting!\n");
-		dnpds40_cleanup_job(job);
-		return CUPS_BACKEND_CANCEL;
+		return ret;
 	}
 
-skip_multicut:
 
 	if (job->fullcut && !ctx->supports_adv_fullcut &&
 	    job->multicut != MULTICUT_6x8) {
@@ -2008,6 +2002,18 @@ skip_checks:
 	return CUPS_BACKEND_OK;
 }
 
+/* Redo the media checks for a job parsed against another printer */
+static int dnpds40_check_job(void *vctx, const void *vjob)
+{
+	struct dnpds40_ctx *ctx = vctx;
+	struct dnpds40_printjob *job = (struct dnpds40_printjob *) vjob;
+
+	if (!ctx || !job)
+		return CUPS_BACKEND_FAILED;
+
+	return dnpds40_check_media(ctx, job);
+}
+
 static int dnpds40_main_loop(void *vctx, const void *vjob) {
 	struct dnpds40_ctx *ctx = vctx;
 	int ret;
@@ -2016,12 +2022,13 @@ static int dnpds40_main_loop(void *vctx, const void *vjob) {
 	int len = 0;
 	uint8_t *ptr;
 	char buf[9];
-	int status;
+	int status, last_status = -1;
 	int buf_needed;
 	int multicut;
 	int count = 0;
 	int manual_copies = 0;
 	int copies;
+	struct dyesub_poll poll;
 
 	const struct dnpds40_printjob *job = vjob;
 
@@ -2066,6 +2073,7 @@ static int dnpds40_main_loop(void *vctx, const void *vjob) {
 		}
 	}
 
+	dyesub_poll_reset(&poll);
 top:
 
 	/* Query status */
@@ -2077,6 +2085,11 @@ top:
 	status = atoi((char*)resp);
 	free(resp);
 
+	if (status != last_status) {
+		last_status = status;
+		dyesub_poll_reset(&poll);
+	}
+
 	/* Figure out what's going on */
 	switch(status) {
 	case 0:	/* Idle; we can continue! */
@@ -2097,7 +2110,7 @@ top:
 		free(resp);
 		if (bufs < buf_needed) {
 			INFO("Insufficient printer buffers (%d vs %d), retrying...\n", bufs, buf_needed);
-			sleep(1);
+			dyesub_poll_sleep(&poll);
 			goto top;
 		}
 		break;
@@ -2105,7 +2118,7 @@ top:
 	case 500: /* Cooling print head */
 	case 510: /* Cooling paper motor */
 		INFO("Printer cooling down...\n");
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	case 900:
 		INFO("Waking printer up from standby...\n");
@@ -2117,7 +2130,7 @@ top:
 	case 1300: /* Paper Jam */
 	case 1400: /* Ribbon Error */
 		WARNING("Printer not ready: %s, please correct...\n", dnpds40_statuses(status));
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	case 1500: /* Paper definition error */
 		ERROR("Paper definition error, aborting job\n");
@@ -2279,6 +2292,7 @@ top:
 		INFO("Waiting for job to complete...\n");
 		int started = 0;
 
+		dyesub_poll_reset(&poll);
 		while (1) {
 			/* Query status */
 			dnpds40_build_cmd(&cmd, "STATUS", "", 0);
@@ -2298,7 +2312,11 @@ top:
 				ERROR("Printer encountered error: %s\n", dnpds40_statuses(status));
 				break;
 			}
-			sleep(1);
+			if (status != last_status) {
+				last_status = status;
+				dyesub_poll_reset(&poll);
+			}
+			dyesub_poll_sleep(&poll);
 		}
 
 		/* Figure out remaining native prints */
@@ -3381,6 +3399,57 @@ static int dnp_job_polarity(void *vctx)
 	return (count & 1);
 }
 
+static int dnp_query_ready(void *vctx)
+{
+	struct dnpds40_ctx *ctx = vctx;
+	struct dnpds40_cmd cmd;
+	uint8_t *resp;
+	int len = 0;
+	int status;
+	int bufs;
+
+	if (test_mode >= TEST_MODE_NOATTACH)
+		return 1;
+
+	/* Query status */
+	dnpds40_build_cmd(&cmd, "STATUS", "", 0);
+	resp = dnpds40_resp_cmd(ctx, &cmd, &len);
+	if (!resp)
+		return -1;
+	dnpds40_cleanup_string((char*)resp, len);
+	status = atoi((char*)resp);
+	free(resp);
+
+	switch(status) {
+	case 0:	/* Idle */
+	case 1: /* Printing */
+		break;
+	case 900: /* Standby */
+		return 1;
+	case 1500: /* Paper definition error */
+	case 1600: /* Data error */
+		/* These are job errors, not printer errors */
+		return 1;
+	default:
+		/* Cooling down, or needs operator attention */
+		if (status < 2000)
+			return 0;
+		return -1;
+	}
+
+	/* Query buffer state */
+	dnpds40_build_cmd(&cmd, "INFO", "FREE_PBUFFER", 0);
+	resp = dnpds40_resp_cmd(ctx, &cmd, &len);
+	if (!resp)
+		return -1;
+
+	dnpds40_cleanup_string((char*)resp, len);
+	bufs = atoi(((char*)resp)+3);
+	free(resp);
+
+	return (bufs > 0) ? bufs : 0;
+}
+
 static const char *dnpds40_prefixes[] = {
 	"dnp_citizen", "dnpds40",  // Family names, do *not* nuke.
 	// backwards compatibility
@@ -3424,6 +3493,8 @@ struct dyesub_backend dnpds40_backend = {
 	.query_stats = dnp_query_stats,
 	.combine_jobs = dnp_combine_jobs,
 	.job_polarity = dnp_job_polarity,
+	.query_ready = dnp_query_ready,
+	.check_job = dnpds40_check_job,
 	.devices = {
 		{ USB_VID_CITIZEN, USB_PID_DNP_DS40, P_DNP_DS40, NULL, "dnp-ds40"},
 		{ USB_VID_CITIZEN, USB_PID_DNP_DS40, P_DNP_DS40, NULL, "citizen-cx"}, /* Duplicate */
@@ -27,6 +27,7 @@
 #define BACKEND hiti_backend
 
 #include "backend_common.h"
+#include "backend_pixfmt.h"
 
 /* For Integration into gutenprint */
 #if defined(HAVE_CONFIG_H)
@@ -915,7 +916,7 @@ static int hiti_attach(void *vctx, struct libusb_device_handle *dev, int type,
 		/* P52x firmware v1.19+ lose their minds when Linux
 		   issues a routine CLEAR_ENDPOINT_HALT.  Printer can recover
 		   if it is reset.  Unclear what the side effects are.. */
-		if (ctx->type == P_HITI_52X)
+		if (ctx->type == P_HITI_52X && dev)
 			libusb_reset_device(dev);
 
 		ret = hiti_query_unk8010(ctx);
@@ -969,7 +970,7 @@ static void hiti_cleanup_job(const void *vjob) {
 	const struct hiti_printjob *job = vjob;
 
 	if (job->databuf)
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
 
 	free((void*)job);
 }
@@ -1277,7 +1278,8 @@ static uint32_t interp1089[33];
 static uint32_t interp33[33];
 static uint16_t interp256[256*9];
 
-static void hiti_interp_init(void)
+/* Not static, as dyesub_bench uses these too */
+void hiti_interp_init(void)
 {
 	int i;
 	uint16_t *pre, *cur;
@@ -1301,7 +1303,7 @@ static void hiti_interp_init(void)
 }
 
 /* src and dst are RGB tuples */
-static void hiti_interp33_256(uint8_t *dst, uint8_t *src, const uint8_t *pTable)
+void hiti_interp33_256(uint8_t *dst, uint8_t *src, const uint8_t *pTable)
 {
 	struct rgb p1_pos, p2_pos, p3_pos, p4_pos;
 	struct rgb p1_val, p2_val, p3_val, p4_val;
@@ -1470,7 +1472,7 @@ static int hiti_read_parse(void *vctx, const void **vjob, int data_fd, int copie
 
 		ERROR("Read failed (%d/%d)\n",
 		      ret, (int)sizeof(job->hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		return ret;
 	}
 
@@ -1520,23 +1522,30 @@ static int hiti_read_parse(void *vctx, const void **vjob, int data_fd, int copie
 		break;
 	}
 
-	/* Allocate a buffer */
-	job->datalen = 0;
-	job->databuf = malloc(job->hdr.payload_len);
-	if (!job->databuf) {
-		ERROR("Memory allocation failure!\n");
-		hiti_cleanup_job(job);
-		return CUPS_BACKEND_RETRY_CURRENT;
+	/* Use the payload in place, if possible */
+	uint32_t remain = job->hdr.payload_len;
+	job->databuf = dyesub_spool_borrow(data_fd, 0, remain);
+	if (job->databuf) {
+		job->datalen = remain;
+		remain = 0;
+	} else {
+		/* Allocate a buffer */
+		job->datalen = 0;
+		job->databuf = dyesub_buf_alloc(remain);
+		if (!job->databuf) {
+			ERROR("Memory allocation failure!\n");
+			hiti_cleanup_job(job);
+			return CUPS_BACKEND_RETRY_CURRENT;
+		}
 	}
 
 	/* Read in data */
-	uint32_t remain = job->hdr.payload_len;
 	while (remain) {
 		ret = read(data_fd, job->databuf + job->datalen, remain);
 		if (ret < 0) {
 			ERROR("Read failed (%d/%u/%u)\n",
 			      ret, remain, job->datalen);
-			perror("ERROR: Read failed");
+			ERROR("Read failed: %s\n", strerror(errno));
 			hiti_cleanup_job(job);
 			return CUPS_BACKEND_CANCEL;
 		}
@@ -1631,8 +1640,9 @@ static int hiti_read_parse(void *vctx, const void **vjob, int data_fd, int copie
 		}
 
 		int stride = ((job->hdr.cols * 4) + 3) / 4;
-		uint8_t *ymcbuf = malloc(job->hdr.rows * stride * 3);
+		uint8_t *ymcbuf = dyesub_buf_alloc(job->hdr.rows * stride * 3);
 		uint32_t i, j;
+		uint64_t timing = dyesub_timing_start();
 
 		if (!ymcbuf) {
 			hiti_cleanup_job(job);
@@ -1641,28 +1651,25 @@ static int hiti_read_parse(void *vctx, const void **vjob, int data_fd, int copie
 		}
 
 		for (i = 0 ; i < job->hdr.rows ; i++) {
-			uint8_t *rowY = ymcbuf + stride * i;
-			uint8_t *rowM = ymcbuf + stride * (job->hdr.rows + i);
-			uint8_t *rowC = ymcbuf + stride * (job->hdr.rows * 2 + i);
-
-			/* Simple optimization */
-			uint8_t oldrgb[3] = { 255, 255, 255 };
-			uint8_t destrgb[3];
+			uint8_t *row = job->databuf + job->hdr.cols * i * 3;
 
+			/* Input data is BGR; run it through the correction
+			   tables in place first, if needed */
 			if (corrdata) {
+				/* Simple optimization */
+				uint8_t oldrgb[3] = { 255, 255, 255 };
+				uint8_t destrgb[3];
+
 				hiti_interp33_256(oldrgb, destrgb, corrdata);
-			}
 
-			for (j = 0 ; j < job->hdr.cols ; j++) {
-				uint8_t rgb[3];
-				uint32_t base = (job->hdr.cols * i + j) * 3;
+				for (j = 0 ; j < job->hdr.cols ; j++) {
+					uint8_t rgb[3];
+					uint8_t *pix = row + j * 3;
 
-				/* Input data is BGR */
-				rgb[2] = job->databuf[base];
-				rgb[1] = job->databuf[base + 1];
-				rgb[0] = job->databuf[base + 2];
+					rgb[2] = pix[0];
+					rgb[1] = pix[1];
+					rgb[0] = pix[2];
 
-				if (corrdata) {
 					if (rgb[0] == oldrgb[0] &&
 					    rgb[1] == oldrgb[1] &&
 					    rgb[2] == oldrgb[2]) {
@@ -1678,17 +1685,25 @@ static int hiti_read_parse(void *vctx, const void **vjob, int data_fd, int copie
 						destrgb[1] = rgb[1];
 						destrgb[2] = rgb[2];
 					}
-				}
 
-				/* Finally convert to YMC */
-				rowY[j] = 255 - rgb[2];
-				rowM[j] = 255 - rgb[1];
-				rowC[j] = 255 - rgb[0];
+					pix[0] = rgb[2];
+					pix[1] = rgb[1];
+					pix[2] = rgb[0];
+				}
 			}
+
+			/* Finally convert to YMC */
+			pixfmt_packed8_to_planar_inv(row,
+						     ymcbuf + stride * i,
+						     ymcbuf + stride * (job->hdr.rows + i),
+						     ymcbuf + stride * (job->hdr.rows * 2 + i),
+						     job->hdr.cols);
 		}
 
+		dyesub_timing_stop(TIMING_LUT, timing);
+
 		/* Nuke the old BGR buffer and replace it with YMC buffer */
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
 		job->databuf = ymcbuf;
 		job->datalen = stride * 3 * job->hdr.cols;
 
@@ -1724,6 +1739,7 @@ static int hiti_main_loop(void *vctx, const void *vjob)
 	uint32_t err = 0;
 	uint8_t sts[3];
 	struct hiti_job jobid;
+	struct dyesub_poll poll;
 
 	const struct hiti_printjob *job = vjob;
 
@@ -1734,6 +1750,7 @@ static int hiti_main_loop(void *vctx, const void *vjob)
 
 	INFO("Waiting for printer idle\n");
 
+	dyesub_poll_reset(&poll);
 	do {
 		ret = hiti_query_status(ctx, sts, &err);
 		if (ret)
@@ -1750,7 +1767,7 @@ static int hiti_main_loop(void *vctx, const void *vjob)
 		if (!(sts[0] & (STATUS0_POWERON|STATUS0_BUSY)))
 			break;
 
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	} while(1);
 
 	dump_markers(&ctx->marker, 1, 0);
@@ -1902,9 +1919,11 @@ resend_c:
 		return CUPS_BACKEND_FAILED;
 
 	INFO("Waiting for printer acknowledgement\n");
+	dyesub_poll_reset(&poll);
+	dyesub_poll_eta(&poll, 1000);
 	do {
 		struct hiti_job_qqa qqa;
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 
 		ret = hiti_query_status(ctx, sts, &err);
 		if (ret)
@@ -342,7 +342,7 @@ static int kodak1400_read_parse(void *vctx, const void **vjob, int data_fd, int
 			return CUPS_BACKEND_CANCEL;
 		ERROR("Read failed (%d/%d/%d)\n",
 		      ret, 0, (int)sizeof(job->hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		return CUPS_BACKEND_CANCEL;
 	}
 	if (job->hdr.hdr[0] != 'P' ||
@@ -385,7 +385,7 @@ static int kodak1400_read_parse(void *vctx, const void **vjob, int data_fd, int
 					ERROR("Read failed (%d/%d/%u) (%d/%u @ %d)\n",
 					      ret, remain, job->hdr.columns,
 					      i, job->hdr.rows, j);
-					perror("ERROR: Read failed");
+					ERROR("Read failed: %s\n", strerror(errno));
 					return CUPS_BACKEND_CANCEL;
 				}
 				ptr += ret;
@@ -411,6 +411,7 @@ static int kodak1400_main_loop(void *vctx, const void *vjob) {
 	int num, ret;
 	uint16_t temp16;
 	int copies;
+	struct dyesub_poll poll;
 
 	const struct kodak1400_printjob *job = vjob;
 
@@ -421,6 +422,7 @@ static int kodak1400_main_loop(void *vctx, const void *vjob) {
 
 	copies = job->copies;
 
+	dyesub_poll_reset(&poll);
 top:
 	if (state != last_state) {
 		if (dyesub_debug)
@@ -444,8 +446,9 @@ top:
 		return CUPS_BACKEND_FAILED;
 	if (memcmp(rdbuf, rdbuf2, READBACK_LEN)) {
 		memcpy(rdbuf2, rdbuf, READBACK_LEN);
+		dyesub_poll_reset(&poll);
 	} else if (state == last_state) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	}
 	last_state = state;
 
@@ -456,7 +459,7 @@ top:
 		return CUPS_BACKEND_STOP;  // HOLD/CANCEL/FAILED?  XXXX parse error!
 	}
 
-	fflush(stderr);
+	dyesub_log_flush();
 
 	switch (state) {
 	case S_IDLE:
@@ -419,7 +419,7 @@ static int kodak605_read_parse(void *vctx, const void **vjob, int data_fd, int c
 	memset(job, 0, sizeof(*job));
 
 	/* Read in header */
-	ret = sinfonia_raw10_read_parse(data_fd, job);
+	ret = sinfonia_raw10_read_parse(data_fd, job, copies);
 	if (ret) {
 		free(job);
 		return ret;
@@ -438,6 +438,8 @@ static int kodak605_main_loop(void *vctx, const void *vjob) {
 	struct kodak605_ctx *ctx = vctx;
 
 	struct kodak605_status sts;
+	struct dyesub_poll poll;
+	uint8_t last_status = 0xff;
 
 	int num, ret;
 	int offset = 0;
@@ -469,6 +471,7 @@ static int kodak605_main_loop(void *vctx, const void *vjob) {
 
 	INFO("Waiting for printer idle (%d banks needed)\n", banks_needed);
 
+	dyesub_poll_reset(&poll);
 	while(1) {
 		if ((ret = kodak605_get_status(ctx, &sts)))
 			return CUPS_BACKEND_FAILED;
@@ -516,7 +519,7 @@ static int kodak605_main_loop(void *vctx, const void *vjob) {
 			break;
 		}
 
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	}
 
 	/* Send backprint */
@@ -583,7 +586,7 @@ retry_print:
 	if (sts.hdr.result != RESULT_SUCCESS) {
 		if (sts.hdr.error == ERROR_BUFFER_FULL) {
 			INFO("Printer Buffers full, retrying\n");
-			sleep(1);
+			dyesub_poll_sleep(&poll);
 			goto retry_print;
 		} else if ((sts.hdr.status & 0xf0) == 0x30 || sts.hdr.status == ERROR_BUFFER_FULL) {
 			INFO("Printer busy (%02x : %s), retrying\n", sts.hdr.status, sinfonia_status_str(sts.hdr.status));
@@ -601,13 +604,22 @@ retry_print:
 	}
 
 	INFO("Sending image data\n");
-	if ((ret = send_data(ctx->dev.dev, ctx->dev.endp_down,
-			     job->databuf + offset, job->datalen - offset)))
+	if (job->streaming)
+		ret = dyesub_stream_send(ctx->dev.dev, ctx->dev.endp_down,
+					 NULL, 0, job->datalen);
+	else
+		ret = send_data(ctx->dev.dev, ctx->dev.endp_down,
+				job->databuf + offset, job->datalen - offset);
+	if (ret)
 		return CUPS_BACKEND_FAILED;
 
 	INFO("Waiting for printer to acknowledge completion\n");
+
+	/* Give the printer a moment to pick up the job first */
+	dyesub_poll_reset(&poll);
+	dyesub_poll_eta(&poll, 1000);
 	do {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		if ((kodak605_get_status(ctx, &sts)) != 0)
 			return CUPS_BACKEND_FAILED;
 
@@ -616,8 +628,12 @@ retry_print:
 			dump_markers(&ctx->marker, 1, 0);
 		}
 
-		INFO("Printer Status:  %02x (%s)\n", sts.hdr.status,
-		     sinfonia_status_str(sts.hdr.status));
+		if (sts.hdr.status != last_status) {
+			INFO("Printer Status:  %02x (%s)\n", sts.hdr.status,
+			     sinfonia_status_str(sts.hdr.status));
+			last_status = sts.hdr.status;
+			dyesub_poll_reset(&poll);
+		}
 
 		if (sts.hdr.result != RESULT_SUCCESS ||
 		    sts.hdr.error == ERROR_PRINTER) {
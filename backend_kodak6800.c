@@ -768,7 +768,7 @@ static int kodak6800_read_parse(void *vctx, const void **vjob, int data_fd, int
 		}
 		ERROR("Read failed (%d/%d/%d)\n",
 		      ret, 0, (int)sizeof(hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		sinfonia_cleanup_job(job);
 		return CUPS_BACKEND_CANCEL;
 	}
@@ -813,7 +813,7 @@ static int kodak6800_read_parse(void *vctx, const void **vjob, int data_fd, int
 			if (ret < 0) {
 				ERROR("Read failed (%d/%d/%d)\n",
 				      ret, remain, job->datalen);
-				perror("ERROR: Read failed");
+				ERROR("Read failed: %s\n", strerror(errno));
 				sinfonia_cleanup_job(job);
 				return CUPS_BACKEND_CANCEL;
 			}
@@ -871,6 +871,7 @@ static int kodak6800_read_parse(void *vctx, const void **vjob, int data_fd, int
 
 static int kodak6800_main_loop(void *vctx, const void *vjob) {
 	struct kodak6800_ctx *ctx = vctx;
+	struct dyesub_poll poll;
 
 	int num, ret;
 	int copies;
@@ -898,6 +899,8 @@ static int kodak6800_main_loop(void *vctx, const void *vjob) {
 
 	INFO("Waiting for printer idle\n");
 
+	dyesub_poll_reset(&poll);
+
 	while(1) {
 		if (kodak6800_get_status(ctx, &ctx->sts))
 			return CUPS_BACKEND_FAILED;
@@ -929,7 +932,7 @@ static int kodak6800_main_loop(void *vctx, const void *vjob) {
                     !ctx->sts.b2_remain)
                         break;
 
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	}
 
 	/* This command is unknown, sort of a secondary status query */
@@ -973,8 +976,9 @@ static int kodak6800_main_loop(void *vctx, const void *vjob) {
 		return CUPS_BACKEND_FAILED;
 
 	INFO("Waiting for printer to acknowledge completion\n");
+	dyesub_poll_reset(&poll);
 	do {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		if (kodak6800_get_status(ctx, &ctx->sts))
 			return CUPS_BACKEND_FAILED;
 
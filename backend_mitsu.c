@@ -63,6 +63,12 @@ int mitsu_loadlib(struct mitsu_lib *lib, int type)
 		lib->DoImageEffect70 = DL_SYM(lib->dl_handle, "do_image_effect70");
 		lib->DoImageEffect80 = DL_SYM(lib->dl_handle, "do_image_effect80");
 		lib->SendImageData = DL_SYM(lib->dl_handle, "send_image_data");
+		lib->DoImageEffect60Lut = DL_SYM(lib->dl_handle, "do_image_effect60_lut");
+		lib->DoImageEffect70Lut = DL_SYM(lib->dl_handle, "do_image_effect70_lut");
+		lib->DoImageEffect80Lut = DL_SYM(lib->dl_handle, "do_image_effect80_lut");
+		lib->DoImageEffect60Stream = DL_SYM(lib->dl_handle, "do_image_effect60_stream");
+		lib->DoImageEffect70Stream = DL_SYM(lib->dl_handle, "do_image_effect70_stream");
+		lib->DoImageEffect80Stream = DL_SYM(lib->dl_handle, "do_image_effect80_stream");
 		lib->CP98xx_DoConvert = DL_SYM(lib->dl_handle, "CP98xx_DoConvert");
 		lib->CP98xx_GetData = DL_SYM(lib->dl_handle, "CP98xx_GetData");
 		lib->CP98xx_DestroyData = DL_SYM(lib->dl_handle, "CP98xx_DestroyData");
@@ -84,7 +90,11 @@ int mitsu_loadlib(struct mitsu_lib *lib, int type)
 		    !lib->Destroy3DColorTable || !lib->DoColorConv ||
 		    !lib->GetCPCData || !lib->DestroyCPCData ||
 		    !lib->DoImageEffect60 || !lib->DoImageEffect70 ||
-		    !lib->DoImageEffect80 || !lib->SendImageData) {
+		    !lib->DoImageEffect80 || !lib->SendImageData ||
+		    !lib->DoImageEffect60Lut || !lib->DoImageEffect70Lut ||
+		    !lib->DoImageEffect80Lut ||
+		    !lib->DoImageEffect60Stream || !lib->DoImageEffect70Stream ||
+		    !lib->DoImageEffect80Stream) {
 			ERROR("Problem resolving symbols in imaging processing library\n");
 			DL_CLOSE(lib->dl_handle);
 			lib->dl_handle = NULL;
@@ -97,20 +107,30 @@ int mitsu_loadlib(struct mitsu_lib *lib, int type)
 	switch (type) {
 	case P_MITSU_D80:
 		lib->DoImageEffect = lib->DoImageEffect80;
+		lib->DoImageEffectLut = lib->DoImageEffect80Lut;
+		lib->DoImageEffectStream = lib->DoImageEffect80Stream;
 		break;
 	case P_MITSU_K60:
 	case P_KODAK_305:
 		lib->DoImageEffect = lib->DoImageEffect60;
+		lib->DoImageEffectLut = lib->DoImageEffect60Lut;
+		lib->DoImageEffectStream = lib->DoImageEffect60Stream;
 		break;
 	case P_MITSU_D70X:
 	case P_FUJI_ASK300:
 		lib->DoImageEffect = lib->DoImageEffect70;
+		lib->DoImageEffectLut = lib->DoImageEffect70Lut;
+		lib->DoImageEffectStream = lib->DoImageEffect70Stream;
+		/* The others can't send until the rewind check is done */
+		lib->stream_early = 1;
 		break;
 	case P_MITSU_9800:
 	case P_MITSU_9800S:
 	case P_MITSU_9810:
 	default:
 		lib->DoImageEffect = NULL;
+		lib->DoImageEffectLut = NULL;
+		lib->DoImageEffectStream = NULL;
 	}
 
 	return CUPS_BACKEND_OK;
@@ -128,6 +148,8 @@ int mitsu_destroylib(struct mitsu_lib *lib)
 			lib->DestroyCPCData(lib->cpcdata);
 		if (lib->ecpcdata)
 			lib->DestroyCPCData(lib->ecpcdata);
+		if (lib->m1cpcdata)
+			lib->M1_DestroyCPCData(lib->m1cpcdata);
 		if (lib->lut)
 			lib->Destroy3DColorTable(lib->lut);
 		DL_CLOSE(lib->dl_handle);
@@ -140,38 +162,79 @@ int mitsu_destroylib(struct mitsu_lib *lib)
 	return CUPS_BACKEND_OK;
 }
 
-int mitsu_apply3dlut(struct mitsu_lib *lib, const char *lutfname, uint8_t *databuf,
-		     uint16_t cols, uint16_t rows, uint16_t stride,
-		     int rgb_bgr)
+/* Load a 3D LUT of the caller's own */
+int mitsu_read3dlut(struct mitsu_lib *lib, const char *lutfname,
+		    struct CColorConv3D **lut)
 {
 #if defined(WITH_DYNAMIC)
 	char full[2048];
 	int i;
 
-	if (!lutfname)
-		return CUPS_BACKEND_OK;
-
+	*lut = NULL;
 	snprintf(full, sizeof(full), "%s/%s", corrtable_path, lutfname);
 
-	if (!lib->lut) {
-		uint8_t *buf = malloc(LUT_LEN);
-		if (!buf) {
-			ERROR("Memory allocation failure!\n");
-			return CUPS_BACKEND_RETRY_CURRENT;
-		}
-		if ((i = dyesub_read_file(full, buf, LUT_LEN, NULL)))
-			return i;
-		lib->lut = lib->Load3DColorTable(buf);
+	uint8_t *buf = malloc(LUT_LEN);
+	if (!buf) {
+		ERROR("Memory allocation failure!\n");
+		return CUPS_BACKEND_RETRY_CURRENT;
+	}
+	if ((i = dyesub_read_file(full, buf, LUT_LEN, NULL))) {
 		free(buf);
-		if (!lib->lut) {
-			ERROR("Unable to parse LUT file '%s'!\n", full);
-			return CUPS_BACKEND_CANCEL;
-		}
+		return i;
 	}
+	*lut = lib->Load3DColorTable(buf);
+	free(buf);
+	if (!*lut) {
+		ERROR("Unable to parse LUT file '%s'!\n", full);
+		return CUPS_BACKEND_CANCEL;
+	}
+#else
+	UNUSED(lib);
+	UNUSED(lutfname);
+	*lut = NULL;
+#endif
+	return CUPS_BACKEND_OK;
+}
+
+/* Load the shared 3D LUT, unless it's from this file already */
+int mitsu_load3dlut(struct mitsu_lib *lib, const char *lutfname)
+{
+	int ret;
+
+	if (!lutfname)
+		return CUPS_BACKEND_OK;
+	if (lib->lut && lib->lutfname && !strcmp(lib->lutfname, lutfname))
+		return CUPS_BACKEND_OK;
+
+	if (lib->lut)
+		lib->Destroy3DColorTable(lib->lut);
+	lib->lutfname = NULL;
+	ret = mitsu_read3dlut(lib, lutfname, &lib->lut);
+	if (!ret)
+		lib->lutfname = lutfname;
+
+	return ret;
+}
+
+int mitsu_apply3dlut(struct mitsu_lib *lib, const char *lutfname, uint8_t *databuf,
+		     uint16_t cols, uint16_t rows, uint16_t stride,
+		     int rgb_bgr)
+{
+#if defined(WITH_DYNAMIC)
+	int ret;
+
+	if (!lutfname)
+		return CUPS_BACKEND_OK;
+
+	ret = mitsu_load3dlut(lib, lutfname);
+	if (ret)
+		return ret;
 
 	if (lib->lut) {
+		uint64_t timing = dyesub_timing_start();
 		DEBUG("Running print data through 3D LUT\n");
 		lib->DoColorConv(lib->lut, databuf, cols, rows, stride, rgb_bgr);
+		dyesub_timing_stop(TIMING_LUT, timing);
 	}
 #endif
 	return CUPS_BACKEND_OK;
@@ -57,8 +57,11 @@ typedef void (*DoColorConvFN)(struct CColorConv3D *this, uint8_t *data, uint16_t
 typedef struct CPCData *(*get_CPCDataFN)(const char *filename);
 typedef void (*destroy_CPCDataFN)(struct CPCData *data);
 typedef int (*do_image_effectFN)(struct CPCData *cpc, struct CPCData *ecpc, struct BandImage *input, struct BandImage *output, int sharpen, int reverse, uint8_t rew[2]);
+typedef int (*do_image_effect_lutFN)(struct CColorConv3D *lut, struct CPCData *cpc, struct CPCData *ecpc, struct BandImage *input, struct BandImage *output, int sharpen, int reverse, uint8_t rew[2]);
 typedef int (*send_image_dataFN)(struct BandImage *out, void *context,
 			       int (*callback_fn)(void *context, void *buffer, uint32_t len));
+typedef int (*do_image_effect_streamFN)(struct CColorConv3D *lut, struct CPCData *cpc, struct CPCData *ecpc, struct BandImage *input, struct BandImage *output, int sharpen, int reverse, uint8_t rew[2],
+					void *context, int (*callback_fn)(void *context, void *buffer, uint32_t len));
 
 typedef int (*CP98xx_DoConvertFN)(const struct mitsu98xx_data *table,
 				  const struct BandImage *input,
@@ -83,7 +86,7 @@ typedef uint8_t (*M1_CalcOpRateGlossFN)(uint16_t rows, uint16_t cols);
 #warning "No dynamic loading support!"
 #endif
 
-#define REQUIRED_LIB_APIVERSION 6
+#define REQUIRED_LIB_APIVERSION 7
 
 #define LIBMITSU_VER "0.06"
 
@@ -103,6 +106,14 @@ struct mitsu_lib {
 	do_image_effectFN DoImageEffect70;
 	do_image_effectFN DoImageEffect80;
 	do_image_effectFN DoImageEffect;
+	do_image_effect_lutFN DoImageEffect60Lut;
+	do_image_effect_lutFN DoImageEffect70Lut;
+	do_image_effect_lutFN DoImageEffect80Lut;
+	do_image_effect_lutFN DoImageEffectLut;
+	do_image_effect_streamFN DoImageEffect60Stream;
+	do_image_effect_streamFN DoImageEffect70Stream;
+	do_image_effect_streamFN DoImageEffect80Stream;
+	do_image_effect_streamFN DoImageEffectStream;
 	send_image_dataFN SendImageData;
 	CP98xx_DoConvertFN CP98xx_DoConvert;
 	CP98xx_GetDataFN CP98xx_GetData;
@@ -115,12 +126,18 @@ struct mitsu_lib {
 	M1_CalcOpRateGlossFN M1_CalcOpRateGloss;
 	M1_CalcOpRateMatteFN M1_CalcOpRateMatte;
 	struct CColorConv3D *lut;
+	const char *lutfname;  /* What 'lut' was loaded from */
 	struct CPCData *cpcdata;
 	struct CPCData *ecpcdata;
+	struct M1CPCData *m1cpcdata;
+	int stream_early;  /* DoImageEffectStream() sends before it is done */
 };
 
 int mitsu_loadlib(struct mitsu_lib *lib, int type);
 int mitsu_destroylib(struct mitsu_lib *lib);
+int mitsu_read3dlut(struct mitsu_lib *lib, const char *lutfname,
+		    struct CColorConv3D **lut);
+int mitsu_load3dlut(struct mitsu_lib *lib, const char *lutfname);
 int mitsu_apply3dlut(struct mitsu_lib *lib, const char *lutfname, uint8_t *databuf,
 		     uint16_t cols, uint16_t rows, uint16_t stride,
 		     int rgb_bgr);
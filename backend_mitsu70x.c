@@ -61,6 +61,7 @@ struct mitsu70x_printjob {
 	uint32_t planelen;
 	uint32_t matte;
 	int raw_format;
+	int streaming; /* RAW payload is still in the spool */
 
 	int decks_exact[2];	 /* Media is exact match */
 	int decks_ok[2];         /* Media can be used */
@@ -73,6 +74,12 @@ struct mitsu70x_printjob {
 	const char *lutfname;
 	const char *cpcfname;
 	const char *ecpcfname;
+
+	/* 3D LUT still to be applied, along with the gamma conversion.
+	   Owned by the job, unless it's a combined one. */
+	struct CColorConv3D *lut;
+	int lut_owned;
+	const struct mitsu_lib *lib;
 };
 
 struct mitsu70x_ctx {
@@ -320,6 +327,7 @@ STATIC_ASSERT(sizeof(struct mitsu70x_hdr) == 512);
 
 static int mitsu70x_get_printerstatus(struct mitsu70x_ctx *ctx, struct mitsu70x_printerstatus_resp *resp);
 static int mitsu70x_main_loop(void *vctx, const void *vjob);
+static int mitsu70x_query_ready(void *vctx);
 
 /* Error dumps, etc */
 
@@ -708,9 +716,13 @@ static void mitsu70x_cleanup_job(const void *vjob) {
 	const struct mitsu70x_printjob *job = vjob;
 
 	if (job->databuf)
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
 	if (job->spoolbuf)
-		free(job->spoolbuf);
+		dyesub_buf_free(job->spoolbuf);
+	if (job->streaming)
+		dyesub_stream_close();
+	if (job->lut && job->lut_owned)
+		job->lib->Destroy3DColorTable(job->lut);
 
 	free((void*)job);
 }
@@ -758,6 +770,9 @@ static void *mitsu70x_combine_jobs(const void *vjob1,
 		goto done;
 	if (job1->raw_format || job2->raw_format)
 		goto done;
+	JOB_EQUIV(lutfname);
+	if (!job1->lut != !job2->lut)
+		goto done;
 	if (hdr1->speed != hdr2->speed)
 		goto done;
 
@@ -797,6 +812,7 @@ static void *mitsu70x_combine_jobs(const void *vjob1,
                 goto done;
         }
         memcpy(newjob, job1, sizeof(*newjob));
+	newjob->lut_owned = 0;
 
 	newjob->spoolbuf = NULL;
 	newjob->rows = newrows;
@@ -805,7 +821,7 @@ static void *mitsu70x_combine_jobs(const void *vjob1,
 	if (newjob->matte) {
 		newjob->matte = ((((newrows + lamoffset) * newcols * 2) + 511) / 512) * 512;
 	}
-        newjob->databuf = malloc(sizeof(*newhdr) + newjob->planelen * 3 + newjob->matte);
+        newjob->databuf = dyesub_buf_alloc(sizeof(*newhdr) + newjob->planelen * 3 + newjob->matte);
         newjob->datalen = 0;
         if (!newjob->databuf) {
 		mitsu70x_cleanup_job(newjob);
@@ -829,7 +845,7 @@ static void *mitsu70x_combine_jobs(const void *vjob1,
 	newhdr->multicut = 1;
 	newhdr->deck = 0;  /* Let printer decide */
 
-	newjob->spoolbuf = malloc(newrows * newcols * 3);
+	newjob->spoolbuf = dyesub_buf_alloc(newrows * newcols * 3);
 	newjob->spoolbuflen = 0;
 	if (!newjob->spoolbuf) {
 		mitsu70x_cleanup_job(newjob);
@@ -856,6 +872,20 @@ static void *mitsu70x_combine_jobs(const void *vjob1,
 	       job2->spoolbuflen);
 	newjob->spoolbuflen += job2->spoolbuflen;
 
+	/* The padding must not go through the LUT, so do the images now */
+	if (newjob->lut) {
+		uint64_t timing = dyesub_timing_start();
+
+		newjob->lib->DoColorConv(job1->lut, newjob->spoolbuf + finalpad * 3,
+					 job1->cols, job1->rows, job1->cols * 3,
+					 COLORCONV_BGR);
+		newjob->lib->DoColorConv(job2->lut, newjob->spoolbuf + newjob->spoolbuflen - job2->spoolbuflen,
+					 job2->cols, job2->rows, job2->cols * 3,
+					 COLORCONV_BGR);
+		dyesub_timing_stop(TIMING_LUT, timing);
+		newjob->lut = NULL;  /* Still job1's */
+	}
+
 	/* Okay, we're done. */
 
 done:
@@ -863,6 +893,77 @@ done:
 }
 #undef JOB_EQUIV
 
+/* Work out which deck(s) hold media the job can be printed on.
+   Returns nonzero if there aren't any. */
+static int mitsu70x_job_decks(const struct mitsu70x_ctx *ctx,
+			      struct mitsu70x_printjob *job)
+{
+	int i;
+
+	memset(job->decks_ok, 0, sizeof(job->decks_ok));
+	memset(job->decks_exact, 0, sizeof(job->decks_exact));
+
+	for (i = 0 ; i < ctx->num_decks ; i++) {
+		switch (ctx->medias[i]) {
+		case 0x1: // 5x3.5
+			if (job->rows == 1076)
+				job->decks_ok[i] = 1;
+			if (job->rows == 1076)
+				job->decks_exact[i] = 1;
+			break;
+		case 0x2: // 4x6
+			if (job->rows == 1218 ||
+			    job->rows == 1228)
+				job->decks_ok[i] = 1;
+			if (job->rows == 1218 ||
+			    job->rows == 1228)
+				job->decks_exact[i] = 1;
+			break;
+		case 0x4: // 5x7
+			if (job->rows == 1076 ||
+			    job->rows == 1524 ||
+			    job->rows == 2128 ||
+			    job->rows == 2190)  /* Combined 5x3.5 */
+				job->decks_ok[i] = 1;
+			if (job->rows == 1524 ||
+			    job->rows == 2128 ||
+			    job->rows == 2190)
+				job->decks_exact[i] = 1;
+			break;
+		case 0x5: // 6x9
+		case 0xf: // 6x8
+			/* This is made more complicated:
+			   some 6x8" jobs are 6x9" sized.  Let printer
+			   sort these out.  It's unlikely we'll have
+			   6x8" in one deck and 6x9" in the other!
+			*/
+			if (job->rows == 1218 ||
+			    job->rows == 1228 ||
+			    job->rows == 1820 ||
+			    job->rows == 2422 ||
+			    job->rows == 2454 ||  /* Combined 6x4 */
+			    job->rows == 2564 ||
+			    job->rows == 2730)
+				job->decks_ok[i] = 1;
+			if (job->rows == 2422 ||
+			    job->rows == 2454 ||
+			    job->rows == 2564 ||
+			    job->rows == 2730)
+				job->decks_exact[i] = 1;
+			break;
+		default:
+			job->decks_ok[i] = 0;
+			job->decks_exact[i] = 0;
+			break;
+		}
+	}
+
+	if (!job->decks_ok[0] && !job->decks_ok[1])
+		return CUPS_BACKEND_CANCEL;
+
+	return CUPS_BACKEND_OK;
+}
+
 static int mitsu70x_read_parse(void *vctx, const void **vjob, int data_fd, int copies) {
 	struct mitsu70x_ctx *ctx = vctx;
 	int i, remain;
@@ -1039,8 +1140,35 @@ repeat:
 
 	remain = 3 * job->planelen + job->matte;
 
+	/* RAW jobs can be sent straight from the spool, if it's mapped */
+	if (job->raw_format) {
+		job->databuf = dyesub_spool_borrow(data_fd, sizeof(mhdr), remain);
+		if (job->databuf) {
+			DEBUG("Using %d bytes of 16bpp YMC%sdata in place\n", remain,
+			      job->matte ? "L " : " ");
+			/* Our header is modified, so update it in place */
+			memcpy(job->databuf, &mhdr, sizeof(mhdr));
+			job->datalen = sizeof(mhdr) + remain;
+			goto bypass_raw;
+		}
+
+		/* Otherwise single copies can be forwarded as they arrive */
+		if (job->copies == 1 && dyesub_stream_open(data_fd, remain)) {
+			job->databuf = malloc(sizeof(mhdr));
+			if (!job->databuf) {
+				ERROR("Memory allocation failure!\n");
+				mitsu70x_cleanup_job(job);
+				return CUPS_BACKEND_RETRY_CURRENT;
+			}
+			job->streaming = 1;
+			memcpy(job->databuf, &mhdr, sizeof(mhdr));
+			job->datalen = sizeof(mhdr) + remain;
+			goto bypass_raw;
+		}
+	}
+
 	job->datalen = 0;
-	job->databuf = malloc(sizeof(mhdr) + remain + LAMINATE_STRIDE*2);  /* Give us a bit extra */
+	job->databuf = dyesub_buf_alloc(sizeof(mhdr) + remain + LAMINATE_STRIDE*2);  /* Give us a bit extra */
 
 	if (!job->databuf) {
 		ERROR("Memory allocation failure!\n");
@@ -1077,7 +1205,13 @@ repeat:
 	DEBUG("Reading in %d bytes of 8bpp BGR data\n", remain);
 
 	job->spoolbuflen = 0;
-	job->spoolbuf = malloc(remain);
+	job->spoolbuf = dyesub_spool_borrow(data_fd, 0, remain);
+	if (job->spoolbuf) {
+		job->spoolbuflen = remain;
+		remain = 0;
+	} else {
+		job->spoolbuf = dyesub_buf_alloc(remain);
+	}
 	if (!job->spoolbuf) {
 		ERROR("Memory allocation failure!\n");
 		mitsu70x_cleanup_job(job);
@@ -1105,69 +1239,20 @@ repeat:
 		return CUPS_BACKEND_CANCEL;
 	}
 
-	/* Run through basic LUT, if present and enabled */
+	/* Load the basic LUT, if present and enabled.  main_loop() applies
+	   it along with the gamma conversion instead of as a separate pass. */
 	if (job->lutfname) {
-		int ret = mitsu_apply3dlut(&ctx->lib, job->lutfname,
-				       job->spoolbuf, job->cols,
-				       job->rows, job->cols * 3,
-				       COLORCONV_BGR);
+		int ret = mitsu_read3dlut(&ctx->lib, job->lutfname, &job->lut);
 		if (ret) {
 			mitsu70x_cleanup_job(job);
 			return ret;
 		}
+		job->lut_owned = 1;
+		job->lib = &ctx->lib;
 	}
 
 bypass_raw:
-	for (i = 0 ; i < ctx->num_decks ; i++) {
-		switch (ctx->medias[i]) {
-		case 0x1: // 5x3.5
-			if (job->rows == 1076)
-				job->decks_ok[i] = 1;
-			if (job->rows == 1076)
-				job->decks_exact[i] = 1;
-			break;
-		case 0x2: // 4x6
-			if (job->rows == 1218 ||
-			    job->rows == 1228)
-				job->decks_ok[i] = 1;
-			if (job->rows == 1218 ||
-			    job->rows == 1228)
-				job->decks_exact[i] = 1;
-			break;
-		case 0x4: // 5x7
-			if (job->rows == 1076 ||
-			    job->rows == 1524 ||
-			    job->rows == 2128)
-				job->decks_ok[i] = 1;
-			if (job->rows == 1524 ||
-			    job->rows == 2128)
-				job->decks_exact[i] = 1;
-			break;
-		case 0x5: // 6x9
-		case 0xf: // 6x8
-			/* This is made more complicated:
-			   some 6x8" jobs are 6x9" sized.  Let printer
-			   sort these out.  It's unlikely we'll have
-			   6x8" in one deck and 6x9" in the other!
-			*/
-			if (job->rows == 1218 ||
-			    job->rows == 1228 ||
-			    job->rows == 1820 ||
-			    job->rows == 2422 ||
-			    job->rows == 2564 ||
-			    job->rows == 2730)
-				job->decks_ok[i] = 1;
-			if (job->rows == 2422 ||
-			    job->rows == 2564 ||
-			    job->rows == 2730)
-				job->decks_exact[i] = 1;
-			break;
-		default:
-			job->decks_ok[i] = 0;
-			job->decks_exact[i] = 0;
-			break;
-		}
-	}
+	mitsu70x_job_decks(ctx, job);
 
 	/* 6x4 can be combined, only on 6x8/6x9" media. */
 	job->can_combine = 0;
@@ -1195,6 +1280,18 @@ bypass_raw:
 	return CUPS_BACKEND_OK;
 }
 
+/* Redo the media checks for a job parsed against another printer */
+static int mitsu70x_check_job(void *vctx, const void *vjob)
+{
+	struct mitsu70x_ctx *ctx = vctx;
+	struct mitsu70x_printjob *job = (struct mitsu70x_printjob *) vjob;
+
+	if (!ctx || !job)
+		return CUPS_BACKEND_FAILED;
+
+	return mitsu70x_job_decks(ctx, job);
+}
+
 static int mitsu70x_get_jobstatus(struct mitsu70x_ctx *ctx, struct mitsu70x_jobstatus *resp, uint16_t jobid)
 {
 	uint8_t cmdbuf[CMDBUF_LEN];
@@ -1451,7 +1548,9 @@ static int mitsu70x_wakeup(struct mitsu70x_ctx *ctx, int wait)
 	int ret;
 	uint8_t buf[512];
 	struct mitsu70x_jobstatus jobstatus;
+	struct dyesub_poll poll;
 
+	dyesub_poll_reset(&poll);
 top:
 	/* Query job status for jobid 0 (global) */
 	ret = mitsu70x_get_jobstatus(ctx, &jobstatus, 0x0000);
@@ -1473,7 +1572,7 @@ top:
 			return CUPS_BACKEND_FAILED;
 
 		if (wait) {
-			sleep(1);
+			dyesub_poll_sleep(&poll);
 			goto top;
 		}
 	}
@@ -1482,6 +1581,16 @@ top:
 	return CUPS_BACKEND_OK;
 }
 
+static void mitsu70x_set_rewind(struct mitsu70x_ctx *ctx, struct mitsu70x_hdr *hdr,
+				const uint8_t rew[2])
+{
+	if (ctx->type != P_MITSU_D70X) {
+		hdr->rewind[0] = !rew[0];
+		hdr->rewind[1] = !rew[1];
+		DEBUG("Rewind Inhibit? %02x %02x\n", hdr->rewind[0], hdr->rewind[1]);
+	}
+}
+
 static int d70_library_callback(void *context, void *buffer, uint32_t len)
 {
 	uint32_t chunk = len;
@@ -1505,6 +1614,46 @@ static int d70_library_callback(void *context, void *buffer, uint32_t len)
 	return ret;
 }
 
+/* Image data straight from the processing library as it is generated.
+   The header has to go first, but can't be sent until the library has
+   settled the rewind flags, ie just before the first block. */
+struct mitsu70x_stream {
+	struct mitsu70x_ctx *ctx;
+	struct mitsu70x_hdr *hdr;
+	uint8_t rew[2];
+	int started;
+};
+
+static int d70_stream_callback(void *context, void *buffer, uint32_t len)
+{
+	struct mitsu70x_stream *stream = context;
+
+	if (!stream->started) {
+		mitsu70x_set_rewind(stream->ctx, stream->hdr, stream->rew);
+		if (send_data(stream->ctx->dev, stream->ctx->endp_down,
+			      (uint8_t*) stream->hdr, sizeof(struct mitsu70x_hdr)))
+			return -1;
+		stream->started = 1;
+	}
+
+	return d70_library_callback(stream->ctx, buffer, len);
+}
+
+/* Could the printer start on this job right away? */
+static int mitsu70x_ready_now(struct mitsu70x_ctx *ctx,
+			      const struct mitsu70x_printjob *job,
+			      const struct mitsu70x_hdr *hdr)
+{
+	struct mitsu70x_memorystatus_resp memory;
+
+	if (mitsu70x_query_ready(ctx) <= 0)
+		return 0;
+	if (mitsu70x_get_memorystatus(ctx, job, hdr->multicut, &memory))
+		return 0;
+
+	return !memory.size && !memory.memory;
+}
+
 static int mitsu70x_main_loop(void *vctx, const void *vjob)
 {
 	struct mitsu70x_ctx *ctx = vctx;
@@ -1512,6 +1661,10 @@ static int mitsu70x_main_loop(void *vctx, const void *vjob)
 	struct mitsu70x_printerstatus_resp resp;
 	struct mitsu70x_hdr *hdr;
 	uint8_t last_status[4] = {0xff, 0xff, 0xff, 0xff};
+	struct dyesub_poll poll;
+	uint64_t timing;
+	struct BandImage input;
+	int deferred = 0;
 
 	int ret;
 	int copies;
@@ -1533,9 +1686,6 @@ static int mitsu70x_main_loop(void *vctx, const void *vjob)
 	if (job->raw_format)
 		goto bypass;
 
-	struct BandImage input;
-	uint8_t rew[2] = { 1, 1 }; /* 1 for rewind ok (default!) */
-
 	/* Load in the CPC file, if needed */
 	if (job->cpcfname && job->cpcfname != ctx->last_cpcfname) {
 		char full[2048];
@@ -1585,29 +1735,45 @@ static int mitsu70x_main_loop(void *vctx, const void *vjob)
 	ctx->output.imgbuf = job->databuf + job->datalen;
 	ctx->output.bytes_per_row = job->cols * 3 * 2;
 
-	DEBUG("Running print data through processing library\n");
-	if (ctx->lib.DoImageEffect(ctx->lib.cpcdata, ctx->lib.ecpcdata,
-				   &input, &ctx->output, job->sharpen, job->reverse, rew)) {
-		ERROR("Image Processing failed, aborting!\n");
-		return CUPS_BACKEND_CANCEL;
-	}
+	/* Normally the image is processed while the printer finishes the
+	   previous one.  If it is already idle, and the library sends data
+	   as it goes, process it as it is sent instead. */
+	if (ctx->lib.DoImageEffectStream && ctx->lib.stream_early &&
+	    test_mode < TEST_MODE_NOPRINT &&
+	    mitsu70x_ready_now(ctx, job, hdr)) {
+		DEBUG("Printer is idle, processing image as it is sent\n");
+		deferred = 1;
+	} else {
+		uint8_t rew[2] = { 1, 1 }; /* 1 for rewind ok (default!) */
+
+		DEBUG("Running print data through processing library\n");
+		dyesub_log_flush(); /* The library writes to stderr directly */
+		timing = dyesub_timing_start();
+		if (job->lut)
+			ret = ctx->lib.DoImageEffectLut(job->lut, ctx->lib.cpcdata, ctx->lib.ecpcdata,
+							&input, &ctx->output, job->sharpen, job->reverse, rew);
+		else
+			ret = ctx->lib.DoImageEffect(ctx->lib.cpcdata, ctx->lib.ecpcdata,
+						     &input, &ctx->output, job->sharpen, job->reverse, rew);
+		if (ret) {
+			ERROR("Image Processing failed, aborting!\n");
+			return CUPS_BACKEND_CANCEL;
+		}
+		dyesub_timing_stop(TIMING_EFFECT, timing);
 
-	/* Twiddle rewind stuff if needed */
-	if (ctx->type != P_MITSU_D70X) {
-		hdr->rewind[0] = !rew[0];
-		hdr->rewind[1] = !rew[1];
-		DEBUG("Rewind Inhibit? %02x %02x\n", hdr->rewind[0], hdr->rewind[1]);
+		/* Twiddle rewind stuff if needed */
+		mitsu70x_set_rewind(ctx, hdr, rew);
+
+		/* Clean up */
+		// XXX not really necessary.
+		dyesub_buf_free(job->spoolbuf);
+		job->spoolbuf = NULL;
+		job->spoolbuflen = 0;
 	}
 
 	/* Move up the pointer to after the image data */
 	job->datalen += 3*job->planelen;
 
-	/* Clean up */
-	// XXX not really necessary.
-	free(job->spoolbuf);
-	job->spoolbuf = NULL;
-	job->spoolbuflen = 0;
-
 	/* Now that we've filled everything in, read matte from file */
 	if (job->matte) {
 		ret = mitsu_readlamdata(job->laminatefname, LAMINATE_STRIDE,
@@ -1633,6 +1799,7 @@ bypass:
 	if (ret)
 		return CUPS_BACKEND_FAILED;
 
+	dyesub_poll_reset(&poll);
 top:
 	/* Query job status for jobid 0 (global) */
 	ret = mitsu70x_get_jobstatus(ctx, &jobstatus, 0x0000);
@@ -1755,7 +1922,7 @@ top:
 		}
 
 		/* Legal decks are busy, retry */
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	}
 
@@ -1775,7 +1942,7 @@ top:
 		}
 		if (memory.memory) {
 			INFO("Printer buffers full, retrying!\n");
-			sleep(1);
+			dyesub_poll_sleep(&poll);
 			goto top;
 		}
 	}
@@ -1820,12 +1987,38 @@ top:
 	/* We're clear to send data over! */
 	INFO("Sending Print Job (internal id %u)\n", ctx->jobid);
 
-	if ((ret = send_data(ctx->dev, ctx->endp_down,
-			     job->databuf,
-			     sizeof(struct mitsu70x_hdr))))
-		return CUPS_BACKEND_FAILED;
+	if (deferred) {
+		struct mitsu70x_stream stream = { ctx, hdr, { 1, 1 }, 0 }; /* 1 for rewind ok (default!) */
+
+		/* Only the first attempt; copies and retries send the result */
+		deferred = 0;
 
-	if (ctx->lib.dl_handle && !job->raw_format) {
+		DEBUG("Running print data through processing library\n");
+		dyesub_log_flush(); /* The library writes to stderr directly */
+		timing = dyesub_timing_start();
+		ret = ctx->lib.DoImageEffectStream(job->lut,
+						   ctx->lib.cpcdata, ctx->lib.ecpcdata,
+						   &input, &ctx->output, job->sharpen, job->reverse,
+						   stream.rew, &stream, d70_stream_callback);
+		dyesub_timing_stop(TIMING_EFFECT, timing);
+
+		dyesub_buf_free(job->spoolbuf);
+		job->spoolbuf = NULL;
+		job->spoolbuflen = 0;
+
+		if (ret) {
+			ERROR("Image Processing failed, aborting!\n");
+			return stream.started ? CUPS_BACKEND_FAILED : CUPS_BACKEND_CANCEL;
+		}
+
+		if (job->matte)
+			if (d70_library_callback(ctx, job->databuf + job->datalen - job->matte, job->matte))
+			    return CUPS_BACKEND_FAILED;
+	} else if ((ret = send_data(ctx->dev, ctx->endp_down,
+				    job->databuf,
+				    sizeof(struct mitsu70x_hdr)))) {
+		return CUPS_BACKEND_FAILED;
+	} else if (ctx->lib.dl_handle && !job->raw_format) {
 		if (ctx->lib.SendImageData(&ctx->output, ctx, d70_library_callback))
 			return CUPS_BACKEND_FAILED;
 
@@ -1839,8 +2032,13 @@ top:
 		int chunk = CHUNK_LEN - sizeof(struct mitsu70x_hdr);
 		int sent = 512;
 		while (chunk > 0) {
-			if ((ret = send_data(ctx->dev, ctx->endp_down,
-					     job->databuf + sent, chunk)))
+			if (job->streaming)
+				ret = dyesub_stream_send(ctx->dev, ctx->endp_down,
+							 NULL, 0, chunk);
+			else
+				ret = send_data(ctx->dev, ctx->endp_down,
+						job->databuf + sent, chunk);
+			if (ret)
 				return CUPS_BACKEND_FAILED;
 			sent += chunk;
 			chunk = job->datalen - sent;
@@ -1852,8 +2050,9 @@ top:
 	/* Then wait for completion, if so desired.. */
 	INFO("Waiting for printer to acknowledge completion\n");
 
+	dyesub_poll_reset(&poll);
 	do {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 
 		ret = mitsu70x_get_printerstatus(ctx, &resp);
 		if (ret)
@@ -1916,13 +2115,15 @@ top:
 		if (jobstatus.job_status[0] != last_status[0] ||
 		    jobstatus.job_status[1] != last_status[1] ||
 		    jobstatus.job_status[2] != last_status[2] ||
-		    jobstatus.job_status[3] != last_status[3])
+		    jobstatus.job_status[3] != last_status[3]) {
 			INFO("%s: %02x/%02x/%02x/%02x\n",
 			     mitsu70x_jobstatuses(jobstatus.job_status),
 			     jobstatus.job_status[0],
 			     jobstatus.job_status[1],
 			     jobstatus.job_status[2],
 			     jobstatus.job_status[3]);
+			dyesub_poll_reset(&poll);
+		}
 
 		/* Check for job completion */
 		if (jobstatus.job_status[0] == JOB_STATUS0_END) {
@@ -2274,6 +2475,39 @@ static int mitsu70x_job_polarity(void *vctx)
 	return (ctx->marker[0].levelnow & 1);
 }
 
+/* Count the decks that could start printing right now */
+static int mitsu70x_query_ready(void *vctx)
+{
+	struct mitsu70x_ctx *ctx = vctx;
+	struct mitsu70x_jobstatus jobstatus;
+	int ready = 0, offline = 0;
+
+	if (test_mode >= TEST_MODE_NOATTACH)
+		return 1;
+
+	if (mitsu70x_get_jobstatus(ctx, &jobstatus, 0x0000))
+		return -1;
+
+	if (jobstatus.error_status[0])
+		offline++;
+	else if (jobstatus.temperature != TEMPERATURE_COOLING &&
+		 jobstatus.mecha_status[0] == MECHA_STATUS_IDLE)
+		ready++;
+
+	if (ctx->num_decks == 2) {
+		if (jobstatus.error_status_up[0])
+			offline++;
+		else if (jobstatus.temperature_up != TEMPERATURE_COOLING &&
+			 jobstatus.mecha_status_up[0] == MECHA_STATUS_IDLE)
+			ready++;
+	}
+
+	if (offline == ctx->num_decks)
+		return -1;
+
+	return ready;
+}
+
 static int mitsu70x_query_stats(void *vctx, struct printerstats *stats)
 {
 	struct mitsu70x_ctx *ctx = vctx;
@@ -2363,6 +2597,8 @@ struct dyesub_backend mitsu70x_backend = {
 	.query_stats = mitsu70x_query_stats,
 	.combine_jobs = mitsu70x_combine_jobs,
 	.job_polarity = mitsu70x_job_polarity,
+	.query_ready = mitsu70x_query_ready,
+	.check_job = mitsu70x_check_job,
 	.devices = {
 		{ USB_VID_MITSU, USB_PID_MITSU_D70X, P_MITSU_D70X, NULL, "mitsubishi-d70dw"},
 		{ USB_VID_MITSU, USB_PID_MITSU_D70X, P_MITSU_D70X, NULL, "mitsubishi-d707dw"}, /* Duplicate */
@@ -28,6 +28,7 @@
 
 #include "backend_common.h"
 #include "backend_mitsu.h"
+#include "backend_pixfmt.h"
 
 #define MITSU_M98xx_LAMINATE_FILE  "M98MATTE.raw"
 #define MITSU_M98xx_DATATABLE_FILE "M98TABLE.dat"
@@ -222,7 +223,7 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob);
 		\
 		/* Make sure we're idle */ \
 		if (sts->sts5 != 0) {  /* Printer ready for another job */ \
-			sleep(1); \
+			dyesub_poll_sleep(&poll); \
 			goto top; \
 		} \
 		/* Check for known errors */ \
@@ -345,7 +346,7 @@ static void mitsu9550_cleanup_job(const void *vjob)
 	const struct mitsu9550_printjob *job = vjob;
 
 	if (job->databuf)
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
 
 	free((void*)job);
 }
@@ -514,7 +515,7 @@ hdr_done:
 
 	/* Allocate buffer for the payload */
 	job->datalen = 0;
-	job->databuf = malloc(remain);
+	job->databuf = dyesub_buf_alloc(remain);
 	if (!job->databuf) {
 		ERROR("Memory allocation failure!\n");
 		mitsu9550_cleanup_job(job);
@@ -915,6 +916,7 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob) {
 	struct mitsu9550_cmd cmd;
 	uint8_t rdbuf[READBACK_LEN];
 	uint8_t *ptr;
+	struct dyesub_poll poll;
 
 	int ret;
 #if 0
@@ -942,7 +944,7 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob) {
 
 	planelen = job->rows * job->cols * 2;
 	remain = (job->hdr1.matte ? 4 : 3) * (planelen + sizeof(struct mitsu9550_plane)) + sizeof(struct mitsu9550_cmd) * (job->hdr1.matte? 2 : 1) + LAMINATE_STRIDE * 2;
-	newbuf = malloc(remain);
+	newbuf = dyesub_buf_alloc(remain);
 	if (!newbuf) {
 		ERROR("Memory allocation Failure!\n");
 		return CUPS_BACKEND_RETRY_CURRENT;
@@ -954,9 +956,9 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob) {
 	struct BandImage input;
 	struct BandImage output;
 
-	uint8_t *convbuf = malloc(planelen * 3);
+	uint8_t *convbuf = dyesub_buf_alloc(planelen * 3);
 	if (!convbuf) {
-		free(newbuf);
+		dyesub_buf_free(newbuf);
 		ERROR("Memory allocation Failure!\n");
 		return CUPS_BACKEND_RETRY_CURRENT;
 	}
@@ -974,13 +976,17 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob) {
 	output.bytes_per_row = job->cols * 3 * sizeof(uint16_t);
 
 	int sharpness = job->hdr2.unkc[7];
+	uint64_t timing;
 
+	dyesub_log_flush(); /* The library writes to stderr directly */
+	timing = dyesub_timing_start();
 	if (!ctx->lib.CP98xx_DoConvert(ctx->m98xxdata, &input, &output, job->hdr2.mode, sharpness, job->hdr2.unkc[8])) {
-		free(convbuf);
-		free(newbuf);
+		dyesub_buf_free(convbuf);
+		dyesub_buf_free(newbuf);
 		ERROR("CP98xx_DoConvert() failed!\n");
 		return CUPS_BACKEND_FAILED;
 	}
+	dyesub_timing_stop(TIMING_EFFECT, timing);
 
 	/* Clear special extension flags used by our backend */
 	if (job->hdr2.mode == 0x11)
@@ -992,7 +998,6 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob) {
 	   We need to convert this to planar YMC16, with a header for
 	   each plane. */
 	uint8_t *yPtr, *mPtr, *cPtr;
-	int j, offset;
 
 	yPtr = newbuf + newlen;
 	memcpy(yPtr, job->databuf, sizeof(struct mitsu9550_plane));
@@ -1012,23 +1017,20 @@ static int mitsu9550_main_loop(void *vctx, const void *vjob) {
 	cPtr += sizeof(struct mitsu9550_plane);
 	newlen += sizeof(struct mitsu9550_plane) + planelen;
 
-	for (offset = 0, i = 0; i < output.rows ; i++) {
-		for (j = 0 ; j < output.cols ; j ++, offset += 3) {
-			yPtr[i*output.cols + j] = convbuf[0 + offset];
-			mPtr[i*output.cols + j] = convbuf[1 + offset];
-			cPtr[i*output.cols + j] = convbuf[2 + offset];
-		}
-	}
+	/* The samples are already big-endian, so just split them up */
+	pixfmt_packed16_to_planar((uint16_t*) convbuf, (uint16_t*) yPtr,
+				  (uint16_t*) mPtr, (uint16_t*) cPtr,
+				  output.rows * output.cols);
 
 	/* All done with conversion buffer, nuke it */
-	free(convbuf);
+	dyesub_buf_free(convbuf);
 
 	/* And finally, append the job footer. */
 	memcpy(newbuf + newlen, job->databuf + sizeof(struct mitsu9550_plane) + planelen/2 * 3, ctx->footer_len);
 	newlen += sizeof(struct mitsu9550_cmd);
 
 	/* Clean up, and move pointer to new buffer; */
-	free(job->databuf);
+	dyesub_buf_free(job->databuf);
 	job->databuf = newbuf;
 	job->datalen = newlen;
 	ptr = job->databuf;
@@ -1045,6 +1047,7 @@ non_98xx:
 	if (test_mode >= TEST_MODE_NOPRINT)
 		return CUPS_BACKEND_OK;
 
+	dyesub_poll_reset(&poll);
 top:
 	if (ctx->is_s) {
 		int num;
@@ -1249,6 +1252,7 @@ top:
 	}
 
 	/* Status loop, run until printer reports completion */
+	dyesub_poll_reset(&poll);
 	while(1) {
 		struct mitsu9550_status *sts = (struct mitsu9550_status*) rdbuf;
 //		struct mitsu9550_status2 *sts2 = (struct mitsu9550_status2*) rdbuf;
@@ -1296,7 +1300,7 @@ top:
 			ERROR("Printer cover open!\n");
 			return CUPS_BACKEND_STOP;
 		}
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	}
 
 	INFO("Print complete\n");
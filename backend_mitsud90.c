@@ -468,6 +468,7 @@ struct mitsud90_ctx {
 
 	/* For the CP-M1 family */
 	struct mitsu_lib lib;
+	const char *last_gammatab;
 
 	struct marker marker;
 };
@@ -897,10 +898,96 @@ static int cpm1_fillmatte(struct mitsud90_printjob *job)
 	return CUPS_BACKEND_OK;
 }
 
+/* Status predicates for dyesub_poll_until() */
+struct mitsud90_wait {
+	uint8_t last_status[2];
+	int copies;
+};
+
+static int mitsud90_check_status(struct mitsud90_wait *wait,
+				 struct dyesub_poll *poll,
+				 struct mitsud90_status_resp *resp)
+{
+	if (resp->code[0] != D90_ERROR_STATUS_OK) {
+		ERROR("Printer reported error condition: %s (%02x %02x)\n",
+		      mitsud90_error_codes(resp->code), resp->code[0], resp->code[1]);
+		return CUPS_BACKEND_STOP;
+	}
+
+	if (resp->mecha[0] != wait->last_status[0] ||
+	    resp->mecha[1] != wait->last_status[1]) {
+		INFO("Printer status: %s\n",
+		     mitsud90_mecha_statuses(resp->mecha));
+		wait->last_status[0] = resp->mecha[0];
+		wait->last_status[1] = resp->mecha[1];
+		dyesub_poll_reset(poll);
+	}
+
+	return DYESUB_POLL_AGAIN;
+}
+
+static int mitsud90_wait_idle(void *vctx, void *arg, struct dyesub_poll *poll)
+{
+	struct mitsud90_status_resp resp;
+	int ret;
+
+	if (mitsud90_query_status(vctx, &resp))
+		return CUPS_BACKEND_FAILED;
+
+	ret = mitsud90_check_status(arg, poll, &resp);
+	if (ret != DYESUB_POLL_AGAIN)
+		return ret;
+
+	if (resp.code[1] & D90_ERROR_STATUS_OK_WARMING ||
+	    resp.temp & D90_ERROR_STATUS_OK_WARMING ) {
+		INFO("Printer warming up\n");
+		return DYESUB_POLL_AGAIN;
+	}
+	if (resp.code[1] & D90_ERROR_STATUS_OK_COOLING ||
+	    resp.temp & D90_ERROR_STATUS_OK_COOLING) {
+		INFO("Printer cooling down\n");
+		return DYESUB_POLL_AGAIN;
+	}
+
+	// we don't have to wait until idle, just
+	// until we have free buffers.  Don't know how
+	// to check this though.. XXXX
+	if (resp.mecha[0] == D90_MECHA_STATUS_IDLE)
+		return CUPS_BACKEND_OK;
+
+	return DYESUB_POLL_AGAIN;
+}
+
+static int mitsud90_wait_done(void *vctx, void *arg, struct dyesub_poll *poll)
+{
+	struct mitsud90_wait *wait = arg;
+	struct mitsud90_status_resp resp;
+	int ret;
+
+	if (mitsud90_query_status(vctx, &resp))
+		return CUPS_BACKEND_FAILED;
+
+	ret = mitsud90_check_status(wait, poll, &resp);
+	if (ret != DYESUB_POLL_AGAIN)
+		return ret;
+
+	/* Terminate when printing complete */
+	if (resp.mecha[0] == D90_MECHA_STATUS_IDLE)
+		return CUPS_BACKEND_OK;
+
+	if (fast_return && wait->copies <= 1) { /* Copies generated by backend? */
+		INFO("Fast return mode enabled.\n");
+		return CUPS_BACKEND_OK;
+	}
+
+	return DYESUB_POLL_AGAIN;
+}
+
 static int mitsud90_main_loop(void *vctx, const void *vjob) {
 	struct mitsud90_ctx *ctx = vctx;
-	struct mitsud90_status_resp resp;
-	uint8_t last_status[2] = {0xff, 0xff};
+	struct mitsud90_wait wait = { {0xff, 0xff}, 0 };
+	struct dyesub_poll poll;
+	uint64_t timing;
 
 	int sent;
 	int ret;
@@ -957,7 +1044,14 @@ static int mitsud90_main_loop(void *vctx, const void *vjob) {
 			gammatab = CPM1_CPC_G1_FNAME;
 		}
 
-		cpc = ctx->lib.M1_GetCPCData(corrtable_path, CPM1_CPC_FNAME, gammatab);
+		/* Load the CPC data, unless we already have it */
+		if (gammatab != ctx->last_gammatab) {
+			if (ctx->lib.m1cpcdata)
+				ctx->lib.M1_DestroyCPCData(ctx->lib.m1cpcdata);
+			ctx->lib.m1cpcdata = ctx->lib.M1_GetCPCData(corrtable_path, CPM1_CPC_FNAME, gammatab);
+			ctx->last_gammatab = ctx->lib.m1cpcdata ? gammatab : NULL;
+		}
+		cpc = ctx->lib.m1cpcdata;
 		if (!cpc) {
 			ERROR("Cannot read data tables\n");
 			free(convbuf);
@@ -965,6 +1059,7 @@ static int mitsud90_main_loop(void *vctx, const void *vjob) {
 		}
 
 		/* Do gamma conversion */
+		timing = dyesub_timing_start();
 		ctx->lib.M1_Gamma8to14(cpc, &input, &output);
 
 		if (job->hdr.sharp_h || job->hdr.sharp_v) {
@@ -977,13 +1072,11 @@ static int mitsud90_main_loop(void *vctx, const void *vjob) {
 			if (ctx->lib.M1_CLocalEnhancer(cpc, sharp, &output)) {
 				ERROR("CLocalEnhancer failed (out of memory?)\n");
 				free(convbuf);
-				ctx->lib.M1_DestroyCPCData(cpc);
 				return CUPS_BACKEND_RETRY_CURRENT;
 			}
 		}
 
-		/* We're done with the CPC data */
-		ctx->lib.M1_DestroyCPCData(cpc);
+		dyesub_timing_stop(TIMING_EFFECT, timing);
 
 #if (__BYTE_ORDER == __BIG_ENDIAN)
 		/* Convert data to LITTLE ENDIAN if needed */
@@ -1021,50 +1114,15 @@ static int mitsud90_main_loop(void *vctx, const void *vjob) {
 
 	INFO("Waiting for printer idle...\n");
 
+	dyesub_poll_reset(&poll);
 top:
 	sent = 0;
 
 	// XXX Figure out if printer is asleep, and wake it up if necessary.
 
 	/* Query status, wait for idle or error out */
-	do {
-		if (mitsud90_query_status(ctx, &resp))
-			return CUPS_BACKEND_FAILED;
-
-		if (resp.code[0] != D90_ERROR_STATUS_OK) {
-			ERROR("Printer reported error condition: %s (%02x %02x)\n",
-			      mitsud90_error_codes(resp.code), resp.code[0], resp.code[1]);
-			return CUPS_BACKEND_STOP;
-		}
-
-		if (resp.code[1] & D90_ERROR_STATUS_OK_WARMING ||
-		    resp.temp & D90_ERROR_STATUS_OK_WARMING ) {
-			INFO("Printer warming up\n");
-			sleep(1);
-			continue;
-		}
-		if (resp.code[1] & D90_ERROR_STATUS_OK_COOLING ||
-			   resp.temp & D90_ERROR_STATUS_OK_COOLING) {
-			INFO("Printer cooling down\n");
-			sleep(1);
-			continue;
-		}
-
-		if (resp.mecha[0] != last_status[0] ||
-		    resp.mecha[1] != last_status[1]) {
-			INFO("Printer status: %s\n",
-			     mitsud90_mecha_statuses(resp.mecha));
-			last_status[0] = resp.mecha[0];
-			last_status[1] = resp.mecha[1];
-		}
-
-		if (resp.mecha[0] == D90_MECHA_STATUS_IDLE) {
-			break;
-			// we don't have to wait until idle, just
-			// until we have free buffers.  Don't know how
-			// to check this though.. XXXX
-		}
-	} while(1);
+	if ((ret = dyesub_poll_until(mitsud90_wait_idle, ctx, &wait)))
+		return ret;
 
 	/* Send memory check */
 	{
@@ -1097,7 +1155,7 @@ top:
 		}
 		if (mem_resp.mem_bad) {
 			ERROR("Printer buffers full, retrying!\n");
-			sleep(1);
+			dyesub_poll_sleep(&poll);
 			goto top;
 		}
 	}
@@ -1126,37 +1184,12 @@ top:
 			return CUPS_BACKEND_FAILED;
 	}
 
-	/* Wait for completion */
-	do {
-		sleep(1);
-
-		if (mitsud90_query_status(ctx, &resp))
-			return CUPS_BACKEND_FAILED;
-
-		if (resp.code[0] != D90_ERROR_STATUS_OK) {
-			ERROR("Printer reported error condition: %s (%02x %02x)\n",
-			      mitsud90_error_codes(resp.code), resp.code[0], resp.code[1]);
-			return CUPS_BACKEND_STOP;
-		}
-
-		if (resp.mecha[0] != last_status[0] ||
-		    resp.mecha[1] != last_status[1]) {
-			INFO("Printer status: %s\n",
-			     mitsud90_mecha_statuses(resp.mecha));
-			last_status[0] = resp.mecha[0];
-			last_status[1] = resp.mecha[1];
-		}
-
-		/* Terminate when printing complete */
-		if (resp.mecha[0] == D90_MECHA_STATUS_IDLE) {
-			break;
-		}
-
-		if (fast_return && copies <= 1) { /* Copies generated by backend? */
-			INFO("Fast return mode enabled.\n");
-			break;
-		}
-	} while(1);
+	/* Wait for completion, after giving the printer a moment to
+	   pick up the job */
+	sleep(1);
+	wait.copies = copies;
+	if ((ret = dyesub_poll_until(mitsud90_wait_done, ctx, &wait)))
+		return ret;
 
 	/* Clean up */
 	if (terminate)
@@ -153,15 +153,13 @@ static int mitsup95d_attach(void *vctx, struct libusb_device_handle *dev, int ty
 	/* Query serial number */
 	{
 		struct libusb_device_descriptor desc;
-		struct libusb_device *udev;
 
-		udev = libusb_get_device(ctx->dev);
-		libusb_get_device_descriptor(udev, &desc);
+		dyesub_get_device_descriptor(ctx->dev, &desc);
 
 		if (!desc.iSerialNumber) {
 			WARNING("Printer configured for iSerial mode U0, so no serial number is reported.\n");
 		} else {
-			libusb_get_string_descriptor_ascii(ctx->dev, desc.iSerialNumber, (uint8_t*)ctx->serno, STR_LEN_MAX);
+			dyesub_get_string_descriptor(ctx->dev, desc.iSerialNumber, (uint8_t*)ctx->serno, STR_LEN_MAX);
 
 			if (strstr(ctx->serno, "000000")) {
 				WARNING("Printer configured for iSerial mode U2, reporting a fixed serial number of 000000\n");
@@ -363,6 +361,7 @@ top:
 static int mitsup95d_main_loop(void *vctx, const void *vjob) {
 	struct mitsup95d_ctx *ctx = vctx;
 	uint8_t queryresp[QUERYRESP_SIZE_MAX];
+	struct dyesub_poll poll;
 	int ret;
 
 	const struct mitsup95d_printjob *job = vjob;
@@ -376,6 +375,7 @@ static int mitsup95d_main_loop(void *vctx, const void *vjob) {
 	INFO("Waiting for printer idle\n");
 
         /* Query Status to make sure printer is idle */
+	dyesub_poll_reset(&poll);
 	do {
 		ret = mitsup95d_get_status(ctx, queryresp);
 		if (ret)
@@ -397,7 +397,7 @@ static int mitsup95d_main_loop(void *vctx, const void *vjob) {
 				break;
 		}
 
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 	} while (1);
 
 	INFO("Sending print job\n");
@@ -469,8 +469,10 @@ static int mitsup95d_main_loop(void *vctx, const void *vjob) {
 	INFO("Waiting for completion\n");
 
 	/* Query status until we're done.. */
+	dyesub_poll_reset(&poll);
+	dyesub_poll_eta(&poll, 1000);
 	do {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 
 		/* Query Status */
 		ret = mitsup95d_get_status(ctx, queryresp);
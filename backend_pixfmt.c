@@ -0,0 +1,366 @@
+/*
+ *   Pixel format conversions shared by the backends
+ *
+ *   (c) 2026 agent <agent@local>
+ *
+ *   The latest version of this program can be found at:
+ *
+ *     http://git.shaftnet.org/cgit/selphy_print.git
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 3 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, see <https://www.gnu.org/licenses/>.
+ *
+ *   SPDX-License-Identifier: GPL-3.0+
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "backend_pixfmt.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXFMT_X86_SIMD
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXFMT_NEON  /* Always there if the compiler says so */
+#include <arm_neon.h>
+#endif
+
+typedef void (*pixfmt_packed8FN)(const uint8_t *src, uint8_t *dst0,
+				 uint8_t *dst1, uint8_t *dst2, uint32_t count);
+typedef void (*pixfmt_packed16FN)(const uint16_t *src, uint16_t *dst0,
+				  uint16_t *dst1, uint16_t *dst2, uint32_t count);
+typedef void (*pixfmt_lutFN)(const uint8_t *src, uint16_t *dst,
+			     const uint16_t lut[256], uint32_t cols, uint32_t rows,
+			     uint32_t pad_l, uint32_t pad_r);
+
+static struct {
+	pixfmt_packed8FN packed8_inv;
+	pixfmt_packed16FN packed16;
+	pixfmt_lutFN lut8to16_pad;
+} pixfmt;
+
+static pthread_once_t pixfmt_once = PTHREAD_ONCE_INIT;
+
+/* Plain C versions; these also handle whatever is left over at the
+   end of a row for the vector versions. */
+static void pixfmt_packed8_inv(const uint8_t *src, uint8_t *dst0,
+			       uint8_t *dst1, uint8_t *dst2, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0 ; i < count ; i++) {
+		dst0[i] = 255 - src[3*i];
+		dst1[i] = 255 - src[3*i+1];
+		dst2[i] = 255 - src[3*i+2];
+	}
+}
+
+static void pixfmt_packed16(const uint16_t *src, uint16_t *dst0,
+			    uint16_t *dst1, uint16_t *dst2, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0 ; i < count ; i++) {
+		dst0[i] = src[3*i];
+		dst1[i] = src[3*i+1];
+		dst2[i] = src[3*i+2];
+	}
+}
+
+static void pixfmt_lut8to16_row(const uint8_t *src, uint16_t *dst,
+				const uint16_t lut[256], uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0 ; i < count ; i++)
+		dst[i] = lut[src[i]];
+}
+
+static void pixfmt_lut8to16(const uint8_t *src, uint16_t *dst,
+			    const uint16_t lut[256], uint32_t cols, uint32_t rows,
+			    uint32_t pad_l, uint32_t pad_r)
+{
+	uint32_t row;
+
+	for (row = 0 ; row < rows ; row++) {
+		memset(dst, 0, pad_l * sizeof(uint16_t));
+		dst += pad_l;
+		pixfmt_lut8to16_row(src, dst, lut, cols);
+		src += cols;
+		dst += cols;
+		memset(dst, 0, pad_r * sizeof(uint16_t));
+		dst += pad_r;
+	}
+}
+
+#ifdef PIXFMT_X86_SIMD
+/* Three 16-byte loads hold 16 packed 8bpp pixels (or 8 packed 16bpp
+   ones); for each plane, one shuffle per load picks out whichever of
+   its samples that load holds.  The AVX2 versions do the same with a
+   second group of pixels in the upper lane. */
+static const int8_t pixfmt_shuf8[3][3][16] = {
+	{ {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 } },
+	{ {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 } },
+	{ {  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 } },
+};
+
+static const int8_t pixfmt_shuf16[3][3][16] = {
+	{ {  0,  1,  6,  7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1,  2,  3,  8,  9, 14, 15, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  4,  5, 10, 11 } },
+	{ {  2,  3,  8,  9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1,  4,  5, 10, 11, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  1,  6,  7, 12, 13 } },
+	{ {  4,  5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1,  0,  1,  6,  7, 12, 13, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  3,  8,  9, 14, 15 } },
+};
+
+#define PIXFMT_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define PIXFMT_LOAD2(lo, hi) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(PIXFMT_LOAD(lo)), PIXFMT_LOAD(hi), 1)
+
+__attribute__((target("ssse3")))
+static void pixfmt_packed8_inv_SSSE3(const uint8_t *src, uint8_t *dst0,
+				     uint8_t *dst1, uint8_t *dst2, uint32_t count)
+{
+	uint8_t *dst[3] = { dst0, dst1, dst2 };
+	const __m128i ones = _mm_set1_epi8(-1);
+	uint32_t k;
+	int c;
+
+	for (k = 0 ; k + 16 <= count ; k += 16) {
+		const __m128i v0 = PIXFMT_LOAD(src + k * 3);
+		const __m128i v1 = PIXFMT_LOAD(src + k * 3 + 16);
+		const __m128i v2 = PIXFMT_LOAD(src + k * 3 + 32);
+
+		for (c = 0 ; c < 3 ; c++) {
+			__m128i v = _mm_shuffle_epi8(v0, PIXFMT_LOAD(pixfmt_shuf8[c][0]));
+			v = _mm_or_si128(v, _mm_shuffle_epi8(v1, PIXFMT_LOAD(pixfmt_shuf8[c][1])));
+			v = _mm_or_si128(v, _mm_shuffle_epi8(v2, PIXFMT_LOAD(pixfmt_shuf8[c][2])));
+			_mm_storeu_si128((__m128i*)(dst[c] + k), _mm_xor_si128(v, ones));
+		}
+	}
+
+	pixfmt_packed8_inv(src + k * 3, dst0 + k, dst1 + k, dst2 + k, count - k);
+}
+
+__attribute__((target("avx2")))
+static void pixfmt_packed8_inv_AVX2(const uint8_t *src, uint8_t *dst0,
+				    uint8_t *dst1, uint8_t *dst2, uint32_t count)
+{
+	uint8_t *dst[3] = { dst0, dst1, dst2 };
+	const __m256i ones = _mm256_set1_epi8(-1);
+	__m256i shuf[3][3];
+	uint32_t k;
+	int c, i;
+
+	for (c = 0 ; c < 3 ; c++)
+		for (i = 0 ; i < 3 ; i++)
+			shuf[c][i] = _mm256_broadcastsi128_si256(PIXFMT_LOAD(pixfmt_shuf8[c][i]));
+
+	for (k = 0 ; k + 32 <= count ; k += 32) {
+		const uint8_t *in = src + k * 3;
+		const __m256i v0 = PIXFMT_LOAD2(in, in + 48);
+		const __m256i v1 = PIXFMT_LOAD2(in + 16, in + 64);
+		const __m256i v2 = PIXFMT_LOAD2(in + 32, in + 80);
+
+		for (c = 0 ; c < 3 ; c++) {
+			__m256i v = _mm256_shuffle_epi8(v0, shuf[c][0]);
+			v = _mm256_or_si256(v, _mm256_shuffle_epi8(v1, shuf[c][1]));
+			v = _mm256_or_si256(v, _mm256_shuffle_epi8(v2, shuf[c][2]));
+			_mm256_storeu_si256((__m256i*)(dst[c] + k), _mm256_xor_si256(v, ones));
+		}
+	}
+
+	pixfmt_packed8_inv(src + k * 3, dst0 + k, dst1 + k, dst2 + k, count - k);
+}
+
+__attribute__((target("ssse3")))
+static void pixfmt_packed16_SSSE3(const uint16_t *src, uint16_t *dst0,
+				  uint16_t *dst1, uint16_t *dst2, uint32_t count)
+{
+	uint16_t *dst[3] = { dst0, dst1, dst2 };
+	uint32_t k;
+	int c;
+
+	for (k = 0 ; k + 8 <= count ; k += 8) {
+		const __m128i v0 = PIXFMT_LOAD(src + k * 3);
+		const __m128i v1 = PIXFMT_LOAD(src + k * 3 + 8);
+		const __m128i v2 = PIXFMT_LOAD(src + k * 3 + 16);
+
+		for (c = 0 ; c < 3 ; c++) {
+			__m128i v = _mm_shuffle_epi8(v0, PIXFMT_LOAD(pixfmt_shuf16[c][0]));
+			v = _mm_or_si128(v, _mm_shuffle_epi8(v1, PIXFMT_LOAD(pixfmt_shuf16[c][1])));
+			v = _mm_or_si128(v, _mm_shuffle_epi8(v2, PIXFMT_LOAD(pixfmt_shuf16[c][2])));
+			_mm_storeu_si128((__m128i*)(dst[c] + k), v);
+		}
+	}
+
+	pixfmt_packed16(src + k * 3, dst0 + k, dst1 + k, dst2 + k, count - k);
+}
+
+__attribute__((target("avx2")))
+static void pixfmt_packed16_AVX2(const uint16_t *src, uint16_t *dst0,
+				 uint16_t *dst1, uint16_t *dst2, uint32_t count)
+{
+	uint16_t *dst[3] = { dst0, dst1, dst2 };
+	__m256i shuf[3][3];
+	uint32_t k;
+	int c, i;
+
+	for (c = 0 ; c < 3 ; c++)
+		for (i = 0 ; i < 3 ; i++)
+			shuf[c][i] = _mm256_broadcastsi128_si256(PIXFMT_LOAD(pixfmt_shuf16[c][i]));
+
+	for (k = 0 ; k + 16 <= count ; k += 16) {
+		const uint16_t *in = src + k * 3;
+		const __m256i v0 = PIXFMT_LOAD2(in, in + 24);
+		const __m256i v1 = PIXFMT_LOAD2(in + 8, in + 32);
+		const __m256i v2 = PIXFMT_LOAD2(in + 16, in + 40);
+
+		for (c = 0 ; c < 3 ; c++) {
+			__m256i v = _mm256_shuffle_epi8(v0, shuf[c][0]);
+			v = _mm256_or_si256(v, _mm256_shuffle_epi8(v1, shuf[c][1]));
+			v = _mm256_or_si256(v, _mm256_shuffle_epi8(v2, shuf[c][2]));
+			_mm256_storeu_si256((__m256i*)(dst[c] + k), v);
+		}
+	}
+
+	pixfmt_packed16(src + k * 3, dst0 + k, dst1 + k, dst2 + k, count - k);
+}
+
+/* Gathers need 32-bit table entries, so widen the table first */
+__attribute__((target("avx2")))
+static void pixfmt_lut8to16_AVX2(const uint8_t *src, uint16_t *dst,
+				 const uint16_t lut[256], uint32_t cols, uint32_t rows,
+				 uint32_t pad_l, uint32_t pad_r)
+{
+	int32_t wide[256];
+	uint32_t row, k;
+
+	for (k = 0 ; k < 256 ; k++)
+		wide[k] = lut[k];
+
+	for (row = 0 ; row < rows ; row++) {
+		memset(dst, 0, pad_l * sizeof(uint16_t));
+		dst += pad_l;
+
+		for (k = 0 ; k + 16 <= cols ; k += 16) {
+			const __m128i b = PIXFMT_LOAD(src + k);
+			__m256i lo = _mm256_i32gather_epi32(wide, _mm256_cvtepu8_epi32(b), 4);
+			__m256i hi = _mm256_i32gather_epi32(wide, _mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)), 4);
+			/* Packing works per lane, so put the halves back in order */
+			__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+			_mm256_storeu_si256((__m256i*)(dst + k), v);
+		}
+		pixfmt_lut8to16_row(src + k, dst + k, lut, cols - k);
+
+		src += cols;
+		dst += cols;
+		memset(dst, 0, pad_r * sizeof(uint16_t));
+		dst += pad_r;
+	}
+}
+#endif /* PIXFMT_X86_SIMD */
+
+#ifdef PIXFMT_NEON
+static void pixfmt_packed8_inv_NEON(const uint8_t *src, uint8_t *dst0,
+				    uint8_t *dst1, uint8_t *dst2, uint32_t count)
+{
+	uint32_t k;
+
+	for (k = 0 ; k + 16 <= count ; k += 16) {
+		uint8x16x3_t v = vld3q_u8(src + k * 3);
+		vst1q_u8(dst0 + k, vmvnq_u8(v.val[0]));
+		vst1q_u8(dst1 + k, vmvnq_u8(v.val[1]));
+		vst1q_u8(dst2 + k, vmvnq_u8(v.val[2]));
+	}
+
+	pixfmt_packed8_inv(src + k * 3, dst0 + k, dst1 + k, dst2 + k, count - k);
+}
+
+static void pixfmt_packed16_NEON(const uint16_t *src, uint16_t *dst0,
+				 uint16_t *dst1, uint16_t *dst2, uint32_t count)
+{
+	uint32_t k;
+
+	for (k = 0 ; k + 8 <= count ; k += 8) {
+		uint16x8x3_t v = vld3q_u16(src + k * 3);
+		vst1q_u16(dst0 + k, v.val[0]);
+		vst1q_u16(dst1 + k, v.val[1]);
+		vst1q_u16(dst2 + k, v.val[2]);
+	}
+
+	pixfmt_packed16(src + k * 3, dst0 + k, dst1 + k, dst2 + k, count - k);
+}
+#endif /* PIXFMT_NEON */
+
+static void pixfmt_init(void)
+{
+	const char *env = getenv("PIXFMT_SIMD");
+
+	pixfmt.packed8_inv = pixfmt_packed8_inv;
+	pixfmt.packed16 = pixfmt_packed16;
+	pixfmt.lut8to16_pad = pixfmt_lut8to16;
+
+	if (env && !atoi(env))
+		return;
+
+#if defined(PIXFMT_X86_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		pixfmt.packed8_inv = pixfmt_packed8_inv_SSSE3;
+		pixfmt.packed16 = pixfmt_packed16_SSSE3;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		pixfmt.packed8_inv = pixfmt_packed8_inv_AVX2;
+		pixfmt.packed16 = pixfmt_packed16_AVX2;
+		pixfmt.lut8to16_pad = pixfmt_lut8to16_AVX2;
+	}
+#elif defined(PIXFMT_NEON)
+	pixfmt.packed8_inv = pixfmt_packed8_inv_NEON;
+	pixfmt.packed16 = pixfmt_packed16_NEON;
+#endif
+}
+
+void pixfmt_packed8_to_planar_inv(const uint8_t *src, uint8_t *dst0,
+				  uint8_t *dst1, uint8_t *dst2, uint32_t count)
+{
+	pthread_once(&pixfmt_once, pixfmt_init);
+	pixfmt.packed8_inv(src, dst0, dst1, dst2, count);
+}
+
+void pixfmt_packed16_to_planar(const uint16_t *src, uint16_t *dst0,
+			       uint16_t *dst1, uint16_t *dst2, uint32_t count)
+{
+	pthread_once(&pixfmt_once, pixfmt_init);
+	pixfmt.packed16(src, dst0, dst1, dst2, count);
+}
+
+void pixfmt_lut8to16_pad(const uint8_t *src, uint16_t *dst,
+			 const uint16_t lut[256], uint32_t cols, uint32_t rows,
+			 uint32_t pad_l, uint32_t pad_r)
+{
+	pthread_once(&pixfmt_once, pixfmt_init);
+	pixfmt.lut8to16_pad(src, dst, lut, cols, rows, pad_l, pad_r);
+}
@@ -0,0 +1,51 @@
+/*
+ *   Pixel format conversions shared by the backends
+ *
+ *   (c) 2026 agent <agent@local>
+ *
+ *   The latest version of this program can be found at:
+ *
+ *     http://git.shaftnet.org/cgit/selphy_print.git
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 3 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, see <https://www.gnu.org/licenses/>.
+ *
+ *   SPDX-License-Identifier: GPL-3.0+
+ *
+ */
+
+#ifndef __BACKEND_PIXFMT_H
+#define __BACKEND_PIXFMT_H
+
+#include <stdint.h>
+
+/* Each of these uses the fastest code the CPU supports, picked the
+   first time any of them is called.  PIXFMT_SIMD=0 forces plain C.
+   The results are the same either way. */
+
+/* Packed 3x8bpp to three 8bpp planes, inverting each sample (ie
+   RGB to CMY).  The first sample of each pixel goes to dst0. */
+void pixfmt_packed8_to_planar_inv(const uint8_t *src, uint8_t *dst0,
+				  uint8_t *dst1, uint8_t *dst2, uint32_t count);
+
+/* Packed 3x16bpp to three 16bpp planes, samples copied as-is */
+void pixfmt_packed16_to_planar(const uint16_t *src, uint16_t *dst0,
+			       uint16_t *dst1, uint16_t *dst2, uint32_t count);
+
+/* 8bpp rows of 'cols' samples through a 16bpp lookup table, each
+   written out with 'pad_l' and 'pad_r' zero samples either side */
+void pixfmt_lut8to16_pad(const uint8_t *src, uint16_t *dst,
+			 const uint16_t lut[256], uint32_t cols, uint32_t rows,
+			 uint32_t pad_l, uint32_t pad_r);
+
+#endif /* __BACKEND_PIXFMT_H */
@@ -1019,6 +1019,7 @@ static int shinkos1245_main_loop(void *vctx, const void *vjob) {
 	struct shinkos1245_ctx *ctx = vctx;
 	int i, num, last_state = -1, state = S_IDLE;
 	struct shinkos1245_resp_status status1, status2;
+	struct dyesub_poll poll;
 	int copies;
 
 	const struct sinfonia_printjob *job = vjob;
@@ -1047,6 +1048,7 @@ static int shinkos1245_main_loop(void *vctx, const void *vjob) {
 	if (copies > 9999) // XXX test against remaining media?
 		copies = 9999;
 
+	dyesub_poll_reset(&poll);
 top:
 	if (state != last_state) {
 		if (dyesub_debug)
@@ -1061,8 +1063,9 @@ top:
 	if (memcmp(&status1, &status2, sizeof(status1))) {
 		memcpy(&status2, &status1, sizeof(status1));
 		// status changed.
+		dyesub_poll_reset(&poll);
 	} else if (state == last_state) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	}
 
@@ -1072,7 +1075,7 @@ top:
 
 	last_state = state;
 
-	fflush(stderr);
+	dyesub_log_flush();
 
 	switch (state) {
 	case S_IDLE:
@@ -1123,7 +1126,7 @@ top:
 				if (i > 0) {
 					INFO("Can't set matte intensity when printing in progress...\n");
 					state = S_IDLE;
-					sleep(1);
+					dyesub_poll_sleep(&poll);
 					break;
 				}
 			}
@@ -1154,7 +1157,7 @@ top:
 		/* Check for buffer full state, and wait if we're full */
 		if (status1.code != CMD_CODE_OK) {
 			if (status1.print_status == STATUS_PRINTING) {
-				sleep(1);
+				dyesub_poll_sleep(&poll);
 				break;
 			} else {
 				goto printer_error;
@@ -938,6 +938,7 @@ static int shinkos2145_main_loop(void *vctx, const void *vjob) {
 	struct sinfonia_printjob *job = (struct sinfonia_printjob*) vjob;
 	struct sinfonia_cmd_hdr cmd;
 	struct s2145_status_resp sts, sts2;
+	struct dyesub_poll poll;
 
 	/* Validate print sizes */
 	for (i = 0; i < ctx->media.count ; i++) {
@@ -954,6 +955,7 @@ static int shinkos2145_main_loop(void *vctx, const void *vjob) {
 
 	// XXX check copies against remaining media!
 
+	dyesub_poll_reset(&poll);
 top:
 	if (state != last_state) {
 		if (dyesub_debug)
@@ -973,6 +975,7 @@ top:
 
 	if (memcmp(&sts, &sts2, sizeof(sts))) {
 		memcpy(&sts2, &sts, sizeof(sts));
+		dyesub_poll_reset(&poll);
 
 		INFO("Printer Status: 0x%02x (%s)\n",
 		     sts.hdr.status, sinfonia_status_str(sts.hdr.status));
@@ -987,12 +990,12 @@ top:
 		if (sts.hdr.error == ERROR_PRINTER)
 			goto printer_error;
 	} else if (state == last_state) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	}
 	last_state = state;
 
-	fflush(stderr);
+	dyesub_log_flush();
 
 	switch (state) {
 	case S_IDLE:
@@ -38,6 +38,7 @@
 
 #include "backend_common.h"
 #include "backend_sinfonia.h"
+#include "backend_pixfmt.h"
 
 #include <time.h>
 
@@ -48,6 +49,8 @@
 /* Image processing library function prototypes */
 typedef int (*ImageProcessingFN)(unsigned char *, unsigned short *, void *);
 typedef int (*ImageAvrCalcFN)(unsigned char *, unsigned short, unsigned short, unsigned char *);
+typedef int (*ImageProcessingStreamFN)(unsigned char *, void *, void *,
+				       int (*callback_fn)(void *context, void *buffer, uint32_t len));
 
 #define LIB_NAME    "libS6145ImageProcess" DLL_SUFFIX    // Official library
 #define LIB_NAME_RE "libS6145ImageReProcess" DLL_SUFFIX // Reimplemented library
@@ -522,6 +525,31 @@ struct s6145_imagecorr_data {
 	uint8_t  data[16];
 } __attribute__((packed));
 
+/* On-disk cache of the correction data and EEPROM.  Both only change
+   with the firmware and print tables, which FWINFO reports the version
+   and CRC of, so they're used to validate the cache instead of pulling
+   the whole lot over USB again for every job. */
+#define S6145_CACHE_MAGIC   0x43353436  /* "645C" */
+#define S6145_CACHE_VERSION 1
+
+struct s6145_cache_fw {
+	uint8_t  major;
+	uint8_t  minor;
+	uint16_t checksum;
+} __attribute__((packed));
+
+struct s6145_cache_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t corrdatalen;
+	uint16_t eepromlen;
+	uint8_t  media;
+	uint8_t  type;
+	uint32_t oc_mode;
+	struct s6145_cache_fw fw[2];  /* Main app, print tables */
+	uint32_t sum;  /* Of the correction data and EEPROM that follow */
+} __attribute__((packed));
+
 /* Private data structure */
 struct shinkos6145_ctx {
 	struct sinfonia_usbdev dev;
@@ -542,10 +570,15 @@ struct shinkos6145_ctx {
 
 	void *dl_handle;
 	ImageProcessingFN ImageProcessing;
+	ImageProcessingFN ImageProcessingParallel;
+	ImageProcessingStreamFN ImageProcessingStream;
 	ImageAvrCalcFN ImageAvrCalc;
 
 	struct shinkos6145_correctionparam *corrdata;
 	uint16_t corrdatalen;
+
+	struct s6145_cache_fw cache_fw[2];
+	int cache_fw_valid;
 };
 
 static int shinkos6145_get_imagecorr(struct shinkos6145_ctx *ctx);
@@ -840,6 +873,183 @@ done:
 	return ret;
 }
 
+static uint32_t shinkos6145_cache_sum(const uint8_t *buf, size_t len, uint32_t sum)
+{
+	while (len--)
+		sum = (sum << 5) + sum + *buf++;
+
+	return sum;
+}
+
+/* Works out the cache file name and the firmware versions it is
+   validated against.  Returns nonzero if the cache can't be used. */
+static int shinkos6145_cache_key(struct shinkos6145_ctx *ctx, uint32_t oc_mode,
+				 char *fname, size_t fnamelen)
+{
+	static const uint8_t targets[2] = { FWINFO_TARGET_MAIN_APP,
+					    FWINFO_TARGET_PRINT_TABLES };
+	struct stat st;
+	int i;
+
+	if (!state_path || !*state_path)
+		return -1;
+
+	/* Anyone else able to write here could feed us bogus tables */
+	if (stat(state_path, &st) || !S_ISDIR(st.st_mode) ||
+	    st.st_uid != geteuid() || (st.st_mode & S_IWOTH)) {
+		DEBUG("Not using cache directory '%s' (missing, or not ours)\n", state_path);
+		return -1;
+	}
+
+	if (!ctx->serial[0] &&
+	    sinfonia_query_serno(ctx->dev.dev, ctx->dev.endp_up,
+				 ctx->dev.endp_down, ctx->dev.iface,
+				 ctx->serial, sizeof(ctx->serial)))
+		return -1;
+	if (!ctx->serial[0] || strchr(ctx->serial, '/'))
+		return -1;
+
+	for (i = 0 ; !ctx->cache_fw_valid && i < 2 ; i++) {
+		struct sinfonia_fwinfo_cmd  fcmd;
+		struct sinfonia_fwinfo_resp resp;
+		int num = 0;
+
+		fcmd.hdr.cmd = cpu_to_le16(SINFONIA_CMD_FWINFO);
+		fcmd.hdr.len = cpu_to_le16(1);
+		fcmd.target = targets[i];
+
+		if (sinfonia_docmd(&ctx->dev,
+				   (uint8_t*)&fcmd, sizeof(fcmd),
+				   (uint8_t*)&resp, sizeof(resp),
+				   &num))
+			return -1;
+		if (le16_to_cpu(resp.hdr.payload_len) != (sizeof(struct sinfonia_fwinfo_resp) - sizeof(struct sinfonia_status_hdr)))
+			return -1;
+
+		ctx->cache_fw[i].major = resp.major;
+		ctx->cache_fw[i].minor = resp.minor;
+		ctx->cache_fw[i].checksum = le16_to_cpu(resp.checksum);
+		if (i == 1)
+			ctx->cache_fw_valid = 1;
+	}
+
+	snprintf(fname, fnamelen, "%s/shinkos6145-%s-%u-%02x.cache",
+		 state_path, ctx->serial, oc_mode, ctx->media.ribbon_code);
+
+	return 0;
+}
+
+/* Fill in the correction data and EEPROM from the cache, if it is
+   there and still matches the printer.  Returns nonzero otherwise. */
+static int shinkos6145_cache_load(struct shinkos6145_ctx *ctx, uint32_t oc_mode)
+{
+	struct s6145_cache_hdr hdr;
+	struct shinkos6145_correctionparam *corrdata;
+	uint8_t eeprom[sizeof(((struct s6145_geteeprom_resp *)0)->data)];
+	char fname[1024];
+	int fd, ok;
+
+	if (shinkos6145_cache_key(ctx, oc_mode, fname, sizeof(fname)))
+		return -1;
+
+	fd = open(fname, O_RDONLY|O_NOFOLLOW);
+	if (fd < 0)
+		return -1;
+
+	corrdata = malloc(sizeof(*corrdata));
+	if (!corrdata) {
+		close(fd);
+		return -1;
+	}
+
+	ok = read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+		hdr.magic == S6145_CACHE_MAGIC &&
+		hdr.version == S6145_CACHE_VERSION &&
+		hdr.type == ctx->dev.type &&
+		hdr.media == ctx->media.ribbon_code &&
+		hdr.oc_mode == oc_mode &&
+		!memcmp(hdr.fw, ctx->cache_fw, sizeof(hdr.fw)) &&
+		hdr.corrdatalen && hdr.corrdatalen <= sizeof(*corrdata) &&
+		hdr.eepromlen && hdr.eepromlen <= sizeof(eeprom) &&
+		read(fd, corrdata, sizeof(*corrdata)) == sizeof(*corrdata) &&
+		read(fd, eeprom, hdr.eepromlen) == hdr.eepromlen &&
+		hdr.sum == shinkos6145_cache_sum(eeprom, hdr.eepromlen,
+						 shinkos6145_cache_sum((uint8_t*)corrdata, sizeof(*corrdata), 5381));
+	close(fd);
+
+	if (!ok) {
+		DEBUG("Ignoring stale or damaged cache '%s'\n", fname);
+		free(corrdata);
+		return -1;
+	}
+
+	if (ctx->eeprom)
+		free(ctx->eeprom);
+	ctx->eeprom = malloc(hdr.eepromlen);
+	if (!ctx->eeprom) {
+		free(corrdata);
+		return -1;
+	}
+	memcpy(ctx->eeprom, eeprom, hdr.eepromlen);
+	ctx->eepromlen = hdr.eepromlen;
+
+	if (ctx->corrdata)
+		free(ctx->corrdata);
+	ctx->corrdata = corrdata;
+	ctx->corrdatalen = hdr.corrdatalen;
+
+	INFO("Using cached image correction data\n");
+
+	return 0;
+}
+
+/* Failing to save the cache isn't fatal; we just fetch it again next time */
+static void shinkos6145_cache_save(struct shinkos6145_ctx *ctx, uint32_t oc_mode)
+{
+	struct s6145_cache_hdr hdr;
+	char fname[1024], tmpname[1040];
+	int fd, ok;
+
+	if (!ctx->corrdata || !ctx->eeprom)
+		return;
+	if (state_path && *state_path)
+		mkdir(state_path, S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH);
+	if (shinkos6145_cache_key(ctx, oc_mode, fname, sizeof(fname)))
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = S6145_CACHE_MAGIC;
+	hdr.version = S6145_CACHE_VERSION;
+	hdr.corrdatalen = ctx->corrdatalen;
+	hdr.eepromlen = ctx->eepromlen;
+	hdr.media = ctx->media.ribbon_code;
+	hdr.type = ctx->dev.type;
+	hdr.oc_mode = oc_mode;
+	memcpy(hdr.fw, ctx->cache_fw, sizeof(hdr.fw));
+	hdr.sum = shinkos6145_cache_sum(ctx->eeprom, ctx->eepromlen,
+					shinkos6145_cache_sum((uint8_t*)ctx->corrdata, sizeof(*ctx->corrdata), 5381));
+
+	/* Written aside and renamed into place, so other jobs never see
+	   a partial file */
+	snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", fname);
+	fd = mkstemp(tmpname);
+	if (fd < 0) {
+		DEBUG("Unable to write cache '%s'\n", tmpname);
+		return;
+	}
+	fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+		write(fd, ctx->corrdata, sizeof(*ctx->corrdata)) == sizeof(*ctx->corrdata) &&
+		write(fd, ctx->eeprom, ctx->eepromlen) == (ssize_t)ctx->eepromlen;
+	if (close(fd))
+		ok = 0;
+
+	if (!ok || rename(tmpname, fname)) {
+		DEBUG("Unable to write cache '%s'\n", fname);
+		unlink(tmpname);
+	}
+}
+
 static void shinkos6145_cmdline(void)
 {
 	DEBUG("\t\t[ -c filename ]  # Get user/NV tone curve\n");
@@ -989,6 +1199,9 @@ static int shinkos6145_attach(void *vctx, struct libusb_device_handle *dev, int
 	if (ctx->dl_handle) {
 		ctx->ImageProcessing = DL_SYM(ctx->dl_handle, "ImageProcessing");
 		ctx->ImageAvrCalc = DL_SYM(ctx->dl_handle, "ImageAvrCalc");
+		/* Only in the reimplemented library; optional */
+		ctx->ImageProcessingParallel = DL_SYM(ctx->dl_handle, "ImageProcessingParallel");
+		ctx->ImageProcessingStream = DL_SYM(ctx->dl_handle, "ImageProcessingStream");
 		if (!ctx->ImageProcessing || !ctx->ImageAvrCalc) {
 			WARNING("Problem resolving symbols in imaging processing library\n");
 			DL_CLOSE(ctx->dl_handle);
@@ -1068,56 +1281,31 @@ static void lib6145_process_image(uint8_t *src, uint16_t *dest,
 				  struct shinkos6145_correctionparam *corrdata,
 				  uint8_t oc_mode)
 {
+	const void *tables[3] = { corrdata->pulseTransTable_Y,
+				  corrdata->pulseTransTable_M,
+				  corrdata->pulseTransTable_C };
+	uint16_t lut[256];
 	uint32_t in, out;
 
-	uint16_t pad_l, pad_r, row_lim;
+	uint16_t pad_l, pad_r, row_lim, width, height;
 	uint16_t row, col;
+	int plane;
 
 	row_lim = le16_to_cpu(corrdata->headDots);
-	pad_l = (row_lim - le16_to_cpu(corrdata->width)) / 2;
-	pad_r = pad_l + le16_to_cpu(corrdata->width);
+	width = le16_to_cpu(corrdata->width);
+	height = le16_to_cpu(corrdata->height);
+	pad_l = (row_lim - width) / 2;
+	pad_r = pad_l + width;
 	out = 0;
 	in = 0;
 
 	/* Convert YMC 8-bit to 16-bit, and pad appropriately to full stripe */
-	for (row = 0 ; row < le16_to_cpu(corrdata->height) ; row++) {
-		for (col = 0 ; col < row_lim; col++) {
-			uint16_t val;
-			if (col < pad_l) {
-				val = 0;
-			} else if (col < pad_r) {
-				val = corrdata->pulseTransTable_Y[src[in++]];
-			} else {
-				val = 0;
-			}
-			dest[out++] = val;
-		}
-	}
-	for (row = 0 ; row < le16_to_cpu(corrdata->height) ; row++) {
-		for (col = 0 ; col < row_lim; col++) {
-			uint16_t val;
-			if (col < pad_l) {
-				val = 0;
-			} else if (col < pad_r) {
-				val = corrdata->pulseTransTable_M[src[in++]];
-			} else {
-				val = 0;
-			}
-			dest[out++] = val;
-		}
-	}
-	for (row = 0 ; row < le16_to_cpu(corrdata->height) ; row++) {
-		for (col = 0 ; col < row_lim; col++) {
-			uint16_t val;
-			if (col < pad_l) {
-				val = 0;
-			} else if (col < pad_r) {
-				val = corrdata->pulseTransTable_C[src[in++]];
-			} else {
-				val = 0;
-			}
-			dest[out++] = val;
-		}
+	for (plane = 0 ; plane < 3 ; plane++) {
+		memcpy(lut, tables[plane], sizeof(lut)); /* Packed struct */
+		pixfmt_lut8to16_pad(src + in, dest + out, lut,
+				    width, height, pad_l, row_lim - pad_r);
+		in += width * height;
+		out += row_lim * height;
 	}
 
 	/* Generate lamination plane, if desired */
@@ -1200,23 +1388,18 @@ static int shinkos6145_read_parse(void *vctx, const void **vjob, int data_fd, in
 	if (!input_ymc) {
 		INFO("Converting Packed RGB to Planar YMC\n");
 		int planelen = job->jp.columns * job->jp.rows;
-		uint8_t *databuf3 = malloc(job->datalen);
-		int i;
+		uint8_t *databuf3 = dyesub_buf_alloc(job->datalen);
 		if (!databuf3) {
 			ERROR("Memory allocation failure!\n");
 			sinfonia_cleanup_job(job);
 			return CUPS_BACKEND_RETRY_CURRENT;
 		}
-		for (i = 0 ; i < planelen ; i++) {
-			uint8_t r, g, b;
-			r = job->databuf[3*i];
-			g = job->databuf[3*i+1];
-			b = job->databuf[3*i+2];
-			databuf3[i] = 255 - b;
-			databuf3[planelen + i] = 255 - g;
-			databuf3[planelen + planelen + i] = 255 - r;
-		}
-		free(job->databuf);
+		/* ie R into the C plane, G into M, B into Y */
+		pixfmt_packed8_to_planar_inv(job->databuf,
+					     databuf3 + planelen + planelen,
+					     databuf3 + planelen,
+					     databuf3, planelen);
+		dyesub_buf_free(job->databuf);
 		job->databuf = databuf3;
 	}
 
@@ -1275,7 +1458,7 @@ static void *shinkos6145_combine_jobs(const void *vjob1,
 	newjob->jp.method = PRINT_METHOD_SPLIT;
 
 	/* Allocate new buffer */
-	newjob->databuf = malloc(newjob->jp.rows * newjob->jp.columns * 3);
+	newjob->databuf = dyesub_buf_alloc(newjob->jp.rows * newjob->jp.columns * 3);
 	newjob->datalen = 0;
 	if (!newjob->databuf) {
 		sinfonia_cleanup_job(newjob);
@@ -1318,15 +1501,26 @@ done:
 	return newjob;
 }
 
+/* Processed image data straight from the library as it is generated */
+static int shinkos6145_stream_callback(void *context, void *buffer, uint32_t len)
+{
+	struct shinkos6145_ctx *ctx = context;
+
+	return send_data(ctx->dev.dev, ctx->dev.endp_down, buffer, len);
+}
+
 static int shinkos6145_main_loop(void *vctx, const void *vjob) {
 	struct shinkos6145_ctx *ctx = vctx;
 
 	int ret, num;
+	int stream;
 
 	int i, last_state = -1, state = S_IDLE;
 
 	struct sinfonia_cmd_hdr cmd;
 	struct s6145_status_resp sts, sts2;
+	struct dyesub_poll poll;
+	uint64_t timing;
 
 	uint32_t cur_mode;
 
@@ -1358,6 +1552,7 @@ static int shinkos6145_main_loop(void *vctx, const void *vjob) {
 		return ret;
 	}
 
+	dyesub_poll_reset(&poll);
 top:
 	if (state != last_state) {
 		if (dyesub_debug)
@@ -1377,6 +1572,7 @@ top:
 
 	if (memcmp(&sts, &sts2, sizeof(sts))) {
 		memcpy(&sts2, &sts, sizeof(sts));
+		dyesub_poll_reset(&poll);
 
 		INFO("Printer Status: 0x%02x (%s)\n",
 		     sts.hdr.status, sinfonia_status_str(sts.hdr.status));
@@ -1391,12 +1587,12 @@ top:
 		if (sts.hdr.status == ERROR_PRINTER)
 			goto printer_error;
 	} else if (state == last_state) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	}
 	last_state = state;
 
-	fflush(stderr);
+	dyesub_log_flush();
 
 	switch (state) {
 	case S_IDLE:
@@ -1423,7 +1619,7 @@ top:
 			if (sts.bank1_status != BANK_STATUS_FREE ||
 			    sts.bank2_status != BANK_STATUS_FREE) {
 				INFO("Need to switch overcoat mode, waiting for printer idle\n");
-				sleep(1);
+				dyesub_poll_sleep(&poll);
 				goto top;
 			}
 			ret = sinfonia_setparam(&ctx->dev, PARAM_OC_PRINT, oc_mode);
@@ -1434,52 +1630,72 @@ top:
 			updated = 1;
 		}
 
-		ret = shinkos6145_get_eeprom(ctx);
-		if (ret) {
-			ERROR("Failed to execute command\n");
-			return ret;
-		}
-
-		/* Get image correction parameters if necessary */
-		if (updated || !ctx->corrdata || !ctx->corrdatalen) {
-			ret = shinkos6145_get_imagecorr(ctx);
-			if (ret) {
-				ERROR("Failed to execute command\n");
-				return ret;
+		/* Get image correction parameters and EEPROM if necessary,
+		   from the on-disk cache if it's still valid */
+		if (updated || !ctx->corrdata || !ctx->corrdatalen ||
+		    !ctx->eeprom) {
+			if (shinkos6145_cache_load(ctx, oc_mode)) {
+				ret = shinkos6145_get_eeprom(ctx);
+				if (ret) {
+					ERROR("Failed to execute command\n");
+					return ret;
+				}
+				ret = shinkos6145_get_imagecorr(ctx);
+				if (ret) {
+					ERROR("Failed to execute command\n");
+					return ret;
+				}
+				shinkos6145_cache_save(ctx, oc_mode);
 			}
 		}
 
-		/* Set up library transform... */
-		uint32_t newlen = le16_to_cpu(ctx->corrdata->headDots) *
-			job->jp.rows * sizeof(uint16_t) * 4;
-		uint16_t *databuf2 = malloc(newlen);
-
 		/* Set the size in the correctiondata */
 		ctx->corrdata->width = cpu_to_le16(job->jp.columns);
 		ctx->corrdata->height = cpu_to_le16(job->jp.rows);
 
+		/* If the library can hand over its output as it goes, hold
+		   off until the printer has accepted the job, then stream
+		   it straight out.  The print command only needs the
+		   averages, and the job's input stays intact for retries. */
+		stream = ctx->dl_handle && ctx->ImageProcessingStream;
 
 		/* Perform the actual library transform */
+		timing = dyesub_timing_start();
 		if (ctx->dl_handle) {
 			INFO("Calling image processing library...\n");
+			dyesub_log_flush(); /* It writes to stderr directly */
 
 			if (ctx->ImageAvrCalc(job->databuf, job->jp.columns, job->jp.rows, ctx->image_avg)) {
-				free(databuf2);
 				ERROR("Library returned error!\n");
 				return CUPS_BACKEND_FAILED;
 			}
-			ctx->ImageProcessing(job->databuf, databuf2, ctx->corrdata);
 		} else {
 			WARNING("Utilizing fallback internal image processing code\n");
 			WARNING(" *** Output quality will be poor! *** \n");
 
 			lib6145_calc_avg(ctx, job, job->jp.columns, job->jp.rows);
-			lib6145_process_image(job->databuf, databuf2, ctx->corrdata, oc_mode);
 		}
 
-		free(job->databuf);
-		job->databuf = (uint8_t*) databuf2;
-		job->datalen = newlen;
+		if (!stream) {
+			/* Set up library transform... */
+			uint32_t newlen = le16_to_cpu(ctx->corrdata->headDots) *
+				job->jp.rows * sizeof(uint16_t) * 4;
+			uint16_t *databuf2 = dyesub_buf_alloc(newlen);
+
+			if (ctx->dl_handle) {
+				if (ctx->ImageProcessingParallel)
+					ctx->ImageProcessingParallel(job->databuf, databuf2, ctx->corrdata);
+				else
+					ctx->ImageProcessing(job->databuf, databuf2, ctx->corrdata);
+			} else {
+				lib6145_process_image(job->databuf, databuf2, ctx->corrdata, oc_mode);
+			}
+
+			dyesub_buf_free(job->databuf);
+			job->databuf = (uint8_t*) databuf2;
+			job->datalen = newlen;
+		}
+		dyesub_timing_stop(TIMING_EFFECT, timing);
 
 
 		INFO("Sending print job (internal id %u)\n", ctx->jobid);
@@ -1549,9 +1765,20 @@ top:
 		INFO("Sending image data to printer\n");
 		// XXX we shouldn't send the lamination layer over if
 		// it's not needed.  hdr->oc_mode == PRINT_MODE_NO_OC
-		if ((ret = send_data(ctx->dev.dev, ctx->dev.endp_down,
-				     job->databuf, job->datalen)))
+		if (stream) {
+			dyesub_log_flush();
+			timing = dyesub_timing_start();
+			ret = ctx->ImageProcessingStream(job->databuf, ctx->corrdata,
+							 ctx, shinkos6145_stream_callback);
+			dyesub_timing_stop(TIMING_EFFECT, timing);
+			if (ret) {
+				ERROR("Library returned error!\n");
+				return CUPS_BACKEND_FAILED;
+			}
+		} else if ((ret = send_data(ctx->dev.dev, ctx->dev.endp_down,
+					    job->databuf, job->datalen))) {
 			return CUPS_BACKEND_FAILED;
+		}
 
 		INFO("Waiting for printer to acknowledge completion\n");
 		sleep(1);
@@ -1650,10 +1877,8 @@ static int shinkos6145_query_stats(void *vctx,  struct printerstats *stats)
 	/* Query USB ID */
 	{
 		struct libusb_device_descriptor desc;
-		struct libusb_device *dev;
 
-		dev = libusb_get_device(ctx->dev.dev);
-		libusb_get_device_descriptor(dev, &desc);
+		dyesub_get_device_descriptor(ctx->dev.dev, &desc);
 
 		usbID = desc.idProduct;
 	}
@@ -1037,7 +1037,7 @@ static int shinkos6245_read_parse(void *vctx, const void **vjob, int data_fd, in
 
 	/* Common read/parse code */
 	if (ctx->dev.type == P_KODAK_8810) {
-		ret = sinfonia_raw18_read_parse(data_fd, job);
+		ret = sinfonia_raw18_read_parse(data_fd, job, copies);
 	} else {
 		ret = sinfonia_read_parse(data_fd, 6245, job);
 	}
@@ -1125,6 +1125,7 @@ static int shinkos6245_main_loop(void *vctx, const void *vjob) {
 	struct sinfonia_cmd_hdr *cmd = (struct sinfonia_cmd_hdr *) cmdbuf;;
 	struct s6245_print_cmd *print = (struct s6245_print_cmd *) cmdbuf;
 	struct s6245_status_resp sts, sts2;
+	struct dyesub_poll poll;
 	struct sinfonia_status_hdr resp;
 
 	struct sinfonia_printjob *job = (struct sinfonia_printjob*) vjob;
@@ -1240,6 +1241,7 @@ static int shinkos6245_main_loop(void *vctx, const void *vjob) {
 
 	// XXX check copies against remaining media!
 
+	dyesub_poll_reset(&poll);
 top:
 	if (state != last_state) {
 		if (dyesub_debug)
@@ -1260,6 +1262,7 @@ top:
 
 	if (memcmp(&sts2, &sts, sizeof(sts))) {
 		memcpy(&sts2, &sts, sizeof(sts));
+		dyesub_poll_reset(&poll);
 
 		INFO("Printer Status: 0x%02x (%s)\n",
 		     sts.hdr.status, sinfonia_status_str(sts.hdr.status));
@@ -1274,12 +1277,12 @@ top:
 		if (sts.hdr.error == ERROR_PRINTER)
 			goto printer_error;
 	} else if (state == last_state) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	}
 	last_state = state;
 
-	fflush(stderr);
+	dyesub_log_flush();
 
 	switch (state) {
 	case S_IDLE:
@@ -1351,8 +1354,13 @@ top:
 		}
 
 		INFO("Sending image data to printer\n");
-		if ((ret = send_data(ctx->dev.dev, ctx->dev.endp_down,
-				     job->databuf, job->datalen)))
+		if (job->streaming)
+			ret = dyesub_stream_send(ctx->dev.dev, ctx->dev.endp_down,
+						 NULL, 0, job->datalen);
+		else
+			ret = send_data(ctx->dev.dev, ctx->dev.endp_down,
+					job->databuf, job->datalen);
+		if (ret)
 			return CUPS_BACKEND_FAILED;
 
 		INFO("Waiting for printer to acknowledge completion\n");
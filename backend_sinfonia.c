@@ -27,6 +27,41 @@
 #include "backend_common.h"
 #include "backend_sinfonia.h"
 
+/* Borrow the payload straight from the spool if possible, else read it */
+static int sinfonia_read_payload(int data_fd, struct sinfonia_printjob *job)
+{
+	int remain = job->datalen;
+	uint8_t *ptr;
+	int ret;
+
+	job->databuf = dyesub_spool_borrow(data_fd, 0, job->datalen);
+	if (job->databuf)
+		return CUPS_BACKEND_OK;
+
+	job->databuf = dyesub_buf_alloc(job->datalen);
+	if (!job->databuf) {
+		ERROR("Memory allocation failure!\n");
+		return CUPS_BACKEND_RETRY_CURRENT;
+	}
+
+	ptr = job->databuf;
+	do {
+		ret = read(data_fd, ptr, remain);
+		if (ret <= 0) {
+			ERROR("Read failed (%d/%d/%d)\n",
+			      ret, remain, job->datalen);
+			ERROR("Read failed: %s\n", strerror(errno));
+			dyesub_buf_free(job->databuf);
+			job->databuf = NULL;
+			return CUPS_BACKEND_CANCEL;
+		}
+		ptr += ret;
+		remain -= ret;
+	} while (remain);
+
+	return CUPS_BACKEND_OK;
+}
+
 int sinfonia_read_parse(int data_fd, uint32_t model,
 			struct sinfonia_printjob *job)
 {
@@ -41,7 +76,7 @@ int sinfonia_read_parse(int data_fd, uint32_t model,
 			return CUPS_BACKEND_CANCEL;
 		ERROR("Read failed (%d/%d)\n",
 		      ret, SINFONIA_HDR_LEN);
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		return ret;
 	}
 
@@ -69,37 +104,17 @@ int sinfonia_read_parse(int data_fd, uint32_t model,
 
 	/* Work out data length */
 	job->datalen = hdr[13] * hdr[14] * 3;
-	job->databuf = malloc(job->datalen);
-	if (!job->databuf) {
-		ERROR("Memory allocation failure!\n");
-		return CUPS_BACKEND_RETRY_CURRENT;
-	}
 
 	/* Read in payload data */
-	{
-		uint32_t remain = job->datalen;
-		uint8_t *ptr = job->databuf;
-		do {
-			ret = read(data_fd, ptr, remain);
-			if (ret < 0) {
-				ERROR("Read failed (%d/%u/%d)\n",
-				      ret, remain, job->datalen);
-				perror("ERROR: Read failed");
-				free(job->databuf);
-				job->databuf = NULL;
-				return ret;
-			}
-			ptr += ret;
-			remain -= ret;
-		} while (remain);
-	}
+	if ((ret = sinfonia_read_payload(data_fd, job)))
+		return ret;
 
 	/* Make sure footer is sane too */
 	ret = read(data_fd, tmpbuf, 4);
 	if (ret != 4) {
 		ERROR("Read failed (%d/%d)\n", ret, 4);
-		perror("ERROR: Read failed");
-		free(job->databuf);
+		ERROR("Read failed: %s\n", strerror(errno));
+		dyesub_buf_free(job->databuf);
 		job->databuf = NULL;
 		return ret;
 	}
@@ -108,7 +123,7 @@ int sinfonia_read_parse(int data_fd, uint32_t model,
 	    tmpbuf[2] != 0x02 ||
 	    tmpbuf[3] != 0x01) {
 		ERROR("Unrecognized footer data format!\n");
-		free (job->databuf);
+		dyesub_buf_free(job->databuf);
 		job->databuf = NULL;
 		return CUPS_BACKEND_CANCEL;
 	}
@@ -137,7 +152,8 @@ int sinfonia_read_parse(int data_fd, uint32_t model,
 	return CUPS_BACKEND_OK;
 }
 
-int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job)
+int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job,
+			      int copies)
 {
 	struct sinfonia_printcmd10_hdr hdr;
 	int ret;
@@ -149,7 +165,7 @@ int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job)
 			return CUPS_BACKEND_CANCEL;
 		ERROR("Read failed (%d/%d/%d)\n",
 		      ret, 0, (int)sizeof(hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		return CUPS_BACKEND_CANCEL;
 	}
 	/* Validate header */
@@ -165,7 +181,7 @@ int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job)
 	job->jp.oc_mode = hdr.oc_mode;
 	job->jp.method = hdr.method;
 
-	/* Allocate buffer */
+	/* Work out payload length */
 	job->datalen = job->jp.rows * job->jp.columns * 3;
 
 	/* Hack in backprinting */
@@ -175,32 +191,20 @@ int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job)
 		job->jp.ext_flags = EXT_FLAG_BACKPRINT;
 	}
 
-	job->databuf = malloc(job->datalen);
-	if (!job->databuf) {
-		ERROR("Memory allocation failure!\n");
-		return CUPS_BACKEND_RETRY_CURRENT;
-	}
-
-	{
-		int remain = job->datalen;
-		uint8_t *ptr = job->databuf;
-		do {
-			ret = read(data_fd, ptr, remain);
-			if (ret < 0) {
-				ERROR("Read failed (%d/%d/%d)\n",
-				      ret, remain, job->datalen);
-				perror("ERROR: Read failed");
-				return CUPS_BACKEND_CANCEL;
-			}
-			ptr += ret;
-			remain -= ret;
-		} while (remain);
+	/* Backprint text is parsed on the host, everything else isn't.
+	   Multiple copies may need the payload more than once. */
+	if (!(job->jp.ext_flags & EXT_FLAG_BACKPRINT) &&
+	    copies == 1 && job->jp.copies <= 1 &&
+	    dyesub_stream_open(data_fd, job->datalen)) {
+		job->streaming = 1;
+		return CUPS_BACKEND_OK;
 	}
 
-	return CUPS_BACKEND_OK;
+	return sinfonia_read_payload(data_fd, job);
 }
 
-int sinfonia_raw18_read_parse(int data_fd, struct sinfonia_printjob *job)
+int sinfonia_raw18_read_parse(int data_fd, struct sinfonia_printjob *job,
+			      int copies)
 {
 	struct sinfonia_printcmd18_hdr hdr;
 	int ret;
@@ -212,7 +216,7 @@ int sinfonia_raw18_read_parse(int data_fd, struct sinfonia_printjob *job)
 			return CUPS_BACKEND_CANCEL;
 		ERROR("Read failed (%d/%d/%d)\n",
 		      ret, 0, (int)sizeof(hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		return CUPS_BACKEND_CANCEL;
 	}
 	/* Validate header */
@@ -228,31 +232,17 @@ int sinfonia_raw18_read_parse(int data_fd, struct sinfonia_printjob *job)
 	job->jp.oc_mode = hdr.oc_mode;
 	job->jp.method = hdr.method;
 
-	/* Allocate buffer */
+	/* Read in payload, or leave it to be forwarded as it arrives
+	   if it is only going to be needed once */
 	job->datalen = job->jp.rows * job->jp.columns * 3;
-	job->databuf = malloc(job->datalen);
-	if (!job->databuf) {
-		ERROR("Memory allocation failure!\n");
-		return CUPS_BACKEND_RETRY_CURRENT;
-	}
 
-	{
-		int remain = job->datalen;
-		uint8_t *ptr = job->databuf;
-		do {
-			ret = read(data_fd, ptr, remain);
-			if (ret < 0) {
-				ERROR("Read failed (%d/%d/%d)\n",
-				      ret, remain, job->datalen);
-				perror("ERROR: Read failed");
-				return CUPS_BACKEND_CANCEL;
-			}
-			ptr += ret;
-			remain -= ret;
-		} while (remain);
+	if (copies == 1 && job->jp.copies <= 1 &&
+	    dyesub_stream_open(data_fd, job->datalen)) {
+		job->streaming = 1;
+		return CUPS_BACKEND_OK;
 	}
 
-	return CUPS_BACKEND_OK;
+	return sinfonia_read_payload(data_fd, job);
 }
 
 int sinfonia_raw28_read_parse(int data_fd, struct sinfonia_printjob *job)
@@ -267,7 +257,7 @@ int sinfonia_raw28_read_parse(int data_fd, struct sinfonia_printjob *job)
 			return CUPS_BACKEND_CANCEL;
 		ERROR("Read failed (%d/%d/%d)\n",
 		      ret, 0, (int)sizeof(hdr));
-		perror("ERROR: Read failed");
+		ERROR("Read failed: %s\n", strerror(errno));
 		return CUPS_BACKEND_CANCEL;
 	}
 	/* Validate header */
@@ -284,31 +274,10 @@ int sinfonia_raw28_read_parse(int data_fd, struct sinfonia_printjob *job)
 	job->jp.quality = hdr.options & 0x08;
 	job->jp.method = hdr.method;
 
-	/* Allocate buffer */
+	/* Read in payload */
 	job->datalen = job->jp.rows * job->jp.columns * 3;
-	job->databuf = malloc(job->datalen);
-	if (!job->databuf) {
-		ERROR("Memory allocation failure!\n");
-		return CUPS_BACKEND_RETRY_CURRENT;
-	}
-
-	{
-		int remain = job->datalen;
-		uint8_t *ptr = job->databuf;
-		do {
-			ret = read(data_fd, ptr, remain);
-			if (ret < 0) {
-				ERROR("Read failed (%d/%d/%d)\n",
-				      ret, remain, job->datalen);
-				perror("ERROR: Read failed");
-				return CUPS_BACKEND_CANCEL;
-			}
-			ptr += ret;
-			remain -= ret;
-		} while (remain);
-	}
 
-	return CUPS_BACKEND_OK;
+	return sinfonia_read_payload(data_fd, job);
 }
 
 void sinfonia_cleanup_job(const void *vjob)
@@ -316,7 +285,9 @@ void sinfonia_cleanup_job(const void *vjob)
 	const struct sinfonia_printjob *job = vjob;
 
 	if (job->databuf)
-		free(job->databuf);
+		dyesub_buf_free(job->databuf);
+	if (job->streaming)
+		dyesub_stream_close();
 
 	free((void*)job);
 }
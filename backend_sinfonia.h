@@ -60,13 +60,16 @@ struct sinfonia_printjob {
 
 	uint8_t *databuf;
 	int datalen;
+	int streaming; /* Payload is still in the spool */
 };
 
 int sinfonia_read_parse(int data_fd, uint32_t model,
 			struct sinfonia_printjob *job);
 
-int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job);
-int sinfonia_raw18_read_parse(int data_fd, struct sinfonia_printjob *job);
+int sinfonia_raw10_read_parse(int data_fd, struct sinfonia_printjob *job,
+			      int copies);
+int sinfonia_raw18_read_parse(int data_fd, struct sinfonia_printjob *job,
+			      int copies);
 int sinfonia_raw28_read_parse(int data_fd, struct sinfonia_printjob *job);
 void sinfonia_cleanup_job(const void *vjob);
 
@@ -402,6 +402,7 @@ static int upd_read_parse(void *vctx, const void **vjob, int data_fd, int copies
 
 static int upd_main_loop(void *vctx, const void *vjob) {
 	struct upd_ctx *ctx = vctx;
+	struct dyesub_poll poll;
 	int i, ret;
 	int copies;
 
@@ -414,6 +415,7 @@ static int upd_main_loop(void *vctx, const void *vjob) {
 
 	copies = job->copies;
 
+	dyesub_poll_reset(&poll);
 top:
 	/* Send Unknown CMD.  Resets? */
 	if (ctx->type == P_SONY_UPD897) {
@@ -444,7 +446,7 @@ top:
 	if (ctx->stsbuf.sts1 != 0x00) {
 		if (ctx->stsbuf.sts1 == 0x80) {
 			INFO("Waiting for printer idle...\n");
-			sleep(1);
+			dyesub_poll_sleep(&poll);
 			goto top;
 		}
 	}
@@ -485,8 +487,10 @@ top:
 	// 1b ee 00 00 00 02 00  NN NN  (BE)
 
 	/* Wait for completion! */
+	dyesub_poll_reset(&poll);
+	dyesub_poll_eta(&poll, 1000);
 retry:
-	sleep(1);
+	dyesub_poll_sleep(&poll);
 
 	/* Check for idle */
 	ret = sony_get_status(ctx, &ctx->stsbuf);
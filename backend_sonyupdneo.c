@@ -455,6 +455,7 @@ static void updneo_dump_status(struct updneo_sts *sts)
 
 static int updneo_main_loop(void *vctx, const void *vjob) {
 	struct updneo_ctx *ctx = vctx;
+	struct dyesub_poll poll;
 	int ret;
 	int copies;
 
@@ -467,6 +468,7 @@ static int updneo_main_loop(void *vctx, const void *vjob) {
 
 	copies = job->copies;
 
+	dyesub_poll_reset(&poll);
 top:
 
 	/* Query printer status */
@@ -483,7 +485,7 @@ top:
 	}
 	/* Wait for the printer to become idle */
 	if (ctx->sts.scprs) {
-		sleep(1);
+		dyesub_poll_sleep(&poll);
 		goto top;
 	}
 
@@ -503,8 +505,10 @@ top:
 		return CUPS_BACKEND_FAILED;
 
 	/* Wait for completion! */
+	dyesub_poll_reset(&poll);
+	dyesub_poll_eta(&poll, 1000);
 retry:
-	sleep(1);
+	dyesub_poll_sleep(&poll);
 
 	if ((ret = updneo_get_status(ctx))) {
 		return ret;
@@ -0,0 +1,855 @@
+/*
+ *   Image processing microbenchmarks
+ *
+ *   (c) 2026 agent <agent@local>
+ *
+ *   The latest version of this program can be found at:
+ *
+ *     http://git.shaftnet.org/cgit/selphy_print.git
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 3 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, see <https://www.gnu.org/licenses/>.
+ *
+ *   SPDX-License-Identifier: GPL-3.0+
+ *
+ */
+
+/* Times the image processing paths used by the backends, using the same
+   libraries and correction tables, and writes one JSON line per kernel
+   to stdout.  Library chatter goes to stderr as usual.
+
+   The image comes from one of the sample jobs, parsed by the backend
+   that would print it. */
+
+#include "backend_common.h"
+#include "backend_mitsu.h"
+#include "backend_pixfmt.h"
+#include "backend_sinfonia.h"
+
+#include <time.h>
+
+#define BENCH_RUNS    10
+#define BENCH_BACKEND "shinkos2145"
+#define BENCH_IMAGE   "testjobs/shinko_s2145_4x6.raw"
+
+/* Backends whose parsed jobs hold the image as packed 8bpp RGB */
+extern struct dyesub_backend shinkos1245_backend;
+extern struct dyesub_backend shinkos2145_backend;
+extern struct dyesub_backend shinkos6245_backend;
+
+static struct dyesub_backend *bench_backends[] = {
+	&shinkos1245_backend,
+	&shinkos2145_backend,
+	&shinkos6245_backend,
+	NULL,
+};
+
+/* Sinfonia S6145 library */
+#define LIB6145_NAME_RE "libS6145ImageReProcess" DLL_SUFFIX
+typedef int (*ImageProcessingFN)(unsigned char *, unsigned short *, void *);
+typedef int (*ImageProcessingStreamFN)(unsigned char *, void *, void *,
+				       int (*callback_fn)(void *context, void *buffer, uint32_t len));
+
+/* Offsets into the S6145 correction data, see lib6145 */
+#define S6145_CORR_LEN         16384
+#define S6145_CORR_MAXPULSE    8776
+#define S6145_CORR_TANK        4168
+#define S6145_CORR_TANK_LEN    128
+#define S6145_CORR_VAL1        8808
+#define S6145_CORR_MATTESIZE   8824
+#define S6145_CORR_HEADDOTS    8834
+#define S6145_CORR_WIDTH       12432
+#define S6145_HEAD_DOTS        1920
+
+/* From backend_hiti.c */
+#define HITI_CORR_LEN (33*33*33*3 + 2)
+void hiti_interp_init(void);
+void hiti_interp33_256(uint8_t *dst, uint8_t *src, const uint8_t *pTable);
+
+struct bench_ctx {
+	uint16_t cols;
+	uint16_t rows;
+	uint8_t *rgb;       /* Packed RGB source frame, never modified */
+	uint8_t *work;      /* Refreshed from 'rgb' before every run */
+	uint16_t *out16;    /* Packed 16bpp output */
+	uint16_t *keep16;   /* Pristine copy of 'out16' for in-place kernels */
+	size_t sent;
+
+	struct mitsu_lib lib;
+	struct CPCData *cpc;
+	struct CPCData *ecpc;
+	struct mitsu98xx_data *m98data;
+	struct M1CPCData *m1cpc;
+
+	void *dl6145;
+	ImageProcessingFN ImageProcessing;
+	ImageProcessingFN ImageProcessingParallel;
+	ImageProcessingStreamFN ImageProcessingStream;
+	uint8_t *corr;      /* S6145 or HiTi correction data */
+};
+
+struct bench_kernel {
+	const char *name;
+	int (*setup)(struct bench_ctx *ctx);
+	void (*prep)(struct bench_ctx *ctx);
+	int (*run)(struct bench_ctx *ctx);
+	void (*teardown)(struct bench_ctx *ctx);
+};
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench_bands(struct bench_ctx *ctx, struct BandImage *in, struct BandImage *out)
+{
+	in->origin_rows = in->origin_cols = 0;
+	in->rows = ctx->rows;
+	in->cols = ctx->cols;
+	in->imgbuf = ctx->work;
+	in->bytes_per_row = ctx->cols * 3;
+
+	out->origin_rows = out->origin_cols = 0;
+	out->rows = ctx->rows;
+	out->cols = ctx->cols;
+	out->imgbuf = ctx->out16;
+	out->bytes_per_row = ctx->cols * 3 * sizeof(uint16_t);
+}
+
+static int bench_needlib(struct bench_ctx *ctx)
+{
+	if (!ctx->lib.dl_handle) {
+		ERROR("%s not loaded\n", LIB_NAME_RE);
+		return 1;
+	}
+	return 0;
+}
+
+static struct CPCData *bench_getcpc(struct bench_ctx *ctx, const char *fname)
+{
+	char full[2048];
+	struct CPCData *cpc;
+
+	snprintf(full, sizeof(full), "%s/%s", corrtable_path, fname);
+	cpc = ctx->lib.GetCPCData(full);
+	if (!cpc)
+		ERROR("Unable to load CPC file '%s'\n", full);
+	return cpc;
+}
+
+static void bench_freecpc(struct bench_ctx *ctx)
+{
+	if (ctx->cpc)
+		ctx->lib.DestroyCPCData(ctx->cpc);
+	if (ctx->ecpc)
+		ctx->lib.DestroyCPCData(ctx->ecpc);
+	ctx->cpc = ctx->ecpc = NULL;
+}
+
+/* CColorConv3D_DoColorConv */
+static int colorconv_setup(struct bench_ctx *ctx)
+{
+	char full[2048];
+	uint8_t *buf;
+
+	if (bench_needlib(ctx))
+		return 1;
+
+	buf = malloc(LUT_LEN);
+	if (!buf) {
+		ERROR("Memory allocation failure!\n");
+		return 1;
+	}
+	snprintf(full, sizeof(full), "%s/%s", corrtable_path, "CPD70L01.lut");
+	if (ctx->lib.Get3DColorTable(buf, full)) {
+		ERROR("Unable to open LUT file '%s'\n", full);
+		free(buf);
+		return 1;
+	}
+	ctx->lib.lut = ctx->lib.Load3DColorTable(buf);
+	free(buf);
+	return !ctx->lib.lut;
+}
+
+static int colorconv_run(struct bench_ctx *ctx)
+{
+	ctx->lib.DoColorConv(ctx->lib.lut, ctx->work, ctx->cols, ctx->rows,
+			     ctx->cols * 3, COLORCONV_RGB);
+	return 0;
+}
+
+static void colorconv_teardown(struct bench_ctx *ctx)
+{
+	if (ctx->lib.lut)
+		ctx->lib.Destroy3DColorTable(ctx->lib.lut);
+	ctx->lib.lut = NULL;
+}
+
+/* do_image_effect60/70/80 */
+static int effect70_setup(struct bench_ctx *ctx)
+{
+	if (bench_needlib(ctx))
+		return 1;
+	ctx->cpc = bench_getcpc(ctx, "CPD70N01.cpc");
+	return !ctx->cpc;
+}
+
+static int effect60_setup(struct bench_ctx *ctx)
+{
+	if (bench_needlib(ctx))
+		return 1;
+	ctx->cpc = bench_getcpc(ctx, "CPS60T01.cpc");
+	return !ctx->cpc;
+}
+
+static int effect80_setup(struct bench_ctx *ctx)
+{
+	if (bench_needlib(ctx))
+		return 1;
+	ctx->cpc = bench_getcpc(ctx, "CPD80S01.cpc");
+	ctx->ecpc = bench_getcpc(ctx, "CPD80E01.cpc");
+	return !ctx->cpc || !ctx->ecpc;
+}
+
+static int effect_run(struct bench_ctx *ctx, do_image_effectFN effect)
+{
+	struct BandImage input, output;
+	uint8_t rew[2] = { 1, 1 };
+
+	bench_bands(ctx, &input, &output);
+	return effect(ctx->cpc, ctx->ecpc, &input, &output, 4, 0, rew);
+}
+
+static int effect70_run(struct bench_ctx *ctx)
+{
+	return effect_run(ctx, ctx->lib.DoImageEffect70);
+}
+
+static int effect60_run(struct bench_ctx *ctx)
+{
+	return effect_run(ctx, ctx->lib.DoImageEffect60);
+}
+
+static int effect80_run(struct bench_ctx *ctx)
+{
+	return effect_run(ctx, ctx->lib.DoImageEffect80);
+}
+
+/* do_image_effect70 with the 3D LUT fused in */
+static int effect70lut_setup(struct bench_ctx *ctx)
+{
+	if (effect70_setup(ctx) || colorconv_setup(ctx))
+		return 1;
+	if (!ctx->lib.DoImageEffect70Lut) {
+		ERROR("Library lacks do_image_effect70_lut\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int effect70lut_run(struct bench_ctx *ctx)
+{
+	struct BandImage input, output;
+	uint8_t rew[2] = { 1, 1 };
+
+	bench_bands(ctx, &input, &output);
+	return ctx->lib.DoImageEffect70Lut(ctx->lib.lut, ctx->cpc, ctx->ecpc,
+					   &input, &output, 4, 0, rew);
+}
+
+static void effect70lut_teardown(struct bench_ctx *ctx)
+{
+	colorconv_teardown(ctx);
+	bench_freecpc(ctx);
+}
+
+/* send_image_data, fed with real do_image_effect70 output */
+static int sendimage_cb(void *context, void *buffer, uint32_t len)
+{
+	struct bench_ctx *ctx = context;
+
+	UNUSED(buffer);
+	ctx->sent += len;
+	return 0;
+}
+
+static int sendimage_setup(struct bench_ctx *ctx)
+{
+	if (effect70_setup(ctx))
+		return 1;
+	memcpy(ctx->work, ctx->rgb, ctx->cols * ctx->rows * 3);
+	return effect70_run(ctx);
+}
+
+static int sendimage_run(struct bench_ctx *ctx)
+{
+	struct BandImage input, output;
+
+	bench_bands(ctx, &input, &output);
+	ctx->sent = 0;
+	return ctx->lib.SendImageData(&output, ctx, sendimage_cb);
+}
+
+/* CP98xx_DoConvert */
+static int cp98xx_setup(struct bench_ctx *ctx)
+{
+	char full[2048];
+
+	if (bench_needlib(ctx))
+		return 1;
+	snprintf(full, sizeof(full), "%s/%s", corrtable_path, "M98TABLE.dat");
+	ctx->m98data = ctx->lib.CP98xx_GetData(full);
+	if (!ctx->m98data) {
+		ERROR("Unable to read 98xx data table file '%s'\n", full);
+		return 1;
+	}
+	return 0;
+}
+
+static int cp98xx_run(struct bench_ctx *ctx)
+{
+	struct BandImage input, output;
+
+	bench_bands(ctx, &input, &output);
+	return !ctx->lib.CP98xx_DoConvert(ctx->m98data, &input, &output, 0x10, 0, 0);
+}
+
+static void cp98xx_teardown(struct bench_ctx *ctx)
+{
+	if (ctx->m98data)
+		ctx->lib.CP98xx_DestroyData(ctx->m98data);
+	ctx->m98data = NULL;
+}
+
+/* M1_Gamma8to14 and M1_CLocalEnhancer */
+static int m1_setup(struct bench_ctx *ctx)
+{
+	if (bench_needlib(ctx))
+		return 1;
+	ctx->m1cpc = ctx->lib.M1_GetCPCData(corrtable_path, "CPM1_N1.csv", "CPM1_G1.csv");
+	if (!ctx->m1cpc) {
+		ERROR("Cannot read data tables\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int gamma_run(struct bench_ctx *ctx)
+{
+	struct BandImage input, output;
+
+	bench_bands(ctx, &input, &output);
+	ctx->lib.M1_Gamma8to14(ctx->m1cpc, &input, &output);
+	return 0;
+}
+
+static int enhancer_setup(struct bench_ctx *ctx)
+{
+	if (m1_setup(ctx))
+		return 1;
+	memcpy(ctx->work, ctx->rgb, ctx->cols * ctx->rows * 3);
+	gamma_run(ctx);
+	memcpy(ctx->keep16, ctx->out16, ctx->cols * ctx->rows * 3 * sizeof(uint16_t));
+	return 0;
+}
+
+static void enhancer_prep(struct bench_ctx *ctx)
+{
+	memcpy(ctx->out16, ctx->keep16, ctx->cols * ctx->rows * 3 * sizeof(uint16_t));
+}
+
+static int enhancer_run(struct bench_ctx *ctx)
+{
+	struct BandImage input, output;
+
+	bench_bands(ctx, &input, &output);
+	return ctx->lib.M1_CLocalEnhancer(ctx->m1cpc, 4, &output);
+}
+
+static void m1_teardown(struct bench_ctx *ctx)
+{
+	if (ctx->m1cpc)
+		ctx->lib.M1_DestroyCPCData(ctx->m1cpc);
+	ctx->m1cpc = NULL;
+}
+
+/* lib6145 ImageProcessing */
+static int s6145_setup(struct bench_ctx *ctx)
+{
+	const char *fname = getenv("S6145_CORRDATA");
+	int i, j;
+
+	if (!ctx->ImageProcessing) {
+		ERROR("%s not loaded\n", LIB6145_NAME_RE);
+		return 1;
+	}
+	if (ctx->cols > S6145_HEAD_DOTS) {
+		ERROR("S6145 frame wider than %d dots\n", S6145_HEAD_DOTS);
+		return 1;
+	}
+
+	ctx->corr = malloc(S6145_CORR_LEN);
+	if (!ctx->corr) {
+		ERROR("Memory allocation failure!\n");
+		return 1;
+	}
+	memset(ctx->corr, 0, S6145_CORR_LEN);
+
+	if (fname) {
+		/* As dumped by 'shinkos6145 -c' */
+		int len;
+		if (dyesub_read_file(fname, ctx->corr, S6145_CORR_LEN, &len))
+			return 1;
+	} else {
+		/* Synthetic tables; the work done doesn't depend on the
+		   values, only that they pass the library's sanity checks */
+		uint16_t *tbl = (uint16_t *) ctx->corr;
+		for (i = 0 ; i < 4 ; i++) {
+			int32_t *tank = (int32_t *)(ctx->corr + S6145_CORR_TANK + i * S6145_CORR_TANK_LEN);
+			for (j = 0 ; j < 256 ; j++) {
+				tbl[i * 256 + j] = cpu_to_le16(j * 32);         /* pulseTrans */
+				tbl[(i + 4) * 256 + j] = cpu_to_le16(255 - j);  /* lineHistCoef */
+			}
+			((uint16_t *)(ctx->corr + S6145_CORR_MAXPULSE))[i] = cpu_to_le16(0xffff);
+			for (j = 0 ; j < 3 ; j++) {
+				tank[j] = cpu_to_le32(128);       /* Tank sizes */
+				tank[j + 3] = cpu_to_le32(1024);  /* Initial energy */
+				tank[j + 6] = cpu_to_le32(16);    /* Conductivity */
+			}
+		}
+		((uint16_t *)(ctx->corr + S6145_CORR_VAL1))[0] = cpu_to_le16(1);
+		((uint16_t *)(ctx->corr + S6145_CORR_VAL1))[1] = cpu_to_le16(1);
+		*(uint16_t *)(ctx->corr + S6145_CORR_MATTESIZE) = cpu_to_le16(1);
+		*(uint16_t *)(ctx->corr + S6145_CORR_HEADDOTS) = cpu_to_le16(S6145_HEAD_DOTS);
+	}
+
+	if (le16_to_cpu(*(uint16_t *)(ctx->corr + S6145_CORR_HEADDOTS)) > S6145_HEAD_DOTS) {
+		ERROR("Unexpected S6145 head width\n");
+		return 1;
+	}
+	((uint16_t *)(ctx->corr + S6145_CORR_WIDTH))[0] = cpu_to_le16(ctx->cols);
+	((uint16_t *)(ctx->corr + S6145_CORR_WIDTH))[1] = cpu_to_le16(ctx->rows);
+
+	return 0;
+}
+
+static int s6145_run(struct bench_ctx *ctx)
+{
+	/* Input is planar YMC, which is as good as anything here */
+	return ctx->ImageProcessing(ctx->work, ctx->out16, ctx->corr);
+}
+
+static int s6145_parallel_setup(struct bench_ctx *ctx)
+{
+	if (!ctx->ImageProcessingParallel) {
+		ERROR("%s has no ImageProcessingParallel\n", LIB6145_NAME_RE);
+		return 1;
+	}
+	return s6145_setup(ctx);
+}
+
+static int s6145_parallel_run(struct bench_ctx *ctx)
+{
+	return ctx->ImageProcessingParallel(ctx->work, ctx->out16, ctx->corr);
+}
+
+static int s6145_stream_setup(struct bench_ctx *ctx)
+{
+	if (!ctx->ImageProcessingStream) {
+		ERROR("%s has no ImageProcessingStream\n", LIB6145_NAME_RE);
+		return 1;
+	}
+	return s6145_setup(ctx);
+}
+
+static int s6145_stream_run(struct bench_ctx *ctx)
+{
+	ctx->sent = 0;
+	return ctx->ImageProcessingStream(ctx->work, ctx->corr, ctx, sendimage_cb);
+}
+
+static void bench_freecorr(struct bench_ctx *ctx)
+{
+	free(ctx->corr);
+	ctx->corr = NULL;
+}
+
+/* HiTi hiti_interp33_256, applied to every pixel */
+static int hiti_setup(struct bench_ctx *ctx)
+{
+	char full[2048];
+	int len;
+
+	ctx->corr = malloc(HITI_CORR_LEN);
+	if (!ctx->corr) {
+		ERROR("Memory allocation failure!\n");
+		return 1;
+	}
+	snprintf(full, sizeof(full), "%s/%s", corrtable_path, "P52x_CCPPri.bin");
+	if (dyesub_read_file(full, ctx->corr, HITI_CORR_LEN, &len))
+		return 1;
+	hiti_interp_init();
+	return 0;
+}
+
+static int hiti_run(struct bench_ctx *ctx)
+{
+	uint32_t i;
+	uint8_t *px = ctx->work;
+
+	for (i = 0 ; i < (uint32_t)ctx->cols * ctx->rows ; i++, px += 3)
+		hiti_interp33_256(px, px, ctx->corr);
+	return 0;
+}
+
+/* backend_pixfmt conversions, on a whole frame */
+static int pixfmt_packed8_setup(struct bench_ctx *ctx)
+{
+	UNUSED(ctx);
+	return 0;
+}
+
+static int pixfmt_packed8_run(struct bench_ctx *ctx)
+{
+	uint32_t planelen = (uint32_t)ctx->cols * ctx->rows;
+	uint8_t *out = (uint8_t *)ctx->out16;
+
+	/* As the S6145 backend does, RGB into planar YMC */
+	pixfmt_packed8_to_planar_inv(ctx->work, out + planelen * 2,
+				     out + planelen, out, planelen);
+	return 0;
+}
+
+static int pixfmt_packed16_setup(struct bench_ctx *ctx)
+{
+	memset(ctx->keep16, 0x5a, ctx->cols * ctx->rows * 3 * sizeof(uint16_t));
+	return 0;
+}
+
+static int pixfmt_packed16_run(struct bench_ctx *ctx)
+{
+	uint32_t planelen = (uint32_t)ctx->cols * ctx->rows;
+
+	pixfmt_packed16_to_planar(ctx->keep16, ctx->out16, ctx->out16 + planelen,
+				  ctx->out16 + planelen * 2, planelen);
+	return 0;
+}
+
+static int pixfmt_lut_setup(struct bench_ctx *ctx)
+{
+	if (ctx->cols > S6145_HEAD_DOTS) {
+		ERROR("Frame wider than %d dots\n", S6145_HEAD_DOTS);
+		return 1;
+	}
+	return 0;
+}
+
+static int pixfmt_lut_run(struct bench_ctx *ctx)
+{
+	uint16_t lut[256];
+	uint32_t pad_l = (S6145_HEAD_DOTS - ctx->cols) / 2;
+	int i;
+
+	for (i = 0 ; i < 256 ; i++)
+		lut[i] = i * 37;
+
+	/* As the S6145 fallback does, three planes out to the head width */
+	for (i = 0 ; i < 3 ; i++)
+		pixfmt_lut8to16_pad(ctx->work + i * ctx->cols * ctx->rows,
+				    ctx->out16 + i * S6145_HEAD_DOTS * ctx->rows,
+				    lut, ctx->cols, ctx->rows, pad_l,
+				    S6145_HEAD_DOTS - ctx->cols - pad_l);
+	return 0;
+}
+
+static const struct bench_kernel kernels[] = {
+	{ "CColorConv3D_DoColorConv", colorconv_setup, NULL, colorconv_run, colorconv_teardown },
+	{ "do_image_effect70", effect70_setup, NULL, effect70_run, bench_freecpc },
+	{ "do_image_effect60", effect60_setup, NULL, effect60_run, bench_freecpc },
+	{ "do_image_effect80", effect80_setup, NULL, effect80_run, bench_freecpc },
+	{ "do_image_effect70_lut", effect70lut_setup, NULL, effect70lut_run, effect70lut_teardown },
+	{ "send_image_data", sendimage_setup, NULL, sendimage_run, bench_freecpc },
+	{ "CP98xx_DoConvert", cp98xx_setup, NULL, cp98xx_run, cp98xx_teardown },
+	{ "M1_Gamma8to14", m1_setup, NULL, gamma_run, m1_teardown },
+	{ "M1_CLocalEnhancer", enhancer_setup, enhancer_prep, enhancer_run, m1_teardown },
+	{ "ImageProcessing", s6145_setup, NULL, s6145_run, bench_freecorr },
+	{ "ImageProcessingParallel", s6145_parallel_setup, NULL, s6145_parallel_run, bench_freecorr },
+	{ "ImageProcessingStream", s6145_stream_setup, NULL, s6145_stream_run, bench_freecorr },
+	{ "hiti_interp33_256", hiti_setup, NULL, hiti_run, bench_freecorr },
+	{ "pixfmt_packed8_to_planar_inv", pixfmt_packed8_setup, NULL, pixfmt_packed8_run, NULL },
+	{ "pixfmt_packed16_to_planar", pixfmt_packed16_setup, NULL, pixfmt_packed16_run, NULL },
+	{ "pixfmt_lut8to16_pad", pixfmt_lut_setup, NULL, pixfmt_lut_run, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
+/* Parse a sample job the same way the backend would print it */
+static int bench_load_job(const char *bname, const char *fname,
+			  struct dyesub_backend **r_backend, void **r_bctx,
+			  const struct sinfonia_printjob **r_job)
+{
+	struct dyesub_backend *backend = NULL;
+	const void *job = NULL;
+	void *bctx;
+	int i, fd, ret;
+
+	for (i = 0 ; bench_backends[i] ; i++) {
+		if (!strcmp(bname, bench_backends[i]->uri_prefixes[0]))
+			backend = bench_backends[i];
+	}
+	if (!backend) {
+		ERROR("Can't take images from backend '%s'\n", bname);
+		return CUPS_BACKEND_FAILED;
+	}
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		ERROR("Unable to open '%s': %s\n", fname, strerror(errno));
+		return CUPS_BACKEND_FAILED;
+	}
+
+	/* No printer here; parse it as the regression tests do */
+	test_mode = TEST_MODE_NOATTACH;
+	bctx = backend->init();
+	if (!bctx) {
+		close(fd);
+		return CUPS_BACKEND_FAILED;
+	}
+	ret = backend->attach(bctx, NULL, backend->devices[0].type, 0x82, 0x01, 0, 1);
+	if (!ret)
+		ret = backend->read_parse(bctx, &job, fd, 1);
+	close(fd);
+	if (ret || !job) {
+		ERROR("Unable to parse '%s' with %s backend\n", fname, backend->name);
+		backend->teardown(bctx);
+		return ret ? ret : CUPS_BACKEND_FAILED;
+	}
+
+	*r_backend = backend;
+	*r_bctx = bctx;
+	*r_job = job;
+	return CUPS_BACKEND_OK;
+}
+
+/* Fill the packed RGB frame from the job, repeating it if it's smaller */
+static void bench_fill_image(struct bench_ctx *ctx, const struct sinfonia_printjob *job)
+{
+	uint32_t jcols = job->jp.columns, jrows = job->jp.rows;
+	uint32_t row, col, len;
+
+	for (row = 0 ; row < ctx->rows ; row++) {
+		const uint8_t *src = job->databuf + (row % jrows) * jcols * 3;
+		uint8_t *dst = ctx->rgb + row * ctx->cols * 3;
+
+		for (col = 0 ; col < ctx->cols ; col += len) {
+			len = ctx->cols - col;
+			if (len > jcols)
+				len = jcols;
+			memcpy(dst + col * 3, src, len * 3);
+		}
+	}
+}
+
+static int bench_kernel(struct bench_ctx *ctx, const struct bench_kernel *k, int runs)
+{
+	uint64_t *ns;
+	uint64_t start;
+	size_t framelen = (size_t)ctx->cols * ctx->rows * 3;
+	double median, p95;
+	int i, ret;
+
+	ns = malloc(runs * sizeof(*ns));
+	if (!ns) {
+		ERROR("Memory allocation failure!\n");
+		return 1;
+	}
+
+	ret = k->setup(ctx);
+	if (ret) {
+		ERROR("Skipping %s\n", k->name);
+		goto teardown;
+	}
+
+	/* One untimed warmup run */
+	for (i = -1 ; i < runs ; i++) {
+		memcpy(ctx->work, ctx->rgb, framelen);
+		if (k->prep)
+			k->prep(ctx);
+		start = bench_now();
+		ret = k->run(ctx);
+		if (i >= 0)
+			ns[i] = bench_now() - start;
+		if (ret) {
+			ERROR("%s failed (%d)\n", k->name, ret);
+			break;
+		}
+	}
+
+teardown:
+	if (k->teardown)
+		k->teardown(ctx);
+	if (ret)
+		goto done;
+
+	qsort(ns, runs, sizeof(*ns), bench_cmp);
+	median = (runs & 1) ? ns[runs / 2] : (ns[runs / 2 - 1] + ns[runs / 2]) / 2.0;
+	p95 = ns[(runs * 95 + 99) / 100 - 1];
+
+	fprintf(stdout, "{\"kernel\":\"%s\",\"cols\":%u,\"rows\":%u,\"runs\":%d,"
+		"\"median_ms\":%.3f,\"p95_ms\":%.3f,\"min_ms\":%.3f,\"mpix_s\":%.2f}\n",
+		k->name, ctx->cols, ctx->rows, runs,
+		median / 1000000.0, p95 / 1000000.0, ns[0] / 1000000.0,
+		(double)ctx->cols * ctx->rows / median * 1000.0);
+	fflush(stdout);
+
+done:
+	free(ns);
+	return ret;
+}
+
+static void bench_help(const char *argv0)
+{
+	const struct bench_kernel *k;
+	int i;
+
+	fprintf(stderr, "Usage: %s [ -n runs ] [ -s COLSxROWS ] [ -b backend -i job ] [ kernel ... ]\n", argv0);
+	fprintf(stderr, "Backends:\n");
+	for (i = 0 ; bench_backends[i] ; i++)
+		fprintf(stderr, "\t%s\n", bench_backends[i]->uri_prefixes[0]);
+	fprintf(stderr, "Kernels:\n");
+	for (k = kernels ; k->name ; k++)
+		fprintf(stderr, "\t%s\n", k->name);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_ctx ctx;
+	const struct bench_kernel *k;
+	const char *bname = BENCH_BACKEND;
+	const char *image = BENCH_IMAGE;
+	struct dyesub_backend *backend = NULL;
+	void *bctx = NULL;
+	const struct sinfonia_printjob *job = NULL;
+	int runs = BENCH_RUNS;
+	unsigned int cols = 0, rows = 0;
+	int size_set = 0;
+	size_t outlen;
+	int i, c, ret = CUPS_BACKEND_OK;
+
+	memset(&ctx, 0, sizeof(ctx));
+	atexit(dyesub_log_flush);
+
+	if (getenv("CORRTABLE_PATH"))
+		corrtable_path = getenv("CORRTABLE_PATH");
+	if (getenv("DYESUB_DEBUG"))
+		dyesub_debug = atoi(getenv("DYESUB_DEBUG"));
+
+	while ((c = getopt(argc, argv, "b:hi:n:s:")) >= 0) {
+		switch (c) {
+		case 'b':
+			bname = optarg;
+			break;
+		case 'i':
+			image = optarg;
+			break;
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%ux%u", &cols, &rows) != 2)
+				cols = 0;
+			size_set = 1;
+			break;
+		case 'h':
+		default:
+			bench_help(argv[0]);
+			return CUPS_BACKEND_FAILED;
+		}
+	}
+	if (runs < 1 ||
+	    (size_set && (!cols || !rows || cols > 0xffff || rows > 0xffff))) {
+		bench_help(argv[0]);
+		return CUPS_BACKEND_FAILED;
+	}
+
+	ret = bench_load_job(bname, image, &backend, &bctx, &job);
+	if (ret)
+		return ret;
+	if (!size_set) {
+		cols = job->jp.columns;
+		rows = job->jp.rows;
+	}
+	ctx.cols = cols;
+	ctx.rows = rows;
+
+	ctx.rgb = malloc((size_t)cols * rows * 3);
+	ctx.work = malloc((size_t)cols * rows * 3);
+	/* Big enough for packed RGB16 as well as S6145 YMCO16 output */
+	outlen = (size_t)rows * sizeof(uint16_t) *
+		(cols * 3 > S6145_HEAD_DOTS * 4 ? cols * 3 : S6145_HEAD_DOTS * 4);
+	ctx.out16 = malloc(outlen);
+	ctx.keep16 = malloc((size_t)cols * rows * 3 * sizeof(uint16_t));
+	if (!ctx.rgb || !ctx.work || !ctx.out16 || !ctx.keep16) {
+		ERROR("Memory allocation failure!\n");
+		ret = CUPS_BACKEND_FAILED;
+		goto done;
+	}
+	bench_fill_image(&ctx, job);
+
+	mitsu_loadlib(&ctx.lib, P_MITSU_D70X);
+#if defined(WITH_DYNAMIC)
+	ctx.dl6145 = DL_OPEN(LIB6145_NAME_RE);
+	if (ctx.dl6145) {
+		ctx.ImageProcessing = DL_SYM(ctx.dl6145, "ImageProcessing");
+		ctx.ImageProcessingParallel = DL_SYM(ctx.dl6145, "ImageProcessingParallel");
+		ctx.ImageProcessingStream = DL_SYM(ctx.dl6145, "ImageProcessingStream");
+	}
+#endif
+
+	for (k = kernels ; k->name ; k++) {
+		if (optind < argc) {
+			for (i = optind ; i < argc ; i++)
+				if (!strcmp(argv[i], k->name))
+					break;
+			if (i == argc)
+				continue;
+		}
+		if (bench_kernel(&ctx, k, runs))
+			ret = CUPS_BACKEND_FAILED;
+	}
+
+#if defined(WITH_DYNAMIC)
+	if (ctx.dl6145)
+		DL_CLOSE(ctx.dl6145);
+#endif
+	mitsu_destroylib(&ctx.lib);
+
+done:
+	backend->cleanup_job(job);
+	backend->teardown(bctx);
+	free(ctx.rgb);
+	free(ctx.work);
+	free(ctx.out16);
+	free(ctx.keep16);
+	return ret;
+}
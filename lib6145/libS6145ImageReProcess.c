@@ -48,6 +48,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIB6145_X86_SIMD
+#include <immintrin.h>
+#endif
 
 //-------------------------------------------------------------------------
 // Structures
@@ -179,47 +186,50 @@ struct imageCorrParam {
 //-------------------------------------------------------------------------
 // Function declarations
 
-#define ASSERT(__COND, __TXT) if ((!__COND)) { printf(__TXT " @ %d\n", __LINE__); exit(1); }
+#define ASSERT(__COND, __TXT) if ((!__COND)) { fprintf(stderr, __TXT " @ %d\n", __LINE__); exit(1); }
+#define UNUSED(expr) do { (void)(expr); } while (0)
+
+struct s6145_state; /* Forward declaration */
 
 static void SetTableData(void *src, void *dest, uint16_t words);
 static int32_t CheckPrintParam(uint8_t *corrdata);
 static uint16_t LinePrintCalcBit(uint16_t val);
 
-static void GetInfo(void);
-static void Global_Init(void);
-static void SetTableColor(uint8_t plane);
-static void LinePrintPreProcess(void);
-static void CTankResetParameter(int32_t *params);
-static void CTankResetTank(void);
-static void PagePrintPreProcess(void);
-static void PagePrintProcess(void);
-static void CTankProcess(void);
-static void SendData(void);
-static void PulseTrans(void);
-static void CTankUpdateTankVolumeInterDot(uint8_t tank);
-static void CTankUpdateTankVolumeInterRay(void);
-static void CTankHoseiPreread(void);
-static void CTankHosei(void);
-static void LineCorrection(void);
-
-static void PulseTransPreReadOP(void);
-static void PulseTransPreReadYMC(void);
-static void CTankProcessPreRead(void);
-static void CTankProcessPreReadDummy(void);
-static void RecieveDataOP_GLOSS(void);
-static void RecieveDataYMC(void);
-static void RecieveDataOP_MATTE(void);
+static void GetInfo(struct s6145_state *st);
+static void Global_Init(struct s6145_state *st);
+static void SetTableColor(struct s6145_state *st, uint8_t plane);
+static void LinePrintPreProcess(struct s6145_state *st);
+static void CTankResetParameter(struct s6145_state *st, int32_t *params);
+static void CTankResetTank(struct s6145_state *st);
+static void PagePrintPreProcess(struct s6145_state *st);
+static void PagePrintProcess(struct s6145_state *st);
+static void CTankProcess(struct s6145_state *st);
+static void SendData(struct s6145_state *st);
+static void PulseTrans(struct s6145_state *st);
+static void CTankUpdateTankVolumeInterDot(struct s6145_state *st, uint8_t tank);
+static void CTankUpdateTankVolumeInterRay(struct s6145_state *st);
+static void CTankHoseiPreread(struct s6145_state *st);
+static void CTankHosei(struct s6145_state *st);
+static void LineCorrection(struct s6145_state *st);
+
+static void PulseTransPreReadOP(struct s6145_state *st);
+static void PulseTransPreReadYMC(struct s6145_state *st);
+static void CTankProcessPreRead(struct s6145_state *st);
+static void CTankProcessPreReadDummy(struct s6145_state *st);
+static void RecieveDataOP_GLOSS(struct s6145_state *st);
+static void RecieveDataYMC(struct s6145_state *st);
+static void RecieveDataOP_MATTE(struct s6145_state *st);
 
 #ifdef S6145_UNUSED
-static void SetTable(void);
-static void ImageLevelAddition(void);
-static void ImageLevelAdditionEx(uint32_t *a1, uint32_t a2, int32_t a3);
-static void RecieveDataOP_Post(void);
-static void RecieveDataYMC_Post(void);
-static void RecieveDataOPLevel_Post(void);
-static void RecieveDataOPMatte_Post(void);
-static void SideEdgeCorrection(void);
-static void LeadEdgeCorrection(void);
+static void SetTable(struct s6145_state *st);
+static void ImageLevelAddition(struct s6145_state *st);
+static void ImageLevelAdditionEx(struct s6145_state *st, uint32_t *a1, uint32_t a2, int32_t a3);
+static void RecieveDataOP_Post(struct s6145_state *st);
+static void RecieveDataYMC_Post(struct s6145_state *st);
+static void RecieveDataOPLevel_Post(struct s6145_state *st);
+static void RecieveDataOPMatte_Post(struct s6145_state *st);
+static void SideEdgeCorrection(struct s6145_state *st);
+static void LeadEdgeCorrection(struct s6145_state *st);
 #endif
 
 //-------------------------------------------------------------------------
@@ -252,154 +262,172 @@ static void LeadEdgeCorrection(void);
 #define MAX_ROWS 2492
 #define MAX_COLS 1844
 
-static void (*g_pfRecieveData)(void);
-static void (*g_pfPulseTransPreRead)(void);
-static void (*g_pfTankProcessPreRead)(void);
-
-static uint8_t g_pusInLineBuf0[BUF_SIZE];
-static uint8_t g_pusInLineBuf1[BUF_SIZE];
-static uint8_t g_pusInLineBuf2[BUF_SIZE];
-static uint8_t g_pusInLineBuf3[BUF_SIZE];
-static uint8_t g_pusInLineBuf4[BUF_SIZE];
-static uint8_t g_pusInLineBuf5[BUF_SIZE];
-static uint8_t g_pusInLineBuf6[BUF_SIZE];
-static uint8_t g_pusInLineBuf7[BUF_SIZE];
-static uint8_t g_pusInLineBuf8[BUF_SIZE];
-static uint8_t g_pusInLineBuf9[BUF_SIZE];
-static uint8_t g_pusInLineBufA[BUF_SIZE];
-
-static uint16_t g_pusOutLineBuf1[BUF_SIZE];
-static uint16_t *g_pusOutLineBufTab[2]; // XXX actually [1]
-
-static uint8_t *g_pusPreReadLineBufTab[12]; // XXX actually [11]
-static uint8_t *g_pusPulseTransLineBufTab[4];
-
-static uint16_t g_pusPreReadOutLineBuf[BUF_SIZE];
-
-static  int32_t m_piTrdTankArray[TANK_SIZE];
-static  int32_t m_piFstTankArray[TANK_SIZE];
-static  int32_t m_piSndTankArray[TANK_SIZE];
-
-static  int16_t g_psMtfPreCalcTable[512];
-static uint16_t g_pusTankMinusMaxEnegyTable[256];
-static uint16_t g_pusTankPlusMaxEnegyTable[256];
-static uint16_t g_pusPulseTransTable[256];
-static uint16_t g_pusLineHistCoefTable[256];
-
-static  int32_t g_piTankParam[128];   // should be struct tankParam[4]
-static  int32_t g_pulRandomTable[32]; // should be u32
-
-static uint8_t  *g_pucInputImageBuf;
-struct imageCorrParam *g_pSPrintParam;
-static uint16_t *g_pusOutputImageBuf;
-
-static uint8_t  g_ucRandomBaseLevel[4];
-static  int16_t g_sPrintSideOffset;
-static uint16_t g_usHeadDots;
-static  int32_t g_iLineCorrectPulse;
-static uint32_t g_uiMtfSlice;    // really u16?
-static uint32_t g_uiMtfWeightV;  // really u16?
-static uint32_t g_uiMtfWeightH;  // really u16?
-static uint16_t g_usLineCorrect_Env_A;
-static uint16_t g_usLineCorrect_Env_B;
-static uint16_t g_usLineCorrect_Env_C;
-
-static uint32_t g_uiOutputImageIndex;
-static uint32_t g_uiInputImageIndex;
-
-static  int32_t g_iMaxPulseValue;
-static uint32_t g_uiMaxPulseBit;
-
-static uint16_t g_usPrintMaxPulse;
-static uint16_t g_usPrintOpLevel;
-static uint16_t g_usMatteSize;
-static uint32_t g_uiLineCorrectSlice;
-static uint32_t g_uiLineCorrectSlice1Line;
-static uint16_t g_usPrintSizeHeight;
-static uint32_t g_uiLineCorrectBase1Line;
-static uint32_t g_uiLineCorrectSum;
-static uint32_t g_uiLineCorrectBase;
-static  int16_t g_sCorrectSw;
-static uint16_t g_usMatteMode;
-static  int32_t g_iLineCorrectPulseMax;
-static uint16_t g_usSheetSizeWidth;
-static uint16_t g_usPrintSizeWidth;
-static uint16_t g_usPrintColor;
-static uint32_t g_uiSendToHeadCounter;
-static uint32_t g_uiLineCopyCounter;
-
-static  int32_t m_iTrdTankSize;
-static  int32_t m_iTrdSndConductivity;
-static  int32_t m_iSndTankSize;
-static  int32_t m_iTankKeisuSndFstDivFst;
-static  int32_t m_iSndSndConductivity;
-static  int32_t m_iTrdTrdConductivity;
-static  int32_t m_iTankKeisuTrdSndDivSnd;
-static  int32_t m_iTankKeisuTrdSndDivTrd;
-static  int32_t m_iSndFstConductivity;
-static  int32_t m_iFstTankSize;
-static  int32_t m_iTrdTankIniEnergy;
-static  int32_t m_iFstTankIniEnergy;
-static  int32_t m_iTankKeisuSndFstDivSnd;
-static  int32_t m_iSndTankIniEnergy;
-static  int32_t m_iPreReadLevelDiff;
-static  int32_t m_iMinusMaxEnergyPreRead;
-static  int32_t m_iOutTrdConductivity;
-static  int32_t m_iFstOutConductivity;
-static  int32_t m_iFstFstConductivity;
-static  int32_t m_iTankKeisuFstOutDivFst;
-static  int32_t m_iTankKeisuOutTrdDivTrd;
+#define LIB6145_MAX_THREADS 4  /* One per plane */
+#define SINK_LINES 64           /* Lines handed to a stream callback at once */
+
+typedef int (*SinkFN)(void *context, void *buffer, uint32_t len);
+
+/* All of the processing state, one of these per job (or plane, see
+   ImageProcessingParallel).  The member names are those of the original
+   library's globals. */
+struct s6145_state {
+	void (*g_pfRecieveData)(struct s6145_state *st);
+	void (*g_pfPulseTransPreRead)(struct s6145_state *st);
+	void (*g_pfTankProcessPreRead)(struct s6145_state *st);
+
+	uint8_t g_pusInLineBuf0[BUF_SIZE];
+	uint8_t g_pusInLineBuf1[BUF_SIZE];
+	uint8_t g_pusInLineBuf2[BUF_SIZE];
+	uint8_t g_pusInLineBuf3[BUF_SIZE];
+	uint8_t g_pusInLineBuf4[BUF_SIZE];
+	uint8_t g_pusInLineBuf5[BUF_SIZE];
+	uint8_t g_pusInLineBuf6[BUF_SIZE];
+	uint8_t g_pusInLineBuf7[BUF_SIZE];
+	uint8_t g_pusInLineBuf8[BUF_SIZE];
+	uint8_t g_pusInLineBuf9[BUF_SIZE];
+	uint8_t g_pusInLineBufA[BUF_SIZE];
+
+	uint16_t g_pusOutLineBuf1[BUF_SIZE];
+	uint16_t *g_pusOutLineBufTab[2]; // XXX actually [1]
+
+	uint8_t *g_pusPreReadLineBufTab[12]; // XXX actually [11]
+	uint8_t *g_pusPulseTransLineBufTab[4];
+
+	uint16_t g_pusPreReadOutLineBuf[BUF_SIZE];
+
+	int32_t m_piTrdTankArray[TANK_SIZE];
+	int32_t m_piFstTankArray[TANK_SIZE];
+	int32_t m_piSndTankArray[TANK_SIZE];
+
+	int16_t g_psMtfPreCalcTable[512];
+	uint16_t g_pusTankMinusMaxEnegyTable[256];
+	uint16_t g_pusTankPlusMaxEnegyTable[256];
+	uint16_t g_pusPulseTransTable[256];
+	uint16_t g_pusLineHistCoefTable[256];
+
+	int32_t g_piTankParam[128];   // should be struct tankParam[4]
+	uint32_t m_puiTankMaxEnergyTable[256]; // Ours; minus | plus << 16
+	int32_t g_pulRandomTable[32]; // should be u32
+
+	uint8_t  *g_pucInputImageBuf;
+	struct imageCorrParam *g_pSPrintParam;
+	uint16_t *g_pusOutputImageBuf;
+
+	uint8_t  g_ucRandomBaseLevel[4];
+	int16_t g_sPrintSideOffset;
+	uint16_t g_usHeadDots;
+	int32_t g_iLineCorrectPulse;
+	uint32_t g_uiMtfSlice;    // really u16?
+	uint32_t g_uiMtfWeightV;  // really u16?
+	uint32_t g_uiMtfWeightH;  // really u16?
+	uint16_t g_usLineCorrect_Env_A;
+	uint16_t g_usLineCorrect_Env_B;
+	uint16_t g_usLineCorrect_Env_C;
+
+	uint32_t g_uiOutputImageIndex;
+	uint32_t g_uiInputImageIndex;
+
+	int32_t g_iMaxPulseValue;
+	uint32_t g_uiMaxPulseBit;
+
+	uint16_t g_usPrintMaxPulse;
+	uint16_t g_usPrintOpLevel;
+	uint16_t g_usMatteSize;
+	uint32_t g_uiLineCorrectSlice;
+	uint32_t g_uiLineCorrectSlice1Line;
+	uint16_t g_usPrintSizeHeight;
+	uint32_t g_uiLineCorrectBase1Line;
+	uint32_t g_uiLineCorrectSum;
+	uint32_t g_uiLineCorrectBase;
+	int16_t g_sCorrectSw;
+	uint16_t g_usMatteMode;
+	int32_t g_iLineCorrectPulseMax;
+	uint16_t g_usSheetSizeWidth;
+	uint16_t g_usPrintSizeWidth;
+	uint16_t g_usPrintColor;
+	uint32_t g_uiSendToHeadCounter;
+	uint32_t g_uiLineCopyCounter;
+
+	int32_t m_iTrdTankSize;
+	int32_t m_iTrdSndConductivity;
+	int32_t m_iSndTankSize;
+	int32_t m_iTankKeisuSndFstDivFst;
+	int32_t m_iSndSndConductivity;
+	int32_t m_iTrdTrdConductivity;
+	int32_t m_iTankKeisuTrdSndDivSnd;
+	int32_t m_iTankKeisuTrdSndDivTrd;
+	int32_t m_iSndFstConductivity;
+	int32_t m_iFstTankSize;
+	int32_t m_iTrdTankIniEnergy;
+	int32_t m_iFstTankIniEnergy;
+	int32_t m_iTankKeisuSndFstDivSnd;
+	int32_t m_iSndTankIniEnergy;
+	int32_t m_iPreReadLevelDiff;
+	int32_t m_iMinusMaxEnergyPreRead;
+	int32_t m_iOutTrdConductivity;
+	int32_t m_iFstOutConductivity;
+	int32_t m_iFstFstConductivity;
+	int32_t m_iTankKeisuFstOutDivFst;
+	int32_t m_iTankKeisuOutTrdDivTrd;
+
+	/* Ours; if set, SendData() passes finished lines on to this
+	   every m_uiSinkLen samples, see ImageProcessingStream() */
+	SinkFN m_pfSinkFn;
+	void *m_pSinkContext;
+	uint32_t m_uiSinkLen;
+	int m_iSinkError;
 
 #ifdef S6145_UNUSED
 
-static void (*g_pfRecieveData_Post)(void);  /* all users are no-ops */
-
-/* Set but never referenced */
-static uint32_t g_uiDataTransCounter;
-static uint32_t g_uiTudenLineCounter;
-
-/* Only ever set to 0 */
-static uint16_t g_usPrintDummyLevel;
-static uint16_t g_usPrintDummyLine;
-static uint16_t g_usRearDummyPrintLine;
-static uint16_t g_usRearDeleteLine;
-
-/* Appear unused */
-static uint16_t g_usCancelCheckLinesForPRec;
-
-static uint16_t g_usPrintSizeLHeight;
-static uint16_t g_usPrintSizeLWidth;
-
-static uint16_t g_pusSideEdgeLvCoefTable[256];
-static uint16_t g_pusSideEdgeCoefTable[128];
-static  int32_t g_iLeadEdgeCorrectPulse;
-
-static  int32_t m_iMinusMaxEnergy;
-static  int32_t m_iPlusMaxEnergy;
-static  int32_t m_iPlusMaxEnergyPreRead;
-
-static uint16_t g_usCenterHeadToColSen;
-static uint16_t g_usThearmEnv;
-static uint16_t g_usThearmHead;
-static uint16_t g_usMatteGloss;
-static uint16_t g_usMatteDeglossBlk;
-static uint16_t g_usMatteDeglossWht;
-static uint16_t g_usPrintOffsetWidth;
-static uint16_t g_usCancelCheckDotsForPRec;
-static uint32_t g_uiOffsetCancelCheckPRec;
-static uint32_t g_uiLevelAveCounter;
-static uint32_t g_uiLevelAveCounter2;
-static uint32_t g_uiLevelAveAddtion;
-static uint32_t g_uiLevelAveAddtion2;
-static uint32_t g_uiDummyPrintCounter;
-static uint16_t g_usRearDummyPrintLevel;
-static uint16_t g_usLastPrintSizeHeight;
-static uint16_t g_usLastPrintSizeWidth;
-static uint16_t g_usLastSheetSizeWidth;
-
-uint16_t g_pusOutLineBuf2[BUF_SIZE];
-uint16_t *g_pusLamiCompInLineBufTab[4];
+	void (*g_pfRecieveData_Post)(struct s6145_state *st);  /* all users are no-ops */
+
+	/* Set but never referenced */
+	uint32_t g_uiDataTransCounter;
+	uint32_t g_uiTudenLineCounter;
+
+	/* Only ever set to 0 */
+	uint16_t g_usPrintDummyLevel;
+	uint16_t g_usPrintDummyLine;
+	uint16_t g_usRearDummyPrintLine;
+	uint16_t g_usRearDeleteLine;
+
+	/* Appear unused */
+	uint16_t g_usCancelCheckLinesForPRec;
+
+	uint16_t g_usPrintSizeLHeight;
+	uint16_t g_usPrintSizeLWidth;
+
+	uint16_t g_pusSideEdgeLvCoefTable[256];
+	uint16_t g_pusSideEdgeCoefTable[128];
+	int32_t g_iLeadEdgeCorrectPulse;
+
+	int32_t m_iMinusMaxEnergy;
+	int32_t m_iPlusMaxEnergy;
+	int32_t m_iPlusMaxEnergyPreRead;
+
+	uint16_t g_usCenterHeadToColSen;
+	uint16_t g_usThearmEnv;
+	uint16_t g_usThearmHead;
+	uint16_t g_usMatteGloss;
+	uint16_t g_usMatteDeglossBlk;
+	uint16_t g_usMatteDeglossWht;
+	uint16_t g_usPrintOffsetWidth;
+	uint16_t g_usCancelCheckDotsForPRec;
+	uint32_t g_uiOffsetCancelCheckPRec;
+	uint32_t g_uiLevelAveCounter;
+	uint32_t g_uiLevelAveCounter2;
+	uint32_t g_uiLevelAveAddtion;
+	uint32_t g_uiLevelAveAddtion2;
+	uint32_t g_uiDummyPrintCounter;
+	uint16_t g_usRearDummyPrintLevel;
+	uint16_t g_usLastPrintSizeHeight;
+	uint16_t g_usLastPrintSizeWidth;
+	uint16_t g_usLastSheetSizeWidth;
+
+	uint16_t g_pusOutLineBuf2[BUF_SIZE];
+	uint16_t *g_pusLamiCompInLineBufTab[4];
 #endif
+};
 
 /* **************************** */
 
@@ -434,15 +462,55 @@ int ImageAvrCalc(uint8_t *input, uint16_t cols, uint16_t rows, uint8_t *avg)
   return 0;
 }
 
-int ImageProcessing(unsigned char *in, unsigned short *out, void *corrdata)
+static void PrintBanner(void)
 {
-  uint8_t i;
-
   fprintf(stderr, "INFO: libS6145ImageReProcess version '%s'\n", LIB_VERSION);
   fprintf(stderr, "INFO: Copyright (c) 2015-2020 Solomon Peachy\n");
   fprintf(stderr, "INFO: This free software comes with ABSOLUTELY NO WARRANTY!\n");
   fprintf(stderr, "INFO: Licensed under the GNU GPLv3.\n");
   fprintf(stderr, "INFO: *** This code is NOT supported or endorsed by Sinfonia! ***\n");
+}
+
+static struct s6145_state *StateInit(unsigned char *in, unsigned short *out, void *corrdata)
+{
+  struct s6145_state *st = calloc(1, sizeof(*st));
+
+  if (!st)
+    return NULL;
+
+  st->g_pucInputImageBuf = in;
+  st->g_pusOutputImageBuf = out;
+  st->g_pSPrintParam = (struct imageCorrParam *) corrdata;
+
+  Global_Init(st);
+#ifdef S6145_UNUSED
+  SetTable(st);
+#endif
+
+  return st;
+}
+
+/* Process one plane, from setting up its tables to its final line */
+static void ProcessPlane(struct s6145_state *st, uint8_t plane)
+{
+  int32_t lines;
+
+  SetTableColor(st, plane);
+  LinePrintPreProcess(st);
+  PagePrintPreProcess(st);
+  lines = st->g_usPrintSizeHeight;
+  while ( lines-- && !st->m_iSinkError ) {
+    PagePrintProcess(st);
+  }
+  st->g_usPrintColor++;
+}
+
+int ImageProcessing(unsigned char *in, unsigned short *out, void *corrdata)
+{
+  struct s6145_state *st;
+  uint8_t i;
+
+  PrintBanner();
 
   if (!in)
 	  return 1;
@@ -451,34 +519,259 @@ int ImageProcessing(unsigned char *in, unsigned short *out, void *corrdata)
   if (!corrdata)
 	  return 3;
 
-  g_pucInputImageBuf = in;
-  g_pusOutputImageBuf = out;
-  g_pSPrintParam = (struct imageCorrParam *) corrdata;
-
   i = CheckPrintParam(corrdata);
   if (i)
     return i;
 
-  Global_Init();
-#ifdef S6145_UNUSED
-  SetTable();
-#endif
+  st = StateInit(in, out, corrdata);
+  if (!st)
+    return 4; /* Out of memory */
 
   for ( i = 0; i < 4; i++ ) {   /* Full YMCO */
-    int32_t lines;
-    SetTableColor(i);
-    LinePrintPreProcess();
-    PagePrintPreProcess();
-    lines = g_usPrintSizeHeight;
-    while ( lines-- ) {
-      PagePrintProcess();
+    ProcessPlane(st, i);
+  }
+
+  free(st);
+  return 0;
+}
+
+/* **************************** */
+
+/* The thermal tanks and line buffers are all reset at the start of each
+   plane, so the planes can be worked on independently.  The only things
+   a plane inherits from the ones before it are its position in the input
+   and output images, and whatever LinePrintPreProcess() leaves behind
+   (notably g_uiLineCorrectBase1Line, which is only updated when the
+   plane has a slice set), so a fresh state is brought up to the start
+   of 'plane' by replaying just those. */
+static struct s6145_state *StateInitPlane(unsigned char *in, unsigned short *out,
+					  void *corrdata, uint8_t plane, uint8_t outplane)
+{
+  struct imageCorrParam *param = corrdata;
+  struct s6145_state *st;
+  uint32_t height = le16_to_cpu(param->height);
+  uint8_t i;
+
+  st = StateInit(in, out, corrdata);
+  if (!st)
+    return NULL;
+
+  for ( i = 0; i < plane; i++ ) {
+    SetTableColor(st, i);
+    LinePrintPreProcess(st);
+    st->g_usPrintColor++;
+  }
+
+  /* Each plane reads one plane of input (bar the overcoat, which
+     reads none) and writes one head-width plane of output.  'out'
+     may start partway in, with plane 'outplane'. */
+  st->g_uiInputImageIndex = plane * le16_to_cpu(param->width) * height;
+  st->g_uiOutputImageIndex = (plane - outplane) * le16_to_cpu(param->headDots) * height;
+
+  return st;
+}
+
+struct s6145_worker {
+  unsigned char *in;
+  unsigned short *out;
+  void *corrdata;
+  uint8_t outplane; /* Plane that 'out' starts with */
+  uint8_t plane;  /* First plane to process */
+  uint8_t step;   /* ..and then every step'th one after that */
+  int ret;
+};
+
+static void *PlaneWorker(void *arg)
+{
+  struct s6145_worker *w = arg;
+  uint8_t plane;
+
+  for ( plane = w->plane; plane < 4; plane += w->step ) {
+    struct s6145_state *st = StateInitPlane(w->in, w->out, w->corrdata, plane, w->outplane);
+    if (!st) {
+      w->ret = 4; /* Out of memory */
+      break;
     }
-    g_usPrintColor++;
+    ProcessPlane(st, plane);
+    free(st);
+  }
+
+  return NULL;
+}
+
+/* Threads to use; LIB6145_THREADS overrides the number of CPUs */
+static int lib6145_threads(void)
+{
+  const char *env = getenv("LIB6145_THREADS");
+  long n = 1;
+
+  if (env)
+    n = atoi(env);
+#if defined(_SC_NPROCESSORS_ONLN)
+  else
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+  if (n < 1)
+    n = 1;
+  if (n > LIB6145_MAX_THREADS)
+    n = LIB6145_MAX_THREADS;
+
+  return n;
+}
+
+/* Same as ImageProcessing(), with identical output, but with the four
+   planes processed concurrently. */
+int ImageProcessingParallel(unsigned char *in, unsigned short *out, void *corrdata)
+{
+  struct s6145_worker workers[LIB6145_MAX_THREADS];
+  pthread_t tids[LIB6145_MAX_THREADS];
+  int started[LIB6145_MAX_THREADS];
+  int n, i;
+
+  PrintBanner();
+
+  if (!in)
+	  return 1;
+  if (!out)
+	  return 2;
+  if (!corrdata)
+	  return 3;
+
+  i = CheckPrintParam(corrdata);
+  if (i)
+    return i;
+
+  n = lib6145_threads();
+  for ( i = 0; i < n; i++ ) {
+    workers[i].in = in;
+    workers[i].out = out;
+    workers[i].corrdata = corrdata;
+    workers[i].outplane = 0;
+    workers[i].plane = i;
+    workers[i].step = n;
+    workers[i].ret = 0;
+  }
+
+  /* If a thread can't be started, its planes are processed here */
+  for ( i = 1; i < n; i++ )
+    started[i] = !pthread_create(&tids[i], NULL, PlaneWorker, &workers[i]);
+
+  PlaneWorker(&workers[0]);
+
+  for ( i = 1; i < n; i++ ) {
+    if (started[i])
+      pthread_join(tids[i], NULL);
+    else
+      PlaneWorker(&workers[i]);
+  }
+
+  for ( i = 0; i < n; i++ ) {
+    if (workers[i].ret)
+      return workers[i].ret;
   }
 
   return 0;
 }
 
+/* Like ImageProcessing(), but instead of filling in an output buffer,
+   hands the output to callback_fn() as it is generated, a batch of
+   lines at a time.  The data and its order are exactly what
+   ImageProcessing() would have written.  The Y plane is passed on as
+   it is worked on; when using more than one thread, the remaining
+   planes are processed alongside it and follow once it is done.  If
+   the callback returns nonzero, processing stops and 5 is returned. */
+int ImageProcessingStream(unsigned char *in, void *corrdata, void *context,
+			  int (*callback_fn)(void *context, void *buffer, uint32_t len))
+{
+  struct imageCorrParam *param = corrdata;
+  struct s6145_worker workers[LIB6145_MAX_THREADS];
+  pthread_t tids[LIB6145_MAX_THREADS];
+  int started[LIB6145_MAX_THREADS];
+  struct s6145_state *st;
+  uint16_t *linebuf, *rest = NULL;
+  uint32_t planelen, sinklen;
+  int n, i, ret = 0;
+
+  PrintBanner();
+
+  if (!in)
+	  return 1;
+  if (!callback_fn)
+	  return 2;
+  if (!corrdata)
+	  return 3;
+
+  i = CheckPrintParam(corrdata);
+  if (i)
+    return i;
+
+  planelen = le16_to_cpu(param->headDots) * le16_to_cpu(param->height);
+  sinklen = le16_to_cpu(param->headDots) * SINK_LINES;
+
+  linebuf = malloc(sinklen * sizeof(uint16_t));
+  if (!linebuf)
+    return 4; /* Out of memory */
+
+  /* M, C, and O go to a buffer on the other threads; if there's only
+     the one thread (or no memory for the buffer) all four planes are
+     passed along as they're generated. */
+  n = lib6145_threads();
+  if (n > 1) {
+    rest = malloc(3 * planelen * sizeof(uint16_t));
+    if (!rest)
+      n = 1;
+  }
+
+  st = StateInit(in, linebuf, corrdata);
+  if (!st) {
+    free(rest);
+    free(linebuf);
+    return 4; /* Out of memory */
+  }
+  st->m_pfSinkFn = callback_fn;
+  st->m_pSinkContext = context;
+  st->m_uiSinkLen = sinklen;
+
+  for ( i = 1; i < n; i++ ) {
+    workers[i].in = in;
+    workers[i].out = rest;
+    workers[i].corrdata = corrdata;
+    workers[i].outplane = 1;
+    workers[i].plane = i;
+    workers[i].step = n - 1;
+    workers[i].ret = 0;
+    started[i] = !pthread_create(&tids[i], NULL, PlaneWorker, &workers[i]);
+  }
+
+  ProcessPlane(st, 0);
+  if (n == 1) {
+    for ( i = 1; i < 4 && !st->m_iSinkError; i++ )
+      ProcessPlane(st, i);
+  }
+
+  for ( i = 1; i < n; i++ ) {
+    if (started[i])
+      pthread_join(tids[i], NULL);
+    else if (!st->m_iSinkError)
+      PlaneWorker(&workers[i]);
+    if (workers[i].ret)
+      ret = workers[i].ret;
+  }
+
+  if (st->m_iSinkError)
+    ret = 5;
+  else if (!ret && rest &&
+	   callback_fn(context, rest, 3 * planelen * sizeof(uint16_t)))
+    ret = 5;
+
+  free(st);
+  free(rest);
+  free(linebuf);
+
+  return ret;
+}
+
 /* **************************** */
 
 static void SetTableData(void *src, void *dest, uint16_t words)
@@ -490,248 +783,255 @@ static void SetTableData(void *src, void *dest, uint16_t words)
   }
 }
 
-static void GetInfo(void)
+static void GetInfo(struct s6145_state *st)
 {
   uint32_t tmp;
 
 #ifdef S6145_UNUSED
-  g_usLastPrintSizeWidth = g_usPrintSizeWidth;
-  g_usLastPrintSizeHeight = g_usPrintSizeHeight;
-  g_usLastSheetSizeWidth = g_usSheetSizeWidth;
-  g_usPrintOffsetWidth = 0;
+  st->g_usLastPrintSizeWidth = st->g_usPrintSizeWidth;
+  st->g_usLastPrintSizeHeight = st->g_usPrintSizeHeight;
+  st->g_usLastSheetSizeWidth = st->g_usSheetSizeWidth;
+  st->g_usPrintOffsetWidth = 0;
 #endif
 
-  g_usPrintSizeWidth = le16_to_cpu(g_pSPrintParam->width);
-  g_usPrintSizeHeight = le16_to_cpu(g_pSPrintParam->height);
-  g_usSheetSizeWidth = g_usPrintSizeWidth;
+  st->g_usPrintSizeWidth = le16_to_cpu(st->g_pSPrintParam->width);
+  st->g_usPrintSizeHeight = le16_to_cpu(st->g_pSPrintParam->height);
+  st->g_usSheetSizeWidth = st->g_usPrintSizeWidth;
 
-  g_sPrintSideOffset = le16_to_cpu(g_pSPrintParam->printSideOffset);
+  st->g_sPrintSideOffset = le16_to_cpu(st->g_pSPrintParam->printSideOffset);
 
-  if ( g_pSPrintParam->val_1 )
-	  g_sCorrectSw |= 1;
-  if ( g_pSPrintParam->val_2 )
-	  g_sCorrectSw |= 2;
+  if ( st->g_pSPrintParam->val_1 )
+	  st->g_sCorrectSw |= 1;
+  if ( st->g_pSPrintParam->val_2 )
+	  st->g_sCorrectSw |= 2;
 
-  g_usPrintOpLevel = le16_to_cpu(g_pSPrintParam->printOpLevel);
+  st->g_usPrintOpLevel = le16_to_cpu(st->g_pSPrintParam->printOpLevel);
 
-  tmp = le16_to_cpu(g_pSPrintParam->randomBase[0]);
-  g_ucRandomBaseLevel[0] = tmp & 0xff;
-  tmp = le16_to_cpu(g_pSPrintParam->randomBase[1]);
-  g_ucRandomBaseLevel[1] = tmp & 0xff;
-  tmp = le16_to_cpu(g_pSPrintParam->randomBase[2]);
-  g_ucRandomBaseLevel[2] = tmp & 0xff;
-  tmp = le16_to_cpu(g_pSPrintParam->randomBase[3]);
-  g_ucRandomBaseLevel[3] = tmp & 0xff;
+  tmp = le16_to_cpu(st->g_pSPrintParam->randomBase[0]);
+  st->g_ucRandomBaseLevel[0] = tmp & 0xff;
+  tmp = le16_to_cpu(st->g_pSPrintParam->randomBase[1]);
+  st->g_ucRandomBaseLevel[1] = tmp & 0xff;
+  tmp = le16_to_cpu(st->g_pSPrintParam->randomBase[2]);
+  st->g_ucRandomBaseLevel[2] = tmp & 0xff;
+  tmp = le16_to_cpu(st->g_pSPrintParam->randomBase[3]);
+  st->g_ucRandomBaseLevel[3] = tmp & 0xff;
 
-  g_usMatteSize = le16_to_cpu(g_pSPrintParam->matteSize);
-  g_usMatteMode = le16_to_cpu(g_pSPrintParam->matteMode);
+  st->g_usMatteSize = le16_to_cpu(st->g_pSPrintParam->matteSize);
+  st->g_usMatteMode = le16_to_cpu(st->g_pSPrintParam->matteMode);
 
 #ifdef S6145_UNUSED
-  g_usMatteGloss = le16_to_cpu(g_pSPrintParam->matteGloss);
-  g_usMatteDeglossBlk = le16_to_cpu(g_pSPrintParam->matteDeglossBlk);
-  g_usMatteDeglossWht = le16_to_cpu(g_pSPrintParam->matteDeglossWht);
+  st->g_usMatteGloss = le16_to_cpu(st->g_pSPrintParam->matteGloss);
+  st->g_usMatteDeglossBlk = le16_to_cpu(st->g_pSPrintParam->matteDeglossBlk);
+  st->g_usMatteDeglossWht = le16_to_cpu(st->g_pSPrintParam->matteDeglossWht);
 #endif
 
-  switch (g_usPrintColor) {
+  switch (st->g_usPrintColor) {
   case 0:
-    g_usPrintMaxPulse = le16_to_cpu(g_pSPrintParam->printMaxPulse_Y);
-    g_uiMtfWeightH = le16_to_cpu(g_pSPrintParam->mtfWeightH_Y);
-    g_uiMtfWeightV = le16_to_cpu(g_pSPrintParam->mtfWeightV_Y);
-    g_uiMtfSlice = le16_to_cpu(g_pSPrintParam->mtfSlice_Y);
-    g_usLineCorrect_Env_A = le16_to_cpu(g_pSPrintParam->lineCorrectEnvA_Y);
-    g_usLineCorrect_Env_B = le16_to_cpu(g_pSPrintParam->lineCorrectEnvB_Y);
-    g_usLineCorrect_Env_C = le16_to_cpu(g_pSPrintParam->lineCorrectEnvC_Y);
-    g_uiLineCorrectSlice = le32_to_cpu(g_pSPrintParam->lineCorrectSlice_Y);
-    g_uiLineCorrectSlice1Line = le32_to_cpu(g_pSPrintParam->lineCorrectSlice1Line_Y);
-    g_iLineCorrectPulseMax = le32_to_cpu(g_pSPrintParam->lineCorrectPulseMax_Y);
+    st->g_usPrintMaxPulse = le16_to_cpu(st->g_pSPrintParam->printMaxPulse_Y);
+    st->g_uiMtfWeightH = le16_to_cpu(st->g_pSPrintParam->mtfWeightH_Y);
+    st->g_uiMtfWeightV = le16_to_cpu(st->g_pSPrintParam->mtfWeightV_Y);
+    st->g_uiMtfSlice = le16_to_cpu(st->g_pSPrintParam->mtfSlice_Y);
+    st->g_usLineCorrect_Env_A = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvA_Y);
+    st->g_usLineCorrect_Env_B = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvB_Y);
+    st->g_usLineCorrect_Env_C = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvC_Y);
+    st->g_uiLineCorrectSlice = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice_Y);
+    st->g_uiLineCorrectSlice1Line = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice1Line_Y);
+    st->g_iLineCorrectPulseMax = le32_to_cpu(st->g_pSPrintParam->lineCorrectPulseMax_Y);
     break;
   case 1:
-    g_usPrintMaxPulse = le16_to_cpu(g_pSPrintParam->printMaxPulse_M);
-    g_uiMtfWeightH = le16_to_cpu(g_pSPrintParam->mtfWeightH_M);
-    g_uiMtfWeightV = le16_to_cpu(g_pSPrintParam->mtfWeightV_M);
-    g_uiMtfSlice = le16_to_cpu(g_pSPrintParam->mtfSlice_M);
-    g_usLineCorrect_Env_A = le16_to_cpu(g_pSPrintParam->lineCorrectEnvA_M);
-    g_usLineCorrect_Env_B = le16_to_cpu(g_pSPrintParam->lineCorrectEnvB_M);
-    g_usLineCorrect_Env_C = le16_to_cpu(g_pSPrintParam->lineCorrectEnvC_M);
-    g_uiLineCorrectSlice = le32_to_cpu(g_pSPrintParam->lineCorrectSlice_M);
-    g_uiLineCorrectSlice1Line = le32_to_cpu(g_pSPrintParam->lineCorrectSlice1Line_M);
-    g_iLineCorrectPulseMax = le32_to_cpu(g_pSPrintParam->lineCorrectPulseMax_M);
+    st->g_usPrintMaxPulse = le16_to_cpu(st->g_pSPrintParam->printMaxPulse_M);
+    st->g_uiMtfWeightH = le16_to_cpu(st->g_pSPrintParam->mtfWeightH_M);
+    st->g_uiMtfWeightV = le16_to_cpu(st->g_pSPrintParam->mtfWeightV_M);
+    st->g_uiMtfSlice = le16_to_cpu(st->g_pSPrintParam->mtfSlice_M);
+    st->g_usLineCorrect_Env_A = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvA_M);
+    st->g_usLineCorrect_Env_B = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvB_M);
+    st->g_usLineCorrect_Env_C = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvC_M);
+    st->g_uiLineCorrectSlice = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice_M);
+    st->g_uiLineCorrectSlice1Line = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice1Line_M);
+    st->g_iLineCorrectPulseMax = le32_to_cpu(st->g_pSPrintParam->lineCorrectPulseMax_M);
     break;
   case 2:
-    g_usPrintMaxPulse = le16_to_cpu(g_pSPrintParam->printMaxPulse_C);
-    g_uiMtfWeightH = le16_to_cpu(g_pSPrintParam->mtfWeightH_C);
-    g_uiMtfWeightV = le16_to_cpu(g_pSPrintParam->mtfWeightV_C);
-    g_uiMtfSlice = le16_to_cpu(g_pSPrintParam->mtfSlice_C);
-    g_usLineCorrect_Env_A = le16_to_cpu(g_pSPrintParam->lineCorrectEnvA_C);
-    g_usLineCorrect_Env_B = le16_to_cpu(g_pSPrintParam->lineCorrectEnvB_C);
-    g_usLineCorrect_Env_C = le16_to_cpu(g_pSPrintParam->lineCorrectEnvC_C);
-    g_uiLineCorrectSlice = le32_to_cpu(g_pSPrintParam->lineCorrectSlice_C);
-    g_uiLineCorrectSlice1Line = le32_to_cpu(g_pSPrintParam->lineCorrectSlice1Line_C);
-    g_iLineCorrectPulseMax = le32_to_cpu(g_pSPrintParam->lineCorrectPulseMax_C);
+    st->g_usPrintMaxPulse = le16_to_cpu(st->g_pSPrintParam->printMaxPulse_C);
+    st->g_uiMtfWeightH = le16_to_cpu(st->g_pSPrintParam->mtfWeightH_C);
+    st->g_uiMtfWeightV = le16_to_cpu(st->g_pSPrintParam->mtfWeightV_C);
+    st->g_uiMtfSlice = le16_to_cpu(st->g_pSPrintParam->mtfSlice_C);
+    st->g_usLineCorrect_Env_A = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvA_C);
+    st->g_usLineCorrect_Env_B = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvB_C);
+    st->g_usLineCorrect_Env_C = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvC_C);
+    st->g_uiLineCorrectSlice = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice_C);
+    st->g_uiLineCorrectSlice1Line = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice1Line_C);
+    st->g_iLineCorrectPulseMax = le32_to_cpu(st->g_pSPrintParam->lineCorrectPulseMax_C);
     break;
   case 3:
-    g_usPrintMaxPulse = le16_to_cpu(g_pSPrintParam->printMaxPulse_O);
-    g_uiMtfWeightH = le16_to_cpu(g_pSPrintParam->mtfWeightH_O);
-    g_uiMtfWeightV = le16_to_cpu(g_pSPrintParam->mtfWeightV_O);
-    g_uiMtfSlice = le16_to_cpu(g_pSPrintParam->mtfSlice_O);;
-    g_usLineCorrect_Env_A = le16_to_cpu(g_pSPrintParam->lineCorrectEnvA_O);
-    g_usLineCorrect_Env_B = le16_to_cpu(g_pSPrintParam->lineCorrectEnvB_O);
-    g_usLineCorrect_Env_C = le16_to_cpu(g_pSPrintParam->lineCorrectEnvC_O);
-    g_uiLineCorrectSlice = le32_to_cpu(g_pSPrintParam->lineCorrectSlice_O);
-    g_uiLineCorrectSlice1Line = le32_to_cpu(g_pSPrintParam->lineCorrectSlice1Line_O);
-    g_iLineCorrectPulseMax = le32_to_cpu(g_pSPrintParam->lineCorrectPulseMax_O);
+    st->g_usPrintMaxPulse = le16_to_cpu(st->g_pSPrintParam->printMaxPulse_O);
+    st->g_uiMtfWeightH = le16_to_cpu(st->g_pSPrintParam->mtfWeightH_O);
+    st->g_uiMtfWeightV = le16_to_cpu(st->g_pSPrintParam->mtfWeightV_O);
+    st->g_uiMtfSlice = le16_to_cpu(st->g_pSPrintParam->mtfSlice_O);;
+    st->g_usLineCorrect_Env_A = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvA_O);
+    st->g_usLineCorrect_Env_B = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvB_O);
+    st->g_usLineCorrect_Env_C = le16_to_cpu(st->g_pSPrintParam->lineCorrectEnvC_O);
+    st->g_uiLineCorrectSlice = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice_O);
+    st->g_uiLineCorrectSlice1Line = le32_to_cpu(st->g_pSPrintParam->lineCorrectSlice1Line_O);
+    st->g_iLineCorrectPulseMax = le32_to_cpu(st->g_pSPrintParam->lineCorrectPulseMax_O);
     break;
   default:
-    printf("ERROR: bad g_usPrintColor %d\n", g_usPrintColor);
+    fprintf(stderr, "ERROR: bad st->g_usPrintColor %d\n", st->g_usPrintColor);
     break;
   }
 
-  g_usHeadDots = le16_to_cpu(g_pSPrintParam->headDots);
+  st->g_usHeadDots = le16_to_cpu(st->g_pSPrintParam->headDots);
 }
 
-static void Global_Init(void)
+static void Global_Init(struct s6145_state *st)
 {
-  g_usPrintColor = 0;
-  g_usPrintSizeWidth = 0;
-  g_usPrintSizeHeight = 0;
-  g_usSheetSizeWidth = 0;
-  g_sPrintSideOffset = 0;
-  g_sCorrectSw = 0;
-  g_usPrintOpLevel = 0;
-  g_uiMtfWeightH = 0;
-  g_uiMtfWeightV = 0;
-  g_uiMtfSlice = 0;
-  g_usPrintMaxPulse = MAX_PULSE;
-  g_usMatteMode = 0;
-  g_usLineCorrect_Env_A = 0;
-  g_usLineCorrect_Env_B = 0;
-  g_usLineCorrect_Env_C = 0;
-  g_uiLineCorrectSum = 0;
-  g_uiLineCorrectBase = 0;
-  g_uiLineCorrectBase1Line = 0;
-  g_iLineCorrectPulse = 0;
-  g_iLineCorrectPulseMax = MAX_PULSE;
-  g_pulRandomTable[0] = 3;
-  g_pulRandomTable[1] = -1708027847;
-  g_pulRandomTable[2] = 853131300;
-  g_pulRandomTable[3] = -1687801470;
-  g_pulRandomTable[4] = 1570894658;
-  g_pulRandomTable[5] = -566525472;
-  g_pulRandomTable[6] = -552964171;
-  g_pulRandomTable[7] = -251413502;
-  g_pulRandomTable[8] = 1223901435;
-  g_pulRandomTable[9] = 1950999915;
-  g_pulRandomTable[10] = -1095640144;
-  g_pulRandomTable[11] = -1420011240;
-  g_pulRandomTable[12] = -1805298435;
-  g_pulRandomTable[13] = -1943115761;
-  g_pulRandomTable[14] = -348292705;
-  g_pulRandomTable[15] = -1323376457;
-  g_pulRandomTable[16] = 759393158;
-  g_pulRandomTable[17] = -630772182;
-  g_pulRandomTable[18] = 361286280;
-  g_pulRandomTable[19] = -479628451;
-  g_pulRandomTable[20] = -1873857033;
-  g_pulRandomTable[21] = -686452778;
-  g_pulRandomTable[22] = 1873211473;
-  g_pulRandomTable[23] = 1634626454;
-  g_pulRandomTable[24] = -1399525412;
-  g_pulRandomTable[25] = 910245779;
-  g_pulRandomTable[26] = -970800488;
-  g_pulRandomTable[27] = -173790536;
-  g_pulRandomTable[28] = -1970743429;
-  g_pulRandomTable[29] = -173171442;
-  g_pulRandomTable[30] = -1986452981;
-  g_pulRandomTable[31] = 670779321;
-  g_uiInputImageIndex = 0;
-  g_uiOutputImageIndex = 0;
-  g_usHeadDots = 0;
+  st->g_usPrintColor = 0;
+  st->g_usPrintSizeWidth = 0;
+  st->g_usPrintSizeHeight = 0;
+  st->g_usSheetSizeWidth = 0;
+  st->g_sPrintSideOffset = 0;
+  st->g_sCorrectSw = 0;
+  st->g_usPrintOpLevel = 0;
+  st->g_uiMtfWeightH = 0;
+  st->g_uiMtfWeightV = 0;
+  st->g_uiMtfSlice = 0;
+  st->g_usPrintMaxPulse = MAX_PULSE;
+  st->g_usMatteMode = 0;
+  st->g_usLineCorrect_Env_A = 0;
+  st->g_usLineCorrect_Env_B = 0;
+  st->g_usLineCorrect_Env_C = 0;
+  st->g_uiLineCorrectSum = 0;
+  st->g_uiLineCorrectBase = 0;
+  st->g_uiLineCorrectBase1Line = 0;
+  st->g_iLineCorrectPulse = 0;
+  st->g_iLineCorrectPulseMax = MAX_PULSE;
+  st->g_pulRandomTable[0] = 3;
+  st->g_pulRandomTable[1] = -1708027847;
+  st->g_pulRandomTable[2] = 853131300;
+  st->g_pulRandomTable[3] = -1687801470;
+  st->g_pulRandomTable[4] = 1570894658;
+  st->g_pulRandomTable[5] = -566525472;
+  st->g_pulRandomTable[6] = -552964171;
+  st->g_pulRandomTable[7] = -251413502;
+  st->g_pulRandomTable[8] = 1223901435;
+  st->g_pulRandomTable[9] = 1950999915;
+  st->g_pulRandomTable[10] = -1095640144;
+  st->g_pulRandomTable[11] = -1420011240;
+  st->g_pulRandomTable[12] = -1805298435;
+  st->g_pulRandomTable[13] = -1943115761;
+  st->g_pulRandomTable[14] = -348292705;
+  st->g_pulRandomTable[15] = -1323376457;
+  st->g_pulRandomTable[16] = 759393158;
+  st->g_pulRandomTable[17] = -630772182;
+  st->g_pulRandomTable[18] = 361286280;
+  st->g_pulRandomTable[19] = -479628451;
+  st->g_pulRandomTable[20] = -1873857033;
+  st->g_pulRandomTable[21] = -686452778;
+  st->g_pulRandomTable[22] = 1873211473;
+  st->g_pulRandomTable[23] = 1634626454;
+  st->g_pulRandomTable[24] = -1399525412;
+  st->g_pulRandomTable[25] = 910245779;
+  st->g_pulRandomTable[26] = -970800488;
+  st->g_pulRandomTable[27] = -173790536;
+  st->g_pulRandomTable[28] = -1970743429;
+  st->g_pulRandomTable[29] = -173171442;
+  st->g_pulRandomTable[30] = -1986452981;
+  st->g_pulRandomTable[31] = 670779321;
+  st->g_uiInputImageIndex = 0;
+  st->g_uiOutputImageIndex = 0;
+  st->g_usHeadDots = 0;
 
 #ifdef S6145_UNUSED
 
-  g_usPrintDummyLevel = 0;
-  g_usPrintDummyLine = 0;
-  g_usRearDummyPrintLine = 0;
-  g_usRearDeleteLine = 0;
+  st->g_usPrintDummyLevel = 0;
+  st->g_usPrintDummyLine = 0;
+  st->g_usRearDummyPrintLine = 0;
+  st->g_usRearDeleteLine = 0;
 
-  g_usPrintSizeLWidth = 0;
-  g_usPrintSizeLHeight = 0;
+  st->g_usPrintSizeLWidth = 0;
+  st->g_usPrintSizeLHeight = 0;
 
-  g_usThearmHead = 0;
-  g_usThearmEnv = 0;
-  g_usRearDummyPrintLevel = 0;
+  st->g_usThearmHead = 0;
+  st->g_usThearmEnv = 0;
+  st->g_usRearDummyPrintLevel = 0;
 
-  g_usLastPrintSizeWidth = 0;
-  g_usLastPrintSizeHeight = 0;
-  g_usLastSheetSizeWidth = 0;
+  st->g_usLastPrintSizeWidth = 0;
+  st->g_usLastPrintSizeHeight = 0;
+  st->g_usLastSheetSizeWidth = 0;
 
-  g_iLeadEdgeCorrectPulse = 0;
+  st->g_iLeadEdgeCorrectPulse = 0;
 
-  g_usCancelCheckLinesForPRec = 118;
+  st->g_usCancelCheckLinesForPRec = 118;
 
-  g_pusLamiCompInLineBufTab[0] = (uint16_t*)g_pusInLineBuf0;
-  g_pusLamiCompInLineBufTab[1] = (uint16_t*)g_pusInLineBuf2;
-  g_pusLamiCompInLineBufTab[2] = g_pusOutLineBuf1;
-  g_pusLamiCompInLineBufTab[3] = g_pusOutLineBuf2;
+  st->g_pusLamiCompInLineBufTab[0] = (uint16_t*)st->g_pusInLineBuf0;
+  st->g_pusLamiCompInLineBufTab[1] = (uint16_t*)st->g_pusInLineBuf2;
+  st->g_pusLamiCompInLineBufTab[2] = st->g_pusOutLineBuf1;
+  st->g_pusLamiCompInLineBufTab[3] = st->g_pusOutLineBuf2;
 
-  g_usMatteGloss = 105;
-  g_usMatteDeglossBlk = 150;
-  g_usMatteDeglossWht = 175;
+  st->g_usMatteGloss = 105;
+  st->g_usMatteDeglossBlk = 150;
+  st->g_usMatteDeglossWht = 175;
 
-  g_usPrintOffsetWidth = 0;
-  g_usCenterHeadToColSen = 268;
+  st->g_usPrintOffsetWidth = 0;
+  st->g_usCenterHeadToColSen = 268;
 
-  g_uiLevelAveAddtion = 0;
-  g_uiLevelAveCounter = 0;
-  g_uiLevelAveCounter2 = 0;
-  g_uiLevelAveAddtion2 = 0;
-  g_usCancelCheckDotsForPRec = 236;
+  st->g_uiLevelAveAddtion = 0;
+  st->g_uiLevelAveCounter = 0;
+  st->g_uiLevelAveCounter2 = 0;
+  st->g_uiLevelAveAddtion2 = 0;
+  st->g_usCancelCheckDotsForPRec = 236;
 #endif
 }
 
 #ifdef S6145_UNUSED
-static void SetTable(void)
+static void SetTable(struct s6145_state *st)
 {
-  SetTableData(g_pSPrintParam->SideEdgeCoefTable, g_pusSideEdgeCoefTable, 128);
-  SetTableData(g_pSPrintParam->SideEdgeLvCoefTable, g_pusSideEdgeLvCoefTable, 256);
+  SetTableData(st->g_pSPrintParam->SideEdgeCoefTable, st->g_pusSideEdgeCoefTable, 128);
+  SetTableData(st->g_pSPrintParam->SideEdgeLvCoefTable, st->g_pusSideEdgeLvCoefTable, 256);
 }
 #endif
 
-static void SetTableColor(uint8_t plane)
+static void SetTableColor(struct s6145_state *st, uint8_t plane)
 {
+  int i;
+
   switch (plane) {
   case 0:
-    SetTableData(g_pSPrintParam->pulseTransTable_Y, g_pusPulseTransTable, 256);
-    SetTableData(g_pSPrintParam->lineHistCoefTable_Y, g_pusLineHistCoefTable, 256);
-    SetTableData(g_pSPrintParam->tankPlusMaxEnergyTable_Y, g_pusTankPlusMaxEnegyTable, 256);
-    SetTableData(g_pSPrintParam->tankMinusMaxEnergy_Y, g_pusTankMinusMaxEnegyTable, 256);
-    memcpy(g_piTankParam, &g_pSPrintParam->tableTankParam_Y, 128);
+    SetTableData(st->g_pSPrintParam->pulseTransTable_Y, st->g_pusPulseTransTable, 256);
+    SetTableData(st->g_pSPrintParam->lineHistCoefTable_Y, st->g_pusLineHistCoefTable, 256);
+    SetTableData(st->g_pSPrintParam->tankPlusMaxEnergyTable_Y, st->g_pusTankPlusMaxEnegyTable, 256);
+    SetTableData(st->g_pSPrintParam->tankMinusMaxEnergy_Y, st->g_pusTankMinusMaxEnegyTable, 256);
+    memcpy(st->g_piTankParam, &st->g_pSPrintParam->tableTankParam_Y, 128);
     break;
   case 1:
-    SetTableData(g_pSPrintParam->pulseTransTable_M, g_pusPulseTransTable, 256);
-    SetTableData(g_pSPrintParam->lineHistCoefTable_M, g_pusLineHistCoefTable, 256);
-    SetTableData(g_pSPrintParam->tankPlusMaxEnergyTable_M, g_pusTankPlusMaxEnegyTable, 256);
-    SetTableData(g_pSPrintParam->tankMinusMaxEnergy_M, g_pusTankMinusMaxEnegyTable, 256);
-    memcpy(&g_piTankParam[32], &g_pSPrintParam->tableTankParam_M, 128);
+    SetTableData(st->g_pSPrintParam->pulseTransTable_M, st->g_pusPulseTransTable, 256);
+    SetTableData(st->g_pSPrintParam->lineHistCoefTable_M, st->g_pusLineHistCoefTable, 256);
+    SetTableData(st->g_pSPrintParam->tankPlusMaxEnergyTable_M, st->g_pusTankPlusMaxEnegyTable, 256);
+    SetTableData(st->g_pSPrintParam->tankMinusMaxEnergy_M, st->g_pusTankMinusMaxEnegyTable, 256);
+    memcpy(&st->g_piTankParam[32], &st->g_pSPrintParam->tableTankParam_M, 128);
     break;
   case 2:
-    SetTableData(g_pSPrintParam->pulseTransTable_C, g_pusPulseTransTable, 256);
-    SetTableData(g_pSPrintParam->lineHistCoefTable_C, g_pusLineHistCoefTable, 256);
-    SetTableData(g_pSPrintParam->tankPlusMaxEnergyTable_C, g_pusTankPlusMaxEnegyTable, 256);
-    SetTableData(g_pSPrintParam->tankMinusMaxEnergy_C, g_pusTankMinusMaxEnegyTable, 256);
-    memcpy(&g_piTankParam[64], &g_pSPrintParam->tableTankParam_C, 128);
+    SetTableData(st->g_pSPrintParam->pulseTransTable_C, st->g_pusPulseTransTable, 256);
+    SetTableData(st->g_pSPrintParam->lineHistCoefTable_C, st->g_pusLineHistCoefTable, 256);
+    SetTableData(st->g_pSPrintParam->tankPlusMaxEnergyTable_C, st->g_pusTankPlusMaxEnegyTable, 256);
+    SetTableData(st->g_pSPrintParam->tankMinusMaxEnergy_C, st->g_pusTankMinusMaxEnegyTable, 256);
+    memcpy(&st->g_piTankParam[64], &st->g_pSPrintParam->tableTankParam_C, 128);
     break;
   case 3:
-    SetTableData(g_pSPrintParam->pulseTransTable_O, g_pusPulseTransTable, 256);
-    SetTableData(g_pSPrintParam->lineHistCoefTable_O, g_pusLineHistCoefTable, 256);
-    SetTableData(g_pSPrintParam->tankPlusMaxEnergyTable_O, g_pusTankPlusMaxEnegyTable, 256);
-    SetTableData(g_pSPrintParam->tankMinusMaxEnergy_O, g_pusTankMinusMaxEnegyTable, 256);
-    memcpy(&g_piTankParam[96], &g_pSPrintParam->tableTankParam_O, 128);
+    SetTableData(st->g_pSPrintParam->pulseTransTable_O, st->g_pusPulseTransTable, 256);
+    SetTableData(st->g_pSPrintParam->lineHistCoefTable_O, st->g_pusLineHistCoefTable, 256);
+    SetTableData(st->g_pSPrintParam->tankPlusMaxEnergyTable_O, st->g_pusTankPlusMaxEnegyTable, 256);
+    SetTableData(st->g_pSPrintParam->tankMinusMaxEnergy_O, st->g_pusTankMinusMaxEnegyTable, 256);
+    memcpy(&st->g_piTankParam[96], &st->g_pSPrintParam->tableTankParam_O, 128);
     break;
   default:
-    printf("ERROR: Bad plane in SetTableColor (%d)\n", plane);
+    fprintf(stderr, "ERROR: Bad plane in SetTableColor (%d)\n", plane);
     break;
   }
+
+  for (i = 0 ; i < 256 ; i++) {
+    st->m_puiTankMaxEnergyTable[i] = st->g_pusTankMinusMaxEnegyTable[i] |
+      ((uint32_t)st->g_pusTankPlusMaxEnegyTable[i] << 16);
+  }
 }
 
 static int32_t CheckPrintParam(uint8_t *corrdataraw)
@@ -796,292 +1096,292 @@ static int32_t CheckPrintParam(uint8_t *corrdataraw)
 
 /* This resets the preprocess pipeline at the start of a new image
    plane. */
-static void LinePrintPreProcess(void)
+static void LinePrintPreProcess(struct s6145_state *st)
 {
   int16_t i;
 
-  GetInfo();
+  GetInfo(st);
 
-  if ( !(g_sCorrectSw & 1) )
+  if ( !(st->g_sCorrectSw & 1) )
   {
-    g_uiMtfWeightH = 0;
-    g_uiMtfWeightV = 0;
-    g_uiMtfSlice = 0;
+    st->g_uiMtfWeightH = 0;
+    st->g_uiMtfWeightV = 0;
+    st->g_uiMtfSlice = 0;
   }
 
   for ( i = -256; i < 256; i++ )
   {
-    if ( (uint32_t)(i * i) >= (uint32_t)(g_uiMtfSlice * g_uiMtfSlice) )
-	    g_psMtfPreCalcTable[i+256] = i;
+    if ( (uint32_t)(i * i) >= (uint32_t)(st->g_uiMtfSlice * st->g_uiMtfSlice) )
+	    st->g_psMtfPreCalcTable[i+256] = i;
     else
-	    g_psMtfPreCalcTable[i+256] = -i;
-  }
-
-  g_pusPreReadLineBufTab[0] = g_pusInLineBuf0;
-  g_pusPreReadLineBufTab[1] = g_pusInLineBuf1;
-  g_pusPreReadLineBufTab[2] = g_pusInLineBuf2;
-  g_pusPreReadLineBufTab[3] = g_pusInLineBuf3;
-  g_pusPreReadLineBufTab[4] = g_pusInLineBuf4;
-  g_pusPreReadLineBufTab[5] = g_pusInLineBuf5;
-  g_pusPreReadLineBufTab[6] = g_pusInLineBuf6;
-  g_pusPreReadLineBufTab[7] = g_pusInLineBuf7;
-  g_pusPreReadLineBufTab[8] = g_pusInLineBuf8;
-  g_pusPreReadLineBufTab[9] = g_pusInLineBuf9;
-  g_pusPreReadLineBufTab[10] = g_pusInLineBufA;
-
-  memset(g_pusInLineBuf0, 0, sizeof(g_pusInLineBuf0));
-  memset(g_pusInLineBuf1, 0, sizeof(g_pusInLineBuf1));
-  memset(g_pusInLineBuf2, 0, sizeof(g_pusInLineBuf2));
-  memset(g_pusInLineBuf3, 0, sizeof(g_pusInLineBuf3));
-  memset(g_pusInLineBuf4, 0, sizeof(g_pusInLineBuf4));
-  memset(g_pusInLineBuf5, 0, sizeof(g_pusInLineBuf5));
-  memset(g_pusInLineBuf6, 0, sizeof(g_pusInLineBuf6));
-  memset(g_pusInLineBuf7, 0, sizeof(g_pusInLineBuf7));
-  memset(g_pusInLineBuf8, 0, sizeof(g_pusInLineBuf8));
-  memset(g_pusInLineBuf9, 0, sizeof(g_pusInLineBuf9));
-  memset(g_pusInLineBufA, 0, sizeof(g_pusInLineBufA));
-
-  g_pusPulseTransLineBufTab[0] = g_pusInLineBuf0;
-  g_pusPulseTransLineBufTab[1] = g_pusInLineBuf1;
-  g_pusPulseTransLineBufTab[2] = g_pusInLineBuf2;
-  g_pusPulseTransLineBufTab[3] = g_pusInLineBuf3;
-
-  memset(g_pusOutLineBuf1, 0, sizeof(g_pusOutLineBuf1));
-  g_pusOutLineBufTab[0] = g_pusOutLineBuf1;
+	    st->g_psMtfPreCalcTable[i+256] = -i;
+  }
+
+  st->g_pusPreReadLineBufTab[0] = st->g_pusInLineBuf0;
+  st->g_pusPreReadLineBufTab[1] = st->g_pusInLineBuf1;
+  st->g_pusPreReadLineBufTab[2] = st->g_pusInLineBuf2;
+  st->g_pusPreReadLineBufTab[3] = st->g_pusInLineBuf3;
+  st->g_pusPreReadLineBufTab[4] = st->g_pusInLineBuf4;
+  st->g_pusPreReadLineBufTab[5] = st->g_pusInLineBuf5;
+  st->g_pusPreReadLineBufTab[6] = st->g_pusInLineBuf6;
+  st->g_pusPreReadLineBufTab[7] = st->g_pusInLineBuf7;
+  st->g_pusPreReadLineBufTab[8] = st->g_pusInLineBuf8;
+  st->g_pusPreReadLineBufTab[9] = st->g_pusInLineBuf9;
+  st->g_pusPreReadLineBufTab[10] = st->g_pusInLineBufA;
+
+  memset(st->g_pusInLineBuf0, 0, sizeof(st->g_pusInLineBuf0));
+  memset(st->g_pusInLineBuf1, 0, sizeof(st->g_pusInLineBuf1));
+  memset(st->g_pusInLineBuf2, 0, sizeof(st->g_pusInLineBuf2));
+  memset(st->g_pusInLineBuf3, 0, sizeof(st->g_pusInLineBuf3));
+  memset(st->g_pusInLineBuf4, 0, sizeof(st->g_pusInLineBuf4));
+  memset(st->g_pusInLineBuf5, 0, sizeof(st->g_pusInLineBuf5));
+  memset(st->g_pusInLineBuf6, 0, sizeof(st->g_pusInLineBuf6));
+  memset(st->g_pusInLineBuf7, 0, sizeof(st->g_pusInLineBuf7));
+  memset(st->g_pusInLineBuf8, 0, sizeof(st->g_pusInLineBuf8));
+  memset(st->g_pusInLineBuf9, 0, sizeof(st->g_pusInLineBuf9));
+  memset(st->g_pusInLineBufA, 0, sizeof(st->g_pusInLineBufA));
+
+  st->g_pusPulseTransLineBufTab[0] = st->g_pusInLineBuf0;
+  st->g_pusPulseTransLineBufTab[1] = st->g_pusInLineBuf1;
+  st->g_pusPulseTransLineBufTab[2] = st->g_pusInLineBuf2;
+  st->g_pusPulseTransLineBufTab[3] = st->g_pusInLineBuf3;
+
+  memset(st->g_pusOutLineBuf1, 0, sizeof(st->g_pusOutLineBuf1));
+  st->g_pusOutLineBufTab[0] = st->g_pusOutLineBuf1;
 
 #ifdef S6145_UNUSED
-  memset(g_pusInLineBuf3, g_usPrintDummyLevel, sizeof(g_pusInLineBuf3)); // XXX redundant with memset above, printDummyLevel is always 0 anyway.
+  memset(st->g_pusInLineBuf3, st->g_usPrintDummyLevel, sizeof(st->g_pusInLineBuf3)); // XXX redundant with memset above, printDummyLevel is always 0 anyway.
 #endif
 
-  g_uiSendToHeadCounter = g_usPrintSizeHeight;
-  g_uiLineCopyCounter = g_usPrintSizeHeight;
+  st->g_uiSendToHeadCounter = st->g_usPrintSizeHeight;
+  st->g_uiLineCopyCounter = st->g_usPrintSizeHeight;
 
 #ifdef S6145_UNUSED
-  g_uiDataTransCounter = g_usPrintSizeHeight;
-  g_uiDataTransCounter += g_usPrintDummyLine;
-  g_uiDataTransCounter -= g_usRearDeleteLine;
-  g_uiDataTransCounter += g_usRearDummyPrintLine;
+  st->g_uiDataTransCounter = st->g_usPrintSizeHeight;
+  st->g_uiDataTransCounter += st->g_usPrintDummyLine;
+  st->g_uiDataTransCounter -= st->g_usRearDeleteLine;
+  st->g_uiDataTransCounter += st->g_usRearDummyPrintLine;
 
-  g_uiSendToHeadCounter += g_usPrintDummyLine;
-  g_uiSendToHeadCounter -= g_usRearDeleteLine;
-  g_uiSendToHeadCounter += g_usRearDummyPrintLine;
+  st->g_uiSendToHeadCounter += st->g_usPrintDummyLine;
+  st->g_uiSendToHeadCounter -= st->g_usRearDeleteLine;
+  st->g_uiSendToHeadCounter += st->g_usRearDummyPrintLine;
 
-  g_uiTudenLineCounter = g_usPrintSizeHeight;
-  g_uiTudenLineCounter += g_usRearDummyPrintLine;
-  g_uiTudenLineCounter -= g_usRearDeleteLine;
+  st->g_uiTudenLineCounter = st->g_usPrintSizeHeight;
+  st->g_uiTudenLineCounter += st->g_usRearDummyPrintLine;
+  st->g_uiTudenLineCounter -= st->g_usRearDeleteLine;
 
-  g_uiLineCopyCounter -= g_usRearDeleteLine;
+  st->g_uiLineCopyCounter -= st->g_usRearDeleteLine;
 
-  if ( g_usPrintColor != 3 )
-    g_usRearDummyPrintLevel = 255;
+  if ( st->g_usPrintColor != 3 )
+    st->g_usRearDummyPrintLevel = 255;
 
-  g_iLeadEdgeCorrectPulse = 0;
+  st->g_iLeadEdgeCorrectPulse = 0;
 #endif
 
-  switch (g_usPrintColor) {
+  switch (st->g_usPrintColor) {
   case 0:
-    CTankResetParameter(&g_piTankParam[0]);
-    g_iMaxPulseValue = g_usPrintMaxPulse;
-    g_uiMaxPulseBit = LinePrintCalcBit(g_usPrintMaxPulse);
-    g_pfRecieveData = RecieveDataYMC;
+    CTankResetParameter(st, &st->g_piTankParam[0]);
+    st->g_iMaxPulseValue = st->g_usPrintMaxPulse;
+    st->g_uiMaxPulseBit = LinePrintCalcBit(st->g_usPrintMaxPulse);
+    st->g_pfRecieveData = RecieveDataYMC;
 #ifdef S6145_UNUSED
-    g_pfRecieveData_Post = RecieveDataYMC_Post;
+    st->g_pfRecieveData_Post = RecieveDataYMC_Post;
 #endif
-    g_pfPulseTransPreRead = PulseTransPreReadYMC;
-    g_pfTankProcessPreRead = CTankProcessPreRead;
+    st->g_pfPulseTransPreRead = PulseTransPreReadYMC;
+    st->g_pfTankProcessPreRead = CTankProcessPreRead;
     break;
   case 1:
-    CTankResetParameter(&g_piTankParam[32]);
-    g_iMaxPulseValue = g_usPrintMaxPulse;
-    g_uiMaxPulseBit = LinePrintCalcBit(g_usPrintMaxPulse);
-    g_pfRecieveData = RecieveDataYMC;
+    CTankResetParameter(st, &st->g_piTankParam[32]);
+    st->g_iMaxPulseValue = st->g_usPrintMaxPulse;
+    st->g_uiMaxPulseBit = LinePrintCalcBit(st->g_usPrintMaxPulse);
+    st->g_pfRecieveData = RecieveDataYMC;
 #ifdef S6145_UNUSED
-    g_pfRecieveData_Post = RecieveDataYMC_Post;
+    st->g_pfRecieveData_Post = RecieveDataYMC_Post;
 #endif
-    g_pfPulseTransPreRead = PulseTransPreReadYMC;
-    g_pfTankProcessPreRead = CTankProcessPreRead;
+    st->g_pfPulseTransPreRead = PulseTransPreReadYMC;
+    st->g_pfTankProcessPreRead = CTankProcessPreRead;
     break;
   case 2:
-    CTankResetParameter(&g_piTankParam[64]);
-    g_iMaxPulseValue = g_usPrintMaxPulse;
-    g_uiMaxPulseBit = LinePrintCalcBit(g_usPrintMaxPulse);
-    g_pfRecieveData = RecieveDataYMC;
+    CTankResetParameter(st, &st->g_piTankParam[64]);
+    st->g_iMaxPulseValue = st->g_usPrintMaxPulse;
+    st->g_uiMaxPulseBit = LinePrintCalcBit(st->g_usPrintMaxPulse);
+    st->g_pfRecieveData = RecieveDataYMC;
 #ifdef S6145_UNUSED
-    g_pfRecieveData_Post = RecieveDataYMC_Post;
+    st->g_pfRecieveData_Post = RecieveDataYMC_Post;
 #endif
-    g_pfPulseTransPreRead = PulseTransPreReadYMC;
-    g_pfTankProcessPreRead = CTankProcessPreRead;
+    st->g_pfPulseTransPreRead = PulseTransPreReadYMC;
+    st->g_pfTankProcessPreRead = CTankProcessPreRead;
     break;
   case 3:
-    CTankResetParameter(&g_piTankParam[96]);
-    g_iMaxPulseValue = g_usPrintMaxPulse;
-    g_uiMaxPulseBit = LinePrintCalcBit(g_usPrintMaxPulse);
-    if ( g_usMatteMode ) {
-      g_pfRecieveData = RecieveDataOP_MATTE;
+    CTankResetParameter(st, &st->g_piTankParam[96]);
+    st->g_iMaxPulseValue = st->g_usPrintMaxPulse;
+    st->g_uiMaxPulseBit = LinePrintCalcBit(st->g_usPrintMaxPulse);
+    if ( st->g_usMatteMode ) {
+      st->g_pfRecieveData = RecieveDataOP_MATTE;
 #ifdef S6145_UNUSED
-      g_pfRecieveData_Post = RecieveDataOPMatte_Post;
+      st->g_pfRecieveData_Post = RecieveDataOPMatte_Post;
 #endif
     } else {
-      g_pfRecieveData = RecieveDataOP_GLOSS;
+      st->g_pfRecieveData = RecieveDataOP_GLOSS;
 #ifdef S6145_UNUSED
-      g_pfRecieveData_Post = RecieveDataOPLevel_Post;
+      st->g_pfRecieveData_Post = RecieveDataOPLevel_Post;
 #endif
     }
-    g_pfPulseTransPreRead = PulseTransPreReadOP;
-    g_pfTankProcessPreRead = CTankProcessPreReadDummy;
+    st->g_pfPulseTransPreRead = PulseTransPreReadOP;
+    st->g_pfTankProcessPreRead = CTankProcessPreReadDummy;
 #ifdef S6145_UNUSED
-    if ( g_usMatteMode )
-      g_iLeadEdgeCorrectPulse = 120;
+    if ( st->g_usMatteMode )
+      st->g_iLeadEdgeCorrectPulse = 120;
 #endif
     break;
   default:
-    printf("ERROR: Bad g_usPrintColor %d\n", g_usPrintColor);
+    fprintf(stderr, "ERROR: Bad st->g_usPrintColor %d\n", st->g_usPrintColor);
     return;
   }
 
-  g_uiLineCorrectSum = 0;
-  g_iLineCorrectPulse = 0;
+  st->g_uiLineCorrectSum = 0;
+  st->g_iLineCorrectPulse = 0;
 
-  if ( g_uiLineCorrectSlice ) {
-    g_uiLineCorrectBase = g_uiLineCorrectSlice * g_usLineCorrect_Env_A;
-    g_uiLineCorrectBase >>= 15;
-    g_uiLineCorrectBase *= g_usSheetSizeWidth;
+  if ( st->g_uiLineCorrectSlice ) {
+    st->g_uiLineCorrectBase = st->g_uiLineCorrectSlice * st->g_usLineCorrect_Env_A;
+    st->g_uiLineCorrectBase >>= 15;
+    st->g_uiLineCorrectBase *= st->g_usSheetSizeWidth;
   } else {
-    g_uiLineCorrectBase = -1;
+    st->g_uiLineCorrectBase = -1;
   }
 
-  if ( g_uiLineCorrectSlice1Line ) {
-    g_uiLineCorrectBase1Line = g_uiLineCorrectSlice1Line * g_usLineCorrect_Env_B;
-    g_uiLineCorrectBase1Line >>= 15;
-    g_uiLineCorrectBase1Line *= g_usSheetSizeWidth;
+  if ( st->g_uiLineCorrectSlice1Line ) {
+    st->g_uiLineCorrectBase1Line = st->g_uiLineCorrectSlice1Line * st->g_usLineCorrect_Env_B;
+    st->g_uiLineCorrectBase1Line >>= 15;
+    st->g_uiLineCorrectBase1Line *= st->g_usSheetSizeWidth;
   }
 
-  if ( g_iLineCorrectPulseMax ) {
-    g_iLineCorrectPulseMax *= g_usLineCorrect_Env_C;
-    g_iLineCorrectPulseMax /= 1024;
+  if ( st->g_iLineCorrectPulseMax ) {
+    st->g_iLineCorrectPulseMax *= st->g_usLineCorrect_Env_C;
+    st->g_iLineCorrectPulseMax /= 1024;
   } else {
-    g_iLineCorrectPulseMax = MAX_PULSE;
+    st->g_iLineCorrectPulseMax = MAX_PULSE;
   }
 
-  CTankResetTank();
+  CTankResetTank(st);
 
 #ifdef S6145_UNUSED
-  g_uiDummyPrintCounter = 0;
+  st->g_uiDummyPrintCounter = 0;
 #endif
 }
 
-static void CTankResetParameter(int32_t *params)
+static void CTankResetParameter(struct s6145_state *st, int32_t *params)
 {
-  m_iTrdTankSize = le32_to_cpu(params[0]);
-  m_iSndTankSize = le32_to_cpu(params[1]);
-  m_iFstTankSize = le32_to_cpu(params[2]);
-  m_iTrdTankIniEnergy = le32_to_cpu(params[3]);
-  m_iSndTankIniEnergy = le32_to_cpu(params[4]);
-  m_iFstTankIniEnergy = le32_to_cpu(params[5]);
-  m_iTrdTrdConductivity = le32_to_cpu(params[6]);
-  m_iSndSndConductivity = le32_to_cpu(params[7]);
-  m_iFstFstConductivity = le32_to_cpu(params[8]);
-  m_iOutTrdConductivity = le32_to_cpu(params[9]);
-  m_iTrdSndConductivity = le32_to_cpu(params[10]);
-  m_iSndFstConductivity = le32_to_cpu(params[11]);
-  m_iFstOutConductivity = le32_to_cpu(params[12]);
+  st->m_iTrdTankSize = le32_to_cpu(params[0]);
+  st->m_iSndTankSize = le32_to_cpu(params[1]);
+  st->m_iFstTankSize = le32_to_cpu(params[2]);
+  st->m_iTrdTankIniEnergy = le32_to_cpu(params[3]);
+  st->m_iSndTankIniEnergy = le32_to_cpu(params[4]);
+  st->m_iFstTankIniEnergy = le32_to_cpu(params[5]);
+  st->m_iTrdTrdConductivity = le32_to_cpu(params[6]);
+  st->m_iSndSndConductivity = le32_to_cpu(params[7]);
+  st->m_iFstFstConductivity = le32_to_cpu(params[8]);
+  st->m_iOutTrdConductivity = le32_to_cpu(params[9]);
+  st->m_iTrdSndConductivity = le32_to_cpu(params[10]);
+  st->m_iSndFstConductivity = le32_to_cpu(params[11]);
+  st->m_iFstOutConductivity = le32_to_cpu(params[12]);
 #ifdef S6145_UNUSED
-  m_iPlusMaxEnergy = le32_to_cpu(params[13]);
-  m_iMinusMaxEnergy = le32_to_cpu(params[14]);
-  m_iPlusMaxEnergyPreRead = le32_to_cpu(params[15]);
+  st->m_iPlusMaxEnergy = le32_to_cpu(params[13]);
+  st->m_iMinusMaxEnergy = le32_to_cpu(params[14]);
+  st->m_iPlusMaxEnergyPreRead = le32_to_cpu(params[15]);
 #endif
 
-  m_iMinusMaxEnergyPreRead = le32_to_cpu(params[16]);
-  m_iPreReadLevelDiff = le32_to_cpu(params[17]);
+  st->m_iMinusMaxEnergyPreRead = le32_to_cpu(params[16]);
+  st->m_iPreReadLevelDiff = le32_to_cpu(params[17]);
 
-  m_iTankKeisuOutTrdDivTrd = (int64_t)m_iOutTrdConductivity * (int64_t)0x10000 / (int64_t)m_iTrdTankSize;
-  m_iTankKeisuTrdSndDivTrd = (int64_t)m_iTrdSndConductivity * (int64_t)0x10000 / (int64_t)m_iTrdTankSize;
-  m_iTankKeisuTrdSndDivSnd = (int64_t)m_iTrdSndConductivity * (int64_t)0x10000 / (int64_t)m_iSndTankSize;
-  m_iTankKeisuSndFstDivSnd = (int64_t)m_iSndFstConductivity * (int64_t)0x10000 / (int64_t)m_iSndTankSize;
-  m_iTankKeisuSndFstDivFst = (int64_t)m_iSndFstConductivity * (int64_t)0x10000 / (int64_t)m_iFstTankSize;
-  m_iTankKeisuFstOutDivFst = (int64_t)m_iFstOutConductivity * (int64_t)0x10000 / (int64_t)m_iFstTankSize;
+  st->m_iTankKeisuOutTrdDivTrd = (int64_t)st->m_iOutTrdConductivity * (int64_t)0x10000 / (int64_t)st->m_iTrdTankSize;
+  st->m_iTankKeisuTrdSndDivTrd = (int64_t)st->m_iTrdSndConductivity * (int64_t)0x10000 / (int64_t)st->m_iTrdTankSize;
+  st->m_iTankKeisuTrdSndDivSnd = (int64_t)st->m_iTrdSndConductivity * (int64_t)0x10000 / (int64_t)st->m_iSndTankSize;
+  st->m_iTankKeisuSndFstDivSnd = (int64_t)st->m_iSndFstConductivity * (int64_t)0x10000 / (int64_t)st->m_iSndTankSize;
+  st->m_iTankKeisuSndFstDivFst = (int64_t)st->m_iSndFstConductivity * (int64_t)0x10000 / (int64_t)st->m_iFstTankSize;
+  st->m_iTankKeisuFstOutDivFst = (int64_t)st->m_iFstOutConductivity * (int64_t)0x10000 / (int64_t)st->m_iFstTankSize;
 
   return;
 }
 
-static void CTankResetTank(void)
+static void CTankResetTank(struct s6145_state *st)
 {
   int i;
 
   for (i = 0 ; i < TANK_SIZE; i++) {
-    m_piTrdTankArray[i] = m_iTrdTankIniEnergy;
-    m_piSndTankArray[i] = m_iSndTankIniEnergy;
-    m_piFstTankArray[i] = m_iFstTankIniEnergy;
+    st->m_piTrdTankArray[i] = st->m_iTrdTankIniEnergy;
+    st->m_piSndTankArray[i] = st->m_iSndTankIniEnergy;
+    st->m_piFstTankArray[i] = st->m_iFstTankIniEnergy;
   }
 }
 
 /* This primes the preprocessing pipeline prior to starting the first
    actual row of image data */
-static void PagePrintPreProcess(void)
+static void PagePrintPreProcess(struct s6145_state *st)
 {
   uint32_t i;
 
-  g_pusPulseTransLineBufTab[3] = g_pusPreReadLineBufTab[1];
-  g_pfRecieveData();
-  g_pusPulseTransLineBufTab[1] = g_pusPulseTransLineBufTab[3];
-  g_uiLineCopyCounter++;
-  g_uiInputImageIndex -= g_usPrintSizeWidth;
-  g_pusPulseTransLineBufTab[3] = g_pusPreReadLineBufTab[2];
-  g_pfRecieveData();
-  g_pusPulseTransLineBufTab[2] = g_pusPulseTransLineBufTab[3];
-  g_pusPulseTransLineBufTab[3] = g_pusPreReadLineBufTab[3];
-  g_pfRecieveData();
+  st->g_pusPulseTransLineBufTab[3] = st->g_pusPreReadLineBufTab[1];
+  st->g_pfRecieveData(st);
+  st->g_pusPulseTransLineBufTab[1] = st->g_pusPulseTransLineBufTab[3];
+  st->g_uiLineCopyCounter++;
+  st->g_uiInputImageIndex -= st->g_usPrintSizeWidth;
+  st->g_pusPulseTransLineBufTab[3] = st->g_pusPreReadLineBufTab[2];
+  st->g_pfRecieveData(st);
+  st->g_pusPulseTransLineBufTab[2] = st->g_pusPulseTransLineBufTab[3];
+  st->g_pusPulseTransLineBufTab[3] = st->g_pusPreReadLineBufTab[3];
+  st->g_pfRecieveData(st);
   for ( i = 0; i < 7; i++ )
   {
-    g_pusPulseTransLineBufTab[3] = g_pusPreReadLineBufTab[i + 4];
-    g_pfRecieveData();
+    st->g_pusPulseTransLineBufTab[3] = st->g_pusPreReadLineBufTab[i + 4];
+    st->g_pfRecieveData(st);
   }
-  g_pusPulseTransLineBufTab[0] = g_pusPreReadLineBufTab[0];
+  st->g_pusPulseTransLineBufTab[0] = st->g_pusPreReadLineBufTab[0];
 }
 
 /* Process a single scanline,
    From reading the input data to writing the output.
  */
-static void PagePrintProcess(void)
+static void PagePrintProcess(struct s6145_state *st)
 {
   uint32_t i;
 
   /* First, rotate the input buffers... */
-  if ( g_usPrintColor != 3 || g_usMatteMode != 1 || g_usMatteSize != 2 ) {
+  if ( st->g_usPrintColor != 3 || st->g_usMatteMode != 1 || st->g_usMatteSize != 2 ) {
     /* If we're not printing a matte layer... */
-    uint8_t *v4 = g_pusPreReadLineBufTab[0];
+    uint8_t *v4 = st->g_pusPreReadLineBufTab[0];
     for ( i = 0; i < 10; i++ )
-      g_pusPreReadLineBufTab[i] = g_pusPreReadLineBufTab[i + 1];
-    g_pusPreReadLineBufTab[10] = v4;
-    g_pusPulseTransLineBufTab[0] = g_pusPreReadLineBufTab[0];
-    g_pusPulseTransLineBufTab[1] = g_pusPreReadLineBufTab[1];
-    g_pusPulseTransLineBufTab[2] = g_pusPreReadLineBufTab[2];
-    g_pusPulseTransLineBufTab[3] = g_pusPreReadLineBufTab[10];
-  } else if ( g_uiLineCopyCounter & 1 ) {
+      st->g_pusPreReadLineBufTab[i] = st->g_pusPreReadLineBufTab[i + 1];
+    st->g_pusPreReadLineBufTab[10] = v4;
+    st->g_pusPulseTransLineBufTab[0] = st->g_pusPreReadLineBufTab[0];
+    st->g_pusPulseTransLineBufTab[1] = st->g_pusPreReadLineBufTab[1];
+    st->g_pusPulseTransLineBufTab[2] = st->g_pusPreReadLineBufTab[2];
+    st->g_pusPulseTransLineBufTab[3] = st->g_pusPreReadLineBufTab[10];
+  } else if ( st->g_uiLineCopyCounter & 1 ) {
     /* in other words, every other line when printing a matte layer..  */
-    uint8_t *v4 = g_pusPreReadLineBufTab[0];
+    uint8_t *v4 = st->g_pusPreReadLineBufTab[0];
     for ( i = 0; i < 10; i++ )
-      g_pusPreReadLineBufTab[i] = g_pusPreReadLineBufTab[i + 1];
-    g_pusPreReadLineBufTab[10] = v4;
-    g_pusPulseTransLineBufTab[0] = g_pusPreReadLineBufTab[0];
-    g_pusPulseTransLineBufTab[1] = g_pusPreReadLineBufTab[1];
-    g_pusPulseTransLineBufTab[2] = g_pusPreReadLineBufTab[2];
-    g_pusPulseTransLineBufTab[3] = g_pusPreReadLineBufTab[10];
+      st->g_pusPreReadLineBufTab[i] = st->g_pusPreReadLineBufTab[i + 1];
+    st->g_pusPreReadLineBufTab[10] = v4;
+    st->g_pusPulseTransLineBufTab[0] = st->g_pusPreReadLineBufTab[0];
+    st->g_pusPulseTransLineBufTab[1] = st->g_pusPreReadLineBufTab[1];
+    st->g_pusPulseTransLineBufTab[2] = st->g_pusPreReadLineBufTab[2];
+    st->g_pusPulseTransLineBufTab[3] = st->g_pusPreReadLineBufTab[10];
   }
 
 #ifdef S6145_UNUSED
-  g_uiTudenLineCounter--;
+  st->g_uiTudenLineCounter--;
 #endif
-  g_pfRecieveData(); /* Read another scanline */
-  PulseTrans();
-  g_pfPulseTransPreRead();
+  st->g_pfRecieveData(st); /* Read another scanline */
+  PulseTrans(st);
+  st->g_pfPulseTransPreRead(st);
 #ifdef S6145_UNUSED
-  g_pfRecieveData_Post();  /* Clean up after the receive */
+  st->g_pfRecieveData_Post(st);  /* Clean up after the receive */
 #endif
-  CTankProcess();  /* Update thermal tank state */
-  g_pfTankProcessPreRead();
-  LineCorrection(); /* Final output compensation */
-  SendData();      /* Write scanline output */
+  CTankProcess(st);  /* Update thermal tank state */
+  st->g_pfTankProcessPreRead(st);
+  LineCorrection(st); /* Final output compensation */
+  SendData(st);      /* Write scanline output */
   return;
 }
 
@@ -1096,39 +1396,40 @@ static uint16_t LinePrintCalcBit(uint16_t val)
 }
 
 /* Update thermal tank state */
-static void CTankProcess(void)
+static void CTankProcess(struct s6145_state *st)
 {
-  if ( g_sCorrectSw & 2 ) {
-    CTankHosei();
-    CTankUpdateTankVolumeInterRay();
-    CTankUpdateTankVolumeInterDot(0);
-    CTankUpdateTankVolumeInterDot(1);
-    CTankUpdateTankVolumeInterDot(2);
+  if ( st->g_sCorrectSw & 2 ) {
+    CTankHosei(st);
+    CTankUpdateTankVolumeInterRay(st);
+    CTankUpdateTankVolumeInterDot(st, 0);
+    CTankUpdateTankVolumeInterDot(st, 1);
+    CTankUpdateTankVolumeInterDot(st, 2);
   }
   return;
 }
 
-static void CTankProcessPreRead(void)
+static void CTankProcessPreRead(struct s6145_state *st)
 {
-  if (g_sCorrectSw & 2)
-     CTankHoseiPreread();
+  if (st->g_sCorrectSw & 2)
+     CTankHoseiPreread(st);
 }
 
-static void CTankProcessPreReadDummy(void)
+static void CTankProcessPreReadDummy(struct s6145_state *st)
 {
+  UNUSED(st);
   return;
 }
 
 /* This will generate one line worth of "gloss" OC data.
    It only covers the imageable area, rather than the head width */
-static void RecieveDataOP_GLOSS(void)
+static void RecieveDataOP_GLOSS(struct s6145_state *st)
 {
-  if ( g_uiLineCopyCounter ) {
-     memset(g_pusPulseTransLineBufTab[3] + ((g_usHeadDots - g_usSheetSizeWidth) / 2),
-	    g_usPrintOpLevel,
-	    g_usSheetSizeWidth);
+  if ( st->g_uiLineCopyCounter ) {
+     memset(st->g_pusPulseTransLineBufTab[3] + ((st->g_usHeadDots - st->g_usSheetSizeWidth) / 2),
+	    st->g_usPrintOpLevel,
+	    st->g_usSheetSizeWidth);
 
-    g_uiLineCopyCounter--;
+    st->g_uiLineCopyCounter--;
   }
 
   return;
@@ -1136,91 +1437,100 @@ static void RecieveDataOP_GLOSS(void)
 
 /* This reads a single line worth of input image data.
  */
-static void RecieveDataYMC(void)
+static void RecieveDataYMC(struct s6145_state *st)
 {
   uint8_t *v1;
   int16_t i;
 
-  v1 = g_pusPulseTransLineBufTab[3] + ((g_usHeadDots - g_usSheetSizeWidth) / 2);
+  v1 = st->g_pusPulseTransLineBufTab[3] + ((st->g_usHeadDots - st->g_usSheetSizeWidth) / 2);
 
-  if ( g_uiLineCopyCounter ) {
+  if ( st->g_uiLineCopyCounter ) {
      /* Read the next line */
-    for ( i = 0; i < g_usPrintSizeWidth; i++ )
-      v1[i] = g_pucInputImageBuf[g_uiInputImageIndex++];
-    --g_uiLineCopyCounter;
+    for ( i = 0; i < st->g_usPrintSizeWidth; i++ )
+      v1[i] = st->g_pucInputImageBuf[st->g_uiInputImageIndex++];
+    --st->g_uiLineCopyCounter;
   } else {
     /* Re-read the previous line */
-    g_uiInputImageIndex -= g_usPrintSizeWidth;
-    for ( i = 0; i < g_usPrintSizeWidth ; i++ )
-      v1[i] = g_pucInputImageBuf[g_uiInputImageIndex++];
+    st->g_uiInputImageIndex -= st->g_usPrintSizeWidth;
+    for ( i = 0; i < st->g_usPrintSizeWidth ; i++ )
+      v1[i] = st->g_pucInputImageBuf[st->g_uiInputImageIndex++];
   }
 }
 
 /* this will generate one scanline (ie 16b * BUF_SIZE) worth of
    "random" data for the matte overcoat */
-static void RecieveDataOP_MATTE(void)
+static void RecieveDataOP_MATTE(struct s6145_state *st)
 {
-  if ( g_uiLineCopyCounter ) {
+  if ( st->g_uiLineCopyCounter ) {
     int32_t v1;
     uint32_t v5;
     int32_t v6;
 
     int16_t matteCtr;
-    uint8_t *outPtr = g_pusPulseTransLineBufTab[3];
+    uint8_t *outPtr = st->g_pusPulseTransLineBufTab[3];
 
-    if ( g_usMatteSize == 2 )
+    if ( st->g_usMatteSize == 2 )
       matteCtr = 256;
     else
       matteCtr = 512;
 
     while ( matteCtr-- ) {
-      if ( g_pulRandomTable[0] >= 31 )
+      if ( st->g_pulRandomTable[0] >= 31 )
         v6 = 1;
       else
-        v6 = g_pulRandomTable[0] + 1;
-      g_pulRandomTable[0] = v6;
+        v6 = st->g_pulRandomTable[0] + 1;
+      st->g_pulRandomTable[0] = v6;
       if ( v6 <= 3 )
-        v1 = g_pulRandomTable[v6 + 28];
+        v1 = st->g_pulRandomTable[v6 + 28];
       else
-        v1 = g_pulRandomTable[v6 - 3];
-      g_pulRandomTable[v6] += v1;
-
-      v5 = (uint32_t)g_pulRandomTable[v6] >> 1;
-      if ( g_usMatteSize == 2 ) {
-	*outPtr++ = g_ucRandomBaseLevel[(v5 >> 1) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 1) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 5) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 5) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 9) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 9) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 13) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 13) & 3];
+        v1 = st->g_pulRandomTable[v6 - 3];
+      st->g_pulRandomTable[v6] += v1;
+
+      v5 = (uint32_t)st->g_pulRandomTable[v6] >> 1;
+      if ( st->g_usMatteSize == 2 ) {
+	*outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 1) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 1) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 5) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 5) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 9) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 9) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 13) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 13) & 3];
       } else {
-	*outPtr++ = g_ucRandomBaseLevel[(v5 >> 1) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 5) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 9) & 3];
-        *outPtr++ = g_ucRandomBaseLevel[(v5 >> 13) & 3];
+	*outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 1) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 5) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 9) & 3];
+        *outPtr++ = st->g_ucRandomBaseLevel[(v5 >> 13) & 3];
       }
     }
-    --g_uiLineCopyCounter;
+    --st->g_uiLineCopyCounter;
   }
 }
 
 /* This writes a single scanline to the output buffer */
-static void SendData(void)
+static void SendData(struct s6145_state *st)
 {
   uint16_t i;
 
-  if ( g_uiSendToHeadCounter ) {
-    for ( i = 0; i < g_usHeadDots; i++ )
-      g_pusOutputImageBuf[g_uiOutputImageIndex++] = cpu_to_le16(g_pusOutLineBufTab[0][i]);
-    --g_uiSendToHeadCounter;
+  if ( st->g_uiSendToHeadCounter ) {
+    for ( i = 0; i < st->g_usHeadDots; i++ )
+      st->g_pusOutputImageBuf[st->g_uiOutputImageIndex++] = cpu_to_le16(st->g_pusOutLineBufTab[0][i]);
+    --st->g_uiSendToHeadCounter;
+
+    if (st->m_pfSinkFn &&
+	(!st->g_uiSendToHeadCounter ||
+	 st->g_uiOutputImageIndex + st->g_usHeadDots > st->m_uiSinkLen)) {
+      if (st->m_pfSinkFn(st->m_pSinkContext, st->g_pusOutputImageBuf,
+			 st->g_uiOutputImageIndex * sizeof(uint16_t)))
+	st->m_iSinkError = 1;
+      st->g_uiOutputImageIndex = 0;
+    }
   }
 }
 
 /* Use the previous two rows to generate the needed impulse for
    the current row. */
-static void PulseTrans(void)
+static void PulseTrans(struct s6145_state *st)
 {
   int32_t overHang;
   int32_t sheetSizeWidth;
@@ -1231,28 +1541,28 @@ static void PulseTrans(void)
 
   uint16_t *out;
 
-  sheetSizeWidth = g_usSheetSizeWidth;
-  overHang = (g_usHeadDots - g_usSheetSizeWidth) / 2;
+  sheetSizeWidth = st->g_usSheetSizeWidth;
+  overHang = (st->g_usHeadDots - st->g_usSheetSizeWidth) / 2;
 
-  currentRow = g_pusPulseTransLineBufTab[0] + overHang;
-  prevRow = g_pusPulseTransLineBufTab[1] + overHang;
-  prevPrevRow = g_pusPulseTransLineBufTab[2] + overHang;
-  out = g_pusOutLineBufTab[0] + g_sPrintSideOffset + overHang;
+  currentRow = st->g_pusPulseTransLineBufTab[0] + overHang;
+  prevRow = st->g_pusPulseTransLineBufTab[1] + overHang;
+  prevPrevRow = st->g_pusPulseTransLineBufTab[2] + overHang;
+  out = st->g_pusOutLineBufTab[0] + st->g_sPrintSideOffset + overHang;
 
-  if ( out >= g_pusOutLineBufTab[0] ) {
-    int32_t offset = g_sPrintSideOffset
-        + g_usSheetSizeWidth
+  if ( out >= st->g_pusOutLineBufTab[0] ) {
+    int32_t offset = st->g_sPrintSideOffset
+        + st->g_usSheetSizeWidth
         + overHang;
     if ( offset > BUF_SIZE )
-      sheetSizeWidth = g_usSheetSizeWidth - (offset - BUF_SIZE);
+      sheetSizeWidth = st->g_usSheetSizeWidth - (offset - BUF_SIZE);
   } else {
-    int32_t offset = (g_pusOutLineBufTab[0] - out);
-    out = g_pusOutLineBufTab[0];
-    sheetSizeWidth = g_usSheetSizeWidth - offset;
+    int32_t offset = (st->g_pusOutLineBufTab[0] - out);
+    out = st->g_pusOutLineBufTab[0];
+    sheetSizeWidth = st->g_usSheetSizeWidth - offset;
     currentRow += offset;
     prevRow += offset;
     prevPrevRow += offset;
-    printf("WARN: PulseTrans() alt path\n");
+    fprintf(stderr, "WARN: PulseTrans() alt path\n");
   }
 
   while ( sheetSizeWidth-- ) {
@@ -1269,10 +1579,10 @@ static void PulseTrans(void)
     v3 = *v2++;
     v12 = *v2;
     prevRow = v2 + 1;
-    v4 = g_psMtfPreCalcTable[256 + v12 - *prevRow] + g_psMtfPreCalcTable[256 + v12 - v3];
-    v6 = g_psMtfPreCalcTable[256 + v12 - *currentRow++];
+    v4 = st->g_psMtfPreCalcTable[256 + v12 - *prevRow] + st->g_psMtfPreCalcTable[256 + v12 - v3];
+    v6 = st->g_psMtfPreCalcTable[256 + v12 - *currentRow++];
 
-    tableOffset = v12 + ((v4 * g_uiMtfWeightH + (g_psMtfPreCalcTable[256 + v12 - *prevPrevRow++] + v6) * g_uiMtfWeightV) >> 7);
+    tableOffset = v12 + ((v4 * st->g_uiMtfWeightH + (st->g_psMtfPreCalcTable[256 + v12 - *prevPrevRow++] + v6) * st->g_uiMtfWeightV) >> 7);
     if ( tableOffset > 255 )
       tableOffset = 255;
     if ( tableOffset <= 0 )
@@ -1280,7 +1590,7 @@ static void PulseTrans(void)
     if ( !v12 )
       tableOffset = 0;
 
-    compVal = g_pusPulseTransTable[tableOffset];
+    compVal = st->g_pusPulseTransTable[tableOffset];
     if ( compVal > MAX_PULSE )
       compVal = MAX_PULSE;
 
@@ -1288,16 +1598,16 @@ static void PulseTrans(void)
   }
 
 #ifdef S6145_UNUSED
-  g_uiDataTransCounter--;
+  st->g_uiDataTransCounter--;
 #endif
 }
 
-static void PulseTransPreReadOP(void)
+static void PulseTransPreReadOP(struct s6145_state *st)
 {
-
+  UNUSED(st);
 }
 
-static void PulseTransPreReadYMC(void)
+static void PulseTransPreReadYMC(struct s6145_state *st)
 {
   uint16_t overHang;
   uint16_t printSizeWidth;
@@ -1315,31 +1625,31 @@ static void PulseTransPreReadYMC(void)
   uint8_t *v16;
   uint8_t *v17;
 
-  printSizeWidth = g_usPrintSizeWidth;
-  overHang = (g_usHeadDots - g_usPrintSizeWidth) / 2;
-  v17 = g_pusPreReadLineBufTab[2] + overHang;
-  v16 = g_pusPreReadLineBufTab[3] + overHang;
-  v15 = g_pusPreReadLineBufTab[4] + overHang;
-  v14 = g_pusPreReadLineBufTab[5] + overHang;
+  printSizeWidth = st->g_usPrintSizeWidth;
+  overHang = (st->g_usHeadDots - st->g_usPrintSizeWidth) / 2;
+  v17 = st->g_pusPreReadLineBufTab[2] + overHang;
+  v16 = st->g_pusPreReadLineBufTab[3] + overHang;
+  v15 = st->g_pusPreReadLineBufTab[4] + overHang;
+  v14 = st->g_pusPreReadLineBufTab[5] + overHang;
 
 #ifdef S6145_UNUSED
-  v1 = g_pusPreReadLineBufTab[6] + overHang;
-  v2 = g_pusPreReadLineBufTab[7] + overHang;
-  v3 = g_pusPreReadLineBufTab[8] + overHang;
-  v4 = g_pusPreReadLineBufTab[9] + overHang;
+  v1 = st->g_pusPreReadLineBufTab[6] + overHang;
+  v2 = st->g_pusPreReadLineBufTab[7] + overHang;
+  v3 = st->g_pusPreReadLineBufTab[8] + overHang;
+  v4 = st->g_pusPreReadLineBufTab[9] + overHang;
 #endif
 
-  out = g_pusPreReadOutLineBuf + overHang + g_sPrintSideOffset;
+  out = st->g_pusPreReadOutLineBuf + overHang + st->g_sPrintSideOffset;
 
-  if ( out < g_pusPreReadOutLineBuf ) {
-    int32_t offset = (g_pusPreReadOutLineBuf - out);
-    out = g_pusPreReadOutLineBuf;
-    printSizeWidth = g_usPrintSizeWidth - offset;
+  if ( out < st->g_pusPreReadOutLineBuf ) {
+    int32_t offset = (st->g_pusPreReadOutLineBuf - out);
+    out = st->g_pusPreReadOutLineBuf;
+    printSizeWidth = st->g_usPrintSizeWidth - offset;
     v17 += offset;
     v16 += offset;
     v15 += offset;
     v14 += offset;
-    printf("WARN: PulseTransPreReadYMC alt path!\n");
+    fprintf(stderr, "WARN: PulseTransPreReadYMC alt path!\n");
   }
 
   while ( printSizeWidth-- ) {
@@ -1347,21 +1657,84 @@ static void PulseTransPreReadYMC(void)
     int32_t v7 = *v16++ + v6;
     int32_t v8 = *v15++ + v7;
     int32_t v9 = *v14++ + v8;
-    int32_t pixel = g_pusPulseTransTable[v9 / 4];
+    int32_t pixel = st->g_pusPulseTransTable[v9 / 4];
     if ( pixel > MAX_PULSE )
       pixel = MAX_PULSE;
     *out++ = pixel;
   }
 }
 
-static void CTankUpdateTankVolumeInterDot(uint8_t tank)
+/*** Thermal tank kernels ***
+
+   The per-line tank stencils, as plain C and (where the CPU has it)
+   AVX2 versions.  The vector ones do the same 32-bit integer math,
+   wraparound included, so their output is identical; this is checked
+   with a self-test the first time the kernels are needed, and if it
+   fails for whatever reason the plain C versions are used instead.
+   Setting LIB6145_SIMD to 0 also forces the plain C versions. */
+
+typedef void (*TankHoseiFN)(uint16_t *out, const uint8_t *in, int32_t *tank,
+			    uint16_t width, int32_t v4, const uint32_t *energy,
+			    uint32_t maxPulseBit, int32_t maxPulseValue);
+typedef void (*TankInterRayFN)(int32_t *fst, int32_t *snd, int32_t *trd,
+			       uint16_t width, const int32_t keisu[6]);
+typedef void (*TankInterDotFN)(int32_t *tank, uint16_t width, int32_t conductivity);
+
+struct tank_kernels {
+  TankHoseiFN hosei;
+  TankInterRayFN interRay;
+  TankInterDotFN interDot;
+};
+
+static void CTankHoseiRow(uint16_t *out, const uint8_t *in, int32_t *tankPtr,
+			  uint16_t sheetSizeWidth, int32_t v4, const uint32_t *energy,
+			  uint32_t maxPulseBit, int32_t maxPulseValue)
 {
-  int32_t *tankIn;
-  int32_t *tankOut;
-  int32_t conductivity;
-  uint16_t sheetSizeWidth;
+  while ( sheetSizeWidth-- ) {
+    int32_t v5;
+    int32_t v8;
+    uint16_t v11;
+    uint32_t v3 = *in++;
+    v5 = *out - ((v4 * (*out + *tankPtr)) >> 20);
+    if ( v5 < 0 )
+      v11 = energy[v3] & 0xffff;
+    else
+      v11 = energy[v3] >> 16;
+    v8 = *out + ((v5 * v11) >> maxPulseBit);
+    if ( v8 < 0 )
+      v8 = 0;
+    if ( v8 > maxPulseValue )
+      v8 = maxPulseValue;
+    *out++ = v8;
+    *tankPtr++ += v8;
+  }
+}
 
-  uint16_t v1;
+/* keisu[] is SndFstDivSnd, SndFstDivFst, FstOutDivFst,
+   TrdSndDivTrd, TrdSndDivSnd, OutTrdDivTrd */
+static void CTankInterRayRow(int32_t *fstTankPtr, int32_t *sndTankPtr, int32_t *trdTankPtr,
+			     uint16_t sheetWidth, const int32_t keisu[6])
+{
+  while ( sheetWidth-- ) {
+    int32_t v2, v3;
+
+    v2 = (*sndTankPtr * keisu[0] - *fstTankPtr * keisu[1]) >> 17;
+    *fstTankPtr = v2 + *fstTankPtr - (*fstTankPtr * keisu[2] >> 17);
+    fstTankPtr++;
+
+    v3 = (*trdTankPtr * keisu[3] - *sndTankPtr * keisu[4]) >> 17;
+    *sndTankPtr = v3 + *sndTankPtr - v2;
+    sndTankPtr++;
+
+    *trdTankPtr = *trdTankPtr - v3 - (*trdTankPtr * keisu[5] >> 17);
+    trdTankPtr++;
+  }
+}
+
+/* Expects the two entries either side of the line to be filled in */
+static void CTankInterDotRow(int32_t *tankIn, uint16_t sheetSizeWidth, int32_t conductivity)
+{
+  int32_t *tankOut = tankIn + 2;
   int32_t v2;
   int32_t v4;
   int32_t v5;
@@ -1371,33 +1744,9 @@ static void CTankUpdateTankVolumeInterDot(uint8_t tank)
   int32_t v19;
   int32_t v20;
 
-  switch (tank) {
-  case 0:
-    tankIn = m_piFstTankArray;
-    tankOut = m_piFstTankArray + 2;
-    conductivity = m_iFstFstConductivity / 2;
-    break;
-  case 1:
-    tankIn = m_piSndTankArray;
-    tankOut = m_piSndTankArray + 2;
-    conductivity = m_iSndSndConductivity / 2;
-    break;
-  case 2:
-    tankIn = m_piTrdTankArray;
-    tankOut = m_piTrdTankArray + 2;
-    conductivity = m_iTrdTrdConductivity / 2;
-    break;
-  default:
-    printf("ERROR: Bad Tank %d in CTankUpdateVolumeInterDot\n", tank);
-    return;
-  }
-
   /* This code basically takes a running average of three running
      averages, and uses that as the basis for the output */
 
-  tankIn[0] = tankIn[1] = tankIn[2];
-  v1 = g_usSheetSizeWidth + 1;
-  tankIn[v1+1] = tankIn[v1+2] = tankIn[v1];
   v2 = *tankIn++;
   v4 = *tankIn++;
   v5 = *tankIn++;
@@ -1407,7 +1756,6 @@ static void CTankUpdateTankVolumeInterDot(uint8_t tank)
   v19 = conductivity * (v5 + v2  - 2 * v4);
   v18 = conductivity * (v8 + v4  - 2 * v5);
   v17 = conductivity * (v20 + v5 - 2 * v8);
-  sheetSizeWidth = g_usSheetSizeWidth;
 
   while ( sheetSizeWidth-- ) {
     int32_t pixel = (v18 >> 6) + v5 - (conductivity * ((2 * v18 - v19 - v17) >> 7) >> 7);
@@ -1423,30 +1771,262 @@ static void CTankUpdateTankVolumeInterDot(uint8_t tank)
   }
 }
 
-static void CTankUpdateTankVolumeInterRay(void)
+#ifdef LIB6145_X86_SIMD
+/* Eight dots at a time; the leftovers go through the same math one
+   at a time. */
+__attribute__((target("avx2")))
+static void CTankHoseiRowAVX2(uint16_t *out, const uint8_t *in, int32_t *tankPtr,
+			      uint16_t sheetSizeWidth, int32_t v4, const uint32_t *energy,
+			      uint32_t maxPulseBit, int32_t maxPulseValue)
 {
-  uint16_t sheetWidth = g_usSheetSizeWidth;
-  int32_t *fstTankPtr = m_piFstTankArray + 2;
-  int32_t *sndTankPtr = m_piSndTankArray + 2;
-  int32_t *trdTankPtr = m_piTrdTankArray + 2;
+  const __m256i vv4 = _mm256_set1_epi32(v4);
+  const __m256i vmax = _mm256_set1_epi32(maxPulseValue);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lo16 = _mm256_set1_epi32(0xffff);
+  const __m128i bits = _mm_cvtsi32_si128(maxPulseBit);
+  uint16_t i = 0;
+
+  for ( ; i + 8 <= sheetSizeWidth; i += 8 ) {
+    __m256i o = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(out + i)));
+    __m256i t = _mm256_loadu_si256((const __m256i*)(tankPtr + i));
+    __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+    __m256i e = _mm256_i32gather_epi32((const int*)energy, idx, 4);
+    __m256i v5, v11, v8;
+
+    v5 = _mm256_sub_epi32(o, _mm256_srai_epi32(_mm256_mullo_epi32(vv4, _mm256_add_epi32(o, t)), 20));
+    /* Minus table in the low half, plus in the high */
+    v11 = _mm256_blendv_epi8(_mm256_srli_epi32(e, 16), _mm256_and_si256(e, lo16),
+			     _mm256_cmpgt_epi32(zero, v5));
+    v8 = _mm256_add_epi32(o, _mm256_sra_epi32(_mm256_mullo_epi32(v5, v11), bits));
+    v8 = _mm256_min_epi32(_mm256_max_epi32(v8, zero), vmax);
+
+    _mm256_storeu_si256((__m256i*)(tankPtr + i), _mm256_add_epi32(t, v8));
+    /* v8 is already within [0, 65535] so this doesn't saturate */
+    v8 = _mm256_packus_epi32(v8, v8);
+    v8 = _mm256_permute4x64_epi64(v8, 0x08);
+    _mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(v8));
+  }
 
-  while ( sheetWidth-- ) {
-    int32_t v2, v3;
+  CTankHoseiRow(out + i, in + i, tankPtr + i, sheetSizeWidth - i, v4, energy,
+		maxPulseBit, maxPulseValue);
+}
 
-    v2 = (*sndTankPtr * m_iTankKeisuSndFstDivSnd - *fstTankPtr * m_iTankKeisuSndFstDivFst) >> 17;
-    *fstTankPtr = v2 + *fstTankPtr - (*fstTankPtr * m_iTankKeisuFstOutDivFst >> 17);
-    fstTankPtr++;
+__attribute__((target("avx2")))
+static void CTankInterRayRowAVX2(int32_t *fst, int32_t *snd, int32_t *trd,
+				 uint16_t sheetWidth, const int32_t keisu[6])
+{
+  const __m256i k0 = _mm256_set1_epi32(keisu[0]);
+  const __m256i k1 = _mm256_set1_epi32(keisu[1]);
+  const __m256i k2 = _mm256_set1_epi32(keisu[2]);
+  const __m256i k3 = _mm256_set1_epi32(keisu[3]);
+  const __m256i k4 = _mm256_set1_epi32(keisu[4]);
+  const __m256i k5 = _mm256_set1_epi32(keisu[5]);
+  uint16_t i = 0;
+
+  for ( ; i + 8 <= sheetWidth; i += 8 ) {
+    __m256i f = _mm256_loadu_si256((const __m256i*)(fst + i));
+    __m256i s = _mm256_loadu_si256((const __m256i*)(snd + i));
+    __m256i t = _mm256_loadu_si256((const __m256i*)(trd + i));
+    __m256i v2, v3;
+
+    v2 = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(s, k0),
+					    _mm256_mullo_epi32(f, k1)), 17);
+    v3 = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(t, k3),
+					    _mm256_mullo_epi32(s, k4)), 17);
+
+    f = _mm256_sub_epi32(_mm256_add_epi32(v2, f),
+			 _mm256_srai_epi32(_mm256_mullo_epi32(f, k2), 17));
+    s = _mm256_sub_epi32(_mm256_add_epi32(v3, s), v2);
+    t = _mm256_sub_epi32(_mm256_sub_epi32(t, v3),
+			 _mm256_srai_epi32(_mm256_mullo_epi32(t, k5), 17));
+
+    _mm256_storeu_si256((__m256i*)(fst + i), f);
+    _mm256_storeu_si256((__m256i*)(snd + i), s);
+    _mm256_storeu_si256((__m256i*)(trd + i), t);
+  }
 
-    v3 = (*trdTankPtr * m_iTankKeisuTrdSndDivTrd - *sndTankPtr * m_iTankKeisuTrdSndDivSnd) >> 17;
-    *sndTankPtr = v3 + *sndTankPtr - v2;
-    sndTankPtr++;
+  CTankInterRayRow(fst + i, snd + i, trd + i, sheetWidth - i, keisu);
+}
 
-    *trdTankPtr = *trdTankPtr - v3 - (*trdTankPtr * m_iTankKeisuOutTrdDivTrd >> 17);
-    trdTankPtr++;
+/* The plain C version works in place, as each output dot lands behind
+   the inputs it still needs.  Eight at a time that's no longer true,
+   so work from a copy of the line. */
+__attribute__((target("avx2")))
+static void CTankInterDotRowAVX2(int32_t *tank, uint16_t sheetSizeWidth, int32_t conductivity)
+{
+  int32_t in[TANK_SIZE + 4];
+  const __m256i c = _mm256_set1_epi32(conductivity);
+  const __m256i zero = _mm256_setzero_si256();
+  uint16_t i = 0;
+
+  memcpy(in, tank, (sheetSizeWidth + 4) * sizeof(int32_t));
+
+  for ( ; i + 8 <= sheetSizeWidth; i += 8 ) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(in + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(in + i + 1));
+    __m256i m = _mm256_loadu_si256((const __m256i*)(in + i + 2));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(in + i + 3));
+    __m256i e = _mm256_loadu_si256((const __m256i*)(in + i + 4));
+    __m256i d1, d2, d3, pixel;
+
+    d1 = _mm256_mullo_epi32(c, _mm256_sub_epi32(_mm256_add_epi32(m, a), _mm256_slli_epi32(b, 1)));
+    d2 = _mm256_mullo_epi32(c, _mm256_sub_epi32(_mm256_add_epi32(d, b), _mm256_slli_epi32(m, 1)));
+    d3 = _mm256_mullo_epi32(c, _mm256_sub_epi32(_mm256_add_epi32(e, m), _mm256_slli_epi32(d, 1)));
+
+    pixel = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_slli_epi32(d2, 1), d1), d3);
+    pixel = _mm256_srai_epi32(_mm256_mullo_epi32(c, _mm256_srai_epi32(pixel, 7)), 7);
+    pixel = _mm256_sub_epi32(_mm256_add_epi32(_mm256_srai_epi32(d2, 6), m), pixel);
+    _mm256_storeu_si256((__m256i*)(tank + i + 2), _mm256_max_epi32(pixel, zero));
+  }
+
+  for ( ; i < sheetSizeWidth; i++ ) {
+    int32_t d1 = conductivity * (in[i + 2] + in[i] - 2 * in[i + 1]);
+    int32_t d2 = conductivity * (in[i + 3] + in[i + 1] - 2 * in[i + 2]);
+    int32_t d3 = conductivity * (in[i + 4] + in[i + 2] - 2 * in[i + 3]);
+    int32_t pixel = (d2 >> 6) + in[i + 2] - (conductivity * ((2 * d2 - d1 - d3) >> 7) >> 7);
+    if ( pixel < 0 )
+      pixel = 0;
+    tank[i + 2] = pixel;
   }
 }
+#endif
 
-static void CTankHoseiPreread(void)
+/* A cheap, repeatable source of junk for the self-test */
+static uint32_t SelfTestRand(uint32_t *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+/* Run both sets of kernels over the same made-up lines, including
+   values big enough to wrap, and make sure they agree. */
+static int TankKernelSelfTest(const struct tank_kernels *ref, const struct tank_kernels *test)
+{
+  static const uint16_t widths[] = { 1844, 1, 7, 8, 9, 333 };
+  uint16_t out[2][TANK_SIZE];
+  int32_t tank[2][3][TANK_SIZE];
+  uint8_t in[TANK_SIZE];
+  uint32_t energy[256];
+  int32_t keisu[6];
+  uint32_t seed = 6145;
+  unsigned int w, i, j;
+
+  for (w = 0 ; w < sizeof(widths) / sizeof(widths[0]) ; w++) {
+    uint16_t width = widths[w];
+    int big = w & 1;  /* Alternate plausible and extreme values */
+    uint32_t bit = 8 + (w % 3);
+    int32_t maxPulse = (1 << bit) - 1;
+    int32_t v4 = (1 << (bit + 20)) / (1 + SelfTestRand(&seed) % (big ? 4 : 1024));
+    int32_t conductivity = SelfTestRand(&seed) % (big ? 0x100000 : 64);
+
+    for (i = 0 ; i < 256 ; i++)
+      energy[i] = SelfTestRand(&seed) << 1 ^ SelfTestRand(&seed);
+    for (i = 0 ; i < 6 ; i++)
+      keisu[i] = SelfTestRand(&seed) % (big ? 0x7fffffff : 0x10000);
+    for (i = 0 ; i < TANK_SIZE ; i++) {
+      in[i] = SelfTestRand(&seed);
+      out[0][i] = SelfTestRand(&seed) % (maxPulse + 1);
+      for (j = 0 ; j < 3 ; j++)
+	tank[0][j][i] = big ? (int32_t)(SelfTestRand(&seed) << 8) : (int32_t)(SelfTestRand(&seed) % 100000);
+    }
+    memcpy(out[1], out[0], sizeof(out[0]));
+    memcpy(tank[1], tank[0], sizeof(tank[0]));
+
+    for (i = 0 ; i < 2 ; i++) {
+      const struct tank_kernels *k = i ? test : ref;
+      k->hosei(out[i], in, tank[i][0] + 2, width, v4, energy, bit, maxPulse);
+      k->interRay(tank[i][0] + 2, tank[i][1] + 2, tank[i][2] + 2, width, keisu);
+      for (j = 0 ; j < 3 ; j++)
+	k->interDot(tank[i][j], width, conductivity);
+    }
+
+    if (memcmp(out[0], out[1], sizeof(out[0])) ||
+	memcmp(tank[0], tank[1], sizeof(tank[0])))
+      return 1;
+  }
+
+  return 0;
+}
+
+static struct tank_kernels tank_kernels = {
+  CTankHoseiRow, CTankInterRayRow, CTankInterDotRow
+};
+static pthread_once_t tank_kernels_once = PTHREAD_ONCE_INIT;
+
+static void TankKernelsInit(void)
+{
+  const char *env = getenv("LIB6145_SIMD");
+
+  if (env && !atoi(env))
+    return;
+
+#ifdef LIB6145_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    static const struct tank_kernels avx2 = {
+      CTankHoseiRowAVX2, CTankInterRayRowAVX2, CTankInterDotRowAVX2
+    };
+    if (TankKernelSelfTest(&tank_kernels, &avx2))
+      fprintf(stderr, "WARNING: libS6145ImageReProcess AVX2 self-test failed, using plain C code\n");
+    else
+      tank_kernels = avx2;
+  }
+#endif
+}
+
+static const struct tank_kernels *TankKernels(void)
+{
+  pthread_once(&tank_kernels_once, TankKernelsInit);
+  return &tank_kernels;
+}
+
+static void CTankUpdateTankVolumeInterDot(struct s6145_state *st, uint8_t tank)
+{
+  int32_t *tankIn;
+  int32_t conductivity;
+  uint16_t v1;
+
+  switch (tank) {
+  case 0:
+    tankIn = st->m_piFstTankArray;
+    conductivity = st->m_iFstFstConductivity / 2;
+    break;
+  case 1:
+    tankIn = st->m_piSndTankArray;
+    conductivity = st->m_iSndSndConductivity / 2;
+    break;
+  case 2:
+    tankIn = st->m_piTrdTankArray;
+    conductivity = st->m_iTrdTrdConductivity / 2;
+    break;
+  default:
+    fprintf(stderr, "ERROR: Bad Tank %d in CTankUpdateVolumeInterDot\n", tank);
+    return;
+  }
+
+  tankIn[0] = tankIn[1] = tankIn[2];
+  v1 = st->g_usSheetSizeWidth + 1;
+  tankIn[v1+1] = tankIn[v1+2] = tankIn[v1];
+
+  TankKernels()->interDot(tankIn, st->g_usSheetSizeWidth, conductivity);
+}
+
+static void CTankUpdateTankVolumeInterRay(struct s6145_state *st)
+{
+  int32_t keisu[6];
+
+  keisu[0] = st->m_iTankKeisuSndFstDivSnd;
+  keisu[1] = st->m_iTankKeisuSndFstDivFst;
+  keisu[2] = st->m_iTankKeisuFstOutDivFst;
+  keisu[3] = st->m_iTankKeisuTrdSndDivTrd;
+  keisu[4] = st->m_iTankKeisuTrdSndDivSnd;
+  keisu[5] = st->m_iTankKeisuOutTrdDivTrd;
+
+  TankKernels()->interRay(st->m_piFstTankArray + 2, st->m_piSndTankArray + 2,
+			  st->m_piTrdTankArray + 2, st->g_usSheetSizeWidth, keisu);
+}
+
+static void CTankHoseiPreread(struct s6145_state *st)
 {
   uint16_t sheetWidth;
   int16_t overHang;
@@ -1456,29 +2036,29 @@ static void CTankHoseiPreread(void)
 
   int32_t v4;
 
-  overHang = (g_usHeadDots - g_usSheetSizeWidth) / 2;
-  inPtr = (int16_t*)g_pusPreReadOutLineBuf + overHang + g_sPrintSideOffset;
-  outPtr = g_pusOutLineBufTab[0] + overHang + g_sPrintSideOffset;
-  if ( outPtr < g_pusOutLineBufTab[0] )
-    outPtr = g_pusOutLineBufTab[0];
-  fstTankPtr = m_piFstTankArray + 2;
-  v4 = (1 << (g_uiMaxPulseBit + 20)) / m_iFstTankSize;
+  overHang = (st->g_usHeadDots - st->g_usSheetSizeWidth) / 2;
+  inPtr = (int16_t*)st->g_pusPreReadOutLineBuf + overHang + st->g_sPrintSideOffset;
+  outPtr = st->g_pusOutLineBufTab[0] + overHang + st->g_sPrintSideOffset;
+  if ( outPtr < st->g_pusOutLineBufTab[0] )
+    outPtr = st->g_pusOutLineBufTab[0];
+  fstTankPtr = st->m_piFstTankArray + 2;
+  v4 = (1 << (st->g_uiMaxPulseBit + 20)) / st->m_iFstTankSize;
 
   /* Walk forward through the line to compute the necessary delta */
-  sheetWidth = g_usSheetSizeWidth;
+  sheetWidth = st->g_usSheetSizeWidth;
   while ( sheetWidth-- ) {
     int32_t v5 = *inPtr - (v4 * (*inPtr + *fstTankPtr++) >> 20);
     int32_t v6 = 0;
-    if ( v5 < m_iPreReadLevelDiff )
-      v6 = -(m_iMinusMaxEnergyPreRead * v5 * v5) >> g_uiMaxPulseBit;
+    if ( v5 < st->m_iPreReadLevelDiff )
+      v6 = -(st->m_iMinusMaxEnergyPreRead * v5 * v5) >> st->g_uiMaxPulseBit;
     *inPtr++ = v6;
   }
 
   /* Now walk backwards through the line to derive the desired pixel
      values, adding the actual value with the necessary delta.. */
-  outPtr += g_usSheetSizeWidth;
+  outPtr += st->g_usSheetSizeWidth;
 
-  sheetWidth = g_usSheetSizeWidth;
+  sheetWidth = st->g_usSheetSizeWidth;
   while ( sheetWidth-- ) {
     int32_t pixel;
 
@@ -1488,14 +2068,14 @@ static void CTankHoseiPreread(void)
     pixel = *inPtr + *outPtr;
     if ( pixel < 0 )
       pixel = 0;
-    if ( pixel > g_iMaxPulseValue )
-      pixel = g_iMaxPulseValue;
+    if ( pixel > st->g_iMaxPulseValue )
+      pixel = st->g_iMaxPulseValue;
     *outPtr = pixel;
   }
 }
 
 /* Apply the correction needed based on the thermal tanks */
-static void CTankHosei(void)
+static void CTankHosei(struct s6145_state *st)
 {
   uint16_t overHang;
   uint16_t sheetSizeWidth;
@@ -1509,56 +2089,41 @@ static void CTankHosei(void)
   int32_t *v12;
 #endif
 
-  sheetSizeWidth = g_usSheetSizeWidth;
-  overHang = (g_usHeadDots - g_usSheetSizeWidth) / 2;
-  out = g_pusOutLineBufTab[0] + (overHang + g_sPrintSideOffset);
-  in = g_pusPulseTransLineBufTab[1] + overHang;
+  sheetSizeWidth = st->g_usSheetSizeWidth;
+  overHang = (st->g_usHeadDots - st->g_usSheetSizeWidth) / 2;
+  out = st->g_pusOutLineBufTab[0] + (overHang + st->g_sPrintSideOffset);
+  in = st->g_pusPulseTransLineBufTab[1] + overHang;
 
-  if ( out >= g_pusOutLineBufTab[0] ) {
-    int32_t offset = g_sPrintSideOffset + sheetSizeWidth + overHang;
+  if ( out >= st->g_pusOutLineBufTab[0] ) {
+    int32_t offset = st->g_sPrintSideOffset + sheetSizeWidth + overHang;
     if ( offset > BUF_SIZE ) {
       offset -= BUF_SIZE;
       sheetSizeWidth -= offset;
     }
   } else {
-    int32_t offset = (g_pusOutLineBufTab[0] - out);
+    int32_t offset = (st->g_pusOutLineBufTab[0] - out);
     sheetSizeWidth -= offset;
-    in += (out - g_pusOutLineBufTab[0]); // XXX was: in += out;
-    out = g_pusOutLineBufTab[0];
-    printf("WARN: CTankHosei() alt path\n");
+    in += (out - st->g_pusOutLineBufTab[0]); // XXX was: in += out;
+    out = st->g_pusOutLineBufTab[0];
+    fprintf(stderr, "WARN: CTankHosei() alt path\n");
   }
-  tankPtr = m_piFstTankArray + 2;
+  tankPtr = st->m_piFstTankArray + 2;
 
 #ifdef S6145_UNUSED
-  v2 = m_iPlusMaxEnergy;
+  v2 = st->m_iPlusMaxEnergy;
   v12 = &v2;
 #endif
 
-  v4 = (1 << (g_uiMaxPulseBit + 20)) / m_iFstTankSize;
+  v4 = (1 << (st->g_uiMaxPulseBit + 20)) / st->m_iFstTankSize;
 
-  while ( sheetSizeWidth-- ) {
-    int32_t v5;
-    int32_t v8;
-    uint16_t v11;
-    uint32_t v3 = *in++;
-    v5 = *out - ((v4 * (*out + *tankPtr)) >> 20);
-    if ( v5 < 0 )
-      v11 = g_pusTankMinusMaxEnegyTable[v3];
-    else
-      v11 = g_pusTankPlusMaxEnegyTable[v3];
-    v8 = *out + ((v5 * v11) >> g_uiMaxPulseBit);
-    if ( v8 < 0 )
-      v8 = 0;
-    if ( v8 > g_iMaxPulseValue )
-      v8 = g_iMaxPulseValue;
-    *out++ = v8;
-    *tankPtr++ += v8;
-  }
+  TankKernels()->hosei(out, in, tankPtr, sheetSizeWidth, v4,
+		       st->m_puiTankMaxEnergyTable,
+		       st->g_uiMaxPulseBit, st->g_iMaxPulseValue);
 }
 
 /* Apply final corrections to the output. */
 #define LINECORR_BUCKETS 4
-static void LineCorrection(void)
+static void LineCorrection(struct s6145_state *st)
 {
   uint16_t sheetSizeWidth;
   uint16_t overHang;
@@ -1568,22 +2133,22 @@ static void LineCorrection(void)
   uint32_t correct;
   uint8_t i;
 
-  sheetSizeWidth = g_usSheetSizeWidth;
-  overHang = (g_usHeadDots - g_usSheetSizeWidth) / 2;
-  in = g_pusPulseTransLineBufTab[1] + overHang;
-  out = g_pusOutLineBufTab[0] + overHang + g_sPrintSideOffset;
-  if ( out >= g_pusOutLineBufTab[0] ) {
-    uint32_t tmp = g_sPrintSideOffset + sheetSizeWidth + overHang;
+  sheetSizeWidth = st->g_usSheetSizeWidth;
+  overHang = (st->g_usHeadDots - st->g_usSheetSizeWidth) / 2;
+  in = st->g_pusPulseTransLineBufTab[1] + overHang;
+  out = st->g_pusOutLineBufTab[0] + overHang + st->g_sPrintSideOffset;
+  if ( out >= st->g_pusOutLineBufTab[0] ) {
+    uint32_t tmp = st->g_sPrintSideOffset + sheetSizeWidth + overHang;
     if ( tmp > BUF_SIZE ) {
       tmp -= BUF_SIZE;
       sheetSizeWidth -= tmp;
     }
   } else {
-    uint32_t tmp = g_pusOutLineBufTab[0] - out;
+    uint32_t tmp = st->g_pusOutLineBufTab[0] - out;
     sheetSizeWidth -= tmp;
-    in += (out - g_pusOutLineBufTab[0]); // XXX was: in += out;
-    out = g_pusOutLineBufTab[0];
-    printf("WARN: LineCorrection() alt path\n");
+    in += (out - st->g_pusOutLineBufTab[0]); // XXX was: in += out;
+    out = st->g_pusOutLineBufTab[0];
+    fprintf(stderr, "WARN: LineCorrection() alt path\n");
   }
 
   /* Apply the correction compensation */
@@ -1593,7 +2158,7 @@ static void LineCorrection(void)
     while ( j-- ) {
       int32_t pixel = *out;
       bucket[i] += pixel;
-      pixel -= g_pusLineHistCoefTable[*in++] * g_iLineCorrectPulse / 1024;
+      pixel -= st->g_pusLineHistCoefTable[*in++] * st->g_iLineCorrectPulse / 1024;
       if ( pixel < 0 )
         pixel = 0;
       *out++ = pixel;
@@ -1603,17 +2168,17 @@ static void LineCorrection(void)
   /* See if we need to increase the correction compensation */
   correct = 0;
   for ( i = 0; i < LINECORR_BUCKETS; i++ ) {
-    if ( g_uiLineCorrectBase1Line / LINECORR_BUCKETS <= bucket[i] )
+    if ( st->g_uiLineCorrectBase1Line / LINECORR_BUCKETS <= bucket[i] )
       correct++;
   }
   if ( correct ) {
     for ( i = 0; i < LINECORR_BUCKETS; i++ )
-      g_uiLineCorrectSum += bucket[i];
+      st->g_uiLineCorrectSum += bucket[i];
   }
-  if ( g_uiLineCorrectSum > g_uiLineCorrectBase ) {
-    g_uiLineCorrectSum -= g_uiLineCorrectBase;
-    if ( g_iLineCorrectPulse < g_iLineCorrectPulseMax )
-      g_iLineCorrectPulse++;
+  if ( st->g_uiLineCorrectSum > st->g_uiLineCorrectBase ) {
+    st->g_uiLineCorrectSum -= st->g_uiLineCorrectBase;
+    if ( st->g_iLineCorrectPulse < st->g_iLineCorrectPulseMax )
+      st->g_iLineCorrectPulse++;
   }
 
 }
@@ -1621,7 +2186,7 @@ static void LineCorrection(void)
 #ifdef S6145_UNUSED
 /* XXX all of these functions are present in the library, but not actually
    referenced by anything, so there's no point in worrying about them. */
-static void SideEdgeCorrection(void)
+static void SideEdgeCorrection(struct s6145_state *st)
 {
   int32_t v0;
   uint32_t v1;
@@ -1639,24 +2204,24 @@ static void SideEdgeCorrection(void)
   int32_t v15;
   int32_t v16;
 
-  v16 = g_usSheetSizeWidth;
-  v0 = (g_usHeadDots - g_usSheetSizeWidth) / 2;
-  v6 = g_pusPulseTransLineBufTab[1] + v0;
-  out = g_pusOutLineBufTab[0] + g_sPrintSideOffset + v0;
+  v16 = st->g_usSheetSizeWidth;
+  v0 = (st->g_usHeadDots - st->g_usSheetSizeWidth) / 2;
+  v6 = st->g_pusPulseTransLineBufTab[1] + v0;
+  out = st->g_pusOutLineBufTab[0] + st->g_sPrintSideOffset + v0;
   v11 = 0;
-  if ( out >= g_pusOutLineBufTab[0] ) {
-    v10 = g_sPrintSideOffset
-        + g_usSheetSizeWidth
+  if ( out >= st->g_pusOutLineBufTab[0] ) {
+    v10 = st->g_sPrintSideOffset
+        + st->g_usSheetSizeWidth
         + v0;
     if ( v10 > BUF_SIZE )
     {
       v10 -= BUF_SIZE;
-      v16 = g_usSheetSizeWidth - v10;
+      v16 = st->g_usSheetSizeWidth - v10;
     }
   } else {
-    v1 = g_pusOutLineBufTab[0] - out;
-    out = g_pusOutLineBufTab[0];
-    v16 = g_usSheetSizeWidth - v1;
+    v1 = st->g_pusOutLineBufTab[0] - out;
+    out = st->g_pusOutLineBufTab[0];
+    v16 = st->g_usSheetSizeWidth - v1;
     v10 = v11;
   }
   v5 = out + 2 * v16;
@@ -1664,9 +2229,9 @@ static void SideEdgeCorrection(void)
   v14 = 128 - v11;
 
   while ( v14 ) {
-    v12 = (((1024 - g_pusSideEdgeLvCoefTable[*v6++] * (uint32_t)g_pusSideEdgeCoefTable[128 - v14--]) >> 10) * *out) >> 10;
-    if ( v12 > g_iMaxPulseValue )
-      v12 = g_iMaxPulseValue;
+    v12 = (((1024 - st->g_pusSideEdgeLvCoefTable[*v6++] * (uint32_t)st->g_pusSideEdgeCoefTable[128 - v14--]) >> 10) * *out) >> 10;
+    if ( v12 > st->g_iMaxPulseValue )
+      v12 = st->g_iMaxPulseValue;
     *out++ = v12;
   }
 
@@ -1677,14 +2242,14 @@ static void SideEdgeCorrection(void)
   while ( v15 ) {
     v9--;
     --v7;
-    v13 = ((1024 - (g_pusSideEdgeLvCoefTable[*v7] * (uint32_t)g_pusSideEdgeCoefTable[128 - v15--]) >> 10) * *v9) >> 10;
-    if ( g_iMaxPulseValue < v13 )
-      v13 = g_iMaxPulseValue;
+    v13 = ((1024 - (st->g_pusSideEdgeLvCoefTable[*v7] * (uint32_t)st->g_pusSideEdgeCoefTable[128 - v15--]) >> 10) * *v9) >> 10;
+    if ( st->g_iMaxPulseValue < v13 )
+      v13 = st->g_iMaxPulseValue;
     *v9 = v13;
   }
 }
 
-static void LeadEdgeCorrection(void)
+static void LeadEdgeCorrection(struct s6145_state *st)
 {
   uint32_t v0;
   uint16_t *out;
@@ -1692,78 +2257,82 @@ static void LeadEdgeCorrection(void)
   uint32_t v5;
   int32_t v6;
 
-  if ( g_iLeadEdgeCorrectPulse ) {
-    v6 = g_usSheetSizeWidth;
-    out = g_pusOutLineBufTab[0] + g_sPrintSideOffset
-       + ((g_usHeadDots - g_usSheetSizeWidth) / 2);
-    if ( out >= g_pusOutLineBufTab[0] ) {
-      v5 = g_sPrintSideOffset
-         + g_usSheetSizeWidth
-         + ((g_usHeadDots - g_usSheetSizeWidth) / 2);
+  if ( st->g_iLeadEdgeCorrectPulse ) {
+    v6 = st->g_usSheetSizeWidth;
+    out = st->g_pusOutLineBufTab[0] + st->g_sPrintSideOffset
+       + ((st->g_usHeadDots - st->g_usSheetSizeWidth) / 2);
+    if ( out >= st->g_pusOutLineBufTab[0] ) {
+      v5 = st->g_sPrintSideOffset
+         + st->g_usSheetSizeWidth
+         + ((st->g_usHeadDots - st->g_usSheetSizeWidth) / 2);
       if ( v5 > BUF_SIZE )
-        v6 = g_usSheetSizeWidth - (v5 - BUF_SIZE);
+        v6 = st->g_usSheetSizeWidth - (v5 - BUF_SIZE);
     } else {
-      v0 = g_pusOutLineBufTab[0] - out;
-      out = g_pusOutLineBufTab[0];
-      v6 = g_usSheetSizeWidth - v0;
+      v0 = st->g_pusOutLineBufTab[0] - out;
+      out = st->g_pusOutLineBufTab[0];
+      v6 = st->g_usSheetSizeWidth - v0;
     }
 
     while ( v6-- ) {
-      v4 = (g_iLeadEdgeCorrectPulse / 4) + *out;
-      if ( v4 > g_iMaxPulseValue )
-        v4 = g_iMaxPulseValue;
+      v4 = (st->g_iLeadEdgeCorrectPulse / 4) + *out;
+      if ( v4 > st->g_iMaxPulseValue )
+        v4 = st->g_iMaxPulseValue;
       *out++ = v4;
     }
-    --g_iLeadEdgeCorrectPulse;
+    --st->g_iLeadEdgeCorrectPulse;
   }
 }
 
-static void RecieveDataOP_Post(void)
+static void RecieveDataOP_Post(struct s6145_state *st)
 {
+  UNUSED(st);
   return;
 }
 
-static void RecieveDataYMC_Post(void)
+static void RecieveDataYMC_Post(struct s6145_state *st)
 {
+  UNUSED(st);
   return;
 }
 
-static void RecieveDataOPLevel_Post(void)
+static void RecieveDataOPLevel_Post(struct s6145_state *st)
 {
+  UNUSED(st);
   return;
 }
 
-static void RecieveDataOPMatte_Post(void)
+static void RecieveDataOPMatte_Post(struct s6145_state *st)
 {
+  UNUSED(st);
   return;
 }
 
-static void ImageLevelAddition(void)
+static void ImageLevelAddition(struct s6145_state *st)
 {
-  if ( g_uiLevelAveCounter < g_usPrintSizeHeight )
+  if ( st->g_uiLevelAveCounter < st->g_usPrintSizeHeight )
   {
-    ImageLevelAdditionEx(&g_uiLevelAveAddtion, 0, g_usSheetSizeWidth);
-    g_uiLevelAveCounter++;
-    if ( g_uiLevelAveCounter2-- == 0 )
+    ImageLevelAdditionEx(st, &st->g_uiLevelAveAddtion, 0, st->g_usSheetSizeWidth);
+    st->g_uiLevelAveCounter++;
+    if ( st->g_uiLevelAveCounter2-- == 0 )
     {
-      ImageLevelAdditionEx(
-	      &g_uiLevelAveAddtion2,
-	      g_uiOffsetCancelCheckPRec,
-	      g_usCancelCheckDotsForPRec);
-      ++g_uiLevelAveCounter2;
+      ImageLevelAdditionEx(st, 
+	      &st->g_uiLevelAveAddtion2,
+	      st->g_uiOffsetCancelCheckPRec,
+	      st->g_usCancelCheckDotsForPRec);
+      ++st->g_uiLevelAveCounter2;
     }
   }
 }
 
-static void ImageLevelAdditionEx(uint32_t *a1, uint32_t a2, int32_t a3)
+static void ImageLevelAdditionEx(struct s6145_state *st, uint32_t *a1, uint32_t a2, int32_t a3)
 {
   int32_t v3;
   uint8_t *v6;
   int32_t i;
   int32_t v8;
 
-  v6 = g_pusPulseTransLineBufTab[1] + a2 +
-	  ((g_usHeadDots - g_usSheetSizeWidth) / 2);
+  v6 = st->g_pusPulseTransLineBufTab[1] + a2 +
+	  ((st->g_usHeadDots - st->g_usSheetSizeWidth) / 2);
   v8 = a3;
   for ( i = 0; v8-- ; i += v3 ) {
     v3 = *v6++;
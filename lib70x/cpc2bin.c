@@ -0,0 +1,94 @@
+/* cpc2bin -- Precompile lib70x CPC correction tables
+
+   Copyright (c) 2026 agent <agent@local>
+
+   ** ** ** ** Do NOT contact Mitsubishi about this library! ** ** ** **
+
+   Converts the CSV correction tables (*.cpc and CPM1_*.csv) into the
+   binary form that the library maps in preference to parsing the CSV.
+   The output is native-endian, so run this on the machine (or at least
+   the architecture) that will be using it.
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+   for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <https://www.gnu.org/licenses/>.
+
+   SPDX-License-Identifier: GPL-3.0+
+
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libMitsuD70ImageReProcess.h"
+
+/* Work out which table this is from its column headings */
+static int compile_table(const char *fname, const char *outname)
+{
+	char buf[256];
+	FILE *f;
+
+	f = fopen(fname, "r");
+	if (!f) {
+		perror(fname);
+		return -1;
+	}
+	if (!fgets(buf, sizeof(buf), f))
+		buf[0] = 0;
+	fclose(f);
+
+	if (!strncmp(buf, "name,", 5))
+		return compile_CPCData(fname, outname);
+	if (!strncmp(buf, "INDEX,GNM", 9))
+		return M1_CompileCPCData(fname, outname, 1);
+	if (!strncmp(buf, "INDEX,", 6))
+		return M1_CompileCPCData(fname, outname, 0);
+
+	fprintf(stderr, "%s: Unrecognized table format\n", fname);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *outname = NULL;
+	int i, c, ret = 0;
+
+	while ((c = getopt(argc, argv, "ho:")) >= 0) {
+		switch (c) {
+		case 'o':
+			outname = optarg;
+			break;
+		case 'h':
+		default:
+			fprintf(stderr, "Usage: %s [ -o output.bin ] table.cpc|table.csv [ ... ]\n", argv[0]);
+			fprintf(stderr, "  Each table is written to <table>.bin unless -o is given\n");
+			return (c == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc || (outname && argc - optind > 1)) {
+		fprintf(stderr, "Usage: %s [ -o output.bin ] table.cpc|table.csv [ ... ]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = optind ; i < argc ; i++) {
+		if (compile_table(argv[i], outname)) {
+			fprintf(stderr, "%s: Conversion failed\n", argv[i]);
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
@@ -62,7 +62,7 @@
 #ifndef __MITSU_D70_H
 #define __MITSU_D70_H
 
-#define LIB_APIVERSION 6
+#define LIB_APIVERSION 7
 
 #include <stdint.h>
 
@@ -89,6 +89,11 @@ struct CPCData *get_CPCData(const char *filename);
 /* Destroy the CPC data */
 void destroy_CPCData(struct CPCData *data);
 
+/* Precompile a CPC table into the binary form that get_CPCData() will
+   map instead of parsing the CSV.  'outname' defaults to
+   "<filename>.bin".  Returns 0 on success. */
+int compile_CPCData(const char *filename, const char *outname);
+
 /* Perform all processing on the 8bpp packed BGR input image, and generate a
    fully-corrected 16bpp YMC packed output image.
    Returns 0 if successful, non-zero for error */
@@ -102,12 +107,55 @@ int do_image_effect80(struct CPCData *cpc, struct CPCData *ecpc,
 		      struct BandImage *input, struct BandImage *output,
 		      int sharpen, int reverse, uint8_t rew[2]);
 
+/* As above, but first run the input through the 3D LUT in the same pass,
+   instead of separately calling CColorConv3D_DoColorConv() beforehand.
+   The input is left unmodified. */
+struct CColorConv3D;
+int do_image_effect70_lut(struct CColorConv3D *lut,
+			  struct CPCData *cpc, struct CPCData *ecpc,
+			  struct BandImage *input, struct BandImage *output,
+			  int sharpen, int reverse, uint8_t rew[2]);
+int do_image_effect60_lut(struct CColorConv3D *lut,
+			  struct CPCData *cpc, struct CPCData *ecpc,
+			  struct BandImage *input, struct BandImage *output,
+			  int sharpen, int reverse, uint8_t rew[2]);
+int do_image_effect80_lut(struct CColorConv3D *lut,
+			  struct CPCData *cpc, struct CPCData *ecpc,
+			  struct BandImage *input, struct BandImage *output,
+			  int sharpen, int reverse, uint8_t rew[2]);
+
 /* Converts the packed 16bpp YMC image into 16bpp YMC planes, with
    proper padding after each plane.  Calls the callback function for each
    block. */
 int send_image_data(struct BandImage *out, void *context,
 		    int (*callback_fn)(void *context, void *buffer, uint32_t len));
 
+/* do_image_effect*_lut() and send_image_data() rolled into one, with
+   each block handed to the callback as soon as it is ready instead of
+   after the whole image has been processed.  'lut' may be NULL.  rew[]
+   is final before the first callback.  Returns 0 if successful,
+   non-zero if either the processing or the callback failed.  'output'
+   holds the complete image afterwards, so it can still be passed to
+   send_image_data() for additional copies. */
+int do_image_effect70_stream(struct CColorConv3D *lut,
+			     struct CPCData *cpc, struct CPCData *ecpc,
+			     struct BandImage *input, struct BandImage *output,
+			     int sharpen, int reverse, uint8_t rew[2],
+			     void *context,
+			     int (*callback_fn)(void *context, void *buffer, uint32_t len));
+int do_image_effect60_stream(struct CColorConv3D *lut,
+			     struct CPCData *cpc, struct CPCData *ecpc,
+			     struct BandImage *input, struct BandImage *output,
+			     int sharpen, int reverse, uint8_t rew[2],
+			     void *context,
+			     int (*callback_fn)(void *context, void *buffer, uint32_t len));
+int do_image_effect80_stream(struct CColorConv3D *lut,
+			     struct CPCData *cpc, struct CPCData *ecpc,
+			     struct BandImage *input, struct BandImage *output,
+			     int sharpen, int reverse, uint8_t rew[2],
+			     void *context,
+			     int (*callback_fn)(void *context, void *buffer, uint32_t len));
+
 /* 3D Color Look-Up-Table */
 #define COLORCONV_RGB 0
 #define COLORCONV_BGR 1
@@ -156,4 +204,7 @@ struct M1CPCData *M1_GetCPCData(const char *corrtable_path,
 				const char *gammafilename);
 void M1_DestroyCPCData(struct M1CPCData *dat);
 
+/* As compile_CPCData(), for the CP-M1 CPC or (if 'gamma') gamma tables */
+int M1_CompileCPCData(const char *filename, const char *outname, int gamma);
+
 #endif /* __MITSU_D70_H */
@@ -0,0 +1,198 @@
+#!/usr/bin/perl
+#######################
+#
+#  Test harness code for the dyesub backend (USB transcript round trips)
+#
+#  Copyright (c) 2026 agent <agent@local>
+#
+#  The latest version of this program can be found at:
+#
+#    http://git.shaftnet.org/cgit/selphy_print.git
+#
+#  This program is free software; you can redistribute it and/or modify it
+#  under the terms of the GNU General Public License as published by the Free
+#  Software Foundation; either version 3 of the License, or (at your option)
+#  any later version.
+#
+#  This program is distributed in the hope that it will be useful, but
+#  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+#  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+#  for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, see <https://www.gnu.org/licenses/>.
+#
+#  SPDX-License-Identifier: GPL-3.0+
+#
+#######################
+#
+#  Each job is replayed from its transcript with USB_RECORD set, and the
+#  new transcript is then replayed in turn.  Both runs must succeed
+#  without the replay flagging anything, and the two recordings must
+#  hold the same records (timings aside).
+#
+#  Backends that never read from the printer can leave the transcript
+#  out; the first run then starts from a transcript holding only the
+#  device, and is expected to flag every write.
+#
+#######################
+use strict;
+use File::Temp qw( tempdir );
+
+my $backend_exec = "./dyesub_backend";
+my $magic = "DSUBUSB1";
+my $quiet = 1;
+my $error = 0;
+
+if (!defined($ARGV[0])) {
+    die ("need a csv file\n");
+};
+
+if (defined($ENV{"STP_VERBOSE"})) {
+    $quiet = !$ENV{"STP_VERBOSE"};
+};
+
+my $tmpdir = tempdir(CLEANUP => 1);
+
+# Run the backend, returning its exit code and what it said
+sub run_backend {
+    my ($replay, $record, $job, $copies) = @_;
+    my $output = "";
+
+    local $ENV{"USB_REPLAY"} = $replay;
+    local $ENV{"USB_RECORD"} = $record;
+
+    my $pid = open(my $fh, "-|");
+    die ("can't fork\n") if (!defined($pid));
+    if ($pid == 0) {
+	open(STDERR, ">&STDOUT");
+	exec($backend_exec, "-d", $copies, $job) || exit(255);
+    }
+    while (<$fh>) {
+	$output .= $_;
+    }
+    close($fh);
+
+    print $output if (!$quiet);
+    return ($? >> 8, $output);
+}
+
+# Everything in a transcript but the timings
+sub load_transcript {
+    my ($fname) = @_;
+    my @recs = ();
+    my $buf;
+
+    open(my $fh, "<", $fname) || return undef;
+    binmode($fh);
+    local $/;
+    $buf = <$fh>;
+    close($fh);
+
+    return undef if (substr($buf, 0, length($magic)) ne $magic);
+
+    my $off = length($magic);
+    while ($off + 16 <= length($buf)) {
+	my ($type, $index, $rsvd, $ret, $len, $usec) =
+	    unpack("C C v l< V V", substr($buf, $off, 16));
+	push(@recs, pack("C C l< V", $type, $index, $ret, $len) .
+	     substr($buf, $off + 16, $len));
+	$off += 16 + $len;
+    }
+
+    return \@recs;
+}
+
+# A transcript with nothing but the device record
+sub make_seed {
+    my ($fname, $vid, $pid) = @_;
+    my $dev = pack("v v C C C C C C C", hex($vid), hex($pid),
+		   1, 2, 3, 0, 0, 0x82, 0x01);
+
+    open(my $fh, ">", $fname) || die ("can't create $fname\n");
+    binmode($fh);
+    print $fh $magic . pack("C C v l< V V", ord("D"), 0, 0, 0, length($dev), 0) . $dev;
+    close($fh);
+}
+
+open (INFILE, "<$ARGV[0]") || die ("can't open csv\n");
+
+my $currow = 0;
+while (<INFILE>) {
+    chomp;
+    next if /^#/;
+    next if /^\s*$/;
+
+    if (defined($ARGV[1])) {
+	next if (index($_,$ARGV[1]) == -1);
+    };
+
+    s/(.+)#.*/$1/;
+    my @row = split(/,/);
+    my $fail = "";
+    my ($ret, $output);
+
+    $ENV{"BACKEND"} = $row[0];
+    if (length($row[4])) {
+	$ENV{"MEDIA_CODE"} = $row[4];
+    } else {
+	delete($ENV{"MEDIA_CODE"});
+    }
+
+    my $seed = $row[5];
+    if (length($seed)) {
+	$seed = "testjobs/$seed";
+    } else {
+	$seed = "$tmpdir/$currow-seed.usbx";
+	make_seed($seed, $row[1], $row[2]);
+    }
+    my $rec1 = "$tmpdir/$currow-1.usbx";
+    my $rec2 = "$tmpdir/$currow-2.usbx";
+    $currow++;
+
+    ($ret, $output) = run_backend($seed, $rec1, "testjobs/$row[3]", 1);
+    if ($ret) {
+	$fail = "first replay returned $ret";
+    } elsif (length($row[5]) && $output =~ /USB replay:/) {
+	$fail = "first replay differed from the transcript";
+    }
+
+    if (!$fail) {
+	($ret, $output) = run_backend($rec1, $rec2, "testjobs/$row[3]", 1);
+	if ($ret) {
+	    $fail = "second replay returned $ret";
+	} elsif ($output =~ /USB replay:/) {
+	    $fail = "second replay differed from the first recording";
+	}
+    }
+
+    if (!$fail) {
+	my $t1 = load_transcript($rec1);
+	my $t2 = load_transcript($rec2);
+
+	if (!defined($t1) || !defined($t2)) {
+	    $fail = "recording is not a transcript";
+	} elsif (!grep { substr($_, 0, 1) eq "D" } @$t1) {
+	    $fail = "recording has no device record";
+	} elsif (scalar(@$t1) != scalar(@$t2)) {
+	    $fail = "recordings have " . scalar(@$t1) . " and " . scalar(@$t2) . " records";
+	} else {
+	    for (my $i = 0 ; $i < scalar(@$t1) ; $i++) {
+		if ($t1->[$i] ne $t2->[$i]) {
+		    $fail = "recordings differ at record $i";
+		    last;
+		}
+	    }
+	}
+    }
+
+    if ($fail) {
+	print("***** $row[0] $row[1] $row[2] $row[3] $row[4] $row[5] ***** FAIL: $fail\n");
+	$error++;
+    } else {
+	print("***** $row[0] $row[1] $row[2] $row[3] $row[4] $row[5] ***** PASS\n");
+    }
+}
+close (INFILE);
+
+exit($error);